@@ -0,0 +1,387 @@
+/******************************************************************************
+ * @file    async.c
+ *          Asynchronous transaction queue of an I2C bus.
+ *
+ *          Callers fill transaction descriptors, read, write or a batch of
+ *          RMW ops, and submit them to the queue of a bus. An I/O thread per
+ *          bus drains the queue back to back, the next transaction starts as
+ *          soon as the last one is done, not when the caller gets to it. The
+ *          caller formats, logs and decides while the bus is busy.
+ *
+ *          Completion is by callback or by waiting the descriptor, a future:
+ *              stAsyncXfer xfer = { .Op = ASYNC_READ, .Addr = 0x68, .Reg = { 0x10 }, .RegLen = 1,
+ *                                   .Buf = buf, .Len = 4 };
+ *              ASYNC_open(0, 400);
+ *              ASYNC_submit(0, &xfer);
+ *              ...                                 // host work, overlapped with the read
+ *              if (ASYNC_wait(0, &xfer) == FT_OK)  // buf is valid from here
+ *
+ *          Callbacks run on a completion thread of the bus in submit order,
+ *          never on the I/O thread, so a slow callback doesn't stall the bus.
+ *          CLI_PRINT of a callback goes to the output of the ASYNC_open()
+ *          caller. A callback must not wait, drain or close its own bus, or
+ *          submit to it when the queue is full.
+ *
+ *          The bus handle belongs to the I/O thread while the queue is open,
+ *          don't use the bus directly until ASYNC_close().
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "ft_i2c.h"
+#include "rmw.h"
+#include "async.h"
+
+//!@typedef stAsyncQueue
+//!         Queue and threads of a bus.
+typedef struct stAsyncQueue
+{
+    _Bool Open;                 //!< Queue opened
+    _Bool Stop;                 //!< Threads exit when queues are empty
+    FT_HANDLE Handle;           //!< I2C bus handle, used by the I/O thread only
+    FILE *Out;                  //!< Output of the opener, for callbacks
+    stI2cWait Wait;             //!< Wait policy of the opener
+    pthread_mutex_t Lock;
+    pthread_cond_t Work;        //!< Signaled on submit and stop, I/O thread waits on it.
+    pthread_cond_t Event;       //!< Broadcast on done, complete and stop.
+    stAsyncXfer *Head;          //!< Submitted, waiting for the bus
+    stAsyncXfer *Tail;
+    stAsyncXfer *DoneHead;      //!< Done on the bus, waiting for completion
+    stAsyncXfer *DoneTail;
+    uint32 Queued;              //!< Submitted and not complete
+    pthread_t Io;
+    pthread_t Completion;
+    stAsyncStat Stat;
+} stAsyncQueue;
+
+static stAsyncQueue gasync_queue[FT_I2C_BUS_MAX];
+
+static stAsyncQueue *async_getQueue(int bus)
+{
+    if ((bus < 0) || (bus >= FT_I2C_BUS_MAX) || !gasync_queue[bus].Open)
+    {
+        return NULL;
+    }
+    return &gasync_queue[bus];
+}
+
+//Run a transaction on the bus, same calls as the fti2c commands.
+static void async_run(FT_HANDLE ftHandle, stAsyncXfer *xfer)
+{
+    FT_STATUS status = FT_OK;
+    uint32 done = 0;
+
+    switch (xfer->Op)
+    {
+    case ASYNC_READ:
+        status = (xfer->RegLen > 0) ?
+                FT_readI2cReg(ftHandle, xfer->Addr, xfer->Reg, xfer->RegLen, xfer->Buf, xfer->Len, &done) :
+                FT_readI2c(ftHandle, xfer->Addr, START_AND_STOP, xfer->Buf, xfer->Len, &done);
+        break;
+    case ASYNC_WRITE:
+        status = (xfer->RegLen > 0) ?
+                FT_writeI2cReg(ftHandle, xfer->Addr, xfer->Reg, xfer->RegLen, xfer->Buf, xfer->Len, &done) :
+                FT_writeI2c(ftHandle, xfer->Addr, START_AND_STOP, xfer->Buf, xfer->Len, &done);
+        break;
+    default:
+        status = RMW_run(ftHandle, xfer->Rmw, xfer->RmwCount, xfer->RegLen, NULL);
+        done = (status == FT_OK) ? xfer->RmwCount : 0;
+        break;
+    }
+    if ((status == FT_OK) && (xfer->Op != ASYNC_RMW))
+    {
+        status = FT_checkI2cBus(ftHandle);
+    }
+    xfer->Status = status;
+    xfer->Done = done;
+}
+
+//I/O thread, run submitted transactions back to back.
+static void *async_io(void *arg)
+{
+    stAsyncQueue *q = (stAsyncQueue*) arg;
+
+    FT_setWaitPolicy(&q->Wait);
+    pthread_mutex_lock(&q->Lock);
+    for (;;)
+    {
+        double idle = FT_getTimeMs();
+        while ((q->Head == NULL) && !q->Stop)
+        {
+            pthread_cond_wait(&q->Work, &q->Lock);
+        }
+        q->Stat.IdleMs += FT_getTimeMs() - idle;
+        if (q->Head == NULL)
+        {
+            break;
+        }
+
+        stAsyncXfer *xfer = q->Head;
+        q->Head = xfer->Next;
+        q->Tail = (q->Head == NULL) ? NULL : q->Tail;
+        pthread_mutex_unlock(&q->Lock);
+
+        //QueueMs holds the submit time until the transaction starts.
+        double start = FT_getTimeMs();
+        xfer->QueueMs = start - xfer->QueueMs;
+        async_run(q->Handle, xfer);
+        xfer->BusMs = FT_getTimeMs() - start;
+
+        pthread_mutex_lock(&q->Lock);
+        q->Stat.BusMs += xfer->BusMs;
+        q->Stat.Errors += (xfer->Status != FT_OK);
+        xfer->Next = NULL;
+        if (q->DoneTail != NULL)
+        {
+            q->DoneTail->Next = xfer;
+        }
+        else
+        {
+            q->DoneHead = xfer;
+        }
+        q->DoneTail = xfer;
+        pthread_cond_broadcast(&q->Event);
+    }
+    pthread_mutex_unlock(&q->Lock);
+    return NULL;
+}
+
+//Completion thread, call callbacks and complete transactions in submit order.
+static void *async_completion(void *arg)
+{
+    stAsyncQueue *q = (stAsyncQueue*) arg;
+
+    FT_setOutput(q->Out);
+    pthread_mutex_lock(&q->Lock);
+    for (;;)
+    {
+        while ((q->DoneHead == NULL) && !q->Stop)
+        {
+            pthread_cond_wait(&q->Event, &q->Lock);
+        }
+        if (q->DoneHead == NULL)
+        {
+            break;
+        }
+
+        stAsyncXfer *xfer = q->DoneHead;
+        q->DoneHead = xfer->Next;
+        q->DoneTail = (q->DoneHead == NULL) ? NULL : q->DoneTail;
+        pthread_mutex_unlock(&q->Lock);
+
+        if (xfer->CallBack != NULL)
+        {
+            xfer->CallBack(xfer);
+        }
+
+        //The caller may free the descriptor once it's complete, it's not touched after.
+        pthread_mutex_lock(&q->Lock);
+        xfer->Complete = 1;
+        q->Queued--;
+        q->Stat.Completed++;
+        pthread_cond_broadcast(&q->Event);
+    }
+    pthread_mutex_unlock(&q->Lock);
+    FT_setOutput(NULL);
+    return NULL;
+}
+
+/*!@brief Open a bus and start its I/O and completion threads.
+ *
+ * @param bus       I2C bus
+ * @param kbps      I2C frequency
+ * @return          FT_OK, error of FT_openI2cBus(), or FT_INSUFFICIENT_RESOURCES if a thread can't start.
+ */
+FT_STATUS ASYNC_open(int bus, uint32 kbps)
+{
+    if ((bus < 0) || (bus >= FT_I2C_BUS_MAX))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+    if (gasync_queue[bus].Open)
+    {
+        return FT_OK;
+    }
+
+    stAsyncQueue *q = &gasync_queue[bus];
+    memset(q, 0, sizeof(stAsyncQueue));
+    CHECK_FUNC_RET(FT_OK, FT_openI2cBus(bus, &q->Handle, kbps));
+    q->Out = FT_getOutput();
+    FT_getWaitPolicy(&q->Wait);
+    pthread_mutex_init(&q->Lock, NULL);
+    pthread_cond_init(&q->Work, NULL);
+    pthread_cond_init(&q->Event, NULL);
+
+    if (pthread_create(&q->Io, NULL, async_io, q) != 0)
+    {
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+    if (pthread_create(&q->Completion, NULL, async_completion, q) != 0)
+    {
+        pthread_mutex_lock(&q->Lock);
+        q->Stop = 1;
+        pthread_cond_signal(&q->Work);
+        pthread_mutex_unlock(&q->Lock);
+        pthread_join(q->Io, NULL);
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+    q->Open = 1;
+    return FT_OK;
+}
+
+/*!@brief Submit a transaction, it waits if ASYNC_QUEUE_MAX transactions are queued.
+ *
+ * @param bus       I2C bus opened by ASYNC_open()
+ * @param xfer      Descriptor, kept by the caller until complete. Result fields are reset.
+ * @return          FT_OK, FT_INVALID_PARAMETER if the bus isn't open or the descriptor is invalid.
+ */
+FT_STATUS ASYNC_submit(int bus, stAsyncXfer *xfer)
+{
+    stAsyncQueue *q = async_getQueue(bus);
+
+    CHECK_NULL_PTR(xfer);
+    if ((q == NULL) || (xfer->RegLen > 2) || (xfer->Op > ASYNC_RMW)
+            || ((xfer->Op != ASYNC_RMW) && (xfer->Buf == NULL) && (xfer->Len > 0))
+            || ((xfer->Op == ASYNC_RMW) && ((xfer->Rmw == NULL) || (xfer->RegLen == 0))))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+    xfer->Status = FT_OK;
+    xfer->Done = 0;
+    xfer->BusMs = 0;
+    xfer->Complete = 0;
+    xfer->Next = NULL;
+
+    pthread_mutex_lock(&q->Lock);
+    if (q->Queued >= ASYNC_QUEUE_MAX)
+    {
+        q->Stat.Full++;
+    }
+    while (q->Queued >= ASYNC_QUEUE_MAX)
+    {
+        pthread_cond_wait(&q->Event, &q->Lock);
+    }
+    xfer->QueueMs = FT_getTimeMs();
+    if (q->Tail != NULL)
+    {
+        q->Tail->Next = xfer;
+    }
+    else
+    {
+        q->Head = xfer;
+    }
+    q->Tail = xfer;
+    q->Queued++;
+    q->Stat.Submitted++;
+    q->Stat.MaxDepth = (q->Queued > q->Stat.MaxDepth) ? q->Queued : q->Stat.MaxDepth;
+    pthread_cond_signal(&q->Work);
+    pthread_mutex_unlock(&q->Lock);
+    return FT_OK;
+}
+
+/*!@brief Wait a transaction to complete, its callback has returned.
+ *
+ * @param bus       I2C bus of the transaction
+ * @param xfer      Submitted descriptor
+ * @return          Status of the transaction, FT_INVALID_PARAMETER if the bus isn't open.
+ */
+FT_STATUS ASYNC_wait(int bus, stAsyncXfer *xfer)
+{
+    stAsyncQueue *q = async_getQueue(bus);
+
+    CHECK_NULL_PTR(xfer);
+    if (q == NULL)
+    {
+        return FT_INVALID_PARAMETER;
+    }
+    pthread_mutex_lock(&q->Lock);
+    while (!xfer->Complete)
+    {
+        pthread_cond_wait(&q->Event, &q->Lock);
+    }
+    pthread_mutex_unlock(&q->Lock);
+    return xfer->Status;
+}
+
+/*!@brief Wait all submitted transactions of a bus to complete.
+ *
+ * @param bus       I2C bus
+ * @return          FT_OK, FT_INVALID_PARAMETER if the bus isn't open.
+ */
+FT_STATUS ASYNC_drain(int bus)
+{
+    stAsyncQueue *q = async_getQueue(bus);
+
+    if (q == NULL)
+    {
+        return FT_INVALID_PARAMETER;
+    }
+    pthread_mutex_lock(&q->Lock);
+    while (q->Queued > 0)
+    {
+        pthread_cond_wait(&q->Event, &q->Lock);
+    }
+    pthread_mutex_unlock(&q->Lock);
+    return FT_OK;
+}
+
+//Complete all transactions and stop the threads, the bus stays open for direct use.
+void ASYNC_close(int bus)
+{
+    stAsyncQueue *q = async_getQueue(bus);
+
+    if (q == NULL)
+    {
+        return;
+    }
+    ASYNC_drain(bus);
+
+    pthread_mutex_lock(&q->Lock);
+    q->Stop = 1;
+    pthread_cond_signal(&q->Work);
+    pthread_cond_broadcast(&q->Event);
+    pthread_mutex_unlock(&q->Lock);
+    pthread_join(q->Io, NULL);
+    pthread_join(q->Completion, NULL);
+
+    pthread_cond_destroy(&q->Work);
+    pthread_cond_destroy(&q->Event);
+    pthread_mutex_destroy(&q->Lock);
+    q->Open = 0;
+}
+
+//Get statistic of a bus queue, kept after ASYNC_close() until the next ASYNC_open().
+void ASYNC_getStat(int bus, stAsyncStat *stat)
+{
+    memset(stat, 0, sizeof(stAsyncStat));
+    if ((bus < 0) || (bus >= FT_I2C_BUS_MAX))
+    {
+        return;
+    }
+
+    stAsyncQueue *q = &gasync_queue[bus];
+    if (q->Open)
+    {
+        pthread_mutex_lock(&q->Lock);
+        *stat = q->Stat;
+        pthread_mutex_unlock(&q->Lock);
+    }
+    else
+    {
+        *stat = q->Stat;
+    }
+}
+
+void ASYNC_printStat(int bus, const stAsyncStat *stat)
+{
+    CLI_PRINT("I2C ASYNC, bus=[%d] submitted=[%u] completed=[%u] errors=[%u] full=[%u] depth max=[%u], "
+            "bus=[%.3f] idle=[%.3f] ms\n", bus, stat->Submitted, stat->Completed, stat->Errors, stat->Full,
+            stat->MaxDepth, stat->BusMs, stat->IdleMs);
+}
@@ -0,0 +1,90 @@
+/******************************************************************************
+ * @file    async.h
+ *          Asynchronous transaction queue of an I2C bus.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef ASYNC_H_
+#define ASYNC_H_
+
+#include "ft_i2c.h"
+#include "rmw.h"
+
+#define ASYNC_QUEUE_MAX         256         //!< Transactions queued per bus, submit waits when full.
+
+//!@enum    ASYNC_OP
+//!         Transaction of a descriptor.
+typedef enum ASYNC_OP
+{
+    ASYNC_READ = 0,             //!< Read Len bytes to Buf, from register Reg if RegLen > 0.
+    ASYNC_WRITE,                //!< Write Len bytes of Buf, to register Reg if RegLen > 0.
+    ASYNC_RMW,                  //!< RMW_run() of Rmw, RegLen is the register address size.
+} ASYNC_OP;
+
+typedef struct stAsyncXfer stAsyncXfer;
+
+//!@typedef AsyncCallBack
+//!         Completion callback, called on the completion thread of the bus in submit order.
+typedef void AsyncCallBack(stAsyncXfer *xfer);
+
+//!@typedef stAsyncXfer
+//!         Transaction descriptor, owned by the caller until it's complete.
+struct stAsyncXfer
+{
+    ASYNC_OP Op;                //!< Transaction
+    uint8 Addr;                 //!< 7-bit slave address
+    uint8 Reg[2];               //!< Register address, MSB first
+    uint8 RegLen;               //!< Register address size, 0 for a raw read or write.
+    uint8 *Buf;                 //!< Data of a read or write
+    uint32 Len;                 //!< Bytes of a read or write
+    stRmwOp *Rmw;               //!< Ops of ASYNC_RMW, New and Old are set when done.
+    int RmwCount;               //!< Op count of ASYNC_RMW
+    AsyncCallBack *CallBack;    //!< Completion callback, NULL to only wait by ASYNC_wait().
+    void *User;                 //!< Caller data for the callback
+    FT_STATUS Status;           //!< Result, set when done
+    uint32 Done;                //!< Bytes transferred, set when done
+    double QueueMs;             //!< Time from submit to start on the bus
+    double BusMs;               //!< Time on the bus
+    _Bool Complete;             //!< Done and callback returned, read by ASYNC_wait().
+    stAsyncXfer *Next;          //!< Queue link, internal
+};
+
+//!@typedef stAsyncStat
+//!         Statistic of a bus queue.
+typedef struct stAsyncStat
+{
+    uint32 Submitted;           //!< Transactions submitted
+    uint32 Completed;           //!< Transactions completed
+    uint32 Errors;              //!< Transactions with status other than FT_OK
+    uint32 Full;                //!< Submits waited as the queue was full
+    uint32 MaxDepth;            //!< Max transactions queued
+    double BusMs;               //!< Time of the I/O thread on the bus
+    double IdleMs;              //!< Time of the I/O thread waiting for transactions
+} stAsyncStat;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FT_STATUS ASYNC_open(int bus, uint32 kbps);
+
+FT_STATUS ASYNC_submit(int bus, stAsyncXfer *xfer);
+
+FT_STATUS ASYNC_wait(int bus, stAsyncXfer *xfer);
+
+FT_STATUS ASYNC_drain(int bus);
+
+void ASYNC_close(int bus);
+
+void ASYNC_getStat(int bus, stAsyncStat *stat);
+
+void ASYNC_printStat(int bus, const stAsyncStat *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ASYNC_H_ */
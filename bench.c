@@ -0,0 +1,470 @@
+/******************************************************************************
+ * @file    bench.c
+ *          fti2c benchmark, measure transactions per second and latency of
+ *          each command mode on real FT4222H or the emulated bridge.
+ *
+ *          For each mode, I2C frequency and transfer size, run N transactions
+ *          the same way fti2c does (transfer + bus idle check), and print one
+ *          CSV line:
+ *          mode,backend,freq_khz,size,iterations,errors,ops_per_sec,kb_per_sec,
+ *          p50_us,p99_us,max_us
+ *
+ *          Modes:
+ *            read       Raw read of [size] bytes.
+ *            devread    Register read of [size] bytes from register 0x00.
+ *            devwrite   Register write of [size] bytes to register 0x00.
+ *            maskwrite  Batch of [size] register read-modify-write.
+ *            regread    [size] scattered registers, 1 register read each.
+ *            gather     [size] scattered registers by RMW_read(), spans joined by --gap.
+ *            async      [size] scattered registers as regread, submitted to the async queue of the
+ *                       bus at once, each value is formatted by its callback while the next is read.
+ *            sweep      Probe 0x00~0x7F by 1 byte read, size is not used.
+ *
+ *          Scattered registers are pairs of 2 registers, 3 registers apart,
+ *          e.g. 0x00 0x01 0x05 0x06 0x0A 0x0B ...
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "cli.h"
+#include "ft_i2c.h"
+#include "hal.h"
+#include "rmw.h"
+#include "latency.h"
+#include "async.h"
+
+#define BENCH_LIST_MAX          16          //!< Max freq / size in a list
+#define BENCH_SIZE_MAX          FT_I2C_STREAM_BLOCK
+
+static int gbench_bus = 0;                  //!< Bus of the async queue
+static uint32 gbench_kbps = 100;            //!< Frequency of the async queue
+
+typedef FT_STATUS BenchFunc(FT_HANDLE ftHandle, uint8 addr, uint8 *buf, uint32 size);
+
+//!@typedef stBenchMode
+//!         A benchmark command mode.
+typedef struct stBenchMode
+{
+    const char *Name;           //!< Mode name
+    BenchFunc *Func;            //!< One transaction
+    _Bool Sized;                //!< Run for each transfer size
+} stBenchMode;
+
+//!@typedef stBenchResult
+//!         Result of a mode at a frequency and size.
+typedef struct stBenchResult
+{
+    int Iterations;
+    int Errors;
+    double TotalMs;             //!< Time of all iterations
+    double OpsPerSec;
+    double KbPerSec;
+    double P50Us;
+    double P99Us;
+    double MaxUs;
+} stBenchResult;
+
+static FT_STATUS bench_read(FT_HANDLE ftHandle, uint8 addr, uint8 *buf, uint32 size)
+{
+    uint32 done = 0;
+
+    CHECK_FUNC_RET(FT_OK, FT_readI2c(ftHandle, addr, START_AND_STOP, buf, size, &done));
+    return FT_checkI2cBus(ftHandle);
+}
+
+static FT_STATUS bench_devread(FT_HANDLE ftHandle, uint8 addr, uint8 *buf, uint32 size)
+{
+    uint8 reg = 0;
+    uint32 done = 0;
+
+    CHECK_FUNC_RET(FT_OK, FT_readI2cReg(ftHandle, addr, &reg, 1, buf, size, &done));
+    return FT_checkI2cBus(ftHandle);
+}
+
+static FT_STATUS bench_devwrite(FT_HANDLE ftHandle, uint8 addr, uint8 *buf, uint32 size)
+{
+    uint8 reg = 0;
+    uint32 done = 0;
+
+    CHECK_FUNC_RET(FT_OK, FT_writeI2cReg(ftHandle, addr, &reg, 1, buf, size, &done));
+    return FT_checkI2cBus(ftHandle);
+}
+
+static FT_STATUS bench_maskwrite(FT_HANDLE ftHandle, uint8 addr, uint8 *buf, uint32 size)
+{
+    static stRmwOp op[BENCH_SIZE_MAX];
+
+    for (uint32 i = 0; i < size; i++)
+    {
+        op[i].Addr = addr;
+        op[i].Reg = i;
+        op[i].Mask = 0x0F;
+        op[i].Data = op[i].New + 1;
+    }
+    return RMW_run(ftHandle, op, size, 1, NULL);
+}
+
+//Register of the scattered pattern, pairs of 2 registers 3 registers apart.
+static uint16 bench_getScattered(uint32 i)
+{
+    return ((i / 2) * 5 + (i % 2)) & 0xFF;
+}
+
+static FT_STATUS bench_regread(FT_HANDLE ftHandle, uint8 addr, uint8 *buf, uint32 size)
+{
+    uint32 done = 0;
+
+    for (uint32 i = 0; i < size; i++)
+    {
+        uint8 reg = bench_getScattered(i);
+        CHECK_FUNC_RET(FT_OK, FT_readI2cReg(ftHandle, addr, &reg, 1, &buf[i], 1, &done));
+        CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
+    }
+    return FT_OK;
+}
+
+static FT_STATUS bench_gather(FT_HANDLE ftHandle, uint8 addr, uint8 *buf, uint32 size)
+{
+    static stRmwRead rd[BENCH_SIZE_MAX];
+
+    for (uint32 i = 0; i < size; i++)
+    {
+        rd[i].Addr = addr;
+        rd[i].Reg = bench_getScattered(i);
+    }
+    return RMW_read(ftHandle, rd, size, 1, NULL);
+}
+
+//Callback of async mode, format the value as a command would print it.
+static void bench_onAsync(stAsyncXfer *xfer)
+{
+    char *text = (char*) xfer->User;
+    snprintf(text, 8, "0x%02X\t", xfer->Buf[0]);
+}
+
+static FT_STATUS bench_async(FT_HANDLE ftHandle, uint8 addr, uint8 *buf, uint32 size)
+{
+    static stAsyncXfer xfer[ASYNC_QUEUE_MAX];
+    static char text[ASYNC_QUEUE_MAX][8];
+    FT_STATUS status = FT_OK;
+
+    //The queue opens the same bus handle, it's kept open until the frequency changes.
+    CHECK_FUNC_RET(FT_OK, ASYNC_open(gbench_bus, gbench_kbps));
+    for (uint32 i = 0; i < size; i++)
+    {
+        stAsyncXfer *x = &xfer[i % ASYNC_QUEUE_MAX];
+
+        //Descriptors are reused round robin, wait the one submitted a queue length ago.
+        if (i >= ASYNC_QUEUE_MAX)
+        {
+            status = (status == FT_OK) ? ASYNC_wait(gbench_bus, x) : status;
+        }
+        memset(x, 0, sizeof(stAsyncXfer));
+        x->Op = ASYNC_READ;
+        x->Addr = addr;
+        x->Reg[0] = bench_getScattered(i);
+        x->RegLen = 1;
+        x->Buf = &buf[i];
+        x->Len = 1;
+        x->CallBack = bench_onAsync;
+        x->User = text[i % ASYNC_QUEUE_MAX];
+
+        //Queued descriptors are static and reused by the next call, they must be done before returning.
+        FT_STATUS submitted = ASYNC_submit(gbench_bus, x);
+        if (submitted != FT_OK)
+        {
+            ASYNC_drain(gbench_bus);
+            return submitted;
+        }
+    }
+    ASYNC_drain(gbench_bus);
+    for (uint32 i = 0; (i < size) && (i < ASYNC_QUEUE_MAX) && (status == FT_OK); i++)
+    {
+        status = xfer[i].Status;
+    }
+    return status;
+}
+
+static FT_STATUS bench_sweep(FT_HANDLE ftHandle, uint8 addr, uint8 *buf, uint32 size)
+{
+    uint8 list[FT_I2C_ADDR_MAX];
+    uint8 found[FT_I2C_ADDR_MAX];
+    int found_count = 0;
+
+    for (int i = 0; i < FT_I2C_ADDR_MAX; i++)
+    {
+        list[i] = i;
+    }
+    return FT_sweepI2cBus(ftHandle, list, FT_I2C_ADDR_MAX, FT_PROBE_READ, found, &found_count);
+}
+
+static const stBenchMode gbench_mode[] =
+{
+{ "read", bench_read, 1 },
+{ "devread", bench_devread, 1 },
+{ "devwrite", bench_devwrite, 1 },
+{ "maskwrite", bench_maskwrite, 1 },
+{ "regread", bench_regread, 1 },
+{ "gather", bench_gather, 1 },
+{ "async", bench_async, 1 },
+{ "sweep", bench_sweep, 0 },
+{ NULL, NULL, 0 } };
+
+static int bench_compare(const void *a, const void *b)
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+//Nearest-rank percentile of sorted samples.
+static double bench_percentile(const double *sorted, int count, double pct)
+{
+    int rank = (int) ceil(pct / 100.0 * count);
+
+    if (count == 0)
+    {
+        return 0;
+    }
+    rank = (rank < 1) ? 1 : rank;
+    return sorted[rank - 1];
+}
+
+//Parse "100,400,1000" to a list, return count.
+static int bench_parseList(const char *string, uint32 *list)
+{
+    char text[256];
+    char *save = NULL;
+    int count = 0;
+
+    snprintf(text, sizeof(text), "%s", string);
+    for (char *tok = strtok_r(text, ",", &save); (tok != NULL) && (count < BENCH_LIST_MAX);
+            tok = strtok_r(NULL, ",", &save))
+    {
+        list[count++] = strtoul(tok, NULL, 0);
+    }
+    return count;
+}
+
+//Check if a comma separated list has the name as a whole word.
+static _Bool bench_hasMode(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+
+    for (const char *pos = strstr(list, name); pos != NULL; pos = strstr(pos + 1, name))
+    {
+        if (((pos == list) || (pos[-1] == ',')) && ((pos[len] == ',') || (pos[len] == 0)))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*!@brief Run 1 mode at current bus setting.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param mode      Mode to run
+ * @param addr      Slave address
+ * @param size      Transfer size
+ * @param iter      Iterations, after 1 warm up transaction.
+ * @param result    Pointer to store result
+ */
+static void bench_run(FT_HANDLE ftHandle, const stBenchMode *mode, uint8 addr, uint32 size, int iter,
+        stBenchResult *result)
+{
+    static uint8 buf[BENCH_SIZE_MAX];
+    double *sample = (double*) malloc(sizeof(double) * iter);
+    int count = 0;
+
+    memset(result, 0, sizeof(stBenchResult));
+    if (sample == NULL)
+    {
+        return;
+    }
+
+    for (uint32 i = 0; i < size; i++)
+    {
+        buf[i] = i;
+    }
+
+    //Warm up, the first transaction may include USB setup.
+    mode->Func(ftHandle, addr, buf, size);
+
+    double start = FT_getTimeMs();
+    for (int i = 0; i < iter; i++)
+    {
+        double t = FT_getTimeMs();
+        if (mode->Func(ftHandle, addr, buf, size) != FT_OK)
+        {
+            result->Errors++;
+            continue;
+        }
+        sample[count++] = (FT_getTimeMs() - t) * 1000.0;
+    }
+    result->TotalMs = FT_getTimeMs() - start;
+    result->Iterations = iter;
+
+    qsort(sample, count, sizeof(double), bench_compare);
+    if (result->TotalMs > 0)
+    {
+        result->OpsPerSec = count * 1000.0 / result->TotalMs;
+        result->KbPerSec = mode->Sized ? result->OpsPerSec * size / 1024.0 : 0;
+    }
+    result->P50Us = bench_percentile(sample, count, 50);
+    result->P99Us = bench_percentile(sample, count, 99);
+    result->MaxUs = (count > 0) ? sample[count - 1] : 0;
+
+    free(sample);
+}
+
+int main(int argc, char *argv[])
+{
+    struct param_bench
+    {
+        int bus;
+        int addr;
+        int iter;
+        char freq[256];
+        char size[256];
+        char mode[256];
+        char emu[256];
+        char output[256];
+        int gap;
+    } param_bench;
+
+    param_bench.bus = 0;
+    param_bench.addr = 0x68;
+    param_bench.iter = 100;
+    strcpy(param_bench.freq, "100,400,1000");
+    strcpy(param_bench.size, "1,16,64,256");
+    strcpy(param_bench.mode, "read,devread,devwrite,maskwrite,regread,gather,async,sweep");
+    param_bench.emu[0] = 0;
+    param_bench.output[0] = 0;
+    param_bench.gap = RMW_GAP_DEFAULT;
+
+    stCliOption option_bench[] =
+    {
+    { OPT_COMMENT, 0, NULL, "Benchmark Parameters", NULL },
+    { OPT_INT, 'B', "bus", "[Bus] I2C bus to run on. Default is 0.", (void*) &param_bench.bus },
+    { OPT_INT, 'a', "addr", "[Addr] Slave address, a register file or RAM. Default is 0x68.",
+            (void*) &param_bench.addr },
+    { OPT_INT, 'i', "iter", "[Count] Transactions of each test. Default is 100.", (void*) &param_bench.iter },
+    { OPT_STRING, 'f', "freq", "[List] I2C frequency list in kHz. Default is 100,400,1000.",
+            (void*) param_bench.freq, NULL, sizeof(param_bench.freq) },
+    { OPT_STRING, 'L', "size", "[List] Transfer size list. Default is 1,16,64,256.",
+            (void*) param_bench.size, NULL, sizeof(param_bench.size) },
+    { OPT_STRING, 'm', "mode", "[List] Modes to run. Default is all modes.",
+            (void*) param_bench.mode, NULL, sizeof(param_bench.mode) },
+    { OPT_INT, 'g', "gap", "[Regs] Max unused registers read to join 2 reads. Default is 4.",
+            (void*) &param_bench.gap },
+    { OPT_STRING, 'E', "emu", "[Config] Use emulated FT4222, \"default\" for default config",
+            (void*) param_bench.emu, NULL, sizeof(param_bench.emu) },
+    { OPT_STRING, 'o', "output", "[File] Write CSV result to file. Default is stdout.",
+            (void*) param_bench.output, NULL, sizeof(param_bench.output) },
+    { OPT_HELP, 'h', "help", "Show help hints", NULL },
+    { OPT_END, 0, NULL, NULL, NULL } };
+
+    if (CLI_parseArgs(argc - 1, argv + 1, option_bench) == CLI_FAILURE)
+    {
+        return FT_INVALID_PARAMETER;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "--help") == 0))
+        {
+            return 0;
+        }
+    }
+
+    uint32 freq[BENCH_LIST_MAX];
+    uint32 size[BENCH_LIST_MAX];
+    int freq_count = bench_parseList(param_bench.freq, freq);
+    int size_count = bench_parseList(param_bench.size, size);
+
+    if ((freq_count == 0) || (size_count == 0) || (param_bench.iter <= 0))
+    {
+        CLI_ERROR("ERROR: Empty frequency/size list or iteration.\n");
+        return FT_INVALID_PARAMETER;
+    }
+    if ((param_bench.gap < 0) || (RMW_setGap(param_bench.gap) != FT_OK))
+    {
+        CLI_ERROR("ERROR: Invalid gap [%d], must be 0~%d.\n", param_bench.gap, RMW_GAP_MAX);
+        return FT_INVALID_PARAMETER;
+    }
+
+    //Backend, FTI2C_LATENCY splits the time of each mode into bridge calls.
+    HAL_useFromEnv();
+    LATENCY_enableFromEnv();
+    if (param_bench.emu[0] != 0)
+    {
+        CHECK_FUNC_RET(FT_OK, HAL_useEmulator(param_bench.emu));
+    }
+
+    FILE *fp = stdout;
+    if (param_bench.output[0] != 0)
+    {
+        fp = fopen(param_bench.output, "w");
+        if (fp == NULL)
+        {
+            CLI_ERROR("ERROR: Can't open file [%s]\n", param_bench.output);
+            return FT_INVALID_PARAMETER;
+        }
+    }
+
+    fprintf(fp, "mode,backend,freq_khz,size,iterations,errors,ops_per_sec,kb_per_sec,p50_us,p99_us,max_us\n");
+
+    FT_STATUS ret = FT_OK;
+    for (int f = 0; (f < freq_count) && (ret == FT_OK); f++)
+    {
+        FT_HANDLE ftHandle = NULL;
+        ret = FT_openI2cBus(param_bench.bus, &ftHandle, freq[f]);
+        if (ret != FT_OK)
+        {
+            break;
+        }
+        gbench_bus = param_bench.bus;
+        gbench_kbps = freq[f];
+
+        for (const stBenchMode *mode = gbench_mode; mode->Name != NULL; mode++)
+        {
+            if (!bench_hasMode(param_bench.mode, mode->Name))
+            {
+                continue;
+            }
+
+            for (int s = 0; s < (mode->Sized ? size_count : 1); s++)
+            {
+                stBenchResult result;
+                uint32 len = mode->Sized ? size[s] : 0;
+
+                if (len > BENCH_SIZE_MAX)
+                {
+                    continue;
+                }
+                bench_run(ftHandle, mode, param_bench.addr, len, param_bench.iter, &result);
+                fprintf(fp, "%s,%s,%u,%u,%d,%d,%.1f,%.2f,%.1f,%.1f,%.1f\n", mode->Name, HAL_getBackend()->Name,
+                        freq[f], len, result.Iterations, result.Errors, result.OpsPerSec, result.KbPerSec, result.P50Us,
+                        result.P99Us, result.MaxUs);
+                fflush(fp);
+            }
+        }
+        ASYNC_close(param_bench.bus);
+    }
+
+    if (fp != stdout)
+    {
+        fclose(fp);
+    }
+    FT_closeI2cBus();
+    LATENCY_print();
+    return ret;
+}
@@ -125,14 +125,23 @@ CLI_RET cli_printCommandHelp(stCliCommand commands[])
 
 /*!@brief Convert to text string to value.
  *
+ * @param arg_name  Option args, e.g. "--test"
  * @param string    Text string, e.g. "0x123"
- * @param data_ptr  Pointer to store the data
- * @param type      Data convert type
- * @return          The number of data_ptr used.
+ * @param option    Option to store the data, ValueCount of OPT_STRING is the buffer size.
+ * @return          The number of data args used, CLI_FAILURE if data is missing or too long.
  */
-int cli_getData(char *string, void *data_ptr, OPT_TYPE type)
+int cli_getData(char *arg_name, char *string, stCliOption *option)
 {
-    switch (type)
+    void *data_ptr = option->ValuePtr;
+
+    //Option at the end of args has no data.
+    if ((string == NULL) && ((option->OptType == OPT_INT) || (option->OptType == OPT_STRING)))
+    {
+        CLI_ERROR("ERROR: Missing data args of [%s]\n", arg_name);
+        return CLI_FAILURE;
+    }
+
+    switch (option->OptType)
     {
     case OPT_INT:
     {
@@ -145,15 +154,14 @@ int cli_getData(char *string, void *data_ptr, OPT_TYPE type)
     }
     case OPT_STRING:
     {
-        if (string == NULL)
-        {
-            CLI_ERROR("ERROR: NULL data for type String!\n");
-            return 0;
-        }
-
         char *d = (char*) data_ptr; //Convert pointer type to char *
 
-        strcpy(d++, string);
+        if (strlen(string) >= option->ValueCount)
+        {
+            CLI_ERROR("ERROR: Data args of [%s] is longer than [%d] chars.\n", arg_name, option->ValueCount - 1);
+            return CLI_FAILURE;
+        }
+        memcpy(d, string, strlen(string) + 1);
 
         return 1;                   //Convert 1x data string for String type
     }
@@ -183,7 +191,7 @@ int cli_getData(char *string, void *data_ptr, OPT_TYPE type)
  * @param arg_name      pointer to long option name args, e.g. "--test"
  * @param arg_data      pointer to data args, e.g. "0x32"
  * @param options       option list.
- * @return
+ * @return              The number of data args used, CLI_FAILURE if data is missing or too long.
  */
 int cli_handleLongOpt(char *arg_name, char *arg_data, stCliOption options[])
 {
@@ -205,7 +213,7 @@ int cli_handleLongOpt(char *arg_name, char *arg_data, stCliOption options[])
                 }
 
                 // Convert arg_data
-                c = cli_getData(arg_data, options[i].ValuePtr, options[i].OptType);
+                c = cli_getData(arg_name, arg_data, &options[i]);
                 return c;
             }
         }
@@ -236,7 +244,7 @@ int cli_handleShortOpt(char *arg_name, char *arg_data, stCliOption options[])
                 }
 
                 // Convert arg_data
-                c = cli_getData(arg_data, options[i].ValuePtr, options[i].OptType);
+                c = cli_getData(arg_name, arg_data, &options[i]);
                 return c;
             }
         }
@@ -268,14 +276,15 @@ CLI_RET CLI_convertStrToArgs(char *string, int *argc, char *args[])
     CHECK_NULL_PTR(args);
 
     char *token = NULL;
+    char *save = NULL;
     int i = 0;
 
-    //Get all the tokens from string.
-    token = strtok(string, CLI_WHITE_SPACE_CHAR);
-    while (token != NULL)
+    //Get all the tokens from string, strtok_r so threads can parse at the same time.
+    token = strtok_r(string, CLI_WHITE_SPACE_CHAR, &save);
+    while ((token != NULL) && (i < CLI_ARG_COUNT_MAX))
     {
         args[i++] = token;
-        token = strtok(NULL, CLI_WHITE_SPACE_CHAR);
+        token = strtok_r(NULL, CLI_WHITE_SPACE_CHAR, &save);
     }
 
     //return args count
@@ -322,7 +331,7 @@ int CLI_excuteCommand(int argc, char *args[], stCliCommand commands[])
  * @param argc      Argument count
  * @param args      Argument string
  * @param options   Argument options
- * @return          The number of un-used Argument count.
+ * @return          The number of un-used Argument count, CLI_FAILURE if an option's data is missing or too long.
  */
 int CLI_parseArgs(int argc, char *args[], stCliOption options[])
 {
@@ -336,32 +345,44 @@ int CLI_parseArgs(int argc, char *args[], stCliOption options[])
     {
         if (args[i][0] == '-')
         {
+            char *arg_data = (i + 1 < argc) ? args[i + 1] : NULL;
+            int c = 0;
+
             if (args[i][1] == '-')
             {
 
-                i += cli_handleLongOpt(args[i], args[i + 1], options);
+                c = cli_handleLongOpt(args[i], arg_data, options);
             }
             else
             {
 
-                i += cli_handleShortOpt(args[i], args[i + 1], options);
+                c = cli_handleShortOpt(args[i], arg_data, options);
             }
+
+            if (c == CLI_FAILURE)
+            {
+                return CLI_FAILURE;
+            }
+            i += c;
         }
         else
         {
             //Store un-used args.
-            unused_args[unused_argc] = args[i];
-            unused_argc++;
+            if (unused_argc < CLI_ARG_COUNT_MAX)
+            {
+                unused_args[unused_argc] = args[i];
+                unused_argc++;
+            }
         }
     }
 
     // If there is a Callback on OPT_END, use it to handle the un-used args.
-    for (i = 0;; i++)
+    for (i = 0; options[i].OptType != OPT_END; i++)
     {
-        if ((options[i].OptType == OPT_END) && (options[i].CallBack != NULL))
-        {
-            return options[i].CallBack(unused_argc, unused_args);
-        }
+    }
+    if (options[i].CallBack != NULL)
+    {
+        return options[i].CallBack(unused_argc, unused_args);
     }
 
     //There's no defined call back at OPT_END, will pass back the unused args.
@@ -12,7 +12,7 @@
 
 #include <stdint.h>
 
-#define CLI_ARG_COUNT_MAX       16          //!< Number of Args supported.
+#define CLI_ARG_COUNT_MAX       256         //!< Number of Args supported.
 #define CLI_LINE_END_CHAR       '\n'        //!< Character as line end.
 #define CLI_WHITE_SPACE_CHAR    " \t\n\r"   //!< Characters as args seperater
 
@@ -60,7 +60,7 @@ typedef struct stCliOption
     const char *HelpText;       //!< Option help text, e.g. "Run the test"
     void *ValuePtr;             //!< Pointer to store option value
     CliCallBack *CallBack;      //!< Function call back
-    int ValueCount;             //!< Data amount for multiple data options
+    int ValueCount;             //!< Data amount for multiple data options, buffer size of OPT_STRING
 } stCliOption;
 
 //!@typedef stCliCommand
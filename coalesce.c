@@ -0,0 +1,215 @@
+/******************************************************************************
+ * @file    coalesce.c
+ *          Register write coalescing, merge writes of contiguous registers.
+ *
+ *          A register write is queued instead of sent. The next write to the
+ *          register right after the queued data, on the same bus and slave,
+ *          is appended, so the whole run goes out as 1 auto-increment burst:
+ *              devwrite 0 0x68 0x10 0x01
+ *              devwrite 0 0x68 0x11 0x02      -> 0x68 REG=[0x10] 0x01 0x02 0x03
+ *              devwrite 0 0x68 0x12 0x03
+ *
+ *          Any other write flushes the queue first. The caller must flush
+ *          before other bus operations and when done. Devices without
+ *          register auto-increment are marked no-inc and written directly.
+ *
+ *          The queue is per thread, each parallel bus has its own.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft_i2c.h"
+#include "coalesce.h"
+
+//!@typedef stCoalesceQueue
+//!         Queued burst write of a device.
+typedef struct stCoalesceQueue
+{
+    FT_HANDLE Handle;           //!< I2C bus handle
+    uint8 Addr;                 //!< 7-bit slave address
+    uint8 RegLen;               //!< Register address size in bytes
+    uint16 Reg;                 //!< First register
+    uint32 Len;                 //!< Data bytes queued, 0 if empty.
+    uint8 Data[COALESCE_BURST_MAX];
+} stCoalesceQueue;
+
+static _Bool gcoalesce_enable = 0;
+static _Bool gcoalesce_noinc[FT_I2C_ADDR_MAX] =
+{ 0 };
+static __thread stCoalesceQueue gcoalesce_queue;
+static __thread stCoalesceStat gcoalesce_stat =
+{ 0 };
+
+//Write register data of a device in 1 transaction and wait bus idle.
+static FT_STATUS coalesce_send(FT_HANDLE ftHandle, uint8 addr, uint16 reg, uint8 reglen, const uint8 *buf, uint32 len)
+{
+    uint8 regbuf[2] =
+    { reg >> 8, reg & 0xFF };
+    uint32 done = 0;
+
+    gcoalesce_stat.Bursts++;
+    CHECK_FUNC_RET(FT_OK,
+            FT_writeI2cReg(ftHandle, addr, &regbuf[2 - reglen], reglen, (uint8*) buf, len, &done));
+    CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
+    if (done != len)
+    {
+        CLI_ERROR("ERROR: Burst write 0x%02X REG=[0x%02X], count=[%u] of [%u].\n", addr, reg, done, len);
+        return FT_OTHER_ERROR;
+    }
+    gcoalesce_stat.Bytes += len;
+    return FT_OK;
+}
+
+//Enable or disable write coalescing, for all threads.
+void COALESCE_enable(_Bool enable)
+{
+    gcoalesce_enable = enable;
+}
+
+_Bool COALESCE_isEnabled(void)
+{
+    return gcoalesce_enable;
+}
+
+//Mark a device without register auto-increment, its writes are never merged.
+void COALESCE_setNoInc(uint8 addr, _Bool noinc)
+{
+    if (addr < FT_I2C_ADDR_MAX)
+    {
+        gcoalesce_noinc[addr] = noinc;
+    }
+}
+
+/*!@brief Mark devices of a list without register auto-increment.
+ *
+ * @param list      "Addr,...", e.g. "0x20,0x21"
+ * @return          FT_OK or FT_INVALID_PARAMETER
+ */
+FT_STATUS COALESCE_parseNoInc(const char *list)
+{
+    char text[256];
+    char *save = NULL;
+
+    snprintf(text, sizeof(text), "%s", list);
+    for (char *tok = strtok_r(text, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+    {
+        char *tail = NULL;
+        unsigned long addr = strtoul(tok, &tail, 0);
+
+        if ((tail == tok) || (*tail != 0) || (addr >= FT_I2C_ADDR_MAX))
+        {
+            CLI_ERROR("ERROR: Invalid slave address [%s].\n", tok);
+            return FT_INVALID_PARAMETER;
+        }
+        COALESCE_setNoInc(addr, 1);
+    }
+    return FT_OK;
+}
+
+_Bool COALESCE_isNoInc(uint8 addr)
+{
+    return (addr < FT_I2C_ADDR_MAX) ? gcoalesce_noinc[addr] : 0;
+}
+
+/*!@brief Write register data, merged with the queued write when the registers are contiguous.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param addr      7-bit slave address
+ * @param reg       Register address, MSB first
+ * @param reglen    Register address size in bytes, 1 or 2.
+ * @param buf       Data to write
+ * @param len       Bytes to write
+ * @param queued    Pointer to store 1 if data is queued, 0 if written to bus, NULL if not used.
+ * @return          FT_OK or error code of the process, including error of flushing the queue.
+ */
+FT_STATUS COALESCE_write(FT_HANDLE ftHandle, uint8 addr, const uint8 *reg, uint8 reglen, const uint8 *buf,
+        uint32 len, _Bool *queued)
+{
+    stCoalesceQueue *q = &gcoalesce_queue;
+    uint16 regval = (reglen == 2) ? (reg[0] << 8 | reg[1]) : reg[0];
+    uint32 regend = (reglen == 2) ? 0x10000 : 0x100;
+
+    if (queued != NULL)
+    {
+        *queued = 0;
+    }
+    if (((reglen != 1) && (reglen != 2)) || (len == 0))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+    gcoalesce_stat.Writes++;
+
+    //1. Append to the queue if it's the next register of the same device.
+    if ((q->Len > 0) && (q->Handle == ftHandle) && (q->Addr == addr) && (q->RegLen == reglen)
+            && (q->Reg + q->Len == regval) && (q->Len + len <= COALESCE_BURST_MAX) && (regval + len <= regend))
+    {
+        memcpy(&q->Data[q->Len], buf, len);
+        q->Len += len;
+        if (queued != NULL)
+        {
+            *queued = 1;
+        }
+        return FT_OK;
+    }
+
+    //2. Otherwise send the queue, then queue this write or send it directly.
+    CHECK_FUNC_RET(FT_OK, COALESCE_flush());
+    if (!gcoalesce_enable || COALESCE_isNoInc(addr) || (len > COALESCE_BURST_MAX))
+    {
+        return coalesce_send(ftHandle, addr, regval, reglen, buf, len);
+    }
+
+    q->Handle = ftHandle;
+    q->Addr = addr;
+    q->RegLen = reglen;
+    q->Reg = regval;
+    q->Len = len;
+    memcpy(q->Data, buf, len);
+    if (queued != NULL)
+    {
+        *queued = 1;
+    }
+    return FT_OK;
+}
+
+/*!@brief Send the queued write of current thread.
+ *
+ * @return          FT_OK or error code of the process, the queue is dropped either way.
+ */
+FT_STATUS COALESCE_flush(void)
+{
+    stCoalesceQueue *q = &gcoalesce_queue;
+    uint32 len = q->Len;
+
+    if (len == 0)
+    {
+        return FT_OK;
+    }
+    q->Len = 0;
+    return coalesce_send(q->Handle, q->Addr, q->Reg, q->RegLen, q->Data, len);
+}
+
+//Get statistic of current thread since last COALESCE_resetStat().
+void COALESCE_getStat(stCoalesceStat *stat)
+{
+    *stat = gcoalesce_stat;
+}
+
+void COALESCE_resetStat(void)
+{
+    memset(&gcoalesce_stat, 0, sizeof(gcoalesce_stat));
+}
+
+void COALESCE_printStat(const stCoalesceStat *stat)
+{
+    uint32 saved = (stat->Writes > stat->Bursts) ? stat->Writes - stat->Bursts : 0;
+
+    CLI_PRINT("I2C COALESCE, writes=[%u] bursts=[%u] bytes=[%u], transactions saved=[%u]\n", stat->Writes,
+            stat->Bursts, stat->Bytes, saved);
+}
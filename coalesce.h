@@ -0,0 +1,55 @@
+/******************************************************************************
+ * @file    coalesce.h
+ *          Register write coalescing, merge writes of contiguous registers.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef COALESCE_H_
+#define COALESCE_H_
+
+#include "ft_i2c.h"
+
+#define COALESCE_BURST_MAX      256         //!< Max data bytes of a merged burst write.
+
+//!@typedef stCoalesceStat
+//!         Write coalescing statistic.
+typedef struct stCoalesceStat
+{
+    uint32 Writes;              //!< Register writes requested
+    uint32 Bursts;              //!< Bus transactions actually done
+    uint32 Bytes;               //!< Data bytes written
+} stCoalesceStat;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void COALESCE_enable(_Bool enable);
+
+_Bool COALESCE_isEnabled(void);
+
+void COALESCE_setNoInc(uint8 addr, _Bool noinc);
+
+FT_STATUS COALESCE_parseNoInc(const char *list);
+
+_Bool COALESCE_isNoInc(uint8 addr);
+
+FT_STATUS COALESCE_write(FT_HANDLE ftHandle, uint8 addr, const uint8 *reg, uint8 reglen, const uint8 *buf,
+        uint32 len, _Bool *queued);
+
+FT_STATUS COALESCE_flush(void);
+
+void COALESCE_getStat(stCoalesceStat *stat);
+
+void COALESCE_resetStat(void);
+
+void COALESCE_printStat(const stCoalesceStat *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COALESCE_H_ */
@@ -0,0 +1,391 @@
+/******************************************************************************
+ * @file    daemon.c
+ *          fti2c daemon, keep FT4222 I2C bus opened and serve commands from
+ *          other fti2c process over a local UNIX socket.
+ *
+ *          Protocol, one command per connection:
+ *          Client -> Daemon: command args, each ended by '\0', then the client
+ *                            shuts down its write side.
+ *          Daemon -> Client: command text output, then '\0' + int32 return value.
+ *
+ *          The daemon has its own working directory, the client makes file
+ *          paths of the args absolute before sending.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <libgen.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "cli.h"
+#include "ft_i2c.h"
+#include "daemon.h"
+
+static volatile sig_atomic_t gdaemon_stop = 0;
+static _Bool gdaemon_server = 0;
+
+static void daemon_onSignal(int sig)
+{
+    gdaemon_stop = 1;
+}
+
+//Connect to the daemon socket, return the socket fd or -1.
+static int daemon_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//Write all data to fd, return CLI_SUCCESS or CLI_FAILURE.
+static CLI_RET daemon_writeAll(int fd, const void *data, size_t len)
+{
+    const char *p = (const char*) data;
+
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return CLI_FAILURE;
+        }
+        p += n;
+        len -= n;
+    }
+    return CLI_SUCCESS;
+}
+
+/*!@brief Serve 1x command on a client connection.
+ *
+ * @param conn      Client connection fd
+ * @param handler   Command handler, e.g. command_i2c
+ */
+static void daemon_serve(int conn, CliCallBack *handler)
+{
+    char line[DAEMON_LINE_MAX] =
+    { 0 };
+    char *args[CLI_ARG_COUNT_MAX + 1] =
+    { 0 };
+    int argc = 0;
+    size_t len = 0;
+    int32_t status = 0;
+    char end = 0;
+
+    //Receive args until the client shuts down its write side.
+    while (len < sizeof(line) - 1)
+    {
+        ssize_t n = read(conn, &line[len], sizeof(line) - 1 - len);
+        if (n <= 0)
+        {
+            if ((n < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            break;
+        }
+        len += n;
+    }
+    line[len] = 0;
+
+    //Each arg is ended by '\0', spaces are part of the arg.
+    for (size_t i = 0; (i < len) && (argc < CLI_ARG_COUNT_MAX); i += strlen(&line[i]) + 1)
+    {
+        args[argc++] = &line[i];
+    }
+
+    //Route command output to client.
+    int saved = dup(STDOUT_FILENO);
+    fflush(stdout);
+    dup2(conn, STDOUT_FILENO);
+
+    status = handler(argc, args);
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    daemon_writeAll(conn, &end, 1);
+    daemon_writeAll(conn, &status, sizeof(status));
+
+    //The adapter may be gone, drop opened handles and open again on next command.
+    if ((status == FT_INVALID_HANDLE) || (status == FT_DEVICE_NOT_FOUND) || (status == FT_DEVICE_NOT_OPENED)
+            || (status == FT_IO_ERROR))
+    {
+        FT_closeI2cBus();
+    }
+}
+
+//Get the socket path, could be override by environment variable.
+const char *DAEMON_getSocketPath(void)
+{
+    const char *path = getenv(DAEMON_SOCKET_ENV);
+
+    if ((path == NULL) || (path[0] == 0))
+    {
+        path = DAEMON_SOCKET_DEFAULT;
+    }
+    return path;
+}
+
+//Check if running inside a daemon, commands should not be forwarded again.
+_Bool DAEMON_isServer(void)
+{
+    return gdaemon_server;
+}
+
+/*!@brief Run daemon, serve commands until SIGINT or SIGTERM.
+ *
+ * @param path      UNIX socket path
+ * @param handler   Command handler, e.g. command_i2c
+ * @return          CLI_SUCCESS or CLI_FAILURE of the process
+ */
+int DAEMON_runServer(const char *path, CliCallBack *handler)
+{
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    int fd = -1;
+
+    //Only 1x daemon on the same socket.
+    fd = daemon_connect(path);
+    if (fd >= 0)
+    {
+        close(fd);
+        CLI_ERROR("ERROR: Daemon is already running on [%s]\n", path);
+        return CLI_FAILURE;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        CLI_ERROR("ERROR: Can't create socket, %s\n", strerror(errno));
+        return CLI_FAILURE;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    if ((bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) || (listen(fd, 8) != 0))
+    {
+        CLI_ERROR("ERROR: Can't listen on [%s], %s\n", path, strerror(errno));
+        close(fd);
+        return CLI_FAILURE;
+    }
+
+    //Stop on SIGINT/SIGTERM, no SA_RESTART so accept() returns.
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = daemon_onSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    gdaemon_server = 1;
+    gdaemon_stop = 0;
+    CLI_PRINT("fti2c daemon running on [%s]\n", path);
+    fflush(stdout);
+
+    while (!gdaemon_stop)
+    {
+        int conn = accept(fd, NULL, NULL);
+        if (conn < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            CLI_ERROR("ERROR: accept() fail, %s\n", strerror(errno));
+            break;
+        }
+        daemon_serve(conn, handler);
+        close(conn);
+    }
+
+    CLI_PRINT("fti2c daemon stopped.\n");
+    close(fd);
+    unlink(path);
+    gdaemon_server = 0;
+    return CLI_SUCCESS;
+}
+
+/*!@brief Get absolute path of a file, the file may not exist yet but its directory must.
+ *
+ * @param path      File path
+ * @return          Absolute path allocated by malloc(), NULL if it can't be resolved.
+ */
+static char *daemon_getAbsPath(const char *path)
+{
+    char dir[PATH_MAX];
+    char name[PATH_MAX];
+    char *abs = realpath(path, NULL);
+
+    if ((abs != NULL) || (strlen(path) >= PATH_MAX))
+    {
+        return abs;
+    }
+
+    //File to be created, e.g. --file of a read, resolve its directory.
+    snprintf(dir, sizeof(dir), "%s", path);
+    snprintf(name, sizeof(name), "%s", path);
+    char *parent = realpath(dirname(dir), NULL);
+    if (parent == NULL)
+    {
+        return NULL;
+    }
+    abs = (char*) malloc(strlen(parent) + strlen(basename(name)) + 2);
+    if (abs != NULL)
+    {
+        sprintf(abs, "%s/%s", parent, basename(name));
+    }
+    free(parent);
+    return abs;
+}
+
+//Check if an arg is one of the options followed by a file path.
+static _Bool daemon_isPathOpt(const char *arg, const char *pathopt[])
+{
+    for (int i = 0; (pathopt != NULL) && (pathopt[i] != NULL); i++)
+    {
+        if (strcmp(arg, pathopt[i]) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*!@brief Forward a command to the daemon and print its output.
+ *
+ * @param path      UNIX socket path
+ * @param argc      Argument count
+ * @param argv      Argument string
+ * @param pathopt   Options followed by a file path, e.g. "-F", ended by NULL. The path is sent as an absolute path.
+ * @param status    Pointer to store the command return value from daemon
+ * @return          CLI_FAILURE if there's no daemon running, the command is not executed.
+ */
+CLI_RET DAEMON_runClient(const char *path, int argc, char *argv[], const char *pathopt[], int *status)
+{
+    char line[DAEMON_LINE_MAX] =
+    { 0 };
+    char buf[512];
+    uint8_t trailer[1 + sizeof(int32_t)];
+    size_t len = 0;
+    size_t trailer_len = 0;
+    int32_t ret = FT_OTHER_ERROR;
+    int fd = -1;
+
+    //Build args, each ended by '\0'.
+    for (int i = 0; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        char *abs = NULL;
+
+        if ((i > 0) && daemon_isPathOpt(argv[i - 1], pathopt) && (strcmp(arg, "-") != 0))
+        {
+            abs = daemon_getAbsPath(arg);
+            arg = (abs != NULL) ? abs : arg;
+        }
+
+        size_t l = strlen(arg) + 1;
+        if (len + l > sizeof(line) - 1)
+        {
+            free(abs);
+            CLI_ERROR("ERROR: Command too long for daemon.\n");
+            return CLI_FAILURE;
+        }
+        memcpy(&line[len], arg, l);
+        len += l;
+        free(abs);
+    }
+
+    fd = daemon_connect(path);
+    if (fd < 0)
+    {
+        return CLI_FAILURE;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    if ((daemon_writeAll(fd, line, len) != CLI_SUCCESS) || (shutdown(fd, SHUT_WR) != 0))
+    {
+        close(fd);
+        return CLI_FAILURE;
+    }
+
+    //Print text output until '\0', then get the return value.
+    for (;;)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+
+        size_t text = n;
+        if (trailer_len == 0)
+        {
+            char *end = memchr(buf, 0, n);
+            if (end != NULL)
+            {
+                text = end - buf;
+            }
+            fwrite(buf, 1, text, stdout);
+        }
+        else
+        {
+            text = 0;
+        }
+
+        for (size_t i = text; (i < (size_t) n) && (trailer_len < sizeof(trailer)); i++)
+        {
+            trailer[trailer_len++] = buf[i];
+        }
+    }
+    close(fd);
+    fflush(stdout);
+
+    if (trailer_len == sizeof(trailer))
+    {
+        memcpy(&ret, &trailer[1], sizeof(ret));
+    }
+    else
+    {
+        CLI_ERROR("ERROR: Daemon connection closed unexpectedly.\n");
+    }
+
+    *status = ret;
+    return CLI_SUCCESS;
+}
@@ -0,0 +1,28 @@
+/******************************************************************************
+ * @file    daemon.h
+ *          fti2c daemon, keep FT4222 I2C bus opened and serve commands from
+ *          other fti2c process over a local UNIX socket.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef DAEMON_H_
+#define DAEMON_H_
+
+#include "cli.h"
+
+#define DAEMON_SOCKET_DEFAULT   "/tmp/fti2c.sock"   //!< Default socket path.
+#define DAEMON_SOCKET_ENV       "FTI2C_SOCKET"      //!< Environment variable to override socket path.
+#define DAEMON_LINE_MAX         4096                //!< Max length of a command, args and their '\0'.
+
+const char *DAEMON_getSocketPath(void);
+
+_Bool DAEMON_isServer(void);
+
+int DAEMON_runServer(const char *path, CliCallBack *handler);
+
+CLI_RET DAEMON_runClient(const char *path, int argc, char *argv[], const char *pathopt[], int *status);
+
+#endif /* DAEMON_H_ */
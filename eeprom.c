@@ -0,0 +1,351 @@
+/******************************************************************************
+ * @file    eeprom.c
+ *          24Cxx I2C EEPROM programming over FT4222H.
+ *
+ *          Data is written page by page, a page write never crosses a page
+ *          boundary. After each page the slave address is probed until the
+ *          EEPROM ACKs again, so no fixed write cycle delay is needed.
+ *
+ *          With 1 byte memory address, offset bit 8~10 go to slave address
+ *          bit 0~2, as 24C04/08/16 do. A range past the address space, 2 KB
+ *          or 64 KB, is refused before any transfer instead of wrapping.
+ *
+ *          Delta write reads the whole range back in max size reads first,
+ *          only pages differing from the image are written. Written pages are
+ *          compared again by EEPROM_verify(), each run of written pages at once.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft_i2c.h"
+#include "shadow.h"
+#include "eeprom.h"
+
+//Get slave address and memory address bytes of an offset.
+static uint8 eeprom_getAddr(stEeprom *eeprom, uint32 offset, uint8 *reg)
+{
+    if (eeprom->AddrSize == 2)
+    {
+        reg[0] = (offset >> 8) & 0xFF;
+        reg[1] = offset & 0xFF;
+        return eeprom->Addr;
+    }
+
+    reg[0] = offset & 0xFF;
+    return eeprom->Addr | ((offset >> 8) & 0x07);
+}
+
+//Check a range is in the memory address space, an address past the end would wrap to offset 0 or another block.
+static FT_STATUS eeprom_checkRange(stEeprom *eeprom, uint32 offset, uint32 len)
+{
+    uint32 max = (eeprom->AddrSize == 2) ? EEPROM_SIZE_MAX_ADDR2 : EEPROM_SIZE_MAX_ADDR1;
+
+    if ((offset > max) || (len > max - offset))
+    {
+        CLI_ERROR("ERROR: EEPROM offset [0x%X] + count [%u] is out of [0x%X] bytes of %u byte address.\n", offset,
+                len, max, eeprom->AddrSize);
+        return FT_INVALID_PARAMETER;
+    }
+    return FT_OK;
+}
+
+//Drop the shadow cache of slave addresses holding a range, other devices on the bus keep theirs.
+static void eeprom_invalidate(stEeprom *eeprom, uint32 offset, uint32 len)
+{
+    uint8 reg[2];
+    uint8 first = eeprom_getAddr(eeprom, offset, reg);
+    uint8 last = eeprom_getAddr(eeprom, (len > 0) ? offset + len - 1 : offset, reg);
+
+    for (int addr = first; addr <= last; addr++)
+    {
+        SHADOW_invalidate(eeprom->Handle, addr);
+    }
+}
+
+/*!@brief Initial EEPROM structure.
+ *
+ * @param eeprom    EEPROM structure
+ * @param ftHandle  I2C bus handle
+ * @param addr      7-bit slave address
+ * @param addrsize  Memory address size in bytes, 1 or 2.
+ * @param pagesize  Page size in bytes, 0 to use EEPROM_PAGE_DEFAULT.
+ */
+void EEPROM_init(stEeprom *eeprom, FT_HANDLE ftHandle, uint8 addr, uint8 addrsize, uint16 pagesize)
+{
+    memset(eeprom, 0, sizeof(stEeprom));
+    eeprom->Handle = ftHandle;
+    eeprom->Addr = addr;
+    eeprom->AddrSize = addrsize;
+    eeprom->PageSize = (pagesize > 0) ? pagesize : EEPROM_PAGE_DEFAULT;
+    eeprom->PollTimeoutMs = EEPROM_POLL_TIMEOUT_MS;
+}
+
+/*!@brief Wait EEPROM internal write cycle by ACK polling.
+ *
+ * @param eeprom    EEPROM structure
+ * @param slvadd    Slave address just written
+ * @return          FT_OK, or FT_OTHER_ERROR if not ACK within PollTimeoutMs.
+ */
+FT_STATUS EEPROM_waitReady(stEeprom *eeprom, uint8 slvadd)
+{
+    double start = FT_getTimeMs();
+    double now = start;
+    _Bool ack = 0;
+
+    do
+    {
+        CHECK_FUNC_RET(FT_OK, FT_probeI2cAddr(eeprom->Handle, slvadd, FT_PROBE_READ, &ack));
+        eeprom->PollCount++;
+        now = FT_getTimeMs();
+    } while (!ack && (now - start < eeprom->PollTimeoutMs));
+
+    eeprom->PollTimeMs += now - start;
+
+    if (!ack)
+    {
+        CLI_ERROR("ERROR: EEPROM 0x%02X not ready after %u ms.\n", slvadd, eeprom->PollTimeoutMs);
+        return FT_OTHER_ERROR;
+    }
+    return FT_OK;
+}
+
+/*!@brief Read EEPROM data of any length.
+ *
+ *          Data is always read from the EEPROM, the shadow cache of its slave addresses is dropped first.
+ *
+ * @param eeprom    EEPROM structure
+ * @param offset    Memory offset
+ * @param buf       Buffer to store data
+ * @param len       Bytes to read
+ * @param done      Pointer to store bytes actually read
+ * @return          FT_OK or error code of the process
+ */
+FT_STATUS EEPROM_read(stEeprom *eeprom, uint32 offset, uint8 *buf, uint32 len, uint32 *done)
+{
+    uint8 reg[2];
+    uint32 count = 0;
+
+    *done = 0;
+    CHECK_FUNC_RET(FT_OK, eeprom_checkRange(eeprom, offset, len));
+    eeprom_invalidate(eeprom, offset, len);
+
+    while (*done < len)
+    {
+        uint32 size = len - *done;
+        uint8 slvadd = eeprom_getAddr(eeprom, offset + *done, reg);
+
+        //Slave address changes every 256 bytes with 1 byte memory address.
+        if ((eeprom->AddrSize == 1) && (size > 0x100 - ((offset + *done) & 0xFF)))
+        {
+            size = 0x100 - ((offset + *done) & 0xFF);
+        }
+
+        CHECK_FUNC_RET(FT_OK,
+                FT_readI2cReg(eeprom->Handle, slvadd, reg, eeprom->AddrSize, &buf[*done], size, &count));
+        CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(eeprom->Handle));
+        *done += count;
+        if (count != size)
+        {
+            break;
+        }
+    }
+    return FT_OK;
+}
+
+/*!@brief Write EEPROM data of any length, split on page boundaries.
+ *          Written pages are not kept in the shadow cache.
+ *
+ * @param eeprom    EEPROM structure
+ * @param offset    Memory offset
+ * @param buf       Data to write
+ * @param len       Bytes to write
+ * @param done      Pointer to store bytes actually written
+ * @return          FT_OK or error code of the process
+ */
+FT_STATUS EEPROM_write(stEeprom *eeprom, uint32 offset, uint8 *buf, uint32 len, uint32 *done)
+{
+    uint8 reg[2];
+    uint32 count = 0;
+
+    *done = 0;
+    CHECK_FUNC_RET(FT_OK, eeprom_checkRange(eeprom, offset, len));
+
+    while (*done < len)
+    {
+        uint32 addr = offset + *done;
+        uint32 size = eeprom->PageSize - (addr % eeprom->PageSize);
+        uint8 slvadd = eeprom_getAddr(eeprom, addr, reg);
+
+        if (size > len - *done)
+        {
+            size = len - *done;
+        }
+
+        //The cache takes the page as linear registers, but a write past the page end wraps in the page.
+        FT_STATUS status = FT_writeI2cReg(eeprom->Handle, slvadd, reg, eeprom->AddrSize, &buf[*done], size, &count);
+        SHADOW_invalidate(eeprom->Handle, slvadd);
+        CHECK_FUNC_RET(FT_OK, status);
+        CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(eeprom->Handle));
+        eeprom->PageCount++;
+        *done += count;
+        if (count != size)
+        {
+            break;
+        }
+
+        CHECK_FUNC_RET(FT_OK, EEPROM_waitReady(eeprom, slvadd));
+    }
+    return FT_OK;
+}
+
+/*!@brief Compare EEPROM data with an image, stop at the first differing byte.
+ *
+ *          Data is read in chunks of EEPROM_VERIFY_CHUNK, each chunk is compared
+ *          by memcmp() as soon as it's read, the byte is located only on a mismatch.
+ *
+ * @param eeprom    EEPROM structure
+ * @param offset    Memory offset
+ * @param buf       Image to compare with
+ * @param len       Bytes of the image
+ * @param match     Pointer to store bytes equal to the image, len if all equal.
+ * @return          FT_OK or error code of the process, a mismatch is not an error.
+ */
+FT_STATUS EEPROM_verify(stEeprom *eeprom, uint32 offset, const uint8 *buf, uint32 len, uint32 *match)
+{
+    uint32 count = 0;
+    FT_STATUS status = FT_OK;
+    uint8 *readbuf = (uint8*) malloc(EEPROM_VERIFY_CHUNK);
+
+    *match = 0;
+    CHECK_NULL_PTR(readbuf);
+    if (eeprom_checkRange(eeprom, offset, len) != FT_OK)
+    {
+        free(readbuf);
+        return FT_INVALID_PARAMETER;
+    }
+
+    while ((status == FT_OK) && (*match < len))
+    {
+        uint32 size = (len - *match > EEPROM_VERIFY_CHUNK) ? EEPROM_VERIFY_CHUNK : len - *match;
+
+        status = EEPROM_read(eeprom, offset + *match, readbuf, size, &count);
+        if ((status == FT_OK) && (count != size))
+        {
+            CLI_ERROR("ERROR: EEPROM 0x%02X read back count=[%u] of [%u].\n", eeprom->Addr, count, size);
+            status = FT_OTHER_ERROR;
+        }
+        if ((status == FT_OK) && (memcmp(readbuf, &buf[*match], size) != 0))
+        {
+            for (uint32 i = 0; readbuf[i] == buf[*match]; i++)
+            {
+                (*match)++;
+            }
+            break;
+        }
+        *match += (status == FT_OK) ? size : 0;
+    }
+
+    free(readbuf);
+    return status;
+}
+
+//Read back a run of written pages and compare with the image.
+static FT_STATUS eeprom_verifyPages(stEeprom *eeprom, uint32 offset, const uint8 *buf, uint32 len)
+{
+    uint32 match = 0;
+
+    CHECK_FUNC_RET(FT_OK, EEPROM_verify(eeprom, offset, buf, len, &match));
+    if (match != len)
+    {
+        CLI_ERROR("ERROR: EEPROM 0x%02X verify failed at offset [0x%X].\n", eeprom->Addr, offset + match);
+        return FT_OTHER_ERROR;
+    }
+    for (uint32 i = 0; i < len; i += eeprom->PageSize - ((offset + i) % eeprom->PageSize))
+    {
+        eeprom->PageVerify++;
+    }
+    return FT_OK;
+}
+
+/*!@brief Write only pages of the image differing from EEPROM data, then verify them.
+ *
+ * @param eeprom    EEPROM structure
+ * @param offset    Memory offset
+ * @param buf       Image to write
+ * @param len       Bytes of the image
+ * @param done      Pointer to store bytes actually written
+ * @return          FT_OK or error code of the process, FT_OTHER_ERROR if verify failed.
+ */
+FT_STATUS EEPROM_writeDelta(stEeprom *eeprom, uint32 offset, const uint8 *buf, uint32 len, uint32 *done)
+{
+    uint32 count = 0;
+    uint32 run = 0;             //Bytes of the current run of written pages, not verified yet.
+    FT_STATUS status = FT_OK;
+    uint8 *readbuf = (uint8*) malloc((len > 0) ? len : 1);
+
+    *done = 0;
+    CHECK_NULL_PTR(readbuf);
+
+    //1. Read back the whole range, EEPROM_read() splits it only where the bridge or slave address needs.
+    status = EEPROM_read(eeprom, offset, readbuf, len, &count);
+    if ((status == FT_OK) && (count != len))
+    {
+        CLI_ERROR("ERROR: EEPROM 0x%02X read back count=[%u] of [%u].\n", eeprom->Addr, count, len);
+        status = FT_OTHER_ERROR;
+    }
+
+    //2. Compare page by page, write pages that differ.
+    for (uint32 i = 0; (status == FT_OK) && (i < len);)
+    {
+        uint32 size = eeprom->PageSize - ((offset + i) % eeprom->PageSize);
+        if (size > len - i)
+        {
+            size = len - i;
+        }
+
+        if (memcmp(&readbuf[i], &buf[i], size) == 0)
+        {
+            eeprom->PageSkip++;
+        }
+        else
+        {
+            status = EEPROM_write(eeprom, offset + i, (uint8*) &buf[i], size, &count);
+            *done += count;
+            if ((status == FT_OK) && (count != size))
+            {
+                status = FT_OTHER_ERROR;
+            }
+        }
+        i += size;
+    }
+
+    //3. Read back written pages, a run of pages is verified once a page is skipped or at the end.
+    for (uint32 i = 0; (status == FT_OK) && (i <= len);)
+    {
+        uint32 size = eeprom->PageSize - ((offset + i) % eeprom->PageSize);
+        if (size > len - i)
+        {
+            size = len - i;
+        }
+
+        if ((i < len) && (memcmp(&readbuf[i], &buf[i], size) != 0))
+        {
+            run += size;
+        }
+        else if (run > 0)
+        {
+            status = eeprom_verifyPages(eeprom, offset + i - run, &buf[i - run], run);
+            run = 0;
+        }
+        i += (size > 0) ? size : 1;
+    }
+
+    free(readbuf);
+    return status;
+}
@@ -0,0 +1,58 @@
+/******************************************************************************
+ * @file    eeprom.h
+ *          24Cxx I2C EEPROM programming over FT4222H.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef EEPROM_H_
+#define EEPROM_H_
+
+#include "ft_i2c.h"
+
+#define EEPROM_PAGE_DEFAULT     8           //!< Default page size, smallest of 24Cxx family.
+#define EEPROM_POLL_TIMEOUT_MS  50          //!< Max write cycle time to wait for ACK.
+#define EEPROM_VERIFY_CHUNK     4096        //!< Bytes read and compared at a time by EEPROM_verify().
+#define EEPROM_SIZE_MAX_ADDR1   0x800       //!< Max memory with 1 byte address, 8 blocks in slave address bit 0~2.
+#define EEPROM_SIZE_MAX_ADDR2   0x10000     //!< Max memory with 2 bytes address.
+
+//!@typedef stEeprom
+//!         EEPROM device and programming statistic.
+typedef struct stEeprom
+{
+    FT_HANDLE Handle;           //!< I2C bus handle
+    uint8 Addr;                 //!< 7-bit slave address
+    uint8 AddrSize;             //!< Memory address size in bytes, 1 or 2.
+    uint16 PageSize;            //!< Page size in bytes
+    uint32 PollTimeoutMs;       //!< Max time to wait for ACK after a page write
+
+    uint32 PageCount;           //!< Pages written
+    uint32 PageSkip;            //!< Pages already equal to the image, not written
+    uint32 PageVerify;          //!< Pages read back equal to the image after written
+    uint32 PollCount;           //!< Address probes while waiting write cycle
+    double PollTimeMs;          //!< Time waiting write cycle
+} stEeprom;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void EEPROM_init(stEeprom *eeprom, FT_HANDLE ftHandle, uint8 addr, uint8 addrsize, uint16 pagesize);
+
+FT_STATUS EEPROM_waitReady(stEeprom *eeprom, uint8 slvadd);
+
+FT_STATUS EEPROM_read(stEeprom *eeprom, uint32 offset, uint8 *buf, uint32 len, uint32 *done);
+
+FT_STATUS EEPROM_write(stEeprom *eeprom, uint32 offset, uint8 *buf, uint32 len, uint32 *done);
+
+FT_STATUS EEPROM_verify(stEeprom *eeprom, uint32 offset, const uint8 *buf, uint32 len, uint32 *match);
+
+FT_STATUS EEPROM_writeDelta(stEeprom *eeprom, uint32 offset, const uint8 *buf, uint32 len, uint32 *done);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EEPROM_H_ */
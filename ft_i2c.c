@@ -0,0 +1,1134 @@
+/******************************************************************************
+ * @file    ft_i2c.c
+ *          FT4222H I2C master helper functions, shared by all fti2c modes.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "ft_i2c.h"
+#include "hal.h"
+#include "shadow.h"
+#include "retry.h"
+
+// FT_STATUS message
+static const char *FT_RET_MSG[] =
+{ "FT_OK", "FT_INVALID_HANDLE", "FT_DEVICE_NOT_FOUND", "FT_DEVICE_NOT_OPENED", "FT_IO_ERROR",
+        "FT_INSUFFICIENT_RESOURCES", "FT_INVALID_PARAMETER", "FT_INVALID_BAUD_RATE", "FT_DEVICE_NOT_OPENED_FOR_ERASE",
+        "FT_DEVICE_NOT_OPENED_FOR_WRITE", "FT_FAILED_TO_WRITE_DEVICE", "FT_EEPROM_READ_FAILED",
+        "FT_EEPROM_WRITE_FAILED", "FT_EEPROM_ERASE_FAILED", "FT_EEPROM_NOT_PRESENT", "FT_EEPROM_NOT_PROGRAMMED",
+        "FT_INVALID_ARGS", "FT_NOT_SUPPORTED", "FT_OTHER_ERROR", "FT_DEVICE_LIST_NOT_READY", };
+
+// FT_STATUS extending message, for FT4222H only, starting from 1000
+static const char *FT_RET_MSG_EXTEND[] =
+{ "FT4222_DEVICE_NOT_SUPPORTED", "FT4222_CLK_NOT_SUPPORTED", "FT4222_VENDER_CMD_NOT_SUPPORTED",
+        "FT4222_IS_NOT_SPI_MODE", "FT4222_IS_NOT_I2C_MODE", "FT4222_IS_NOT_SPI_SINGLE_MODE",
+        "FT4222_IS_NOT_SPI_MULTI_MODE", "FT4222_WRONG_I2C_ADDR", "FT4222_INVAILD_FUNCTION", "FT4222_INVALID_POINTER",
+        "FT4222_EXCEEDED_MAX_TRANSFER_SIZE", "FT4222_FAILED_TO_READ_DEVICE", "FT4222_I2C_NOT_SUPPORTED_IN_THIS_MODE",
+        "FT4222_GPIO_NOT_SUPPORTED_IN_THIS_MODE", "FT4222_GPIO_EXCEEDED_MAX_PORTNUM", "FT4222_GPIO_WRITE_NOT_SUPPORTED",
+        "FT4222_GPIO_PULLUP_INVALID_IN_INPUTMODE", "FT4222_GPIO_PULLDOWN_INVALID_IN_INPUTMODE",
+        "FT4222_GPIO_OPENDRAIN_INVALID_IN_OUTPUTMODE", "FT4222_INTERRUPT_NOT_SUPPORTED",
+        "FT4222_GPIO_INPUT_NOT_SUPPORTED", "FT4222_EVENT_NOT_SUPPORTED", "FT4222_FUN_NOT_SUPPORT" };
+
+//!@typedef stI2cBus
+//!         Opened I2C bus, kept until FT_closeI2cBus() so repeated commands skip USB setup.
+typedef struct stI2cBus
+{
+    FT_HANDLE Handle;           //!< Handle from FT_OpenEx, NULL if not opened.
+    uint32 Kbps;                //!< I2C frequency the master is initialized with.
+    FT_HANDLE Gpio;             //!< Handle of the GPIO interface, NULL if not opened.
+} stI2cBus;
+
+static stI2cBus gbus_open[FT_I2C_BUS_MAX] =
+{
+{ 0 } };
+
+//Enumeration cache, bus index is the index in genum_info.
+static FT_DEVICE_LIST_INFO_NODE genum_info[FT_I2C_BUS_MAX];
+static int genum_count = -1;                    //!< -1 if not enumerated yet
+static const stI2cBackend *genum_backend = NULL; //!< Backend of the cache
+static _Bool genum_snapshot = 0;                //!< Cache is loaded from snapshot file
+
+//Opened bus list is shared by all threads, each thread uses its own bus.
+static pthread_mutex_t gbus_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//Wait policy, statistic and output are per thread, so parallel buses don't mix.
+static __thread stI2cWait gi2c_wait =
+{ FT_WAIT_SPIN_DEFAULT, FT_WAIT_MIN_US_DEFAULT, FT_WAIT_MAX_US_DEFAULT, FT_WAIT_TIMEOUT_DEFAULT };
+
+static __thread stI2cWaitStat gi2c_wait_stat =
+{ 0 };
+
+static __thread FILE *gi2c_out = NULL;
+
+//Slave address of the last transfer, bus errors are counted to it.
+static __thread uint16 gi2c_addr = 0;
+
+//Handle of the last transfer if the retry policy already found the bus idle without error, NULL otherwise.
+static __thread FT_HANDLE gi2c_checked = NULL;
+
+//Get output stream of CLI_PRINT in current thread, stdout by default.
+FILE *FT_getOutput(void)
+{
+    return (gi2c_out != NULL) ? gi2c_out : stdout;
+}
+
+//Set output stream of CLI_PRINT in current thread, NULL for stdout.
+void FT_setOutput(FILE *fp)
+{
+    gi2c_out = fp;
+}
+
+//Get text message of a FT_STATUS / FT4222_STATUS
+const char *FT_getStatusMsg(int status)
+{
+    int count = sizeof(FT_RET_MSG) / sizeof(FT_RET_MSG[0]);
+    int count_extend = sizeof(FT_RET_MSG_EXTEND) / sizeof(FT_RET_MSG_EXTEND[0]);
+
+    if ((status >= 1000) && (status < 1000 + count_extend))
+    {
+        return FT_RET_MSG_EXTEND[status - 1000];
+    }
+    if ((status >= 0) && (status < count))
+    {
+        return FT_RET_MSG[status];
+    }
+    return "UNKNOWN_STATUS";
+}
+
+//Get monotonic time in ms.
+double FT_getTimeMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+//Get monotonic time in ns, for timing of single calls.
+uint64 FT_getTimeNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//Print uint8 data array
+void print_u8(int c, uint8 *d)
+{
+    for (int i = 0; i < c; i++)
+    {
+        CLI_PRINT("0x%02X\t", d[i]);
+    }
+    CLI_PRINT("\n");
+}
+
+void print_devinfo(FT_DEVICE_LIST_INFO_NODE *devInfo)
+{
+    int i = 0;
+
+    for (i = 0; devInfo[i].ID != 0; i++)
+    {
+        CLI_PRINT("Dev Index [%d]:\n", i);
+        CLI_PRINT("  Flags\t\t=0x%x\n", devInfo[i].Flags);
+        CLI_PRINT("  Type\t\t=0x%x\n", devInfo[i].Type);
+        CLI_PRINT("  ID\t\t=0x%x\n", devInfo[i].ID);
+        CLI_PRINT("  LocId\t\t=0x%x\n", devInfo[i].LocId);
+        CLI_PRINT("  SerialNumber\t=%s\n", devInfo[i].SerialNumber);
+        CLI_PRINT("  Description\t=%s\n", devInfo[i].Description);
+        CLI_PRINT("  ftHandle\t=0x%X\n", (int ) devInfo[i].ftHandle);
+    }
+}
+
+FT_STATUS FT_getVersion(FT_HANDLE ftHandle)
+{
+    FT4222_Version ft4222Version;
+    HAL_getVersion(ftHandle, &ft4222Version);
+    CLI_PRINT("Chip version: %08X, LibFT4222 version: %08X\n", (unsigned int) ft4222Version.chipVersion,
+            (unsigned int) ft4222Version.dllVersion);
+    return FT_OK;
+}
+
+uint8 FT_checkI2cAddr(FT_HANDLE ftHandle, uint8 slvadd)
+{
+    _Bool ack = 0;
+
+    CHECK_FUNC_RET(FT_OK, FT_probeI2cAddr(ftHandle, slvadd, FT_PROBE_READ, &ack));
+
+    if (!ack)
+    {
+        return -1;
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+/*!@brief Probe if a slave ACKs its address.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param slvadd    7-bit slave address
+ * @param mode      Probe method, quick write returns the status without error message if not supported.
+ * @param ack       Pointer to store the result, 1 if the address is ACKed.
+ * @return          FT_OK or error code of the process
+ */
+FT_STATUS FT_probeI2cAddr(FT_HANDLE ftHandle, uint8 slvadd, FT_PROBE mode, _Bool *ack)
+{
+    uint8 ReadPtr[1] =
+    { 0 };
+    uint16 TransferSize = 0;
+    uint8 i2cstatus = 0;
+    int retry = 0;
+
+    gi2c_checked = NULL;
+    if (mode == FT_PROBE_QUICK_WRITE)
+    {
+        FT_STATUS ret = HAL_writeEx(ftHandle, slvadd, START_AND_STOP, ReadPtr, 0, &TransferSize);
+        if (ret != FT_OK)
+        {
+            return ret;
+        }
+    }
+    else
+    {
+        CHECK_FUNC_RET(FT_OK, HAL_readEx(ftHandle, slvadd, START_AND_STOP, ReadPtr, 1, &TransferSize));
+    }
+
+    //Other status bits are invalid while controller is busy.
+    do
+    {
+        CHECK_FUNC_RET(FT_OK, HAL_getStatus(ftHandle, &i2cstatus));
+    } while (I2CM_CONTROLLER_BUSY(i2cstatus) && (++retry < 100));
+
+    *ack = !I2CM_ADDRESS_NACK(i2cstatus);
+
+    //Only a NACK leaves the controller in error state, skip the reset round trip on ACK.
+    if (!*ack)
+    {
+        CHECK_FUNC_RET(FT_OK, HAL_reset(ftHandle));
+    }
+
+    return FT_OK;
+}
+
+/*!@brief Sweep a list of slave address.
+ *
+ * @param ftHandle      I2C bus handle
+ * @param addr          Address list to probe
+ * @param count         Address count
+ * @param mode          Probe method, fall back to FT_PROBE_READ if quick write is not supported.
+ * @param found         Buffer to store detected address, at least count bytes.
+ * @param found_count   Pointer to store the detected address count.
+ * @return              FT_OK or error code of the process
+ */
+FT_STATUS FT_sweepI2cBus(FT_HANDLE ftHandle, const uint8 *addr, int count, FT_PROBE mode, uint8 *found,
+        int *found_count)
+{
+    _Bool ack = 0;
+    FT_STATUS ret = FT_OK;
+
+    *found_count = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        ret = FT_probeI2cAddr(ftHandle, addr[i], mode, &ack);
+        if ((ret != FT_OK) && (mode == FT_PROBE_QUICK_WRITE))
+        {
+            CLI_WARNING("WARNING: Quick write probe not supported, use 1 byte read instead.\n");
+            mode = FT_PROBE_READ;
+            ret = FT_probeI2cAddr(ftHandle, addr[i], mode, &ack);
+        }
+        if (ret != FT_OK)
+        {
+            return ret;
+        }
+
+        if (ack)
+        {
+            found[(*found_count)++] = addr[i];
+        }
+    }
+
+    return FT_OK;
+}
+
+//Wait I2C bus idle and get the controller status.
+//Status is re-polled immediately for SpinCount times, then with exponential backoff until TimeoutMs.
+static FT_STATUS ft_waitI2cBus(FT_HANDLE ftHandle, uint8 *pstatus)
+{
+    uint8 i2cstatus = 0;
+    uint32 spin = 0;
+    uint32 delay = gi2c_wait.BackoffMinUs;
+    double start = 0;
+    double wait = 0;
+
+    gi2c_wait_stat.Calls++;
+    gi2c_wait_stat.Polls++;
+    CHECK_FUNC_RET(FT_OK, HAL_getStatus(ftHandle, &i2cstatus));
+
+    //Wait bus busy flag.
+    if (I2CM_BUS_BUSY(i2cstatus) || I2CM_CONTROLLER_BUSY(i2cstatus))
+    {
+        gi2c_wait_stat.BusyCalls++;
+        start = FT_getTimeMs();
+
+        while (I2CM_BUS_BUSY(i2cstatus) || I2CM_CONTROLLER_BUSY(i2cstatus))
+        {
+            wait = FT_getTimeMs() - start;
+            if (wait > gi2c_wait.TimeoutMs)
+            {
+                gi2c_wait_stat.Timeouts++;
+                CLI_ERROR("I2C BUS Timeout: I2CM_BUS_BUSY, Error Code = [0x%X]\n", i2cstatus);
+                break;
+            }
+
+            if (spin < gi2c_wait.SpinCount)
+            {
+                spin++;
+            }
+            else
+            {
+                usleep(delay);
+                gi2c_wait_stat.Sleeps++;
+                delay = (delay * 2 > gi2c_wait.BackoffMaxUs) ? gi2c_wait.BackoffMaxUs : delay * 2;
+            }
+
+            gi2c_wait_stat.Polls++;
+            CHECK_FUNC_RET(FT_OK, HAL_getStatus(ftHandle, &i2cstatus));
+        }
+
+        wait = FT_getTimeMs() - start;
+        gi2c_wait_stat.WaitMs += wait;
+        if (wait > gi2c_wait_stat.MaxWaitMs)
+        {
+            gi2c_wait_stat.MaxWaitMs = wait;
+        }
+    }
+
+    *pstatus = i2cstatus;
+    return FT_OK;
+}
+
+//Report a failed transaction, the controller is reset for the next one.
+static FT_STATUS ft_failI2cBus(FT_HANDLE ftHandle, uint8 i2cstatus)
+{
+    // Print Error Message
+    if (i2cstatus & 0x02)
+    {
+        CLI_ERROR("I2C BUS ERROR: ");
+        if (I2CM_DATA_NACK(i2cstatus))
+        {
+            CLI_ERROR("[I2CM_DATA_NACK] ");
+        }
+        if (I2CM_ADDRESS_NACK(i2cstatus))
+        {
+            CLI_ERROR("[I2CM_ADDRESS_NACK] ");
+        }
+        if (I2CM_ARB_LOST(i2cstatus))
+        {
+            CLI_ERROR("[I2CM_ARB_LOST] ");
+        }
+        CLI_ERROR("\n");
+    }
+
+    //Register values of a failed transaction are unknown.
+    SHADOW_invalidate(ftHandle, SHADOW_ADDR_ALL);
+    HAL_reset(ftHandle);
+
+    return FT_OTHER_ERROR;
+}
+
+/*!@brief Wait I2C bus idle and check error of the last transaction.
+ *        Status is re-polled immediately for SpinCount times, then with exponential backoff until TimeoutMs.
+ *        It's not polled again if the retry policy already checked the last transaction.
+ *
+ * @param ftHandle  I2C bus handle
+ * @return          FT_OK if bus is free without error.
+ */
+uint8 FT_checkI2cBus(FT_HANDLE ftHandle)
+{
+    uint8 i2cstatus = 0;
+
+    if ((gi2c_checked != NULL) && (gi2c_checked == ftHandle))
+    {
+        gi2c_checked = NULL;
+        return FT_OK;
+    }
+
+    CHECK_FUNC_RET(FT_OK, ft_waitI2cBus(ftHandle, &i2cstatus));
+
+    // The normal condition should be bus free
+    if (i2cstatus == 0x20)
+    {
+        return FT_OK;
+    }
+
+    //Data of the transaction is gone here, it's only counted. Retry is done by the transfer functions.
+    RETRY_addError(gi2c_addr, i2cstatus, 0);
+    return ft_failI2cBus(ftHandle, i2cstatus);
+}
+
+//Frequency the bus of a handle is initialized with, 0 if not opened.
+static uint32 ft_getI2cKbps(FT_HANDLE ftHandle)
+{
+    uint32 kbps = 0;
+
+    pthread_mutex_lock(&gbus_lock);
+    for (int i = 0; i < FT_I2C_BUS_MAX; i++)
+    {
+        if (gbus_open[i].Handle == ftHandle)
+        {
+            kbps = gbus_open[i].Kbps;
+        }
+    }
+    pthread_mutex_unlock(&gbus_lock);
+    return kbps;
+}
+
+/*!@brief Check a whole transaction when retry is enabled, recover the controller if it's retried.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param slvadd    7-bit slave address of the transaction
+ * @param attempt   Retries done before, 0 for the first attempt.
+ * @param status    Pointer to store FT_OK, or the error if the transaction failed.
+ * @return          1 to issue the transaction again.
+ */
+static _Bool ft_retryI2c(FT_HANDLE ftHandle, uint16 slvadd, uint32 attempt, FT_STATUS *status)
+{
+    uint8 i2cstatus = 0;
+    RETRY_RECOVER recover = RETRY_RESET;
+
+    //Without retry the caller checks the bus by FT_checkI2cBus() as before, no extra status poll.
+    *status = FT_OK;
+    if (!RETRY_isEnabled())
+    {
+        return 0;
+    }
+
+    *status = ft_waitI2cBus(ftHandle, &i2cstatus);
+    if ((*status != FT_OK) || (i2cstatus == 0x20))
+    {
+        if ((*status == FT_OK) && (attempt > 0))
+        {
+            RETRY_addRecovered(slvadd);
+        }
+        //The caller's FT_checkI2cBus() has nothing left to check.
+        gi2c_checked = (*status == FT_OK) ? ftHandle : NULL;
+        return 0;
+    }
+
+    _Bool retry = RETRY_isRetry(i2cstatus, attempt, &recover);
+    RETRY_addError(slvadd, i2cstatus, retry);
+    if (!retry)
+    {
+        *status = ft_failI2cBus(ftHandle, i2cstatus);
+        return 0;
+    }
+
+    //Registers of the device may be half written, the retry writes them again.
+    SHADOW_invalidate(ftHandle, slvadd);
+    *status = HAL_reset(ftHandle);
+    if ((*status == FT_OK) && (recover == RETRY_REINIT))
+    {
+        *status = HAL_init(ftHandle, ft_getI2cKbps(ftHandle));
+    }
+    if (*status != FT_OK)
+    {
+        CLI_ERROR("ERROR: Can't recover I2C bus, Return=[%d] %s\n", *status, FT_getStatusMsg(*status));
+        return 0;
+    }
+    RETRY_backoff(attempt);
+    return 1;
+}
+
+//A whole transaction has START and STOP, a repeated start continues a transaction.
+static _Bool ft_isTransaction(uint8 flag)
+{
+    return (flag != NONE) && ((flag & Repeated_START) == START) && (flag & STOP);
+}
+
+//Get max bytes of 1x ReadEx/WriteEx call.
+FT_STATUS FT_getMaxTransferSize(FT_HANDLE ftHandle, uint16 *size)
+{
+    CHECK_FUNC_RET(FT_OK, HAL_getMaxTransferSize(ftHandle, size));
+
+    if (*size == 0)
+    {
+        *size = 1;
+    }
+    return FT_OK;
+}
+
+//Get the flag of a chunk, START part goes to the first chunk and STOP part goes to the last chunk.
+static uint8 ft_getChunkFlag(uint8 flag, _Bool first, _Bool last)
+{
+    uint8 chunk_flag = 0;
+
+    if (first && (flag != NONE))
+    {
+        chunk_flag |= flag & Repeated_START;
+    }
+    if (last && (flag != NONE))
+    {
+        chunk_flag |= flag & STOP;
+    }
+    return (chunk_flag == 0) ? NONE : chunk_flag;
+}
+
+//1 attempt of FT_readI2c(), without retry.
+static FT_STATUS ft_readI2c(FT_HANDLE ftHandle, uint16 slvadd, uint8 flag, uint8 *buf, uint32 len, uint32 *done)
+{
+    uint16 max = 0;
+    uint16 TransferSize = 0;
+    uint32 offset = 0;
+
+    *done = 0;
+    CHECK_FUNC_RET(FT_OK, FT_getMaxTransferSize(ftHandle, &max));
+
+    do
+    {
+        uint16 chunk = (len - offset > max) ? max : len - offset;
+        uint8 chunk_flag = ft_getChunkFlag(flag, offset == 0, offset + chunk == len);
+
+        CHECK_FUNC_RET(FT_OK,
+                HAL_readEx(ftHandle, slvadd, chunk_flag, &buf[offset], chunk, &TransferSize));
+        offset += TransferSize;
+        if (TransferSize != chunk)
+        {
+            break;
+        }
+    } while (offset < len);
+
+    *done = offset;
+    return FT_OK;
+}
+
+/*!@brief Read data of any length, split into chunks of max transfer size in one I2C transaction.
+ *        A whole transaction, START to STOP, is issued again on a bus error by the retry policy.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param slvadd    7-bit slave address
+ * @param flag      I2C_MasterFlag of the whole transfer, e.g. START_AND_STOP, or NONE to continue a transaction.
+ * @param buf       Buffer to store data
+ * @param len       Bytes to read
+ * @param done      Pointer to store bytes actually read, stop at the first short chunk.
+ * @return          FT_OK or error code of the process
+ */
+FT_STATUS FT_readI2c(FT_HANDLE ftHandle, uint16 slvadd, uint8 flag, uint8 *buf, uint32 len, uint32 *done)
+{
+    FT_STATUS status = FT_OK;
+    uint32 attempt = 0;
+
+    gi2c_addr = slvadd;
+    gi2c_checked = NULL;
+    do
+    {
+        CHECK_FUNC_RET(FT_OK, ft_readI2c(ftHandle, slvadd, flag, buf, len, done));
+    } while (ft_isTransaction(flag) && ft_retryI2c(ftHandle, slvadd, attempt++, &status));
+    return status;
+}
+
+//1 attempt of FT_writeI2c(), without retry.
+static FT_STATUS ft_writeI2c(FT_HANDLE ftHandle, uint16 slvadd, uint8 flag, uint8 *buf, uint32 len, uint32 *done)
+{
+    uint16 max = 0;
+    uint16 TransferSize = 0;
+    uint32 offset = 0;
+
+    *done = 0;
+    CHECK_FUNC_RET(FT_OK, FT_getMaxTransferSize(ftHandle, &max));
+
+    //Raw data starting a transaction may set any register of the device.
+    if (flag & START)
+    {
+        SHADOW_invalidate(ftHandle, slvadd);
+    }
+
+    do
+    {
+        uint16 chunk = (len - offset > max) ? max : len - offset;
+        uint8 chunk_flag = ft_getChunkFlag(flag, offset == 0, offset + chunk == len);
+
+        CHECK_FUNC_RET(FT_OK,
+                HAL_writeEx(ftHandle, slvadd, chunk_flag, &buf[offset], chunk, &TransferSize));
+        offset += TransferSize;
+        if (TransferSize != chunk)
+        {
+            break;
+        }
+    } while (offset < len);
+
+    *done = offset;
+    return FT_OK;
+}
+
+/*!@brief Write data of any length, split into chunks of max transfer size in one I2C transaction.
+ *        A whole transaction, START to STOP, is issued again on a bus error by the retry policy.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param slvadd    7-bit slave address
+ * @param flag      I2C_MasterFlag of the whole transfer, e.g. START_AND_STOP, or NONE to continue a transaction.
+ * @param buf       Data to write
+ * @param len       Bytes to write
+ * @param done      Pointer to store bytes actually written, stop at the first short chunk.
+ * @return          FT_OK or error code of the process
+ */
+FT_STATUS FT_writeI2c(FT_HANDLE ftHandle, uint16 slvadd, uint8 flag, uint8 *buf, uint32 len, uint32 *done)
+{
+    FT_STATUS status = FT_OK;
+    uint32 attempt = 0;
+
+    gi2c_addr = slvadd;
+    gi2c_checked = NULL;
+    do
+    {
+        CHECK_FUNC_RET(FT_OK, ft_writeI2c(ftHandle, slvadd, flag, buf, len, done));
+    } while (ft_isTransaction(flag) && ft_retryI2c(ftHandle, slvadd, attempt++, &status));
+    return status;
+}
+
+//Register address bytes to value, MSB first.
+static uint16 ft_getRegValue(const uint8 *reg, uint8 reglen)
+{
+    return (reglen >= 2) ? (reg[0] << 8 | reg[1]) : reg[0];
+}
+
+/*!@brief Read register data of any length, register pointer write + repeated start read.
+ *        Non-volatile registers known by the shadow cache are not read from bus.
+ *        Pointer write and read are issued again on a bus error by the retry policy.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param slvadd    7-bit slave address
+ * @param reg       Register address, MSB first
+ * @param reglen    Register address size in bytes
+ * @param buf       Buffer to store data
+ * @param len       Bytes to read
+ * @param done      Pointer to store bytes actually read
+ * @return          FT_OK or error code of the process
+ */
+FT_STATUS FT_readI2cReg(FT_HANDLE ftHandle, uint16 slvadd, uint8 *reg, uint8 reglen, uint8 *buf, uint32 len,
+        uint32 *done)
+{
+    uint16 TransferSize = 0;
+    uint16 regval = ft_getRegValue(reg, reglen);
+    FT_STATUS status = FT_OK;
+    uint32 attempt = 0;
+
+    *done = 0;
+
+    //Non-volatile registers already known are not read again.
+    if (SHADOW_read(ftHandle, slvadd, regval, buf, len))
+    {
+        *done = len;
+        return FT_OK;
+    }
+
+    gi2c_addr = slvadd;
+    gi2c_checked = NULL;
+    do
+    {
+        CHECK_FUNC_RET(FT_OK, HAL_writeEx(ftHandle, slvadd, START, reg, reglen, &TransferSize));
+        CHECK_FUNC_RET(FT_OK, ft_readI2c(ftHandle, slvadd, Repeated_START | STOP, buf, len, done));
+    } while (ft_retryI2c(ftHandle, slvadd, attempt++, &status));
+    if (status != FT_OK)
+    {
+        return status;
+    }
+
+    SHADOW_update(ftHandle, slvadd, regval, buf, *done);
+    return FT_OK;
+}
+
+//1 attempt of FT_writeI2cReg(), without retry and register cache.
+static FT_STATUS ft_sendI2cReg(FT_HANDLE ftHandle, uint16 slvadd, uint8 *reg, uint8 reglen, uint8 *buf, uint32 len,
+        uint32 *done)
+{
+    uint8 packet[FT_I2C_PACKET_MAX];
+    uint16 TransferSize = 0;
+    uint16 max = 0;
+
+    *done = 0;
+    CHECK_FUNC_RET(FT_OK, FT_getMaxTransferSize(ftHandle, &max));
+
+    if ((reglen + len <= max) && (reglen + len <= sizeof(packet)))
+    {
+        memcpy(packet, reg, reglen);
+        memcpy(&packet[reglen], buf, len);
+        CHECK_FUNC_RET(FT_OK,
+                HAL_writeEx(ftHandle, slvadd, START_AND_STOP, packet, reglen + len, &TransferSize));
+        *done = (TransferSize > reglen) ? TransferSize - reglen : 0;
+        return FT_OK;
+    }
+
+    CHECK_FUNC_RET(FT_OK, HAL_writeEx(ftHandle, slvadd, START, reg, reglen, &TransferSize));
+    return ft_writeI2c(ftHandle, slvadd, STOP, buf, len, done);
+}
+
+//FT_writeI2cReg() without register cache.
+static FT_STATUS ft_writeI2cReg(FT_HANDLE ftHandle, uint16 slvadd, uint8 *reg, uint8 reglen, uint8 *buf, uint32 len,
+        uint32 *done)
+{
+    FT_STATUS status = FT_OK;
+    uint32 attempt = 0;
+
+    gi2c_addr = slvadd;
+    gi2c_checked = NULL;
+    do
+    {
+        CHECK_FUNC_RET(FT_OK, ft_sendI2cReg(ftHandle, slvadd, reg, reglen, buf, len, done));
+    } while (ft_retryI2c(ftHandle, slvadd, attempt++, &status));
+    return status;
+}
+
+/*!@brief Write register data of any length in one I2C transaction, and update the shadow cache.
+ *        Register pointer and data are sent in 1x USB transfer when they fit in max transfer size.
+ *        The transaction is issued again on a bus error by the retry policy.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param slvadd    7-bit slave address
+ * @param reg       Register address, MSB first
+ * @param reglen    Register address size in bytes
+ * @param buf       Data to write
+ * @param len       Bytes to write
+ * @param done      Pointer to store data bytes actually written, register address excluded.
+ * @return          FT_OK or error code of the process
+ */
+FT_STATUS FT_writeI2cReg(FT_HANDLE ftHandle, uint16 slvadd, uint8 *reg, uint8 reglen, uint8 *buf, uint32 len,
+        uint32 *done)
+{
+    FT_STATUS ret = ft_writeI2cReg(ftHandle, slvadd, reg, reglen, buf, len, done);
+
+    //Registers written are known, unless the write failed half way.
+    if (ret == FT_OK)
+    {
+        SHADOW_update(ftHandle, slvadd, ft_getRegValue(reg, reglen), buf, *done);
+    }
+    else
+    {
+        SHADOW_invalidate(ftHandle, slvadd);
+    }
+    return ret;
+}
+
+/*!@brief Read data of any length into a file, in one I2C transaction.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param slvadd    7-bit slave address
+ * @param flag      I2C_MasterFlag of the whole transfer, e.g. START_AND_STOP
+ * @param fp        File to write data
+ * @param len       Bytes to read
+ * @param done      Pointer to store bytes actually read
+ * @return          FT_OK or error code of the process
+ */
+FT_STATUS FT_readI2cToFile(FT_HANDLE ftHandle, uint16 slvadd, uint8 flag, FILE *fp, uint32 len, uint32 *done)
+{
+    uint8 *block = (uint8*) malloc(FT_I2C_STREAM_BLOCK);
+    uint32 offset = 0;
+    uint32 count = 0;
+    FT_STATUS ret = FT_OK;
+
+    *done = 0;
+    if (block == NULL)
+    {
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+
+    while (offset < len)
+    {
+        uint32 size = (len - offset > FT_I2C_STREAM_BLOCK) ? FT_I2C_STREAM_BLOCK : len - offset;
+        uint8 block_flag = ft_getChunkFlag(flag, offset == 0, offset + size == len);
+
+        ret = FT_readI2c(ftHandle, slvadd, block_flag, block, size, &count);
+        if (fwrite(block, 1, count, fp) != count)
+        {
+            ret = FT_IO_ERROR;
+        }
+        offset += count;
+        if ((ret != FT_OK) || (count != size))
+        {
+            break;
+        }
+    }
+
+    free(block);
+    *done = offset;
+    return ret;
+}
+
+/*!@brief Write data of any length from a file, in one I2C transaction.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param slvadd    7-bit slave address
+ * @param flag      I2C_MasterFlag of the whole transfer, e.g. START_AND_STOP
+ * @param fp        File to read data
+ * @param len       Bytes to write, the file must have at least len bytes left.
+ * @param done      Pointer to store bytes actually written
+ * @return          FT_OK or error code of the process
+ */
+FT_STATUS FT_writeI2cFromFile(FT_HANDLE ftHandle, uint16 slvadd, uint8 flag, FILE *fp, uint32 len, uint32 *done)
+{
+    uint8 *block = (uint8*) malloc(FT_I2C_STREAM_BLOCK);
+    uint32 offset = 0;
+    uint32 count = 0;
+    FT_STATUS ret = FT_OK;
+
+    *done = 0;
+    if (block == NULL)
+    {
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+
+    while (offset < len)
+    {
+        uint32 size = (len - offset > FT_I2C_STREAM_BLOCK) ? FT_I2C_STREAM_BLOCK : len - offset;
+        uint8 block_flag = ft_getChunkFlag(flag, offset == 0, offset + size == len);
+
+        if (fread(block, 1, size, fp) != size)
+        {
+            ret = FT_IO_ERROR;
+            break;
+        }
+        ret = FT_writeI2c(ftHandle, slvadd, block_flag, block, size, &count);
+        offset += count;
+        if ((ret != FT_OK) || (count != size))
+        {
+            break;
+        }
+    }
+
+    free(block);
+    *done = offset;
+    return ret;
+}
+
+//Set the strategy of FT_checkI2cBus() waiting bus idle.
+void FT_setWaitPolicy(const stI2cWait *wait)
+{
+    gi2c_wait = *wait;
+    if (gi2c_wait.BackoffMinUs == 0)
+    {
+        gi2c_wait.BackoffMinUs = 1;
+    }
+    if (gi2c_wait.BackoffMaxUs < gi2c_wait.BackoffMinUs)
+    {
+        gi2c_wait.BackoffMaxUs = gi2c_wait.BackoffMinUs;
+    }
+}
+
+void FT_getWaitPolicy(stI2cWait *wait)
+{
+    *wait = gi2c_wait;
+}
+
+//Get statistic of FT_checkI2cBus() since last FT_resetWaitStat().
+void FT_getWaitStat(stI2cWaitStat *stat)
+{
+    *stat = gi2c_wait_stat;
+}
+
+void FT_resetWaitStat(void)
+{
+    memset(&gi2c_wait_stat, 0, sizeof(gi2c_wait_stat));
+}
+
+void FT_printWaitStat(const stI2cWaitStat *stat)
+{
+    CLI_PRINT("I2C WAIT, checks=[%d] busy=[%d] polls=[%d] sleeps=[%d] timeouts=[%d], wait=[%.3f] ms max=[%.3f] ms",
+            stat->Calls, stat->BusyCalls, stat->Polls, stat->Sleeps, stat->Timeouts, stat->WaitMs, stat->MaxWaitMs);
+    CLI_PRINT(", avg polls/check=[%.2f]\n", stat->Calls ? (double) stat->Polls / stat->Calls : 0);
+}
+
+//Enumerate FT4222 I2C bus and save the snapshot, with gbus_lock held.
+static int ft_enumI2cBus(void)
+{
+    memset(genum_info, 0, sizeof(genum_info));
+    genum_count = HAL_listBus(genum_info, FT_I2C_BUS_MAX);
+    genum_backend = HAL_getBackend();
+    genum_snapshot = 0;
+
+    //The emulator keeps a snapshot too, so the stale snapshot handling is tested without hardware.
+    const char *path = getenv(FT_BUS_CACHE_ENV);
+    if (path != NULL)
+    {
+        FILE *fp = fopen(path, "w");
+        if (fp != NULL)
+        {
+            fprintf(fp, "%s %s\n", FT_BUS_CACHE_TAG, genum_backend->Name);
+            for (int i = 0; i < genum_count; i++)
+            {
+                fprintf(fp, "0x%X 0x%X 0x%X 0x%X %s %s\n", genum_info[i].LocId, genum_info[i].Flags,
+                        genum_info[i].Type, genum_info[i].ID, genum_info[i].SerialNumber, genum_info[i].Description);
+            }
+            fclose(fp);
+        }
+    }
+    return genum_count;
+}
+
+//Load bus list from snapshot of an earlier run, return 0 if no valid snapshot.
+static _Bool ft_loadI2cBus(void)
+{
+    const char *path = getenv(FT_BUS_CACHE_ENV);
+    char line[256];
+    char tag[64];
+    char name[64];
+    int count = 0;
+
+    if (path == NULL)
+    {
+        return 0;
+    }
+
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+
+    //Header must match the backend in use.
+    if ((fgets(line, sizeof(line), fp) == NULL) || (sscanf(line, "%63s %63s", tag, name) != 2)
+            || (strcmp(tag, FT_BUS_CACHE_TAG) != 0) || (strcmp(name, HAL_getBackend()->Name) != 0))
+    {
+        fclose(fp);
+        return 0;
+    }
+
+    memset(genum_info, 0, sizeof(genum_info));
+    while ((count < FT_I2C_BUS_MAX) && (fgets(line, sizeof(line), fp) != NULL))
+    {
+        FT_DEVICE_LIST_INFO_NODE *info = &genum_info[count];
+        if (sscanf(line, "%x %x %x %x %15s %63[^\n]", &info->LocId, &info->Flags, &info->Type, &info->ID,
+                info->SerialNumber, info->Description) == 6)
+        {
+            count++;
+        }
+    }
+    fclose(fp);
+
+    genum_count = count;
+    genum_backend = HAL_getBackend();
+    genum_snapshot = 1;
+    return (count > 0);
+}
+
+//Get bus list from cache, enumerate only if there's no cache, with gbus_lock held.
+static int ft_getI2cBus(void)
+{
+    if ((genum_count >= 0) && (genum_backend == HAL_getBackend()))
+    {
+        return genum_count;
+    }
+    if (ft_loadI2cBus())
+    {
+        return genum_count;
+    }
+    return ft_enumI2cBus();
+}
+
+/*!@brief Get all FT4222 I2C bus, from the enumeration cache if there's one.
+ *
+ * @param I2cDevInfo    Buffer of FT_I2C_BUS_MAX nodes to store bus info.
+ * @return              Bus count
+ */
+int FT_listI2cBus(FT_DEVICE_LIST_INFO_NODE *I2cDevInfo)
+{
+    pthread_mutex_lock(&gbus_lock);
+    int count = ft_getI2cBus();
+    memcpy(I2cDevInfo, genum_info, sizeof(FT_DEVICE_LIST_INFO_NODE) * count);
+    pthread_mutex_unlock(&gbus_lock);
+    return count;
+}
+
+//Enumerate FT4222 I2C bus again and update the cache, return bus count.
+int FT_refreshI2cBus(void)
+{
+    pthread_mutex_lock(&gbus_lock);
+    int count = ft_enumI2cBus();
+    pthread_mutex_unlock(&gbus_lock);
+    return count;
+}
+
+//Match bus id in the cache, with gbus_lock held.
+static int ft_matchI2cBus(const char *id)
+{
+    char *tail = NULL;
+    unsigned long value = strtoul(id, &tail, 0);
+    _Bool number = (*id != 0) && (*tail == 0);
+
+    for (int i = 0; number && (i < genum_count); i++)
+    {
+        if ((value < FT_I2C_BUS_MAX) && (value == i))
+        {
+            return i;
+        }
+        if ((value >= FT_I2C_BUS_MAX) && (value == genum_info[i].LocId))
+        {
+            return i;
+        }
+    }
+
+    //A serial number may be all digits, it's compared when the number doesn't match.
+    for (int i = 0; i < genum_count; i++)
+    {
+        if (strcmp(id, genum_info[i].SerialNumber) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*!@brief Find I2C bus index by index, serial number or location ID.
+ *
+ * @param id    Bus index if < FT_I2C_BUS_MAX, location ID if a larger number, otherwise or if the number
+ *              doesn't match, serial number.
+ * @return      Bus index, or -1 if not found.
+ */
+int FT_findI2cBus(const char *id)
+{
+    pthread_mutex_lock(&gbus_lock);
+    ft_getI2cBus();
+    int index = ft_matchI2cBus(id);
+
+    //Snapshot may be out of date, enumerate again.
+    if ((index < 0) && genum_snapshot)
+    {
+        ft_enumI2cBus();
+        index = ft_matchI2cBus(id);
+    }
+    pthread_mutex_unlock(&gbus_lock);
+    return index;
+}
+
+//FT_openI2cBus() with gbus_lock held.
+static FT_STATUS ft_openI2cBus(int devicenumber, FT_HANDLE *pHandle, uint32 kbps)
+{
+    stI2cBus *bus = NULL;
+
+    if ((devicenumber < 0) || (devicenumber >= FT_I2C_BUS_MAX))
+    {
+        CLI_ERROR("ERROR: Invalid I2C bus [%d].\n", devicenumber);
+        return FT_INVALID_PARAMETER;
+    }
+
+    //Re-use the handle if the bus is already opened.
+    if (gbus_open[devicenumber].Handle != NULL)
+    {
+        bus = &gbus_open[devicenumber];
+        if (bus->Kbps != kbps)
+        {
+            CHECK_FUNC_RET(FT_OK, HAL_init(bus->Handle, kbps));
+            bus->Kbps = kbps;
+        }
+        *pHandle = bus->Handle;
+        return FT_OK;
+    }
+
+    int count = ft_getI2cBus();
+    FT_STATUS status = (devicenumber < count) ? HAL_open(genum_info[devicenumber].LocId, pHandle) : FT_DEVICE_NOT_FOUND;
+
+    //Bus list of snapshot may be out of date, enumerate again and retry.
+    if ((status != FT_OK) && genum_snapshot)
+    {
+        count = ft_enumI2cBus();
+        status = (devicenumber < count) ? HAL_open(genum_info[devicenumber].LocId, pHandle) : FT_DEVICE_NOT_FOUND;
+    }
+
+    if (devicenumber >= count)
+    {
+        CLI_ERROR("ERROR: Can't find I2C bus [%d], [%d] FT4222 I2C bus found.\n", devicenumber, count);
+        return FT_DEVICE_NOT_FOUND;
+    }
+    CHECK_FUNC_RET(FT_OK, status);
+
+    //A handle failed to init isn't kept, close it so the bus can be opened again.
+    status = HAL_init(*pHandle, kbps);
+    if (status != FT_OK)
+    {
+        HAL_close(*pHandle);
+        *pHandle = NULL;
+    }
+    CHECK_FUNC_RET(FT_OK, status);
+
+    gbus_open[devicenumber].Handle = *pHandle;
+    gbus_open[devicenumber].Kbps = kbps;
+    return FT_OK;
+}
+
+/*!@brief Get a handle of an I2C bus, opened devices are kept for later calls.
+ *          Thread safe, but a handle must be used by one thread at a time.
+ *
+ * @param devicenumber  I2C bus index, as listed by FT_listI2cBus()
+ * @param pHandle       Pointer to store the handle
+ * @param kbps          I2C frequency in kHz, the master is re-initialized if it changes.
+ * @return              FT_OK or error code of the process
+ */
+FT_STATUS FT_openI2cBus(int devicenumber, FT_HANDLE *pHandle, uint32 kbps)
+{
+    pthread_mutex_lock(&gbus_lock);
+    FT_STATUS ret = ft_openI2cBus(devicenumber, pHandle, kbps);
+    pthread_mutex_unlock(&gbus_lock);
+    return ret;
+}
+
+/*!@brief Get a handle of the GPIO interface of an opened I2C bus, kept until FT_closeI2cBus().
+ *
+ * @param devicenumber  I2C bus index, opened by FT_openI2cBus()
+ * @param pHandle       Pointer to store the GPIO handle
+ * @return              FT_OK or error code of the process
+ */
+FT_STATUS FT_openGpio(int devicenumber, FT_HANDLE *pHandle)
+{
+    FT_STATUS status = FT_DEVICE_NOT_OPENED;
+
+    *pHandle = NULL;
+    pthread_mutex_lock(&gbus_lock);
+    if ((devicenumber >= 0) && (devicenumber < FT_I2C_BUS_MAX) && (gbus_open[devicenumber].Handle != NULL))
+    {
+        stI2cBus *bus = &gbus_open[devicenumber];
+        status = FT_OK;
+        if (bus->Gpio == NULL)
+        {
+            status = HAL_gpioOpen(genum_info[devicenumber].LocId, pHandle);
+            bus->Gpio = (status == FT_OK) ? *pHandle : NULL;
+        }
+        *pHandle = bus->Gpio;
+    }
+    pthread_mutex_unlock(&gbus_lock);
+    CHECK_FUNC_RET(FT_OK, status);
+    return FT_OK;
+}
+
+//Close all the I2C bus opened by FT_openI2cBus(), and drop the enumeration cache.
+void FT_closeI2cBus(void)
+{
+    pthread_mutex_lock(&gbus_lock);
+    for (int i = 0; i < FT_I2C_BUS_MAX; i++)
+    {
+        if (gbus_open[i].Gpio != NULL)
+        {
+            HAL_gpioClose(gbus_open[i].Gpio);
+            gbus_open[i].Gpio = NULL;
+        }
+        if (gbus_open[i].Handle != NULL)
+        {
+            HAL_close(gbus_open[i].Handle);
+            gbus_open[i].Handle = NULL;
+            gbus_open[i].Kbps = 0;
+        }
+    }
+
+    //Bus may be unplugged or backend changed, enumerate again on next open.
+    genum_count = -1;
+    pthread_mutex_unlock(&gbus_lock);
+    SHADOW_invalidate(NULL, SHADOW_ADDR_ALL);
+}
@@ -0,0 +1,176 @@
+/******************************************************************************
+ * @file    ft_i2c.h
+ *          FT4222H I2C master helper functions, shared by all fti2c modes.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef FT_I2C_H_
+#define FT_I2C_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <ftd2xx.h>
+#include <libft4222.h>
+
+//C99 _Bool of the C API is bool for C++ consumers, see ft_i2c.hpp.
+#ifdef __cplusplus
+typedef bool _Bool;
+#endif
+
+#define FT_I2C_BUS_MAX          16          //!< Number of FT4222 I2C bus supported.
+#define FT_I2C_ADDR_MAX         0x80        //!< Number of 7-bit I2C address.
+#define FT_I2C_STREAM_BLOCK     0x10000     //!< Buffer size for file transfer, split into max transfer size.
+#define FT_I2C_PACKET_MAX       512         //!< Max bytes of register + data sent in 1x WriteEx.
+#define FT_BUS_CACHE_ENV        "FTI2C_BUS_CACHE"   //!< Environment variable of bus list snapshot file.
+#define FT_BUS_CACHE_TAG        "fti2c-bus-cache"   //!< First word of snapshot file.
+
+//!@enum    FT_PROBE
+//!         Method to probe an I2C slave address.
+typedef enum FT_PROBE
+{
+    FT_PROBE_READ = 0,          //!< Read 1 byte, works with all slaves.
+    FT_PROBE_QUICK_WRITE,       //!< Write 0 byte, no data phase on the bus.
+} FT_PROBE;
+
+#define FT_WAIT_SPIN_DEFAULT    2           //!< Immediate status re-poll before sleeping.
+#define FT_WAIT_MIN_US_DEFAULT  50          //!< First sleep of exponential backoff.
+#define FT_WAIT_MAX_US_DEFAULT  1000        //!< Max sleep of exponential backoff.
+#define FT_WAIT_TIMEOUT_DEFAULT 1000        //!< Bus busy timeout in ms.
+
+//!@typedef stI2cWait
+//!         Strategy to wait I2C controller and bus idle after a transaction.
+typedef struct stI2cWait
+{
+    uint32 SpinCount;           //!< Status re-poll without sleep
+    uint32 BackoffMinUs;        //!< First sleep, doubled on each poll
+    uint32 BackoffMaxUs;        //!< Max sleep
+    uint32 TimeoutMs;           //!< Give up after this time
+} stI2cWait;
+
+//!@typedef stI2cWaitStat
+//!         Statistic of waiting I2C bus idle.
+typedef struct stI2cWaitStat
+{
+    uint32 Calls;               //!< FT_checkI2cBus() calls
+    uint32 BusyCalls;           //!< Calls that found the bus busy
+    uint32 Polls;               //!< FT4222_I2CMaster_GetStatus() calls
+    uint32 Sleeps;              //!< Backoff sleeps
+    uint32 Timeouts;            //!< Calls that timed out
+    double WaitMs;              //!< Total time waiting bus busy
+    double MaxWaitMs;           //!< Max time of a single wait
+} stI2cWaitStat;
+
+//General Print, to the output stream of current thread.
+#define CLI_PRINT(msg, args...)  \
+    do {\
+        fprintf(FT_getOutput(), msg, ##args);\
+    } while (0)
+
+//Warning info
+#define CLI_WARNING(msg, args...)  \
+    do {\
+        fprintf(FT_getOutput(), "\e[33m"msg"\e[0m", ##args);\
+    } while (0)
+
+//Error Message output, with RED color.
+#define CLI_ERROR(msg, args...)  \
+    do {\
+        fprintf(FT_getOutput(), "\e[31m"msg"\e[0m", ##args);\
+    } while (0)
+
+//Check null pointer and return failure with a simple error message.
+#define CHECK_NULL_PTR(ptr) \
+    do {\
+        if (ptr == NULL) \
+        {\
+            CLI_ERROR("ERROR: NULL pointer="#ptr"<%s:%d>\n", __FILE__, __LINE__);\
+            return -1;\
+        }\
+    }while(0)
+
+//Check function return = status, otherwise return with a error message.
+#define CHECK_FUNC_RET(status, func) \
+    do {\
+        int ret = func;\
+        if (status != ret)\
+        {\
+            CLI_ERROR("ERROR: Return=[%d] %s <%s:%d>\n", ret, FT_getStatusMsg(ret), __FILE__, __LINE__);\
+            return ret;\
+        }\
+    } while (0)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const char *FT_getStatusMsg(int status);
+
+FILE *FT_getOutput(void);
+
+void FT_setOutput(FILE *fp);
+
+double FT_getTimeMs(void);
+
+uint64 FT_getTimeNs(void);
+
+void print_u8(int c, uint8 *d);
+
+void print_devinfo(FT_DEVICE_LIST_INFO_NODE *devInfo);
+
+FT_STATUS FT_getVersion(FT_HANDLE ftHandle);
+
+uint8 FT_checkI2cAddr(FT_HANDLE ftHandle, uint8 slvadd);
+
+FT_STATUS FT_probeI2cAddr(FT_HANDLE ftHandle, uint8 slvadd, FT_PROBE mode, _Bool *ack);
+
+FT_STATUS FT_sweepI2cBus(FT_HANDLE ftHandle, const uint8 *addr, int count, FT_PROBE mode, uint8 *found,
+        int *found_count);
+
+uint8 FT_checkI2cBus(FT_HANDLE ftHandle);
+
+void FT_setWaitPolicy(const stI2cWait *wait);
+
+void FT_getWaitPolicy(stI2cWait *wait);
+
+void FT_getWaitStat(stI2cWaitStat *stat);
+
+void FT_resetWaitStat(void);
+
+void FT_printWaitStat(const stI2cWaitStat *stat);
+
+FT_STATUS FT_getMaxTransferSize(FT_HANDLE ftHandle, uint16 *size);
+
+FT_STATUS FT_readI2c(FT_HANDLE ftHandle, uint16 slvadd, uint8 flag, uint8 *buf, uint32 len, uint32 *done);
+
+FT_STATUS FT_writeI2c(FT_HANDLE ftHandle, uint16 slvadd, uint8 flag, uint8 *buf, uint32 len, uint32 *done);
+
+FT_STATUS FT_readI2cReg(FT_HANDLE ftHandle, uint16 slvadd, uint8 *reg, uint8 reglen, uint8 *buf, uint32 len,
+        uint32 *done);
+
+FT_STATUS FT_writeI2cReg(FT_HANDLE ftHandle, uint16 slvadd, uint8 *reg, uint8 reglen, uint8 *buf, uint32 len,
+        uint32 *done);
+
+FT_STATUS FT_readI2cToFile(FT_HANDLE ftHandle, uint16 slvadd, uint8 flag, FILE *fp, uint32 len, uint32 *done);
+
+FT_STATUS FT_writeI2cFromFile(FT_HANDLE ftHandle, uint16 slvadd, uint8 flag, FILE *fp, uint32 len, uint32 *done);
+
+int FT_listI2cBus(FT_DEVICE_LIST_INFO_NODE *I2cDevInfo);
+
+int FT_refreshI2cBus(void);
+
+int FT_findI2cBus(const char *id);
+
+FT_STATUS FT_openI2cBus(int devicenumber, FT_HANDLE *pHandle, uint32 kbps);
+
+FT_STATUS FT_openGpio(int devicenumber, FT_HANDLE *pHandle);
+
+void FT_closeI2cBus(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FT_I2C_H_ */
@@ -0,0 +1,294 @@
+/******************************************************************************
+ * @file    ft_i2c.hpp
+ *          Typed register access for C++ consumers, header only, C++17.
+ *
+ *          Registers and fields are types, address, width, byte order and
+ *          bit position are compile time constants. A field access is the
+ *          register transfer plus a constant shift and mask, no register map
+ *          is looked up at runtime:
+ *
+ *              using Ctrl = fti2c::Register<0x10>;
+ *              using Mode = fti2c::Field<Ctrl, 7, 4>;
+ *              using En   = fti2c::Field<Ctrl, 0>;
+ *              using Thresh = fti2c::Register<0x12, 2, fti2c::Endian::Little>;
+ *
+ *              FT_HANDLE ftHandle = NULL;
+ *              FT_openI2cBus(0, &ftHandle, 400);
+ *              fti2c::Device sensor(ftHandle, 0x68);
+ *
+ *              Mode mode;
+ *              sensor.read(mode);                  // 1 register read
+ *              sensor.write(Thresh{ 0x1234 });     // 1 register write
+ *              sensor.modify(Mode{ 0xA }, En{ 1 }); // 1 read + 1 write, mask folded at compile time
+ *
+ *          Fields of 1 modify() must be of the same register, it's checked
+ *          at compile time. When the fields cover the whole register the read
+ *          is dropped at compile time, a write of an unchanged value is
+ *          skipped. All calls return FT_STATUS of the core functions in
+ *          ft_i2c.c, link with CORESOURCE of the Makefile.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef FT_I2C_HPP_
+#define FT_I2C_HPP_
+
+#include <cstdint>
+#include <type_traits>
+
+#include "ft_i2c.h"
+
+namespace fti2c
+{
+
+//!@enum    Endian
+//!         Byte order of a multi-byte register, Big is MSB at the lowest register address.
+enum class Endian
+{
+    Big,
+    Little,
+};
+
+/*!@brief Register descriptor, also holds a value of the register.
+ *
+ * @tparam Addr     Register address
+ * @tparam Width    Register width in bytes, 1~4.
+ * @tparam Order    Byte order of the value
+ */
+template<uint16_t Addr, uint8_t Width = 1, Endian Order = Endian::Big>
+struct Register
+{
+    static_assert((Width >= 1) && (Width <= 4), "Register width must be 1~4 bytes.");
+    static_assert(Addr + Width - 1 <= 0xFFFF, "Register exceeds 16-bit address space.");
+
+    using value_type = std::conditional_t<(Width == 1), uint8_t, std::conditional_t<(Width == 2), uint16_t, uint32_t>>;
+
+    static constexpr uint16_t address = Addr;
+    static constexpr uint8_t width = Width;
+    static constexpr Endian order = Order;
+    static constexpr uint32_t mask = (Width == 4) ? 0xFFFFFFFFu : ((1u << (Width * 8)) - 1);
+
+    value_type value = 0;
+
+    //Register bytes to value.
+    static constexpr uint32_t decode(const uint8_t *buf)
+    {
+        uint32_t v = 0;
+        for (int i = 0; i < Width; i++)
+        {
+            v |= uint32_t(buf[i]) << ((Order == Endian::Big) ? (Width - 1 - i) * 8 : i * 8);
+        }
+        return v;
+    }
+
+    //Value to register bytes.
+    static constexpr void encode(uint32_t v, uint8_t *buf)
+    {
+        for (int i = 0; i < Width; i++)
+        {
+            buf[i] = uint8_t(v >> ((Order == Endian::Big) ? (Width - 1 - i) * 8 : i * 8));
+        }
+    }
+};
+
+/*!@brief Bit field descriptor of a register, also holds a value of the field.
+ *
+ * @tparam Reg      Register of the field
+ * @tparam Msb      Highest bit of the register value
+ * @tparam Lsb      Lowest bit of the register value
+ */
+template<class Reg, unsigned Msb, unsigned Lsb = Msb>
+struct Field
+{
+    static_assert(Msb >= Lsb, "Field Msb must not be lower than Lsb.");
+    static_assert(Msb < Reg::width * 8u, "Field exceeds register width.");
+
+    using register_type = Reg;
+    using value_type = typename Reg::value_type;
+
+    static constexpr unsigned shift = Lsb;
+    static constexpr uint32_t mask = ((Msb - Lsb + 1 >= 32) ? 0xFFFFFFFFu : ((1u << (Msb - Lsb + 1)) - 1)) << Lsb;
+
+    value_type value = 0;
+
+    //Field value of a register value.
+    static constexpr value_type get(uint32_t regvalue)
+    {
+        return value_type((regvalue & mask) >> shift);
+    }
+
+    //Register bits of this field value, extra bits of value are dropped.
+    constexpr uint32_t put() const
+    {
+        return (uint32_t(value) << shift) & mask;
+    }
+};
+
+//Check if a type is a Field.
+template<class T, class = void>
+struct is_field : std::false_type
+{
+};
+
+template<class T>
+struct is_field<T, std::void_t<typename T::register_type>> : std::true_type
+{
+};
+
+/*!@brief A slave device on an opened I2C bus.
+ */
+class Device
+{
+public:
+    /*!@param ftHandle  I2C bus handle of FT_openI2cBus()
+     * @param addr      7-bit slave address
+     * @param reglen    Register address size in bytes, 1 or 2.
+     */
+    Device(FT_HANDLE ftHandle, uint8_t addr, uint8_t reglen = 1) :
+            mHandle(ftHandle), mAddr(addr), mRegLen(reglen)
+    {
+    }
+
+    //Read a register, or the register of a field.
+    template<class T>
+    FT_STATUS read(T &target)
+    {
+        using Reg = typename register_of<T>::type;
+        uint32_t v = 0;
+        FT_STATUS status = readValue<Reg>(v);
+
+        if (status == FT_OK)
+        {
+            if constexpr (is_field<T>::value)
+            {
+                target.value = T::get(v);
+            }
+            else
+            {
+                target.value = typename Reg::value_type(v);
+            }
+        }
+        return status;
+    }
+
+    //Write a whole register.
+    template<class Reg>
+    FT_STATUS write(const Reg &reg)
+    {
+        static_assert(!is_field<Reg>::value, "Use modify() to write a field.");
+        return writeValue<Reg>(reg.value & Reg::mask);
+    }
+
+    //Write fields of 1 register in 1 read-modify-write.
+    template<class F, class ... Fs>
+    FT_STATUS modify(const F &field, const Fs &... fields)
+    {
+        using Reg = typename F::register_type;
+        static_assert(is_field<F>::value && (is_field<Fs>::value && ...), "modify() takes fields only.");
+        static_assert((std::is_same_v<Reg, typename Fs::register_type> && ...),
+                "Fields of 1 modify() must be of the same register.");
+
+        constexpr uint32_t mask = (F::mask | ... | Fs::mask);
+        const uint32_t data = (field.put() | ... | fields.put());
+
+        //Fields cover the whole register, no read needed.
+        if constexpr (mask == Reg::mask)
+        {
+            return writeValue<Reg>(data);
+        }
+        else
+        {
+            uint32_t old = 0;
+            FT_STATUS status = readValue<Reg>(old);
+            uint32_t v = (old & ~mask) | data;
+
+            if ((status != FT_OK) || (v == old))
+            {
+                return status;
+            }
+            return writeValue<Reg>(v);
+        }
+    }
+
+private:
+    FT_HANDLE mHandle;
+    uint8_t mAddr;
+    uint8_t mRegLen;
+
+    template<class T, class = void>
+    struct register_of
+    {
+        using type = T;
+    };
+
+    template<class T>
+    struct register_of<T, std::void_t<typename T::register_type>>
+    {
+        using type = typename T::register_type;
+    };
+
+    //Register address bytes, MSB first, 0 if the address doesn't fit reglen.
+    uint8_t getReg(uint16_t address, uint8_t *reg) const
+    {
+        if ((mRegLen == 1) && (address <= 0xFF))
+        {
+            reg[0] = uint8_t(address);
+            return 1;
+        }
+        if (mRegLen == 2)
+        {
+            reg[0] = uint8_t(address >> 8);
+            reg[1] = uint8_t(address);
+            return 2;
+        }
+        return 0;
+    }
+
+    template<class Reg>
+    FT_STATUS readValue(uint32_t &v)
+    {
+        uint8_t reg[2];
+        uint8_t buf[Reg::width];
+        uint32 done = 0;
+
+        if (getReg(Reg::address, reg) == 0)
+        {
+            return FT_INVALID_PARAMETER;
+        }
+        FT_STATUS status = FT_readI2cReg(mHandle, mAddr, reg, mRegLen, buf, Reg::width, &done);
+        status = (status == FT_OK) ? FT_checkI2cBus(mHandle) : status;
+        if ((status == FT_OK) && (done != Reg::width))
+        {
+            status = FT_OTHER_ERROR;
+        }
+        v = (status == FT_OK) ? Reg::decode(buf) : 0;
+        return status;
+    }
+
+    template<class Reg>
+    FT_STATUS writeValue(uint32_t v)
+    {
+        uint8_t reg[2];
+        uint8_t buf[Reg::width];
+        uint32 done = 0;
+
+        if (getReg(Reg::address, reg) == 0)
+        {
+            return FT_INVALID_PARAMETER;
+        }
+        Reg::encode(v, buf);
+        FT_STATUS status = FT_writeI2cReg(mHandle, mAddr, reg, mRegLen, buf, Reg::width, &done);
+        status = (status == FT_OK) ? FT_checkI2cBus(mHandle) : status;
+        if ((status == FT_OK) && (done != Reg::width))
+        {
+            status = FT_OTHER_ERROR;
+        }
+        return status;
+    }
+};
+
+} /* namespace fti2c */
+
+#endif /* FT_I2C_HPP_ */
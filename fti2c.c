@@ -26,11 +26,120 @@
  *      Reg - Device register to start writing to
  *      Mask - Mask to apply to Data
  *      Data - String of bytes to write out
- *--sweep|-s [Bus]    Sweep I2C bus for devices
+ *      Each register is read with repeated start, masked bits are replaced by Data and written back.
+ *--rmw|-M [Bus] [Addr] [Reg] [Mask] [Data] ... Batch of register read-modify-write
+ *      Addr Reg Mask Data - 1 op, repeated for more ops. Reg is 1 value for --addrsize 1 and 2.
+ *      Ops are grouped by device, nearby registers share 1 read and each run of registers is written
+ *      back in 1 transaction, unchanged values are not written.
+ *--gather|-G [Bus] [Addr] [Reg] ... Read scattered registers
+ *      Addr Reg - 1 register, repeated for more. Reg is 1 value for --addrsize 1 and 2.
+ *      Registers are grouped by device, nearby registers are read in 1 burst and values are printed in
+ *      the given order.
+ *--gap|-g [Regs]
+ *      (optional)  Max unused registers read to join 2 reads of --rmw/--gather into 1. Default is 4.
+ *--eeprom|-e [Bus] [Addr] [Offset] Write EEPROM with image of --file
+ *      Bus - Bus to perform the write on
+ *      Addr - I2C Addr of the EEPROM (in hex)
+ *      Offset - EEPROM memory offset to start writing to
+ *      Data is split on page boundaries, each page waits write cycle by address ACK polling.
+ *      Memory address size is set by --addrsize.
+ *--verify|-y [Bus] [Addr] [Offset] Compare EEPROM data with image of --file
+ *      Data is read in 4 KB chunks and compared as read, stops at the first differing byte.
+ *      Memory address size is set by --addrsize.
+ *--delta|-u
+ *      (optional)  --eeprom reads the EEPROM back first and writes only pages differing from the image,
+ *      written pages are read back to verify.
+ *--page|-p [Size]
+ *      (optional)  EEPROM page size in bytes. If not specified, it defaults to 8.
+ *--monitor|-o [Bus] [Addr] [Reg] ...   Sample registers at a fixed rate
+ *      Addr Reg - 1 register, repeated for more. Reg is 1 value for --addrsize 1 and 2.
+ *      Samples are printed as CSV lines by a writer thread, or saved to --file. Stops after --samples
+ *      or on Ctrl-C, then prints achieved rate, jitter and dropped samples.
+ *--rate|-H [Hz]
+ *      (optional)  Sample rate of --monitor. If not specified, it defaults to 100.
+ *--samples|-x [Count]
+ *      (optional)  Samples of --monitor, if not specified it runs until Ctrl-C. Reads of --trigger,
+ *      if not specified it's 1.
+ *--trigger|-T [Bus] [Addr] [Reg] [Length]    Read register data on GPIO edges
+ *      Waits an edge of --gpio before each read, only the GPIO trigger queue is polled while waiting.
+ *      An edge must come within --timeout.
+ *--gpio|-I [Port][:rising|falling|both]
+ *      (optional)  GPIO port and edge of --trigger. If not specified, it defaults to 3:falling.
+ *--replay|-Y [Bus]    Replay a trace of --trace on the bus
+ *      Reads, writes, idle status polls and resets of the traced bus are issued again at their recorded times,
+ *      the trace is given by --file. Replay diverges when a status, transferred size or controller error
+ *      differs from the recording.
+ *      It stops at the first divergence unless --keepgoing is given.
+ *--fast|-Q
+ *      (optional)  Replay with no delay between calls instead of the recorded timing.
+ *--compare|-K
+ *      (optional)  Replay diverges also when read data differs from the recording.
+ *--sweep|-s [Bus] [Addr...]    Sweep I2C bus for devices
  *      Bus - Bus to sweep
+ *      Addr - (optional) Address list to probe, otherwise probe the range of --from/--to
+ *--file|-F [File]
+ *      (optional)  --read/--devread save data to File, --write/--devwrite send data of File.
+ *      Transfer of any length is split into chunks of the max transfer size of the bridge.
+ *--timeout|-t [ms]
+ *      (optional)  Bus busy timeout in ms. If not specified, it defaults to 1000.
+ *--waitstat|-W
+ *      (optional)  Print statistic of waiting bus idle, polls and wait time.
+ *--from|-a [Addr] --to|-b [Addr]
+ *      (optional)  Sweep address range. If not specified, it defaults to 0x00~0x7F.
+ *--quick|-q
+ *      (optional)  Sweep with 0 byte write instead of 1 byte read.
  *--addrsize|-z [Size]
  *      (optional)  Register address size in bytes. If not specified, it defaults to 1.
  *      Size - Accept values: 1 2.
+ *--daemon|-D  Run as daemon, keep I2C bus opened and serve commands from other fti2c calls.
+ *      Socket path is /tmp/fti2c.sock, or set by environment variable FTI2C_SOCKET.
+ *      When a daemon is running, fti2c forwards commands to it unless --nodaemon is given. Paths of --file,
+ *      --script and --regmap are made absolute before forwarding. --emu, --trace, --monitor without --samples
+ *      and --trigger with --timeout 0 are refused by the daemon.
+ *--script|-S [File] Run fti2c commands from file line by line, "-" to read from stdin.
+ *      File - Each line is a command, e.g. "devwrite 0 0x50 0x00 0x12" or "-d 0 0x50 0x00 1".
+ *--keepgoing|-k
+ *      (optional)  Continue the script when a line fails.
+ *--id|-i [Serial|LocId]
+ *      (optional)  Select the I2C bus of the operation by serial number or location ID, it replaces the Bus arg.
+ *      I2C bus list is enumerated once per process. Set environment variable FTI2C_BUS_CACHE to a file
+ *      path to keep a snapshot for later runs, it is refreshed by --list or when a bus can't be opened.
+ *--parallel|-P [Bus,...] Run --script on the buses at once, one thread per bus, "all" for all buses.
+ *      Bus args in the script are replaced by each bus, "%d" in the script path is replaced by the bus
+ *      number for a per-bus script. Output is collected and printed bus by bus. --gap, --coalesce and --noinc
+ *      are shared by all buses, they are given with --parallel and refused in the script.
+ *--cache|-C
+ *      (optional)  Cache register values of --devread/--devwrite/--maskwrite/--rmw, a register already
+ *      known is not read again. The cache is kept for the process, e.g. a script or a daemon.
+ *      A raw --write, a bus error or closing the bus drops the cache of the device or bus.
+ *--volatile|-V [Addr:Reg[:Count],...] --nonvolatile|-N [Addr:Reg[:Count],...]
+ *      (optional)  Mark registers always read from bus, e.g. status registers, or cached again.
+ *      Registers are non-volatile by default, the last matching range wins. Count defaults to 1.
+ *--retry|-U [Spec]
+ *      (optional)  Retry a transaction failed by address NACK, data NACK or arbitration lost, see retry.c for
+ *      the syntax, e.g. "addr=5,arb=3,backoff=200:10000,reinit". Only the failed transaction is issued again
+ *      after a controller reset, or a full re-init, and a backoff sleep. Kept for the process like --cache.
+ *      Streamed --file transfers are not retried. Errors and retries per slave address are printed by --waitstat.
+ *--coalesce|-c
+ *      (optional)  In a script, --devwrite lines to the register right after the previous one, on the same
+ *      bus and device, are merged into 1 auto-increment burst write. Any other line sends the queued burst
+ *      first, so an error of a queued write is reported by the next line. Saved transactions are printed.
+ *--noinc|-A [Addr,...]
+ *      (optional)  Devices without register auto-increment, their writes are never merged.
+ *--regmap|-R [File]
+ *      (optional)  Load register map, see regmap.c for the syntax. Environment variable FTI2C_REGMAP does the same.
+ *      --devread/--devwrite accept a device name as Addr and a register name as Reg, e.g. "-d 0 sensor CTRL".
+ *      Length of --devread defaults to the register width, 1 value of --devwrite is split into the register
+ *      width. "REG.FIELD" writes a field by read-modify-write. Data of known registers is printed by field.
+ *--trace|-j [File]
+ *      (optional)  Record all bridge calls of the process to a binary trace file, see trace.c for the format.
+ *      With --daemon the daemon records the calls of all clients. Call statistic is printed at exit.
+ *      Set environment variable FTI2C_LATENCY=1 to print latency histograms of each bridge call type at
+ *      exit, or on SIGUSR1. See latency.c.
+ *--emu|-E [Config]
+ *      (optional)  Use emulated FT4222 bridge instead of USB hardware, see hal_emu.c for Config syntax.
+ *      Config - e.g. "bus=2,latency=125,eeprom=0x50:32768:64:2", "default" for an EEPROM at 0x50
+ *               and registers at 0x68. Environment variable FTI2C_EMU does the same.
  */
 
 #include <stdio.h>
@@ -38,86 +147,50 @@
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <ftd2xx.h>
 #include <libft4222.h>
 
 #include "cli.h"
-
-// FT_STATUS message
-static const char *FT_RET_MSG[] =
-{ "FT_OK", "FT_INVALID_HANDLE", "FT_DEVICE_NOT_FOUND", "FT_DEVICE_NOT_OPENED", "FT_IO_ERROR",
-        "FT_INSUFFICIENT_RESOURCES", "FT_INVALID_PARAMETER", "FT_INVALID_BAUD_RATE", "FT_DEVICE_NOT_OPENED_FOR_ERASE",
-        "FT_DEVICE_NOT_OPENED_FOR_WRITE", "FT_FAILED_TO_WRITE_DEVICE", "FT_EEPROM_READ_FAILED",
-        "FT_EEPROM_WRITE_FAILED", "FT_EEPROM_ERASE_FAILED", "FT_EEPROM_NOT_PRESENT", "FT_EEPROM_NOT_PROGRAMMED",
-        "FT_INVALID_ARGS", "FT_NOT_SUPPORTED", "FT_OTHER_ERROR", "FT_DEVICE_LIST_NOT_READY", };
-
-// FT_STATUS extending message, for FT4222H only, starting from 1000
-static const char *FT_RET_MSG_EXTEND[] =
-{ "FT4222_DEVICE_NOT_SUPPORTED", "FT4222_CLK_NOT_SUPPORTED", "FT4222_VENDER_CMD_NOT_SUPPORTED",
-        "FT4222_IS_NOT_SPI_MODE", "FT4222_IS_NOT_I2C_MODE", "FT4222_IS_NOT_SPI_SINGLE_MODE",
-        "FT4222_IS_NOT_SPI_MULTI_MODE", "FT4222_WRONG_I2C_ADDR", "FT4222_INVAILD_FUNCTION", "FT4222_INVALID_POINTER",
-        "FT4222_EXCEEDED_MAX_TRANSFER_SIZE", "FT4222_FAILED_TO_READ_DEVICE", "FT4222_I2C_NOT_SUPPORTED_IN_THIS_MODE",
-        "FT4222_GPIO_NOT_SUPPORTED_IN_THIS_MODE", "FT4222_GPIO_EXCEEDED_MAX_PORTNUM", "FT4222_GPIO_WRITE_NOT_SUPPORTED",
-        "FT4222_GPIO_PULLUP_INVALID_IN_INPUTMODE", "FT4222_GPIO_PULLDOWN_INVALID_IN_INPUTMODE",
-        "FT4222_GPIO_OPENDRAIN_INVALID_IN_OUTPUTMODE", "FT4222_INTERRUPT_NOT_SUPPORTED",
-        "FT4222_GPIO_INPUT_NOT_SUPPORTED", "FT4222_EVENT_NOT_SUPPORTED", "FT4222_FUN_NOT_SUPPORT" };
-
-//General Print
-#define CLI_PRINT(msg, args...)  \
-    do {\
-        printf(msg, ##args);\
-    } while (0)
-
-//Warning info
-#define CLI_WARNING(msg, args...)  \
-    do {\
-        printf("\e[33m"msg"\e[0m", ##args);\
-    } while (0)
-
-//Error Message output, with RED color.
-#define CLI_ERROR(msg, args...)  \
-    do {\
-        printf("\e[31m"msg"\e[0m", ##args);\
-    } while (0)
-
-//Check null pointer and return failure with a simple error message.
-#define CHECK_NULL_PTR(ptr) \
-    do {\
-        if (ptr == NULL) \
-        {\
-            CLI_ERROR("ERROR: NULL pointer="#ptr"<%s:%d>\n", __FILE__, __LINE__);\
-            return CLI_FAILURE;\
-        }\
-    }while(0)
-
-//Check function return = CLI_SUCCESS, otherwise jump to exit label with a error message.
-#define CHECK_FUNC_RET(status, func) \
-    do {\
-        int ret = func;\
-        if (status != ret)\
-        {\
-            if(ret >= 1000)\
-                CLI_ERROR("ERROR: Return=[%d] %s <%s:%d>\n", ret, FT_RET_MSG_EXTEND[ret-1000], __FILE__, __LINE__);\
-            else\
-                CLI_ERROR("ERROR: Return=[%d] %s <%s:%d>\n", ret, FT_RET_MSG[ret], __FILE__, __LINE__);\
-            return ret;\
-        }\
-    } while (0)
-
-//Static buffers
-static uint8 gbuf_value[256] =
+#include "ft_i2c.h"
+#include "hal.h"
+#include "daemon.h"
+#include "script.h"
+#include "parallel.h"
+#include "eeprom.h"
+#include "monitor.h"
+#include "trigger.h"
+#include "rmw.h"
+#include "shadow.h"
+#include "retry.h"
+#include "coalesce.h"
+#include "regmap.h"
+#include "trace.h"
+#include "replay.h"
+#include "latency.h"
+
+//Static buffers, per thread for parallel mode.
+static __thread uint8 gbuf_value[256] =
+{ 0 };
+static __thread uint32 gbuf_raw[256] =
+{ 0 };
+static __thread uint16 gbuf_count = 0;
+//Arg strings that are not numbers, names of the register map. NULL for numbers.
+static __thread const char *gbuf_name[256] =
 { 0 };
-static uint16 gbuf_count = 0;
 
-//Print uint8 data array
-void print_u8(int c, uint8 *d)
-{
-    for (int i = 0; i < c; i++)
-    {
-        CLI_PRINT("0x%02X\t", d[i]);
-    }
-    CLI_PRINT("\n");
-}
+//Data buffer for transfers larger than gbuf_value, only grows and is kept for later commands of the thread.
+static __thread uint8 *gbuf_data = NULL;
+static __thread uint32 gbuf_data_size = 0;
+
+//Run locally for the whole process, set by --nodaemon so script lines are not forwarded.
+static _Bool gi2c_nodaemon = 0;
+
+//Options followed by a file path, the path is made absolute when the command is forwarded to a daemon.
+static const char *gi2c_pathopt[] =
+{ "-F", "--file", "-S", "--script", "-R", "--regmap", NULL };
 
 //Print args
 int print_args(int argc, char **args)
@@ -140,23 +213,6 @@ int print_args(int argc, char **args)
     return 0;
 }
 
-void print_devinfo(FT_DEVICE_LIST_INFO_NODE *devInfo)
-{
-    int i = 0;
-
-    for (i = 0; devInfo[i].ID != 0; i++)
-    {
-        CLI_PRINT("Dev Index [%d]:\n", i);
-        CLI_PRINT("  Flags\t\t=0x%x\n", devInfo[i].Flags);
-        CLI_PRINT("  Type\t\t=0x%x\n", devInfo[i].Type);
-        CLI_PRINT("  ID\t\t=0x%x\n", devInfo[i].ID);
-        CLI_PRINT("  LocId\t\t=0x%x\n", devInfo[i].LocId);
-        CLI_PRINT("  SerialNumber\t=%s\n", devInfo[i].SerialNumber);
-        CLI_PRINT("  Description\t=%s\n", devInfo[i].Description);
-        CLI_PRINT("  ftHandle\t=0x%X\n", (int ) devInfo[i].ftHandle);
-    }
-}
-
 //Convert string to uint8
 int str_to_u8(int argc, char *argv[])
 {
@@ -171,163 +227,239 @@ int str_to_u8(int argc, char *argv[])
         }
         char *tail = NULL;
 
-        gbuf_value[gbuf_count] = strtol(argv[i], &tail, 0);
+        gbuf_raw[gbuf_count] = strtoul(argv[i], &tail, 0);
+        gbuf_value[gbuf_count] = gbuf_raw[gbuf_count];
 
-        if (tail[0] != 0)
-        {
-            CLI_WARNING("[Warning]Ignore un-recognized string of [%s]\n", argv[i]);
-        }
-        else
-        {
-            gbuf_count++;
-        }
+        //Keep names, they are resolved when the register map is loaded.
+        gbuf_name[gbuf_count] = (tail[0] != 0) ? argv[i] : NULL;
+        gbuf_count++;
     }
 
     return i;
 }
 
-FT_STATUS FT_getVersion(FT_HANDLE ftHandle)
+//Remove arg of index, later args are moved forward.
+void buf_remove(int index)
 {
-    FT4222_Version ft4222Version;
-    FT4222_GetVersion(ftHandle, &ft4222Version);
-    printf("Chip version: %08X, LibFT4222 version: %08X\n", (unsigned int) ft4222Version.chipVersion,
-            (unsigned int) ft4222Version.dllVersion);
-    return FT_OK;
+    for (int i = index; i < gbuf_count - 1; i++)
+    {
+        gbuf_value[i] = gbuf_value[i + 1];
+        gbuf_raw[i] = gbuf_raw[i + 1];
+        gbuf_name[i] = gbuf_name[i + 1];
+    }
+    gbuf_count--;
 }
 
-uint8 FT_checkI2cAddr(FT_HANDLE ftHandle, uint8 slvadd)
+//Insert a number arg before index.
+void buf_insert(int index, uint32 value)
 {
-    uint8 ReadPtr[1] =
-    { 0 };
-    uint16 TransferSize = 0;
-    uint8 i2cstatus = 0;
-
-    CHECK_FUNC_RET(FT_OK, FT4222_I2CMaster_ReadEx(ftHandle, slvadd, START_AND_STOP, ReadPtr, 1, &TransferSize));
-    CHECK_FUNC_RET(FT_OK, FT4222_I2CMaster_GetStatus(ftHandle, &i2cstatus));
-    CHECK_FUNC_RET(FT_OK, FT4222_I2CMaster_Reset(ftHandle));
-
-    if (I2CM_ADDRESS_NACK(i2cstatus))
-    {
-        return -1;
-    }
-    else
+    for (int i = gbuf_count; i > index; i--)
     {
-        return 0;
+        gbuf_value[i] = gbuf_value[i - 1];
+        gbuf_raw[i] = gbuf_raw[i - 1];
+        gbuf_name[i] = gbuf_name[i - 1];
     }
+    gbuf_raw[index] = value;
+    gbuf_value[index] = value;
+    gbuf_name[index] = NULL;
+    gbuf_count++;
 }
 
-uint8 FT_checkI2cBus(FT_HANDLE ftHandle)
+/*!@brief Resolve register map names of [Addr] [Reg] args, [Reg] is replaced by reglen bytes.
+ *
+ * @param reglen    Register address size in bytes
+ * @param def       Pointer to store the register of a [Reg] name, NULL if [Reg] is a number.
+ * @param field     Pointer to store the field of a "REG.FIELD" name, NULL if no field.
+ * @return          FT_OK, or FT_INVALID_PARAMETER if a name is not found.
+ */
+FT_STATUS resolve_names(int reglen, const stRegDef **def, const stRegField **field)
 {
-    uint8 i2cstatus = 0;
-    uint32 timeout = 0;
+    *def = NULL;
+    *field = NULL;
 
-    CHECK_FUNC_RET(FT_OK, FT4222_I2CMaster_GetStatus(ftHandle, &i2cstatus));
-
-    //Wait bus busy flag.
-    while (I2CM_BUS_BUSY(i2cstatus) || I2CM_CONTROLLER_BUSY(i2cstatus))
+    if ((gbuf_count >= 1) && (gbuf_name[0] != NULL))
     {
-        timeout++;
-        usleep(1000);
-        if (timeout > 1000)
+        int addr = REGMAP_findDevice(gbuf_name[0]);
+        if (addr < 0)
         {
-            CLI_ERROR("I2C BUS Timeout: I2CM_BUS_BUSY, Error Code = [0x%X]\n", i2cstatus);
-            break;
+            CLI_ERROR("ERROR: Unknown device [%s] of register map [%s].\n", gbuf_name[0], REGMAP_getPath());
+            return FT_INVALID_PARAMETER;
         }
-        CHECK_FUNC_RET(FT_OK, FT4222_I2CMaster_GetStatus(ftHandle, &i2cstatus));
-    }
-
-    // The normal condition should be bus free
-    if (i2cstatus == 0x20)
-    {
-        return FT_OK;
+        gbuf_raw[0] = addr;
+        gbuf_value[0] = addr;
+        gbuf_name[0] = NULL;
     }
 
-    // Print Error Message
-    if (i2cstatus & 0x02)
+    if ((gbuf_count >= 2) && (gbuf_name[1] != NULL))
     {
-        CLI_ERROR("I2C BUS ERROR: ");
-        if (I2CM_DATA_NACK(i2cstatus))
+        *def = REGMAP_findReg(gbuf_value[0], gbuf_name[1], field);
+        if ((*def == NULL) || ((reglen == 1) && ((*def)->Reg > 0xFF)) || (gbuf_count >= 255))
         {
-            CLI_ERROR("[I2CM_DATA_NACK] ");
+            CLI_ERROR("ERROR: Unknown register [%s] of device [0x%02X].\n", gbuf_name[1], gbuf_value[0]);
+            return FT_INVALID_PARAMETER;
         }
-        if (I2CM_ADDRESS_NACK(i2cstatus))
+        buf_remove(1);
+        if (reglen == 2)
         {
-            CLI_ERROR("[I2CM_ADDRESS_NACK] ");
+            buf_insert(1, (*def)->Reg & 0xFF);
+            buf_insert(1, (*def)->Reg >> 8);
         }
-        if (I2CM_ARB_LOST(i2cstatus))
+        else
         {
-            CLI_ERROR("[I2CM_ARB_LOST] ");
+            buf_insert(1, (*def)->Reg);
         }
-        CLI_ERROR("\n");
     }
+    return FT_OK;
+}
 
-    FT4222_I2CMaster_Reset(ftHandle);
+//Get a data buffer of at least size bytes.
+uint8 *buf_reserve(uint32 size)
+{
+    if (size > gbuf_data_size)
+    {
+        uint8 *p = (uint8*) realloc(gbuf_data, size);
+        if (p == NULL)
+        {
+            return NULL;
+        }
+        gbuf_data = p;
+        gbuf_data_size = size;
+    }
+    return (gbuf_data != NULL) ? gbuf_data : gbuf_value;
+}
 
-    return FT_OTHER_ERROR;
+//Free the data buffer of current thread.
+void buf_release(void)
+{
+    free(gbuf_data);
+    gbuf_data = NULL;
+    gbuf_data_size = 0;
 }
 
-int FT_listI2cBus(FT_DEVICE_LIST_INFO_NODE *I2cDevInfo)
+//Get file size and rewind to the beginning.
+uint32 file_size(FILE *fp)
 {
-    FT_STATUS ftStatus;
-    FT_DEVICE_LIST_INFO_NODE *devInfo;
-    DWORD numDevs = 0;
-    DWORD numI2cDevs = 0;
+    long size = 0;
 
-    // Create the device information list
-    ftStatus = FT_CreateDeviceInfoList(&numDevs);
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    return (size > 0) ? size : 0;
+}
+
+//Map a file read only, return NULL if it can't be mapped or is empty.
+const uint8 *file_map(const char *path, uint32 *size)
+{
+    struct stat st;
+    void *p = MAP_FAILED;
+    int fd = open(path, O_RDONLY);
 
-    if (numDevs > 0)
+    *size = 0;
+    if (fd < 0)
     {
-        // allocate storage for list based on numDevs
-        devInfo = (FT_DEVICE_LIST_INFO_NODE*) malloc(sizeof(FT_DEVICE_LIST_INFO_NODE) * numDevs);
-        // get the device information list
-        ftStatus = FT_GetDeviceInfoList(devInfo, &numDevs);
-        if (ftStatus == FT_OK)
-        {
-            for (int i = 0; i < numDevs; i++)
-            {
-                if (strcmp(devInfo[i].Description, "FT4222 A") == 0)
-                {
-                    //Copy device info
-                    memcpy(&I2cDevInfo[numI2cDevs], &devInfo[i], sizeof(FT_DEVICE_LIST_INFO_NODE));
-                    numI2cDevs++;
-                }
+        return NULL;
+    }
+    if ((fstat(fd, &st) == 0) && (st.st_size > 0) && (st.st_size <= 0xFFFFFFFF))
+    {
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        *size = (p != MAP_FAILED) ? st.st_size : 0;
+    }
+    close(fd);
+    return (p != MAP_FAILED) ? (const uint8*) p : NULL;
+}
 
-            }
-        }
+void file_unmap(const uint8 *p, uint32 size)
+{
+    if (p != NULL)
+    {
+        munmap((void*) p, size);
     }
+}
 
-    return numI2cDevs;
+//Register address bytes to value, MSB first.
+uint16 get_reg(const uint8 *reg, int reglen)
+{
+    return (reglen == 2) ? (reg[0] << 8 | reg[1]) : reg[0];
 }
 
-FT_STATUS FT_openI2cBus(int devicenumber, FT_HANDLE *pHandle, uint32 kbps)
+//Check a register of the args fits in the register address size, a larger one would be truncated.
+FT_STATUS check_reg(uint32 reg, int reglen)
 {
-    FT_DEVICE_LIST_INFO_NODE devInfo[16];
-    DWORD numI2cDevs = 0;
-    DWORD locid = 0;
+    if ((reg > 0xFFFF) || ((reglen == 1) && (reg > 0xFF)))
+    {
+        CLI_ERROR("ERROR: Register [0x%X] is larger than --addrsize [%d].\n", reg, reglen);
+        return FT_INVALID_PARAMETER;
+    }
+    return FT_OK;
+}
 
-    numI2cDevs = FT_listI2cBus(devInfo);
-    if (numI2cDevs == 0)
+//Start trace of the process, a later line of a script with the same file keeps the trace running.
+FT_STATUS start_trace(const char *path)
+{
+    if ((path[0] == 0) || (TRACE_isEnabled() && (strcmp(path, TRACE_getPath()) == 0)))
     {
-        CLI_ERROR("ERROR: No FT4222 I2C found! exit(-1)\n");
-        exit(-1);
+        return FT_OK;
     }
+    if (TRACE_isEnabled() || (PARALLEL_getBus() >= 0))
+    {
+        CLI_ERROR("ERROR: Trace can only be started once per process, before parallel mode.\n");
+        return FT_INVALID_PARAMETER;
+    }
+    return TRACE_start(path);
+}
 
-    if (devicenumber < numI2cDevs)
+//Print statistic of trace and stop it if it's started.
+void stop_trace(void)
+{
+    stTraceStat stat;
+
+    if (TRACE_isEnabled())
     {
-        locid = devInfo[devicenumber].LocId;
+        TRACE_stop();
+        TRACE_getStat(&stat);
+        TRACE_printStat(&stat);
     }
-    else
+}
+
+//Print statistic of write coalescing if it's enabled.
+void print_coalescestat(void)
+{
+    stCoalesceStat stat;
+
+    if (COALESCE_isEnabled())
     {
-        locid = devInfo[0].LocId;
-        CLI_WARNING("WARNING: Can't find I2C bus [%d], use I2C bus [0] instead, location ID = [0x%X].\n", devicenumber,
-                locid);
+        COALESCE_getStat(&stat);
+        COALESCE_printStat(&stat);
     }
+}
 
-    CHECK_FUNC_RET(FT_OK, FT_OpenEx((void *)locid, FT_OPEN_BY_LOCATION, pHandle));
-    //CHECK_FUNC_RET(FT_OK, FT_OpenEx("FT4222 A", FT_OPEN_BY_DESCRIPTION, pHandle));
-    CHECK_FUNC_RET(FT_OK, FT4222_I2CMaster_Init(*pHandle, kbps));
-    return FT_OK;
+//Print bus error statistic per slave address, if retry is enabled or there was an error.
+void print_retrystat(void)
+{
+    stRetryStat stat;
+    _Bool error = 0;
+
+    RETRY_getStat(&stat);
+    for (int i = 0; i < FT_I2C_ADDR_MAX; i++)
+    {
+        error |= (stat.Addr[i].Retries + stat.Addr[i].Failed > 0);
+    }
+    if (RETRY_isEnabled() || error)
+    {
+        RETRY_printStat(&stat);
+    }
+}
+
+//Print statistic of register cache if it's enabled.
+void print_cachestat(void)
+{
+    stShadowStat stat;
+
+    if (SHADOW_isEnabled())
+    {
+        SHADOW_getStat(&stat);
+        SHADOW_printStat(&stat);
+    }
 }
 
 int command_i2c(int argc, char *argv[])
@@ -343,10 +475,46 @@ int command_i2c(int argc, char *argv[])
         int ch_devread;
         int ch_devwrite;
         int ch_maskwrite;
+        int ch_rmw;
+        int ch_gather;
         int ch_sweep;
+        int ch_eeprom;
+        int ch_verify;
+        int ch_monitor;
+        int monitor_rate;
+        int monitor_samples;
+        int ch_trigger;
+        int ch_replay;
+        _Bool replay_fast;
+        _Bool replay_compare;
+        char trigger_gpio[256];
+        int eeprom_page;
+        _Bool eeprom_delta;
         _Bool i2c_list;
+        _Bool i2c_daemon;
+        _Bool i2c_nodaemon;
+        _Bool i2c_keepgoing;
+        char i2c_script[256];
+        char i2c_file[256];
+        _Bool sweep_quick;
+        int sweep_from;
+        int sweep_to;
         int reg_length;
         int i2c_kbps;
+        int i2c_timeout;
+        int rmw_gap;
+        char i2c_regmap[256];
+        _Bool i2c_waitstat;
+        _Bool i2c_cache;
+        char i2c_volatile[256];
+        char i2c_nonvolatile[256];
+        _Bool i2c_coalesce;
+        char i2c_noinc[256];
+        char i2c_retry[256];
+        char i2c_emu[256];
+        char i2c_trace[256];
+        char i2c_parallel[256];
+        char i2c_id[256];
     } param_i2c;
 
     // Set default value
@@ -355,9 +523,46 @@ int command_i2c(int argc, char *argv[])
     param_i2c.ch_devread = -1;
     param_i2c.ch_devwrite = -1;
     param_i2c.ch_maskwrite = -1;
+    param_i2c.ch_rmw = -1;
+    param_i2c.ch_gather = -1;
     param_i2c.ch_sweep = -1;
+    param_i2c.ch_eeprom = -1;
+    param_i2c.ch_verify = -1;
+    param_i2c.ch_monitor = -1;
+    param_i2c.monitor_rate = MONITOR_RATE_DEFAULT;
+    param_i2c.monitor_samples = 0;
+    param_i2c.ch_trigger = -1;
+    param_i2c.ch_replay = -1;
+    param_i2c.replay_fast = 0;
+    param_i2c.replay_compare = 0;
+    snprintf(param_i2c.trigger_gpio, sizeof(param_i2c.trigger_gpio), "%s", TRIGGER_DEFAULT);
+    param_i2c.eeprom_page = EEPROM_PAGE_DEFAULT;
+    param_i2c.eeprom_delta = 0;
+    param_i2c.i2c_list = 0;
+    param_i2c.i2c_daemon = 0;
+    param_i2c.i2c_nodaemon = 0;
+    param_i2c.i2c_keepgoing = 0;
+    param_i2c.i2c_script[0] = 0;
+    param_i2c.i2c_file[0] = 0;
+    param_i2c.sweep_quick = 0;
+    param_i2c.sweep_from = 0x00;
+    param_i2c.sweep_to = FT_I2C_ADDR_MAX - 1;
     param_i2c.reg_length = 1;
     param_i2c.i2c_kbps = 100;
+    param_i2c.i2c_timeout = FT_WAIT_TIMEOUT_DEFAULT;
+    param_i2c.rmw_gap = -1;
+    param_i2c.i2c_regmap[0] = 0;
+    param_i2c.i2c_trace[0] = 0;
+    param_i2c.i2c_waitstat = 0;
+    param_i2c.i2c_cache = 0;
+    param_i2c.i2c_volatile[0] = 0;
+    param_i2c.i2c_nonvolatile[0] = 0;
+    param_i2c.i2c_coalesce = 0;
+    param_i2c.i2c_noinc[0] = 0;
+    param_i2c.i2c_retry[0] = 0;
+    param_i2c.i2c_emu[0] = 0;
+    param_i2c.i2c_parallel[0] = 0;
+    param_i2c.i2c_id[0] = 0;
 
     //Build option structure.
     stCliOption option_i2c[] =
@@ -369,16 +574,308 @@ int command_i2c(int argc, char *argv[])
     { OPT_INT, 'v', "devwrite", "[Bus] [Addr] [Reg] [Data] Write register data", (void*) &param_i2c.ch_devwrite },
     { OPT_INT, 'm', "maskwrite", "[Bus] [Addr] [Reg] [Mask] [Data]Write register data with mask",
             (void*) &param_i2c.ch_maskwrite },
-    { OPT_INT, 's', "sweep", "[Bus] Sweep I2C bus for devices", (void*) &param_i2c.ch_sweep },
+    { OPT_INT, 'M', "rmw", "[Bus] [Addr] [Reg] [Mask] [Data] ... Batch of register read-modify-write",
+            (void*) &param_i2c.ch_rmw },
+    { OPT_INT, 'G', "gather", "[Bus] [Addr] [Reg] ... Read scattered registers in minimum burst reads",
+            (void*) &param_i2c.ch_gather },
+    { OPT_INT, 'o', "monitor", "[Bus] [Addr] [Reg] ... Sample registers at --rate until Ctrl-C",
+            (void*) &param_i2c.ch_monitor },
+    { OPT_INT, 'T', "trigger", "[Bus] [Addr] [Reg] [Length] Read register data on edges of --gpio",
+            (void*) &param_i2c.ch_trigger },
+    { OPT_INT, 'Y', "replay", "[Bus] Replay a trace of --file on the bus", (void*) &param_i2c.ch_replay },
+    { OPT_INT, 's', "sweep", "[Bus] [Addr...] Sweep I2C bus for devices", (void*) &param_i2c.ch_sweep },
+    { OPT_INT, 'e', "eeprom", "[Bus] [Addr] [Offset] Write EEPROM with image of --file", (void*) &param_i2c.ch_eeprom },
+    { OPT_INT, 'y', "verify", "[Bus] [Addr] [Offset] Compare EEPROM with image of --file", (void*) &param_i2c.ch_verify },
     { OPT_BOOL, 'l', "list", "List I2c bus available", (void*) &param_i2c.i2c_list },
+    { OPT_STRING, 'S', "script", "[File] Run commands from file, \"-\" for stdin",
+            (void*) param_i2c.i2c_script, NULL, sizeof(param_i2c.i2c_script) },
+    { OPT_STRING, 'P', "parallel", "[Bus,...] Run --script on buses at once, \"all\" for all buses",
+            (void*) param_i2c.i2c_parallel, NULL, sizeof(param_i2c.i2c_parallel) },
     { OPT_COMMENT, 0, NULL, "Optional Parameters", NULL },
+    { OPT_STRING, 'i', "id", "[Serial|LocId] Select I2C bus by serial number or location ID",
+            (void*) param_i2c.i2c_id, NULL, sizeof(param_i2c.i2c_id) },
     { OPT_INT, 'f', "freq", "[Freq] Set I2c frequency in kHz. Default is 100.", (void*) &param_i2c.i2c_kbps },
     { OPT_INT, 'z', "addrsize", "[Size] Register address size in bytes. Default is 1.", (void*) &param_i2c.reg_length },
+    { OPT_INT, 't', "timeout", "[ms] Bus busy timeout in ms. Default is 1000.", (void*) &param_i2c.i2c_timeout },
+    { OPT_STRING, 'R', "regmap", "[File] Load register map, names of devices, registers and fields",
+            (void*) param_i2c.i2c_regmap, NULL, sizeof(param_i2c.i2c_regmap) },
+    { OPT_INT, 'g', "gap", "[Regs] Max unused registers read to join 2 reads of --rmw/--gather. Default is 4.",
+            (void*) &param_i2c.rmw_gap },
+    { OPT_BOOL, 'W', "waitstat", "Print statistic of waiting bus idle", (void*) &param_i2c.i2c_waitstat },
+    { OPT_BOOL, 'C', "cache", "Cache register values, skip reads of registers already known",
+            (void*) &param_i2c.i2c_cache },
+    { OPT_STRING, 'V', "volatile", "[Addr:Reg[:Count],...] Registers always read from bus",
+            (void*) param_i2c.i2c_volatile, NULL, sizeof(param_i2c.i2c_volatile) },
+    { OPT_STRING, 'N', "nonvolatile", "[Addr:Reg[:Count],...] Registers cached again after --volatile",
+            (void*) param_i2c.i2c_nonvolatile, NULL, sizeof(param_i2c.i2c_nonvolatile) },
+    { OPT_BOOL, 'c', "coalesce", "Merge --devwrite of contiguous registers in a script into burst writes",
+            (void*) &param_i2c.i2c_coalesce },
+    { OPT_STRING, 'A', "noinc", "[Addr,...] Devices without register auto-increment, never merged",
+            (void*) param_i2c.i2c_noinc, NULL, sizeof(param_i2c.i2c_noinc) },
+    { OPT_STRING, 'U', "retry", "[Spec] Retry failed transactions, e.g. \"addr=5,arb=3,reinit\", see retry.c",
+            (void*) param_i2c.i2c_retry, NULL, sizeof(param_i2c.i2c_retry) },
+    { OPT_STRING, 'F', "file", "[File] Read data to file, or write data from file",
+            (void*) param_i2c.i2c_file, NULL, sizeof(param_i2c.i2c_file) },
+    { OPT_INT, 'p', "page", "[Size] EEPROM page size in bytes. Default is 8.", (void*) &param_i2c.eeprom_page },
+    { OPT_BOOL, 'u', "delta", "Write only EEPROM pages differing from --file, then verify",
+            (void*) &param_i2c.eeprom_delta },
+    { OPT_INT, 'H', "rate", "[Hz] Sample rate of --monitor. Default is 100.", (void*) &param_i2c.monitor_rate },
+    { OPT_INT, 'x', "samples", "[Count] Samples of --monitor, reads of --trigger. Default is until Ctrl-C / 1.",
+            (void*) &param_i2c.monitor_samples },
+    { OPT_BOOL, 'Q', "fast", "Replay with no delay instead of the recorded timing", (void*) &param_i2c.replay_fast },
+    { OPT_BOOL, 'K', "compare", "Replay diverges also when read data differs from the trace",
+            (void*) &param_i2c.replay_compare },
+    { OPT_STRING, 'I', "gpio", "[Port][:rising|falling|both] GPIO edge of --trigger. Default is 3:falling.",
+            (void*) param_i2c.trigger_gpio, NULL, sizeof(param_i2c.trigger_gpio) },
+    { OPT_INT, 'a', "from", "[Addr] First address to sweep. Default is 0x00.", (void*) &param_i2c.sweep_from },
+    { OPT_INT, 'b', "to", "[Addr] Last address to sweep. Default is 0x7F.", (void*) &param_i2c.sweep_to },
+    { OPT_BOOL, 'q', "quick", "Sweep with 0 byte write instead of 1 byte read", (void*) &param_i2c.sweep_quick },
+    { OPT_BOOL, 'D', "daemon", "Run as daemon, serve commands from other fti2c calls", (void*) &param_i2c.i2c_daemon },
+    { OPT_BOOL, 'n', "nodaemon", "Run command locally even if a daemon is running", (void*) &param_i2c.i2c_nodaemon },
+    { OPT_BOOL, 'k', "keepgoing", "Continue the script when a line fails", (void*) &param_i2c.i2c_keepgoing },
+    { OPT_STRING, 'j', "trace", "[File] Record all bridge calls to a binary trace file",
+            (void*) param_i2c.i2c_trace, NULL, sizeof(param_i2c.i2c_trace) },
+    { OPT_STRING, 'E', "emu", "[Config] Use emulated FT4222, \"default\" for default config",
+            (void*) param_i2c.i2c_emu, NULL, sizeof(param_i2c.i2c_emu) },
     { OPT_HELP, 'h', "help", "Show help hints", NULL },
     { OPT_END, 0, NULL, NULL, NULL, str_to_u8 } };
 
-    //Run Arguments parse using option_i2c
-    CLI_parseArgs(argc, argv, option_i2c);
+    //Run Arguments parse using option_i2c, a missing or too long option data fails the command.
+    if (CLI_parseArgs(argc, argv, option_i2c) == CLI_FAILURE)
+    {
+        return FT_INVALID_PARAMETER;
+    }
+
+    //--cache|-C Register cache is kept for the process, e.g. all lines of a script or all clients of a daemon.
+    if (param_i2c.i2c_cache)
+    {
+        SHADOW_enable(1);
+    }
+    if (param_i2c.i2c_volatile[0] != 0)
+    {
+        CHECK_FUNC_RET(FT_OK, SHADOW_parseVolatile(param_i2c.i2c_volatile, 1));
+    }
+    if (param_i2c.i2c_nonvolatile[0] != 0)
+    {
+        CHECK_FUNC_RET(FT_OK, SHADOW_parseVolatile(param_i2c.i2c_nonvolatile, 0));
+    }
+
+    //--regmap|-R [File] Parsed once, a script or daemon line with the same file doesn't load it again.
+    if ((param_i2c.i2c_regmap[0] != 0) && (strcmp(param_i2c.i2c_regmap, REGMAP_getPath()) != 0))
+    {
+        if (PARALLEL_getBus() >= 0)
+        {
+            CLI_ERROR("ERROR: Can't change register map in parallel mode.\n");
+            return FT_INVALID_PARAMETER;
+        }
+        CHECK_FUNC_RET(FT_OK, REGMAP_load(param_i2c.i2c_regmap));
+    }
+
+    //--gap, --coalesce and --noinc are shared by all workers and read without a lock, set them on --parallel.
+    if ((PARALLEL_getBus() >= 0)
+            && ((param_i2c.rmw_gap >= 0) || param_i2c.i2c_coalesce || (param_i2c.i2c_noinc[0] != 0)))
+    {
+        CLI_ERROR("ERROR: Can't change --gap, --coalesce or --noinc in parallel mode, give them with --parallel.\n");
+        return FT_INVALID_PARAMETER;
+    }
+
+    //--gap|-g Kept for the process like --cache, later lines of a script use the same gap.
+    if (param_i2c.rmw_gap >= 0)
+    {
+        if (RMW_setGap(param_i2c.rmw_gap) != FT_OK)
+        {
+            CLI_ERROR("ERROR: Invalid gap [%d], must be 0~%d.\n", param_i2c.rmw_gap, RMW_GAP_MAX);
+            return FT_INVALID_PARAMETER;
+        }
+    }
+
+    //--coalesce|-c Register writes of a script line are queued, any other line sends the queue first.
+    if (param_i2c.i2c_coalesce)
+    {
+        COALESCE_enable(1);
+    }
+    if (param_i2c.i2c_noinc[0] != 0)
+    {
+        CHECK_FUNC_RET(FT_OK, COALESCE_parseNoInc(param_i2c.i2c_noinc));
+    }
+    //--retry|-U [Spec] Kept for the process like --cache, a later spec replaces the whole policy.
+    if (param_i2c.i2c_retry[0] != 0)
+    {
+        CHECK_FUNC_RET(FT_OK, RETRY_parsePolicy(param_i2c.i2c_retry));
+    }
+
+    _Bool coalesce = COALESCE_isEnabled() && SCRIPT_isRunning() && (param_i2c.ch_devwrite >= 0)
+            && (param_i2c.i2c_file[0] == 0) && (param_i2c.ch_read < 0) && (param_i2c.ch_write < 0)
+            && (param_i2c.ch_devread < 0) && (param_i2c.ch_maskwrite < 0) && (param_i2c.ch_rmw < 0)
+            && (param_i2c.ch_gather < 0) && (param_i2c.ch_sweep < 0) && (param_i2c.ch_eeprom < 0)
+            && (param_i2c.ch_verify < 0) && (param_i2c.ch_monitor < 0) && (param_i2c.ch_trigger < 0)
+            && (param_i2c.ch_replay < 0) && !param_i2c.i2c_list;
+    if (!coalesce)
+    {
+        CHECK_FUNC_RET(FT_OK, COALESCE_flush());
+    }
+
+    /********************************************************
+     * Daemon
+     ********************************************************/
+    //A daemon serves all clients one by one, a command must not change its backend or trace, or run until Ctrl-C.
+    if (DAEMON_isServer()
+            && ((param_i2c.i2c_emu[0] != 0) || (param_i2c.i2c_trace[0] != 0)
+                    || ((param_i2c.ch_monitor >= 0) && (param_i2c.monitor_samples == 0))
+                    || ((param_i2c.ch_trigger >= 0) && (param_i2c.i2c_timeout <= 0))))
+    {
+        CLI_ERROR("ERROR: --emu, --trace, or --monitor/--trigger without --samples/--timeout can't run in the daemon, "
+                "use --nodaemon.\n");
+        return FT_INVALID_PARAMETER;
+    }
+
+    //--daemon|-D  Keep I2C bus opened, serve commands from other fti2c calls.
+    if (param_i2c.i2c_daemon)
+    {
+        if (DAEMON_isServer() || SCRIPT_isRunning())
+        {
+            CLI_ERROR("ERROR: Already running as daemon.\n");
+            return FT_INVALID_PARAMETER;
+        }
+        CHECK_FUNC_RET(FT_OK, start_trace(param_i2c.i2c_trace));
+        return DAEMON_runServer(DAEMON_getSocketPath(), command_i2c);
+    }
+
+    //Forward I2C operations to daemon if there's one running.
+    gi2c_nodaemon |= param_i2c.i2c_nodaemon;
+    if (!DAEMON_isServer() && !gi2c_nodaemon && (PARALLEL_getBus() < 0)
+            && ((param_i2c.ch_read >= 0) || (param_i2c.ch_write >= 0) || (param_i2c.ch_devread >= 0)
+                    || (param_i2c.ch_devwrite >= 0) || (param_i2c.ch_maskwrite >= 0) || (param_i2c.ch_sweep >= 0)
+                    || (param_i2c.ch_rmw >= 0) || (param_i2c.ch_gather >= 0)
+                    || (param_i2c.ch_eeprom >= 0) || (param_i2c.ch_verify >= 0) || (param_i2c.ch_monitor >= 0)
+                    || (param_i2c.ch_trigger >= 0) || (param_i2c.ch_replay >= 0) || param_i2c.i2c_list))
+    {
+        int status = 0;
+        if (DAEMON_runClient(DAEMON_getSocketPath(), argc, argv, gi2c_pathopt, &status) == CLI_SUCCESS)
+        {
+            return status;
+        }
+    }
+
+    //--trace|-j [File] Started after forwarding, the daemon records calls of its own process only.
+    CHECK_FUNC_RET(FT_OK, start_trace(param_i2c.i2c_trace));
+
+    //--emu|-E [Config] Switch to emulated FT4222, emulated memory is kept while config is the same.
+    if (param_i2c.i2c_emu[0] != 0)
+    {
+        const char *config = (strcmp(param_i2c.i2c_emu, "default") == 0) ? "" : param_i2c.i2c_emu;
+        if ((HAL_getBackend() != &HAL_EMU) || (strcmp(config, EMU_getConfig()) != 0))
+        {
+            if (PARALLEL_getBus() >= 0)
+            {
+                CLI_ERROR("ERROR: Can't change backend in parallel mode.\n");
+                return FT_INVALID_PARAMETER;
+            }
+            FT_closeI2cBus();
+            CHECK_FUNC_RET(FT_OK, HAL_useEmulator(config));
+        }
+    }
+
+    //In parallel mode, the bus of all operations is the worker's bus, or the bus of --id.
+    //--id is looked up after --emu, in the bus list of the backend the command runs on.
+    int bus_select = PARALLEL_getBus();
+    if (param_i2c.i2c_id[0] != 0)
+    {
+        if (bus_select >= 0)
+        {
+            CLI_ERROR("ERROR: --id can't be used in parallel mode.\n");
+            return FT_INVALID_PARAMETER;
+        }
+        bus_select = FT_findI2cBus(param_i2c.i2c_id);
+        if (bus_select < 0)
+        {
+            CLI_ERROR("ERROR: Can't find I2C bus [%s].\n", param_i2c.i2c_id);
+            return FT_DEVICE_NOT_FOUND;
+        }
+    }
+    if (bus_select >= 0)
+    {
+        int *bus_arg[] =
+        { &param_i2c.ch_read, &param_i2c.ch_write, &param_i2c.ch_devread, &param_i2c.ch_devwrite,
+                &param_i2c.ch_maskwrite, &param_i2c.ch_rmw, &param_i2c.ch_gather, &param_i2c.ch_sweep,
+                &param_i2c.ch_eeprom, &param_i2c.ch_verify, &param_i2c.ch_monitor,
+                &param_i2c.ch_trigger, &param_i2c.ch_replay };
+
+        for (int i = 0; i < sizeof(bus_arg) / sizeof(bus_arg[0]); i++)
+        {
+            *bus_arg[i] = (*bus_arg[i] >= 0) ? bus_select : *bus_arg[i];
+        }
+    }
+
+    //Bus busy timeout of this command, statistic is counted for the whole script.
+    stI2cWait wait;
+    stI2cWaitStat wait_stat;
+
+    FT_getWaitPolicy(&wait);
+    wait.TimeoutMs = (param_i2c.i2c_timeout > 0) ? param_i2c.i2c_timeout : FT_WAIT_TIMEOUT_DEFAULT;
+    FT_setWaitPolicy(&wait);
+    if (!SCRIPT_isRunning())
+    {
+        FT_resetWaitStat();
+        SHADOW_resetStat();
+        COALESCE_resetStat();
+        RETRY_resetStat();
+    }
+
+    /********************************************************
+     * Script
+     ********************************************************/
+    //--parallel|-P [Bus,...] Run the script on all buses at once, one worker thread per bus.
+    if (param_i2c.i2c_parallel[0] != 0)
+    {
+        int bus[FT_I2C_BUS_MAX];
+        int count = PARALLEL_parseBus(param_i2c.i2c_parallel, bus);
+
+        if (SCRIPT_isRunning() || (PARALLEL_getBus() >= 0))
+        {
+            CLI_ERROR("ERROR: Parallel mode can't be nested.\n");
+            return FT_INVALID_PARAMETER;
+        }
+        if ((count <= 0) || (param_i2c.i2c_script[0] == 0))
+        {
+            CLI_ERROR("ERROR: Invalid bus list [%s], or no --script.\n", param_i2c.i2c_parallel);
+            return FT_INVALID_PARAMETER;
+        }
+
+        int ret = PARALLEL_run(bus, count, param_i2c.i2c_script, param_i2c.i2c_kbps, command_i2c,
+                param_i2c.i2c_keepgoing, &wait_stat);
+        if (param_i2c.i2c_waitstat)
+        {
+            FT_printWaitStat(&wait_stat);
+            print_cachestat();
+            print_retrystat();
+        }
+        return ret;
+    }
+
+    //--script|-S [File] Run commands line by line, I2C bus is opened once and shared by all lines.
+    if (param_i2c.i2c_script[0] != 0)
+    {
+        int ret = SCRIPT_run(param_i2c.i2c_script, command_i2c, param_i2c.i2c_keepgoing);
+        int status = COALESCE_flush();
+
+        ret = (ret == 0) ? status : ret;
+        print_coalescestat();
+
+        //Data buffer of a parallel worker is not used after its script.
+        if (PARALLEL_getBus() >= 0)
+        {
+            buf_release();
+        }
+        if (param_i2c.i2c_waitstat)
+        {
+            FT_getWaitStat(&wait_stat);
+            FT_printWaitStat(&wait_stat);
+            print_cachestat();
+            print_retrystat();
+        }
+        return ret;
+    }
 
     /********************************************************
      * I2C operation
@@ -386,11 +883,45 @@ int command_i2c(int argc, char *argv[])
     FT_HANDLE ftHandle = 0;
     uint8 Addr = 0;
     uint8 Mask = 0;
-    uint16 Length = 0;
+    uint32 Length = 0;
+    uint32 Count = 0;
     uint16 TransferSize = 0;
+    FT_STATUS Status = FT_OK;
+    double Time = 0;
+    _Bool Queued = 0;
     uint8 *WritePtr = NULL;
     uint8 *ReadPtr = NULL;
     uint8 *RegPtr = NULL;
+    const stRegDef *RegDef = NULL;
+    const stRegField *RegField = NULL;
+
+    //Names are only known with a register map.
+    for (int i = 0; !REGMAP_isLoaded() && (i < gbuf_count);)
+    {
+        if (gbuf_name[i] != NULL)
+        {
+            CLI_WARNING("[Warning]Ignore un-recognized string of [%s]\n", gbuf_name[i]);
+            buf_remove(i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    //Register map names of [Addr] [Reg] args, only --devread and --devwrite accept names.
+    if ((param_i2c.ch_devread >= 0) || (param_i2c.ch_devwrite >= 0))
+    {
+        CHECK_FUNC_RET(FT_OK, resolve_names(param_i2c.reg_length, &RegDef, &RegField));
+    }
+    for (int i = 0; i < gbuf_count; i++)
+    {
+        if (gbuf_name[i] != NULL)
+        {
+            CLI_ERROR("ERROR: Name [%s] can't be used here, Try [--help].\n", gbuf_name[i]);
+            return FT_INVALID_PARAMETER;
+        }
+    }
 
     //--read|-r [Bus] [Addr] [Length] Read raw data
     if (param_i2c.ch_read >= 0)
@@ -404,24 +935,60 @@ int command_i2c(int argc, char *argv[])
 
         //Handle command syntax
         Addr = gbuf_value[0];
-        Length = gbuf_value[1];
-        ReadPtr = &gbuf_value[2];
+        Length = gbuf_raw[1];
 
         //Initial I2C port
         CHECK_FUNC_RET(FT_OK, FT_openI2cBus(param_i2c.ch_read, &ftHandle, param_i2c.i2c_kbps));
 
         //I2c read operation
-        CHECK_FUNC_RET(FT_OK, FT4222_I2CMaster_ReadEx(ftHandle, Addr, START_AND_STOP, ReadPtr, Length, &TransferSize));
-        CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
-
-        //Print read result
-        CLI_PRINT("I2C READ, count=[%d]\n", TransferSize);
-        print_u8(TransferSize, ReadPtr);
+        if (param_i2c.i2c_file[0] != 0)
+        {
+            FILE *fp = fopen(param_i2c.i2c_file, "wb");
+            if (fp == NULL)
+            {
+                CLI_ERROR("ERROR: Can't open file [%s]\n", param_i2c.i2c_file);
+                return FT_INVALID_PARAMETER;
+            }
+            Time = FT_getTimeMs();
+            Status = FT_readI2cToFile(ftHandle, Addr, START_AND_STOP, fp, Length, &Count);
+            Time = FT_getTimeMs() - Time;
+            fclose(fp);
+            CHECK_FUNC_RET(FT_OK, Status);
+            CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
+
+            CLI_PRINT("I2C READ, count=[%d], file=[%s], %.1f KB/s\n", Count, param_i2c.i2c_file,
+                    Count / (Time > 0 ? Time : 1));
+        }
+        else
+        {
+            ReadPtr = buf_reserve(Length);
+            CHECK_NULL_PTR(ReadPtr);
+            CHECK_FUNC_RET(FT_OK, FT_readI2c(ftHandle, Addr, START_AND_STOP, ReadPtr, Length, &Count));
+            CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
+
+            //Print read result
+            CLI_PRINT("I2C READ, count=[%d]\n", Count);
+            print_u8(Count, ReadPtr);
+        }
     }
 
     //--devread|-d [Bus] [Addr] [Reg] [Length]   Read register data
     if (param_i2c.ch_devread >= 0)
     {
+        //Length of a named register defaults to its width.
+        if (RegDef != NULL)
+        {
+            if (RegDef->Access == REG_WO)
+            {
+                CLI_ERROR("ERROR: Register [%s] is write only.\n", RegDef->Name);
+                return FT_INVALID_PARAMETER;
+            }
+            if (gbuf_count == 1 + param_i2c.reg_length)
+            {
+                buf_insert(gbuf_count, RegDef->Width);
+            }
+        }
+
         //Check minimum args count
         if (gbuf_count < 3)
         {
@@ -434,13 +1001,11 @@ int command_i2c(int argc, char *argv[])
         RegPtr = &gbuf_value[1];
         if (param_i2c.reg_length == 1)
         {
-            Length = gbuf_value[2];
-            ReadPtr = &gbuf_value[3];
+            Length = gbuf_raw[2];
         }
         else if (param_i2c.reg_length == 2)
         {
-            Length = gbuf_value[3];
-            ReadPtr = &gbuf_value[4];
+            Length = gbuf_raw[3];
         }
         else
         {
@@ -452,28 +1017,60 @@ int command_i2c(int argc, char *argv[])
         CHECK_FUNC_RET(FT_OK, FT_openI2cBus(param_i2c.ch_devread, &ftHandle, param_i2c.i2c_kbps));
 
         //3. I2c write/read operation
-        CHECK_FUNC_RET(FT_OK,
-                FT4222_I2CMaster_WriteEx(ftHandle, Addr, START, RegPtr, param_i2c.reg_length, &TransferSize));
-        CHECK_FUNC_RET(FT_OK, FT4222_I2CMaster_ReadEx(ftHandle, Addr, START_AND_STOP, ReadPtr, Length, &TransferSize));
-        CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
+        if (param_i2c.i2c_file[0] != 0)
+        {
+            FILE *fp = fopen(param_i2c.i2c_file, "wb");
+            if (fp == NULL)
+            {
+                CLI_ERROR("ERROR: Can't open file [%s]\n", param_i2c.i2c_file);
+                return FT_INVALID_PARAMETER;
+            }
+            Time = FT_getTimeMs();
+            Status = HAL_writeEx(ftHandle, Addr, START, RegPtr, param_i2c.reg_length, &TransferSize);
+            if (Status == FT_OK)
+            {
+                Status = FT_readI2cToFile(ftHandle, Addr, Repeated_START | STOP, fp, Length, &Count);
+            }
+            Time = FT_getTimeMs() - Time;
+            fclose(fp);
+            CHECK_FUNC_RET(FT_OK, Status);
+            CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
+        }
+        else
+        {
+            ReadPtr = buf_reserve(Length);
+            CHECK_NULL_PTR(ReadPtr);
+            CHECK_FUNC_RET(FT_OK,
+                    FT_readI2cReg(ftHandle, Addr, RegPtr, param_i2c.reg_length, ReadPtr, Length, &Count));
+            CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
+        }
+
         //4. Print read result
         if (param_i2c.reg_length == 1)
         {
-            CLI_PRINT("I2C REG_READ, REG=[0x%02X], count=[%d]\n", RegPtr[0], TransferSize);
+            CLI_PRINT("I2C REG_READ, REG=[0x%02X], count=[%d]", RegPtr[0], Count);
         }
         else if (param_i2c.reg_length == 2)
         {
-            CLI_PRINT("I2C REG_READ, REG=[0x%02X%02X], count=[%d]\n", RegPtr[0], RegPtr[1], TransferSize);
+            CLI_PRINT("I2C REG_READ, REG=[0x%02X%02X], count=[%d]", RegPtr[0], RegPtr[1], Count);
+        }
+        if (param_i2c.i2c_file[0] != 0)
+        {
+            CLI_PRINT(", file=[%s], %.1f KB/s\n", param_i2c.i2c_file, Count / (Time > 0 ? Time : 1));
+        }
+        else
+        {
+            CLI_PRINT("\n");
+            print_u8(Count, ReadPtr);
+            REGMAP_print(Addr, get_reg(RegPtr, param_i2c.reg_length), ReadPtr, Count);
         }
-        print_u8(TransferSize, ReadPtr);
-
     }
 
     //--write|-w [Bus] [Addr] [Data]  Write register data
     if (param_i2c.ch_write >= 0)
     {
         //Check minimum args count
-        if (gbuf_count < 2)
+        if ((gbuf_count < 2) && ((gbuf_count < 1) || (param_i2c.i2c_file[0] == 0)))
         {
             CLI_ERROR("ERROR:Not enough parameters, Try [--help].\n");
             return FT_INVALID_PARAMETER;
@@ -488,20 +1085,122 @@ int command_i2c(int argc, char *argv[])
         CHECK_FUNC_RET(FT_OK, FT_openI2cBus(param_i2c.ch_write, &ftHandle, param_i2c.i2c_kbps));
 
         //3. I2C write operation
-        CHECK_FUNC_RET(FT_OK, FT4222_I2CMaster_Write(ftHandle, Addr, WritePtr, Length, &TransferSize));
-        CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
-        //CHECK_FUNC_RET(FT_OK, FT4222_I2CMaster_WriteEx(ftHandle, Addr, START_AND_STOP, WritePtr, Length, &TransferSize));
+        if (param_i2c.i2c_file[0] != 0)
+        {
+            FILE *fp = fopen(param_i2c.i2c_file, "rb");
+            if (fp == NULL)
+            {
+                CLI_ERROR("ERROR: Can't open file [%s]\n", param_i2c.i2c_file);
+                return FT_INVALID_PARAMETER;
+            }
+            Length = file_size(fp);
+            Time = FT_getTimeMs();
+            Status = FT_writeI2cFromFile(ftHandle, Addr, START_AND_STOP, fp, Length, &Count);
+            Time = FT_getTimeMs() - Time;
+            fclose(fp);
+            CHECK_FUNC_RET(FT_OK, Status);
+            CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
+
+            CLI_PRINT("I2C WRITE, count=[%d], file=[%s], %.1f KB/s\n", Count, param_i2c.i2c_file,
+                    Count / (Time > 0 ? Time : 1));
+        }
+        else
+        {
+            CHECK_FUNC_RET(FT_OK, FT_writeI2c(ftHandle, Addr, START_AND_STOP, WritePtr, Length, &Count));
+            CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
 
-        //4. Print read result
-        CLI_PRINT("I2C WRITE, count=[%d]\n", TransferSize);
-        print_u8(TransferSize, WritePtr);
+            //4. Print read result
+            CLI_PRINT("I2C WRITE, count=[%d]\n", Count);
+            print_u8(Count, WritePtr);
+        }
+    }
+
+    //--devwrite|-v [Bus] [Device] [REG.FIELD] [Value]  Write a field of a named register
+    if ((param_i2c.ch_devwrite >= 0) && (RegField != NULL))
+    {
+        stRmwOp op[REGMAP_WIDTH_MAX];
+        stRmwStat stat;
+        uint8 mask[REGMAP_WIDTH_MAX];
+        uint8 data[REGMAP_WIDTH_MAX];
+        uint32 field_mask = REGMAP_getFieldMask(RegField);
+        uint32 value = gbuf_raw[gbuf_count - 1];
+        uint32 old = 0;
+        int count = 0;
+
+        //1. Field value is 1 arg after [Reg]
+        if ((gbuf_count != 2 + param_i2c.reg_length) || (RegDef->Access == REG_RO)
+                || (value > (field_mask >> RegField->Lsb)))
+        {
+            CLI_ERROR("ERROR: Field [%s.%s] needs 1 value of [%u] bits, in a writable register.\n", RegDef->Name,
+                    RegField->Name, RegField->Msb - RegField->Lsb + 1);
+            return FT_INVALID_PARAMETER;
+        }
+
+        //2. 1 op for each register byte of the field, MSB first
+        Addr = gbuf_value[0];
+        REGMAP_setValue(RegDef, field_mask, mask);
+        REGMAP_setValue(RegDef, value << RegField->Lsb, data);
+        for (int i = 0; i < RegDef->Width; i++)
+        {
+            if (mask[i] != 0)
+            {
+                op[count].Addr = Addr;
+                op[count].Reg = RegDef->Reg + i;
+                op[count].Mask = mask[i];
+                op[count].Data = data[i];
+                count++;
+            }
+        }
+
+        //3. Read-modify-write, queued writes of a script are sent first.
+        CHECK_FUNC_RET(FT_OK, COALESCE_flush());
+        CHECK_FUNC_RET(FT_OK, FT_openI2cBus(param_i2c.ch_devwrite, &ftHandle, param_i2c.i2c_kbps));
+        CHECK_FUNC_RET(FT_OK, RMW_run(ftHandle, op, count, param_i2c.reg_length, &stat));
+
+        //4. Print result
+        for (int i = 0; i < count; i++)
+        {
+            data[op[i].Reg - RegDef->Reg] = op[i].Old;
+        }
+        for (int i = 0; i < RegDef->Width; i++)
+        {
+            old = (old << 8) | (mask[i] ? data[i] : 0);
+        }
+        CLI_PRINT("I2C FIELD_WRITE, %s.%s REG=[0x%02X] 0x%X -> 0x%X, reads=[%u] writes=[%u]\n", RegDef->Name,
+                RegField->Name, RegDef->Reg, (old & field_mask) >> RegField->Lsb, value, stat.Reads, stat.Writes);
     }
 
     //--devwrite|-v [Bus] [Addr] [Reg] [Data] Write register data
-    if (param_i2c.ch_devwrite >= 0)
+    if ((param_i2c.ch_devwrite >= 0) && (RegField == NULL))
     {
+        //Named register, 1 value is split into bytes of the register width, MSB first.
+        if (RegDef != NULL)
+        {
+            int index = 1 + param_i2c.reg_length;
+            if (RegDef->Access == REG_RO)
+            {
+                CLI_ERROR("ERROR: Register [%s] is read only.\n", RegDef->Name);
+                return FT_INVALID_PARAMETER;
+            }
+            if ((gbuf_count == index + 1) && (RegDef->Width > 1) && (param_i2c.i2c_file[0] == 0))
+            {
+                uint8 bytes[REGMAP_WIDTH_MAX];
+                if ((RegDef->Width < 4) && (gbuf_raw[index] >> (RegDef->Width * 8) != 0))
+                {
+                    CLI_ERROR("ERROR: Value [0x%X] is larger than register [%s].\n", gbuf_raw[index], RegDef->Name);
+                    return FT_INVALID_PARAMETER;
+                }
+                REGMAP_setValue(RegDef, gbuf_raw[index], bytes);
+                buf_remove(index);
+                for (int i = 0; i < RegDef->Width; i++)
+                {
+                    buf_insert(index + i, bytes[i]);
+                }
+            }
+        }
+
         //Check minimum args count
-        if (gbuf_count < 3)
+        if ((gbuf_count < 3) && ((gbuf_count < 1 + param_i2c.reg_length) || (param_i2c.i2c_file[0] == 0)))
         {
             CLI_ERROR("ERROR:Not enough parameters, Try [--help].\n");
             return FT_INVALID_PARAMETER;
@@ -530,22 +1229,60 @@ int command_i2c(int argc, char *argv[])
         CHECK_FUNC_RET(FT_OK, FT_openI2cBus(param_i2c.ch_devwrite, &ftHandle, param_i2c.i2c_kbps));
 
         //3. I2c write operation
-        CHECK_FUNC_RET(FT_OK,
-                FT4222_I2CMaster_WriteEx(ftHandle, Addr, START, RegPtr, param_i2c.reg_length, &TransferSize));
-        CHECK_FUNC_RET(FT_OK,
-                FT4222_I2CMaster_WriteEx(ftHandle, Addr, Repeated_START | STOP, WritePtr, Length, &TransferSize));
-        CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
+        if (param_i2c.i2c_file[0] != 0)
+        {
+            FILE *fp = fopen(param_i2c.i2c_file, "rb");
+            if (fp == NULL)
+            {
+                CLI_ERROR("ERROR: Can't open file [%s]\n", param_i2c.i2c_file);
+                return FT_INVALID_PARAMETER;
+            }
+            Length = file_size(fp);
+            Time = FT_getTimeMs();
+            Status = HAL_writeEx(ftHandle, Addr, START, RegPtr, param_i2c.reg_length, &TransferSize);
+            if (Status == FT_OK)
+            {
+                Status = FT_writeI2cFromFile(ftHandle, Addr, STOP, fp, Length, &Count);
+            }
+            Time = FT_getTimeMs() - Time;
+            fclose(fp);
+            CHECK_FUNC_RET(FT_OK, Status);
+        }
+        else if (coalesce)
+        {
+            CHECK_FUNC_RET(FT_OK,
+                    COALESCE_write(ftHandle, Addr, RegPtr, param_i2c.reg_length, WritePtr, Length, &Queued));
+            Count = Length;
+        }
+        else
+        {
+            CHECK_FUNC_RET(FT_OK,
+                    FT_writeI2cReg(ftHandle, Addr, RegPtr, param_i2c.reg_length, WritePtr, Length, &Count));
+        }
+        if (!Queued)
+        {
+            CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
+        }
 
         //4. Print read result
         if (param_i2c.reg_length == 1)
         {
-            CLI_PRINT("I2C REG_WRITE, REG=[0x%02X], count=[%d]\n", RegPtr[0], TransferSize);
+            CLI_PRINT("I2C REG_WRITE, REG=[0x%02X], count=[%d]", RegPtr[0], Count);
         }
         else if (param_i2c.reg_length == 2)
         {
-            CLI_PRINT("I2c EG_WRITE, REG=[0x%02X%02X], count=[%d]\n", RegPtr[0], RegPtr[1], TransferSize);
+            CLI_PRINT("I2C REG_WRITE, REG=[0x%02X%02X], count=[%d]", RegPtr[0], RegPtr[1], Count);
+        }
+        if (param_i2c.i2c_file[0] != 0)
+        {
+            CLI_PRINT(", file=[%s], %.1f KB/s\n", param_i2c.i2c_file, Count / (Time > 0 ? Time : 1));
+        }
+        else
+        {
+            CLI_PRINT(Queued ? ", queued\n" : "\n");
+            print_u8(Count, WritePtr);
+            REGMAP_print(Addr, get_reg(RegPtr, param_i2c.reg_length), WritePtr, Count);
         }
-        print_u8(TransferSize, WritePtr);
     }
 
     //--maskwrite|-m [Bus] [Addr] [Reg] [Mask] [Data] Write register data
@@ -565,13 +1302,13 @@ int command_i2c(int argc, char *argv[])
         if (param_i2c.reg_length == 1)
         {
             Mask = gbuf_value[2];
-            Length = gbuf_count - 2;
+            Length = gbuf_count - 3;
             WritePtr = &gbuf_value[3];
         }
         else if (param_i2c.reg_length == 2)
         {
             Mask = gbuf_value[3];
-            Length = gbuf_count - 3;
+            Length = gbuf_count - 4;
             WritePtr = &gbuf_value[4];
         }
         else
@@ -580,71 +1317,460 @@ int command_i2c(int argc, char *argv[])
             return -1;
         }
 
-        ReadPtr = (uint8*) malloc(Length);
+        if (Length == 0)
+        {
+            CLI_ERROR("ERROR:Not enough parameters, Try [--help].\n");
+            return FT_INVALID_PARAMETER;
+        }
+
+        //Mask is applied to each data byte, for consecutive registers.
+        stRmwOp op[256];
+        uint16 Reg = (param_i2c.reg_length == 2) ? (RegPtr[0] << 8 | RegPtr[1]) : RegPtr[0];
+        CHECK_FUNC_RET(FT_OK, check_reg((uint32) Reg + Length - 1, param_i2c.reg_length));
+        for (int i = 0; i < Length; i++)
+        {
+            op[i].Addr = Addr;
+            op[i].Reg = Reg + i;
+            op[i].Mask = Mask;
+            op[i].Data = WritePtr[i];
+        }
 
         //2. Initial I2C port
         CHECK_FUNC_RET(FT_OK, FT_openI2cBus(param_i2c.ch_maskwrite, &ftHandle, param_i2c.i2c_kbps));
 
-        //3. I2C read and mask write
-        CHECK_FUNC_RET(FT_OK,
-                FT4222_I2CMaster_WriteEx(ftHandle, Addr, START, RegPtr, param_i2c.reg_length, &TransferSize));
-        CHECK_FUNC_RET(FT_OK,
-                FT4222_I2CMaster_ReadEx(ftHandle, Addr, Repeated_START | STOP, ReadPtr, Length, &TransferSize));
+        //3. Register pointer write + repeated start read, merge, and write back
+        CHECK_FUNC_RET(FT_OK, RMW_run(ftHandle, op, Length, param_i2c.reg_length, NULL));
 
+        //4. Print result
         for (int i = 0; i < Length; i++)
         {
-            WritePtr[i] = ReadPtr[i] & Mask;
+            WritePtr[i] = op[i].New;
         }
+        CLI_PRINT("I2c MASK_WRITE, REG=[0x%02X], count=[%d]\n", Reg, Length);
+        print_u8(Length, WritePtr);
+    }
+
+    //--rmw|-M [Bus] [Addr] [Reg] [Mask] [Data] ... Batch of read-modify-write
+    if (param_i2c.ch_rmw >= 0)
+    {
+        stRmwOp op[CLI_ARG_COUNT_MAX / 4];
+        stRmwStat stat;
+        int count = gbuf_count / 4;
 
-        CHECK_FUNC_RET(FT_OK,
-                FT4222_I2CMaster_WriteEx(ftHandle, Addr, START, RegPtr, param_i2c.reg_length, &TransferSize));
-        CHECK_FUNC_RET(FT_OK,
-                FT4222_I2CMaster_WriteEx(ftHandle, Addr, START_AND_STOP, WritePtr, Length, &TransferSize));
+        //1. Each op is 4 values, Reg is 1 value for all --addrsize.
+        if ((gbuf_count < 4) || (gbuf_count % 4 != 0))
+        {
+            CLI_ERROR("ERROR:Parameters must be groups of [Addr] [Reg] [Mask] [Data], Try [--help].\n");
+            return FT_INVALID_PARAMETER;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            CHECK_FUNC_RET(FT_OK, check_reg(gbuf_raw[i * 4 + 1], param_i2c.reg_length));
+            op[i].Addr = gbuf_value[i * 4];
+            op[i].Reg = gbuf_raw[i * 4 + 1];
+            op[i].Mask = gbuf_value[i * 4 + 2];
+            op[i].Data = gbuf_value[i * 4 + 3];
+        }
+
+        //2. Initial I2C port
+        CHECK_FUNC_RET(FT_OK, FT_openI2cBus(param_i2c.ch_rmw, &ftHandle, param_i2c.i2c_kbps));
+
+        //3. Run batch, grouped by device
+        Time = FT_getTimeMs();
+        Status = RMW_run(ftHandle, op, count, param_i2c.reg_length, &stat);
+        Time = FT_getTimeMs() - Time;
+        CHECK_FUNC_RET(FT_OK, Status);
 
         //4. Print result
-        CLI_PRINT("I2c MASK_WRITE, REG=[0x%02X], count=[%d]\n", RegPtr[0], TransferSize);
-        print_u8(TransferSize, WritePtr);
+        for (int i = 0; i < count; i++)
+        {
+            CLI_PRINT("0x%02X REG=[0x%02X] MASK=[0x%02X] 0x%02X -> 0x%02X\n", op[i].Addr, op[i].Reg, op[i].Mask,
+                    op[i].Old, op[i].New);
+        }
+        CLI_PRINT("I2C RMW, ops=[%u] devices=[%u] reads=[%u] writes=[%u] skipped=[%u], time=[%.3f] ms\n", stat.Ops,
+                stat.Devices, stat.Reads, stat.Writes, stat.Skipped, Time);
     }
 
-    //--sweep|-s [Bus]    Sweep I2C bus for devices
+    //--gather|-G [Bus] [Addr] [Reg] ... Read scattered registers
+    if (param_i2c.ch_gather >= 0)
+    {
+        stRmwRead rd[CLI_ARG_COUNT_MAX / 2];
+        stRmwStat stat;
+        int count = gbuf_count / 2;
+
+        //1. Each read is 2 values, Reg is 1 value for all --addrsize.
+        if ((gbuf_count < 2) || (gbuf_count % 2 != 0))
+        {
+            CLI_ERROR("ERROR:Parameters must be groups of [Addr] [Reg], Try [--help].\n");
+            return FT_INVALID_PARAMETER;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            CHECK_FUNC_RET(FT_OK, check_reg(gbuf_raw[i * 2 + 1], param_i2c.reg_length));
+            rd[i].Addr = gbuf_value[i * 2];
+            rd[i].Reg = gbuf_raw[i * 2 + 1];
+        }
+
+        //2. Initial I2C port
+        CHECK_FUNC_RET(FT_OK, FT_openI2cBus(param_i2c.ch_gather, &ftHandle, param_i2c.i2c_kbps));
+
+        //3. Burst read each span of nearby registers
+        Time = FT_getTimeMs();
+        Status = RMW_read(ftHandle, rd, count, param_i2c.reg_length, &stat);
+        Time = FT_getTimeMs() - Time;
+        CHECK_FUNC_RET(FT_OK, Status);
+
+        //4. Print result in the given order
+        for (int i = 0; i < count; i++)
+        {
+            CLI_PRINT("0x%02X REG=[0x%02X] 0x%02X\n", rd[i].Addr, rd[i].Reg, rd[i].Value);
+        }
+        CLI_PRINT("I2C GATHER, regs=[%u] devices=[%u] reads=[%u] bridged=[%u] gap=[%u], time=[%.3f] ms\n", stat.Ops,
+                stat.Devices, stat.Reads, stat.Bridged, RMW_getGap(), Time);
+    }
+
+    //--eeprom|-e [Bus] [Addr] [Offset] Write EEPROM with image of --file
+    if (param_i2c.ch_eeprom >= 0)
+    {
+        stEeprom eeprom;
+
+        //1. Check parameters and load image
+        if ((gbuf_count < 2) || (param_i2c.i2c_file[0] == 0))
+        {
+            CLI_ERROR("ERROR:Not enough parameters, Try [--help].\n");
+            return FT_INVALID_PARAMETER;
+        }
+        if ((param_i2c.reg_length != 1) && (param_i2c.reg_length != 2))
+        {
+            CLI_ERROR("ERROR:Invalid register size, must be 1 or 2.\n");
+            return FT_INVALID_PARAMETER;
+        }
+        if ((param_i2c.eeprom_page <= 0) || (param_i2c.eeprom_page > FT_I2C_PACKET_MAX - 2))
+        {
+            CLI_ERROR("ERROR:Invalid page size.\n");
+            return FT_INVALID_PARAMETER;
+        }
+
+        //Image is mapped instead of copied, an image equal to the EEPROM is only compared.
+        WritePtr = (uint8*) file_map(param_i2c.i2c_file, &Length);
+        if (WritePtr == NULL)
+        {
+            CLI_ERROR("ERROR: Can't read file [%s]\n", param_i2c.i2c_file);
+            return FT_IO_ERROR;
+        }
+
+        //2. Initial I2C port
+        Status = FT_openI2cBus(param_i2c.ch_eeprom, &ftHandle, param_i2c.i2c_kbps);
+        if (Status != FT_OK)
+        {
+            file_unmap(WritePtr, Length);
+            CHECK_FUNC_RET(FT_OK, Status);
+        }
+        EEPROM_init(&eeprom, ftHandle, gbuf_value[0], param_i2c.reg_length, param_i2c.eeprom_page);
+
+        //3. Page write with ACK polling, or delta write of differing pages
+        Time = FT_getTimeMs();
+        if (param_i2c.eeprom_delta)
+        {
+            Status = EEPROM_writeDelta(&eeprom, gbuf_raw[1], WritePtr, Length, &Count);
+        }
+        else
+        {
+            Status = EEPROM_write(&eeprom, gbuf_raw[1], WritePtr, Length, &Count);
+        }
+        Time = FT_getTimeMs() - Time;
+        file_unmap(WritePtr, Length);
+
+        //4. Print result
+        if (param_i2c.eeprom_delta)
+        {
+            CLI_PRINT("EEPROM DELTA, offset=[0x%X], size=[%d], count=[%d], pages skipped=[%d] written=[%d] "
+                    "verified=[%d], polls=[%d], wait=[%.3f] ms, time=[%.3f] ms\n", gbuf_raw[1], Length, Count,
+                    eeprom.PageSkip, eeprom.PageCount, eeprom.PageVerify, eeprom.PollCount, eeprom.PollTimeMs, Time);
+        }
+        else
+        {
+            CLI_PRINT("EEPROM WRITE, offset=[0x%X], count=[%d], pages=[%d], polls=[%d], wait=[%.3f] ms, "
+                    "time=[%.3f] ms, %.1f B/s\n", gbuf_raw[1], Count, eeprom.PageCount, eeprom.PollCount,
+                    eeprom.PollTimeMs, Time, Count * 1000.0 / (Time > 0 ? Time : 1));
+        }
+        CHECK_FUNC_RET(FT_OK, Status);
+    }
+
+    //--verify|-y [Bus] [Addr] [Offset] Compare EEPROM data with image of --file
+    if (param_i2c.ch_verify >= 0)
+    {
+        stEeprom eeprom;
+        const uint8 *image = NULL;
+
+        //1. Check parameters and map image
+        if ((gbuf_count < 2) || (param_i2c.i2c_file[0] == 0))
+        {
+            CLI_ERROR("ERROR:Not enough parameters, Try [--help].\n");
+            return FT_INVALID_PARAMETER;
+        }
+        if ((param_i2c.reg_length != 1) && (param_i2c.reg_length != 2))
+        {
+            CLI_ERROR("ERROR:Invalid register size, must be 1 or 2.\n");
+            return FT_INVALID_PARAMETER;
+        }
+        image = file_map(param_i2c.i2c_file, &Length);
+        if (image == NULL)
+        {
+            CLI_ERROR("ERROR: Can't read file [%s]\n", param_i2c.i2c_file);
+            return FT_IO_ERROR;
+        }
+
+        //2. Initial I2C port
+        Status = FT_openI2cBus(param_i2c.ch_verify, &ftHandle, param_i2c.i2c_kbps);
+        if (Status != FT_OK)
+        {
+            file_unmap(image, Length);
+            CHECK_FUNC_RET(FT_OK, Status);
+        }
+        EEPROM_init(&eeprom, ftHandle, gbuf_value[0], param_i2c.reg_length, param_i2c.eeprom_page);
+
+        //3. Read and compare chunk by chunk, nothing is printed until done.
+        Time = FT_getTimeMs();
+        Status = EEPROM_verify(&eeprom, gbuf_raw[1], image, Length, &Count);
+        Time = FT_getTimeMs() - Time;
+        file_unmap(image, Length);
+        CHECK_FUNC_RET(FT_OK, Status);
+
+        //4. Print result
+        if (Count != Length)
+        {
+            CLI_ERROR("EEPROM VERIFY, offset=[0x%X], count=[%d], mismatch at [0x%X], time=[%.3f] ms\n", gbuf_raw[1],
+                    Length, gbuf_raw[1] + Count, Time);
+            return FT_OTHER_ERROR;
+        }
+        CLI_PRINT("EEPROM VERIFY, offset=[0x%X], count=[%d], match, time=[%.3f] ms, %.1f KB/s\n", gbuf_raw[1], Count,
+                Time, Count / (Time > 0 ? Time : 1));
+    }
+
+    //--monitor|-o [Bus] [Addr] [Reg] ...   Sample registers at a fixed rate
+    if (param_i2c.ch_monitor >= 0)
+    {
+        stRmwRead rd[CLI_ARG_COUNT_MAX / 2];
+        stMonitorStat stat;
+        FILE *fp = FT_getOutput();
+        int count = gbuf_count / 2;
+
+        //1. Each register is 2 values, Reg is 1 value for all --addrsize.
+        if ((gbuf_count < 2) || (gbuf_count % 2 != 0))
+        {
+            CLI_ERROR("ERROR:Parameters must be groups of [Addr] [Reg], Try [--help].\n");
+            return FT_INVALID_PARAMETER;
+        }
+        if ((param_i2c.monitor_rate <= 0) || (param_i2c.monitor_rate > MONITOR_RATE_MAX)
+                || (param_i2c.monitor_samples < 0))
+        {
+            CLI_ERROR("ERROR:Invalid rate or samples, rate must be 1~%d Hz.\n", MONITOR_RATE_MAX);
+            return FT_INVALID_PARAMETER;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            CHECK_FUNC_RET(FT_OK, check_reg(gbuf_raw[i * 2 + 1], param_i2c.reg_length));
+            rd[i].Addr = gbuf_value[i * 2];
+            rd[i].Reg = gbuf_raw[i * 2 + 1];
+        }
+        if (param_i2c.i2c_file[0] != 0)
+        {
+            fp = fopen(param_i2c.i2c_file, "w");
+            if (fp == NULL)
+            {
+                CLI_ERROR("ERROR: Can't open file [%s]\n", param_i2c.i2c_file);
+                return FT_INVALID_PARAMETER;
+            }
+        }
+
+        //2. Initial I2C port, kept open for all samples
+        Status = FT_openI2cBus(param_i2c.ch_monitor, &ftHandle, param_i2c.i2c_kbps);
+
+        //3. Sample, the writer thread prints samples to fp
+        if (Status == FT_OK)
+        {
+            Status = MONITOR_run(ftHandle, rd, count, param_i2c.reg_length, param_i2c.monitor_rate,
+                    param_i2c.monitor_samples, fp, &stat);
+        }
+        if (fp != FT_getOutput())
+        {
+            fclose(fp);
+        }
+        CHECK_FUNC_RET(FT_OK, Status);
+
+        //4. Print statistic
+        MONITOR_printStat(&stat);
+    }
+
+    //--trigger|-T [Bus] [Addr] [Reg] [Length]    Read register data on GPIO edges
+    if (param_i2c.ch_trigger >= 0)
+    {
+        FT_HANDLE gpio = NULL;
+        GPIO_Port port = GPIO_PORT3;
+        GPIO_Trigger trigger = GPIO_TRIGGER_FALLING;
+        stTriggerStat stat;
+        uint32 edges = 0;
+        int reads = (param_i2c.monitor_samples > 0) ? param_i2c.monitor_samples : 1;
+
+        //1. Handle command syntax, same as --devread
+        if ((param_i2c.reg_length != 1) && (param_i2c.reg_length != 2))
+        {
+            CLI_ERROR("ERROR:Invalid register size, must be 1 or 2.\n");
+            return FT_INVALID_PARAMETER;
+        }
+        if (gbuf_count != 2 + param_i2c.reg_length)
+        {
+            CLI_ERROR("ERROR:Parameters must be [Addr] [Reg] [Length], Try [--help].\n");
+            return FT_INVALID_PARAMETER;
+        }
+        CHECK_FUNC_RET(FT_OK, TRIGGER_parse(param_i2c.trigger_gpio, &port, &trigger));
+        Addr = gbuf_value[0];
+        RegPtr = &gbuf_value[1];
+        Length = gbuf_raw[1 + param_i2c.reg_length];
+        ReadPtr = buf_reserve(Length);
+        CHECK_NULL_PTR(ReadPtr);
+
+        //2. Initial I2C port and GPIO, edges before arming are dropped.
+        CHECK_FUNC_RET(FT_OK, FT_openI2cBus(param_i2c.ch_trigger, &ftHandle, param_i2c.i2c_kbps));
+        CHECK_FUNC_RET(FT_OK, FT_openGpio(param_i2c.ch_trigger, &gpio));
+        CHECK_FUNC_RET(FT_OK, TRIGGER_arm(gpio, port, trigger));
+        memset(&stat, 0, sizeof(stat));
+
+        //3. Wait edge then read, no I2C traffic while waiting.
+        for (int i = 0; i < reads; i++)
+        {
+            CHECK_FUNC_RET(FT_OK, TRIGGER_wait(gpio, port, param_i2c.i2c_timeout, &edges, &stat));
+            if (edges == 0)
+            {
+                CLI_ERROR("ERROR: No edge on GPIO%d in [%d] ms.\n", port, param_i2c.i2c_timeout);
+                TRIGGER_printStat(&stat);
+                return FT_OTHER_ERROR;
+            }
+
+            //The edge tells the register changed, never take it from the cache.
+            if (SHADOW_isEnabled())
+            {
+                SHADOW_invalidate(ftHandle, Addr);
+            }
+            Time = FT_getTimeMs();
+            CHECK_FUNC_RET(FT_OK,
+                    FT_readI2cReg(ftHandle, Addr, RegPtr, param_i2c.reg_length, ReadPtr, Length, &Count));
+            CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
+            Time = FT_getTimeMs() - Time;
+
+            CLI_PRINT("I2C TRIGGER_READ, REG=[0x%02X], count=[%d], edges=[%u], read=[%.3f] ms\n",
+                    get_reg(RegPtr, param_i2c.reg_length), Count, edges, Time);
+            print_u8(Count, ReadPtr);
+        }
+        TRIGGER_printStat(&stat);
+    }
+
+    //--replay|-Y [Bus]    Replay a trace of --file on the bus
+    if (param_i2c.ch_replay >= 0)
+    {
+        stTraceFile trace;
+        stReplayStat stat;
+        REPLAY_TIMING timing = param_i2c.replay_fast ? REPLAY_FAST : REPLAY_ORIGINAL;
+
+        //1. Load the whole trace, a trace cut short by a crash is replayed up to the cut.
+        if (param_i2c.i2c_file[0] == 0)
+        {
+            CLI_ERROR("ERROR:Trace must be given by --file, Try [--help].\n");
+            return FT_INVALID_PARAMETER;
+        }
+        CHECK_FUNC_RET(FT_OK, TRACE_load(param_i2c.i2c_file, &trace));
+        if (trace.Truncated)
+        {
+            CLI_ERROR("WARNING: Trace [%s] is cut short, [%u] records before the cut are replayed.\n",
+                    param_i2c.i2c_file, trace.Count);
+        }
+
+        //2. Replay, the cache doesn't know the registers written.
+        Status = FT_openI2cBus(param_i2c.ch_replay, &ftHandle, param_i2c.i2c_kbps);
+        if (Status == FT_OK)
+        {
+            Status = REPLAY_run(ftHandle, &trace, timing, param_i2c.replay_compare, param_i2c.i2c_keepgoing, &stat);
+            REPLAY_printStat(&stat);
+            if (SHADOW_isEnabled())
+            {
+                SHADOW_invalidate(ftHandle, SHADOW_ADDR_ALL);
+            }
+        }
+        TRACE_unload(&trace);
+        CHECK_FUNC_RET(FT_OK, Status);
+    }
+
+    //--sweep|-s [Bus] [Addr...]    Sweep I2C bus for devices
     if (param_i2c.ch_sweep >= 0)
     {
-        uint8 i = 0;
-        uint8 count = 0;
-        uint8 result = -1;
+        uint8 addr[FT_I2C_ADDR_MAX];
+        uint8 found[FT_I2C_ADDR_MAX];
+        int count = 0;
+        int found_count = 0;
+        double time = 0;
+        FT_PROBE mode = param_i2c.sweep_quick ? FT_PROBE_QUICK_WRITE : FT_PROBE_READ;
+
+        //1. Address allowlist from args, or the range of --from/--to
+        if (gbuf_count > 0)
+        {
+            for (int i = 0; (i < gbuf_count) && (count < FT_I2C_ADDR_MAX); i++)
+            {
+                addr[count++] = gbuf_value[i] & 0x7F;
+            }
+        }
+        else
+        {
+            if ((param_i2c.sweep_from < 0) || (param_i2c.sweep_to >= FT_I2C_ADDR_MAX)
+                    || (param_i2c.sweep_from > param_i2c.sweep_to))
+            {
+                CLI_ERROR("ERROR:Invalid sweep range, must be within 0x00~0x7F.\n");
+                return FT_INVALID_PARAMETER;
+            }
+            for (int i = param_i2c.sweep_from; i <= param_i2c.sweep_to; i++)
+            {
+                addr[count++] = i;
+            }
+        }
 
         CLI_PRINT("I2C slave sweep on bus [%d]\n", param_i2c.ch_sweep);
 
         //2. Initial I2C port
         CHECK_FUNC_RET(FT_OK, FT_openI2cBus(param_i2c.ch_sweep, &ftHandle, param_i2c.i2c_kbps));
 
-        for (i = 0; i < 0x80; i++)
+        //3. Probe address
+        time = FT_getTimeMs();
+        CHECK_FUNC_RET(FT_OK, FT_sweepI2cBus(ftHandle, addr, count, mode, found, &found_count));
+        time = FT_getTimeMs() - time;
+
+        //4. Print result
+        for (int i = 0; i < found_count; i++)
         {
-            result = FT_checkI2cAddr(ftHandle, i);
-            if (result == FT_OK)
-            {
-                CLI_PRINT("I2C slave detected: 0x%02X\n", i);
-                count++;
-            }
+            CLI_PRINT("I2C slave detected: 0x%02X\n", found[i]);
         }
+        CLI_PRINT("I2C sweep done, probed=[%d] detected=[%d], time=[%.3f] ms\n", count, found_count, time);
     }
 
     if (param_i2c.i2c_list)
     {
-        FT_DEVICE_LIST_INFO_NODE devInfo[16];
+        FT_DEVICE_LIST_INFO_NODE devInfo[FT_I2C_BUS_MAX + 1];
         DWORD numI2cDevs = 0;
 
+        //Always enumerate again, --list also refreshes the enumeration cache.
+        memset(devInfo, 0, sizeof(devInfo));
+        FT_refreshI2cBus();
         numI2cDevs = FT_listI2cBus(devInfo);
 
         CLI_PRINT("I2C Master Bus Count = [%d]\n-----------------\n", numI2cDevs);
         print_devinfo(devInfo);
     }
 
-    //Finish all operation, close device.
-    if (ftHandle)
+    if (param_i2c.i2c_waitstat)
     {
-        FT4222_UnInitialize(ftHandle);
-        FT_Close(ftHandle);
+        FT_getWaitStat(&wait_stat);
+        FT_printWaitStat(&wait_stat);
+        print_cachestat();
+        print_retrystat();
     }
 
     return 0;
@@ -652,5 +1778,22 @@ int command_i2c(int argc, char *argv[])
 
 int main(int argc, char *argv[])
 {
-    return command_i2c(--argc, ++argv);
+    //Use emulated FT4222 if FTI2C_EMU is set.
+    HAL_useFromEnv();
+
+    //Time all bridge calls if FTI2C_LATENCY is set, before any thread is created.
+    LATENCY_enableFromEnv();
+
+    //Load register map if FTI2C_REGMAP is set.
+    CHECK_FUNC_RET(FT_OK, REGMAP_loadFromEnv());
+
+    int ret = command_i2c(--argc, ++argv);
+
+    //Finish all operation, close device.
+    FT_closeI2cBus();
+    REGMAP_free();
+    stop_trace();
+    LATENCY_print();
+
+    return ret;
 }
@@ -0,0 +1,280 @@
+/******************************************************************************
+ * @file    hal.c
+ *          Hardware abstraction of FT4222H I2C master, all USB calls of fti2c
+ *          go through the selected backend. Calls are timed for the trace and
+ *          latency histograms when enabled.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hal.h"
+#include "trace.h"
+#include "latency.h"
+
+//Default to libft4222, emulator only build has no other choice.
+#ifndef FTI2C_NO_FT4222
+static const stI2cBackend *gi2c_backend = &HAL_FT4222;
+#else
+static const stI2cBackend *gi2c_backend = &HAL_EMU;
+#endif
+
+/*!@brief Use emulated FT4222H bridge.
+ *
+ * @param config    Emulator config, NULL, "" or "default" for default.
+ * @return          FT_OK or FT_INVALID_PARAMETER if config is invalid.
+ */
+FT_STATUS HAL_useEmulator(const char *config)
+{
+    if ((config == NULL) || (strcmp(config, "default") == 0))
+    {
+        config = "";
+    }
+
+    //Keep emulated memory if config is the same.
+    if ((gi2c_backend == &HAL_EMU) && (strcmp(config, EMU_getConfig()) == 0))
+    {
+        return FT_OK;
+    }
+
+    FT_STATUS ret = EMU_config(config);
+    if (ret == FT_OK)
+    {
+        gi2c_backend = &HAL_EMU;
+    }
+    return ret;
+}
+
+//Use emulator if environment variable FTI2C_EMU is set.
+void HAL_useFromEnv(void)
+{
+    const char *config = getenv(HAL_EMU_ENV);
+
+    if (config != NULL)
+    {
+        HAL_useEmulator(config);
+    }
+}
+
+//Calls are timed only when trace or latency histograms are enabled, otherwise it's 1 branch.
+static inline _Bool hal_isProbed(void)
+{
+    return TRACE_isEnabled() || LATENCY_isEnabled();
+}
+
+const stI2cBackend *HAL_getBackend(void)
+{
+    return gi2c_backend;
+}
+
+int HAL_listBus(FT_DEVICE_LIST_INFO_NODE *devInfo, int max)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->ListBus(devInfo, max);
+    }
+
+    uint64 start = FT_getTimeNs();
+    int count = gi2c_backend->ListBus(devInfo, max);
+    LATENCY_add(LATENCY_LIST, start, 0);
+    return count;
+}
+
+FT_STATUS HAL_open(DWORD locid, FT_HANDLE *pHandle)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->Open(locid, pHandle);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->Open(locid, pHandle);
+    LATENCY_add(LATENCY_OPEN, start, 0);
+    TRACE_add(TRACE_OPEN, start, (status == FT_OK) ? *pHandle : NULL, status, locid);
+    return status;
+}
+
+FT_STATUS HAL_close(FT_HANDLE ftHandle)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->Close(ftHandle);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->Close(ftHandle);
+    LATENCY_add(LATENCY_CLOSE, start, 0);
+    TRACE_add(TRACE_CLOSE, start, ftHandle, status, 0);
+    return status;
+}
+
+FT_STATUS HAL_init(FT_HANDLE ftHandle, uint32 kbps)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->Init(ftHandle, kbps);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->Init(ftHandle, kbps);
+    LATENCY_add(LATENCY_INIT, start, 0);
+    TRACE_add(TRACE_INIT, start, ftHandle, status, kbps);
+    return status;
+}
+
+FT_STATUS HAL_getVersion(FT_HANDLE ftHandle, FT4222_Version *pVersion)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->GetVersion(ftHandle, pVersion);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->GetVersion(ftHandle, pVersion);
+    LATENCY_add(LATENCY_VERSION, start, 0);
+    return status;
+}
+
+FT_STATUS HAL_getMaxTransferSize(FT_HANDLE ftHandle, uint16 *pMaxSize)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->GetMaxTransferSize(ftHandle, pMaxSize);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->GetMaxTransferSize(ftHandle, pMaxSize);
+    LATENCY_add(LATENCY_MAXSIZE, start, 0);
+    return status;
+}
+
+FT_STATUS HAL_readEx(FT_HANDLE ftHandle, uint16 deviceAddress, uint8 flag, uint8 *buffer, uint16 bufferSize,
+        uint16 *sizeTransferred)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->ReadEx(ftHandle, deviceAddress, flag, buffer, bufferSize, sizeTransferred);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->ReadEx(ftHandle, deviceAddress, flag, buffer, bufferSize, sizeTransferred);
+    uint16 done = (*sizeTransferred <= bufferSize) ? *sizeTransferred : bufferSize;
+    LATENCY_add(LATENCY_READ, start, done);
+    TRACE_addTransfer(TRACE_READ, start, ftHandle, status, deviceAddress, flag, buffer, bufferSize, done);
+    return status;
+}
+
+FT_STATUS HAL_writeEx(FT_HANDLE ftHandle, uint16 deviceAddress, uint8 flag, uint8 *buffer, uint16 bufferSize,
+        uint16 *sizeTransferred)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->WriteEx(ftHandle, deviceAddress, flag, buffer, bufferSize, sizeTransferred);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->WriteEx(ftHandle, deviceAddress, flag, buffer, bufferSize, sizeTransferred);
+    LATENCY_add(LATENCY_WRITE, start, *sizeTransferred);
+    TRACE_addTransfer(TRACE_WRITE, start, ftHandle, status, deviceAddress, flag, buffer, bufferSize,
+            *sizeTransferred);
+    return status;
+}
+
+FT_STATUS HAL_getStatus(FT_HANDLE ftHandle, uint8 *controllerStatus)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->GetStatus(ftHandle, controllerStatus);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->GetStatus(ftHandle, controllerStatus);
+    LATENCY_add(LATENCY_STATUS, start, 0);
+    TRACE_add(TRACE_STATUS, start, ftHandle, status, *controllerStatus);
+    return status;
+}
+
+FT_STATUS HAL_reset(FT_HANDLE ftHandle)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->Reset(ftHandle);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->Reset(ftHandle);
+    LATENCY_add(LATENCY_RESET, start, 0);
+    TRACE_add(TRACE_RESET, start, ftHandle, status, 0);
+    return status;
+}
+
+FT_STATUS HAL_gpioOpen(DWORD locid, FT_HANDLE *pHandle)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->GpioOpen(locid, pHandle);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->GpioOpen(locid, pHandle);
+    LATENCY_add(LATENCY_GPIO_OPEN, start, 0);
+    return status;
+}
+
+FT_STATUS HAL_gpioClose(FT_HANDLE ftHandle)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->GpioClose(ftHandle);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->GpioClose(ftHandle);
+    LATENCY_add(LATENCY_GPIO_CLOSE, start, 0);
+    return status;
+}
+
+FT_STATUS HAL_gpioSetTrigger(FT_HANDLE ftHandle, GPIO_Port port, GPIO_Trigger trigger)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->GpioSetTrigger(ftHandle, port, trigger);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->GpioSetTrigger(ftHandle, port, trigger);
+    LATENCY_add(LATENCY_GPIO_TRIGGER, start, 0);
+    return status;
+}
+
+FT_STATUS HAL_gpioGetTriggerStatus(FT_HANDLE ftHandle, GPIO_Port port, uint16 *queueSize)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->GpioGetTriggerStatus(ftHandle, port, queueSize);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->GpioGetTriggerStatus(ftHandle, port, queueSize);
+    LATENCY_add(LATENCY_GPIO_STATUS, start, 0);
+    return status;
+}
+
+FT_STATUS HAL_gpioReadTriggerQueue(FT_HANDLE ftHandle, GPIO_Port port, GPIO_Trigger *events, uint16 readSize,
+        uint16 *sizeofRead)
+{
+    if (!hal_isProbed())
+    {
+        return gi2c_backend->GpioReadTriggerQueue(ftHandle, port, events, readSize, sizeofRead);
+    }
+
+    uint64 start = FT_getTimeNs();
+    FT_STATUS status = gi2c_backend->GpioReadTriggerQueue(ftHandle, port, events, readSize, sizeofRead);
+    LATENCY_add(LATENCY_GPIO_QUEUE, start, 0);
+    return status;
+}
@@ -0,0 +1,101 @@
+/******************************************************************************
+ * @file    hal.h
+ *          Hardware abstraction of FT4222H I2C master, all USB calls of fti2c
+ *          go through the selected backend.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <ftd2xx.h>
+#include <libft4222.h>
+
+#define HAL_EMU_ENV             "FTI2C_EMU"     //!< Environment variable to use emulator with a config.
+
+//!@typedef stI2cBackend
+//!         FT4222H I2C master backend, same syntax as libft4222.
+typedef struct stI2cBackend
+{
+    const char *Name;                                           //!< Backend name
+    int (*ListBus)(FT_DEVICE_LIST_INFO_NODE *devInfo, int max); //!< Get "FT4222 A" interfaces, return count.
+    FT_STATUS (*Open)(DWORD locid, FT_HANDLE *pHandle);         //!< Open by location ID
+    FT_STATUS (*Close)(FT_HANDLE ftHandle);                     //!< Un-initial and close
+    FT_STATUS (*Init)(FT_HANDLE ftHandle, uint32 kbps);         //!< FT4222_I2CMaster_Init
+    FT_STATUS (*GetVersion)(FT_HANDLE ftHandle, FT4222_Version *pVersion);
+    FT_STATUS (*GetMaxTransferSize)(FT_HANDLE ftHandle, uint16 *pMaxSize);
+    FT_STATUS (*ReadEx)(FT_HANDLE ftHandle, uint16 deviceAddress, uint8 flag, uint8 *buffer, uint16 bufferSize,
+            uint16 *sizeTransferred);
+    FT_STATUS (*WriteEx)(FT_HANDLE ftHandle, uint16 deviceAddress, uint8 flag, uint8 *buffer, uint16 bufferSize,
+            uint16 *sizeTransferred);
+    FT_STATUS (*GetStatus)(FT_HANDLE ftHandle, uint8 *controllerStatus);
+    FT_STATUS (*Reset)(FT_HANDLE ftHandle);
+    FT_STATUS (*GpioOpen)(DWORD locid, FT_HANDLE *pHandle);     //!< Open GPIO interface of the bus of locid
+    FT_STATUS (*GpioClose)(FT_HANDLE ftHandle);
+    FT_STATUS (*GpioSetTrigger)(FT_HANDLE ftHandle, GPIO_Port port, GPIO_Trigger trigger);
+    FT_STATUS (*GpioGetTriggerStatus)(FT_HANDLE ftHandle, GPIO_Port port, uint16 *queueSize);
+    FT_STATUS (*GpioReadTriggerQueue)(FT_HANDLE ftHandle, GPIO_Port port, GPIO_Trigger *events, uint16 readSize,
+            uint16 *sizeofRead);
+} stI2cBackend;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef FTI2C_NO_FT4222
+extern const stI2cBackend HAL_FT4222;
+#endif
+extern const stI2cBackend HAL_EMU;
+
+FT_STATUS HAL_useEmulator(const char *config);
+
+void HAL_useFromEnv(void);
+
+const stI2cBackend *HAL_getBackend(void);
+
+int HAL_listBus(FT_DEVICE_LIST_INFO_NODE *devInfo, int max);
+
+FT_STATUS HAL_open(DWORD locid, FT_HANDLE *pHandle);
+
+FT_STATUS HAL_close(FT_HANDLE ftHandle);
+
+FT_STATUS HAL_init(FT_HANDLE ftHandle, uint32 kbps);
+
+FT_STATUS HAL_getVersion(FT_HANDLE ftHandle, FT4222_Version *pVersion);
+
+FT_STATUS HAL_getMaxTransferSize(FT_HANDLE ftHandle, uint16 *pMaxSize);
+
+FT_STATUS HAL_readEx(FT_HANDLE ftHandle, uint16 deviceAddress, uint8 flag, uint8 *buffer, uint16 bufferSize,
+        uint16 *sizeTransferred);
+
+FT_STATUS HAL_writeEx(FT_HANDLE ftHandle, uint16 deviceAddress, uint8 flag, uint8 *buffer, uint16 bufferSize,
+        uint16 *sizeTransferred);
+
+FT_STATUS HAL_getStatus(FT_HANDLE ftHandle, uint8 *controllerStatus);
+
+FT_STATUS HAL_reset(FT_HANDLE ftHandle);
+
+FT_STATUS HAL_gpioOpen(DWORD locid, FT_HANDLE *pHandle);
+
+FT_STATUS HAL_gpioClose(FT_HANDLE ftHandle);
+
+FT_STATUS HAL_gpioSetTrigger(FT_HANDLE ftHandle, GPIO_Port port, GPIO_Trigger trigger);
+
+FT_STATUS HAL_gpioGetTriggerStatus(FT_HANDLE ftHandle, GPIO_Port port, uint16 *queueSize);
+
+FT_STATUS HAL_gpioReadTriggerQueue(FT_HANDLE ftHandle, GPIO_Port port, GPIO_Trigger *events, uint16 readSize,
+        uint16 *sizeofRead);
+
+//Emulator configuration, see hal_emu.c for the syntax.
+FT_STATUS EMU_config(const char *config);
+
+const char *EMU_getConfig(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_H_ */
@@ -0,0 +1,824 @@
+/******************************************************************************
+ * @file    hal_emu.c
+ *          Emulated FT4222H I2C master backend, for test and benchmark
+ *          without hardware.
+ *
+ *          Config is a list of "key=value" separated by ',', e.g.
+ *          "bus=2,latency=125,eeprom=0x50:32768:64:2,regs=0x68:256"
+ *            bus=[Count]           Emulated FT4222 I2C bus count. Default is 1.
+ *            latency=[us]          USB round trip of each call. Default is 125.
+ *            bustime=[0|1]         Add I2C bus time of the bytes at --freq. Default is 1.
+ *            max=[Size]            Max transfer size of ReadEx/WriteEx. Default is 512.
+ *            busy=[Polls]          GetStatus reports busy for Polls times after a transfer. Default is 0.
+ *            twr=[us]              EEPROM write cycle time, NACK until done. Default is 5000.
+ *            nack=[Percent]        Random address NACK of transactions to a present slave. Default is 0.
+ *            arb=[Percent]         Random arbitration lost of transactions. Default is 0.
+ *            eeprom=[Addr]:[Size][:Page][:AddrSize]
+ *                                  24Cxx EEPROM slave, page default 8, address size default
+ *                                  1 for size <= 2048 (block bits in slave address) or 2.
+ *            regs=[Addr]:[Size][:AddrSize]
+ *                                  Register file slave, auto increment. Address size default 1.
+ *            gpio=[Port]:[PeriodUs]
+ *                                  Square wave on a GPIO port as a data ready line, falling
+ *                                  edge at half period and rising edge at the end of each
+ *                                  period, counted from the trigger set. Default is none.
+ *          Each bus has its own copy of all slaves. Empty config is
+ *          "eeprom=0x50:256:8,regs=0x68:256".
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "hal.h"
+
+#define EMU_BUS_MAX             16          //!< Max emulated bus
+#define EMU_SLAVE_MAX           16          //!< Max emulated slave on a bus
+#define EMU_CONFIG_DEFAULT      "eeprom=0x50:256:8,regs=0x68:256"
+#define EMU_LOCID_BASE          0x1000      //!< Location ID of emulated bus 0
+#define EMU_GPIO_QUEUE          64          //!< Trigger queue size, older edges are dropped.
+
+#define EMU_STATUS_IDLE         0x20        //!< Controller idle
+#define EMU_STATUS_BUSY         0x41        //!< Controller and bus busy
+#define EMU_STATUS_ERROR        0x02        //!< Error bit of a failed transaction
+#define EMU_STATUS_ADDR_NACK    0x26        //!< Idle + error + address NACK
+#define EMU_STATUS_ARB_LOST     0x32        //!< Idle + error + arbitration lost
+#define EMU_FAULT_SEED          0x2545F491  //!< Fault injection starts the same way on each config.
+
+//!@enum    EMU_TYPE
+//!         Emulated slave type.
+typedef enum EMU_TYPE
+{
+    EMU_EEPROM = 0,             //!< 24Cxx EEPROM, page write and write cycle
+    EMU_REGS,                   //!< Register file, no write cycle
+} EMU_TYPE;
+
+//!@typedef stEmuSlave
+//!         Emulated slave config.
+typedef struct stEmuSlave
+{
+    EMU_TYPE Type;              //!< Slave type
+    uint8 Addr;                 //!< 7-bit slave address
+    uint8 Span;                 //!< Slave address count, 24C04/08/16 use 2/4/8.
+    uint8 AddrSize;             //!< Memory address size in bytes
+    uint32 Size;                //!< Memory size in bytes
+    uint32 PageSize;            //!< Page size, EEPROM only
+} stEmuSlave;
+
+//!@typedef stEmuDevice
+//!         Emulated slave state on a bus.
+typedef struct stEmuDevice
+{
+    const stEmuSlave *Slave;    //!< Slave config
+    uint8 *Mem;                 //!< Memory
+    uint32 Ptr;                 //!< Memory pointer
+    double BusyUntilMs;         //!< EEPROM write cycle end time
+} stEmuDevice;
+
+//!@typedef stEmuBus
+//!         Emulated FT4222 I2C master.
+typedef struct stEmuBus
+{
+    DWORD LocId;                //!< Location ID
+    _Bool Opened;               //!< Opened by HAL_open
+    uint32 Kbps;                //!< I2C frequency
+    uint8 Status;               //!< Controller status of last transfer
+    uint32 BusyLeft;            //!< GetStatus calls left to report busy
+    stEmuDevice Dev[EMU_SLAVE_MAX];
+    stEmuDevice *Cur;           //!< Slave of current transaction, NULL if none
+    uint8 Block;                //!< Slave address offset of current transaction
+    uint8 PtrBytes;             //!< Memory address bytes received in current write
+    _Bool DataWritten;          //!< Data written in current transaction
+    uint32 FaultSeed;           //!< Random state of fault injection
+} stEmuBus;
+
+//!@typedef stEmuGpio
+//!         Emulated GPIO interface of a bus.
+typedef struct stEmuGpio
+{
+    _Bool Opened;               //!< Opened by HAL_gpioOpen
+    uint8 Trigger[4];           //!< GPIO_Trigger of each port, 0 if not set.
+    double ArmMs[4];            //!< Time the trigger is set
+    uint32 Taken[4];            //!< Edges read out of the trigger queue
+} stEmuGpio;
+
+//!@typedef stEmuConfig
+//!         Emulator config.
+typedef struct stEmuConfig
+{
+    char Text[256];             //!< Config string
+    uint32 BusCount;
+    uint32 LatencyUs;
+    _Bool BusTime;
+    uint16 MaxTransfer;
+    uint32 BusyPolls;
+    uint32 WriteCycleUs;
+    uint32 NackPercent;         //!< Random address NACK rate
+    uint32 ArbPercent;          //!< Random arbitration lost rate
+    int GpioPort;               //!< Port of the square wave, -1 if none.
+    uint32 GpioPeriodUs;        //!< Period of the square wave
+    stEmuSlave Slave[EMU_SLAVE_MAX];
+    int SlaveCount;
+} stEmuConfig;
+
+static stEmuConfig gemu_config =
+{
+{ 0 } };
+static stEmuBus gemu_bus[EMU_BUS_MAX];
+static stEmuGpio gemu_gpio[EMU_BUS_MAX];
+static _Bool gemu_ready = 0;
+
+static double emu_getTimeMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+//Emulate USB round trip and I2C bus time of a transfer.
+static void emu_delay(stEmuBus *bus, uint32 bytes)
+{
+    uint64 ns = (uint64) gemu_config.LatencyUs * 1000;
+
+    if (gemu_config.BusTime && (bus->Kbps > 0))
+    {
+        //9 clocks per byte, plus the address byte.
+        ns += (uint64) (bytes + 1) * 9 * 1000000 / bus->Kbps;
+    }
+    if (ns > 0)
+    {
+        struct timespec ts =
+        { ns / 1000000000, ns % 1000000000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+//Free memory of all emulated bus.
+static void emu_free(void)
+{
+    for (int b = 0; b < EMU_BUS_MAX; b++)
+    {
+        for (int s = 0; s < EMU_SLAVE_MAX; s++)
+        {
+            free(gemu_bus[b].Dev[s].Mem);
+        }
+    }
+    memset(gemu_bus, 0, sizeof(gemu_bus));
+    memset(gemu_gpio, 0, sizeof(gemu_gpio));
+    gemu_ready = 0;
+}
+
+//Parse "Addr:Size:Opt1:Opt2" of a slave.
+static FT_STATUS emu_parseSlave(EMU_TYPE type, char *value)
+{
+    uint32 field[4] =
+    { 0 };
+    int count = 0;
+    char *save = NULL;
+
+    if (gemu_config.SlaveCount >= EMU_SLAVE_MAX)
+    {
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+
+    for (char *tok = strtok_r(value, ":", &save); (tok != NULL) && (count < 4); tok = strtok_r(NULL, ":", &save))
+    {
+        field[count++] = strtoul(tok, NULL, 0);
+    }
+    if ((count < 2) || (field[0] >= 0x80) || (field[1] == 0))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+
+    stEmuSlave *slave = &gemu_config.Slave[gemu_config.SlaveCount++];
+    slave->Type = type;
+    slave->Addr = field[0];
+    slave->Size = field[1];
+    slave->Span = 1;
+
+    if (type == EMU_EEPROM)
+    {
+        slave->PageSize = (count > 2 && field[2] > 0) ? field[2] : 8;
+        slave->AddrSize = (count > 3) ? field[3] : ((slave->Size <= 2048) ? 1 : 2);
+        if (slave->AddrSize == 1 && slave->Size > 256)
+        {
+            slave->Span = (slave->Size + 255) / 256;
+            slave->Addr &= ~(slave->Span - 1);
+        }
+    }
+    else
+    {
+        slave->AddrSize = (count > 2) ? field[2] : 1;
+    }
+
+    if ((slave->AddrSize != 1) && (slave->AddrSize != 2))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+    return FT_OK;
+}
+
+//Find the slave responding to an address, NULL if NACK.
+static stEmuDevice *emu_findDevice(stEmuBus *bus, uint16 addr, uint8 *block)
+{
+    double now = emu_getTimeMs();
+
+    for (int i = 0; i < gemu_config.SlaveCount; i++)
+    {
+        stEmuDevice *dev = &bus->Dev[i];
+        if ((addr >= dev->Slave->Addr) && (addr < dev->Slave->Addr + dev->Slave->Span))
+        {
+            if (now < dev->BusyUntilMs)
+            {
+                return NULL;
+            }
+            *block = addr - dev->Slave->Addr;
+            return dev;
+        }
+    }
+    return NULL;
+}
+
+//Pseudo random 0~99 of fault injection, xorshift32 per bus so parallel buses don't share it.
+static uint32 emu_getFault(stEmuBus *bus)
+{
+    bus->FaultSeed ^= bus->FaultSeed << 13;
+    bus->FaultSeed ^= bus->FaultSeed >> 17;
+    bus->FaultSeed ^= bus->FaultSeed << 5;
+    return bus->FaultSeed % 100;
+}
+
+//Start a transaction if flag has START, return 0 if address NACK or arbitration lost.
+static _Bool emu_start(stEmuBus *bus, uint16 addr, uint8 flag)
+{
+    uint8 fail = 0;
+
+    bus->BusyLeft = gemu_config.BusyPolls;
+
+    if ((flag != NONE) && (flag & START))
+    {
+        //A repeated start continues the transaction, an error of it stays until the next START or reset.
+        if (((flag & Repeated_START) == Repeated_START) && (bus->Status & EMU_STATUS_ERROR))
+        {
+            bus->Cur = NULL;
+            return 0;
+        }
+
+        bus->Cur = emu_findDevice(bus, addr, &bus->Block);
+        bus->PtrBytes = 0;
+        bus->DataWritten = 0;
+
+        //Injected faults, the transaction is dropped as a real slave or master would.
+        if ((gemu_config.ArbPercent > 0) && (emu_getFault(bus) < gemu_config.ArbPercent))
+        {
+            fail = EMU_STATUS_ARB_LOST;
+        }
+        else if ((bus->Cur != NULL) && (gemu_config.NackPercent > 0) && (emu_getFault(bus) < gemu_config.NackPercent))
+        {
+            fail = EMU_STATUS_ADDR_NACK;
+        }
+        bus->Cur = (fail != 0) ? NULL : bus->Cur;
+    }
+
+    if (bus->Cur == NULL)
+    {
+        bus->Status = (fail != 0) ? fail : EMU_STATUS_ADDR_NACK;
+        return 0;
+    }
+    bus->Status = EMU_STATUS_IDLE;
+    return 1;
+}
+
+//End a transaction if flag has STOP, EEPROM starts write cycle.
+static void emu_stop(stEmuBus *bus, uint8 flag)
+{
+    if ((flag == NONE) || !(flag & STOP) || (bus->Cur == NULL))
+    {
+        return;
+    }
+    if ((bus->Cur->Slave->Type == EMU_EEPROM) && bus->DataWritten)
+    {
+        bus->Cur->BusyUntilMs = emu_getTimeMs() + gemu_config.WriteCycleUs / 1000.0;
+    }
+    bus->Cur = NULL;
+}
+
+static stEmuBus *emu_getBus(FT_HANDLE ftHandle)
+{
+    stEmuBus *bus = (stEmuBus*) ftHandle;
+
+    if ((bus < &gemu_bus[0]) || (bus >= &gemu_bus[EMU_BUS_MAX]) || !bus->Opened)
+    {
+        return NULL;
+    }
+    return bus;
+}
+
+/*!@brief Config emulator, all emulated memory is reset.
+ *
+ * @param config    Config string, NULL or "" for default.
+ * @return          FT_OK or FT_INVALID_PARAMETER
+ */
+FT_STATUS EMU_config(const char *config)
+{
+    char text[256];
+    char *save = NULL;
+    FT_STATUS ret = FT_OK;
+
+    emu_free();
+    memset(&gemu_config, 0, sizeof(gemu_config));
+    gemu_config.BusCount = 1;
+    gemu_config.LatencyUs = 125;
+    gemu_config.BusTime = 1;
+    gemu_config.MaxTransfer = 512;
+    gemu_config.WriteCycleUs = 5000;
+    gemu_config.GpioPort = -1;
+
+    if (config == NULL)
+    {
+        config = "";
+    }
+    snprintf(gemu_config.Text, sizeof(gemu_config.Text), "%s", config);
+    snprintf(text, sizeof(text), "%s", (config[0] != 0) ? config : EMU_CONFIG_DEFAULT);
+
+    for (char *tok = strtok_r(text, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+    {
+        char *value = strchr(tok, '=');
+        if (value == NULL)
+        {
+            ret = FT_INVALID_PARAMETER;
+            break;
+        }
+        *value++ = 0;
+
+        if (strcmp(tok, "bus") == 0)
+        {
+            gemu_config.BusCount = strtoul(value, NULL, 0);
+        }
+        else if (strcmp(tok, "latency") == 0)
+        {
+            gemu_config.LatencyUs = strtoul(value, NULL, 0);
+        }
+        else if (strcmp(tok, "bustime") == 0)
+        {
+            gemu_config.BusTime = strtoul(value, NULL, 0) != 0;
+        }
+        else if (strcmp(tok, "max") == 0)
+        {
+            gemu_config.MaxTransfer = strtoul(value, NULL, 0);
+        }
+        else if (strcmp(tok, "busy") == 0)
+        {
+            gemu_config.BusyPolls = strtoul(value, NULL, 0);
+        }
+        else if (strcmp(tok, "twr") == 0)
+        {
+            gemu_config.WriteCycleUs = strtoul(value, NULL, 0);
+        }
+        else if (strcmp(tok, "nack") == 0)
+        {
+            gemu_config.NackPercent = strtoul(value, NULL, 0);
+        }
+        else if (strcmp(tok, "arb") == 0)
+        {
+            gemu_config.ArbPercent = strtoul(value, NULL, 0);
+        }
+        else if (strcmp(tok, "gpio") == 0)
+        {
+            char *period = strchr(value, ':');
+            gemu_config.GpioPort = strtoul(value, NULL, 0);
+            gemu_config.GpioPeriodUs = (period != NULL) ? strtoul(period + 1, NULL, 0) : 0;
+            if ((gemu_config.GpioPort > GPIO_PORT3) || (gemu_config.GpioPeriodUs == 0))
+            {
+                ret = FT_INVALID_PARAMETER;
+            }
+        }
+        else if (strcmp(tok, "eeprom") == 0)
+        {
+            ret = emu_parseSlave(EMU_EEPROM, value);
+        }
+        else if (strcmp(tok, "regs") == 0)
+        {
+            ret = emu_parseSlave(EMU_REGS, value);
+        }
+        else
+        {
+            ret = FT_INVALID_PARAMETER;
+        }
+
+        if (ret != FT_OK)
+        {
+            break;
+        }
+    }
+
+    if ((gemu_config.BusCount == 0) || (gemu_config.BusCount > EMU_BUS_MAX) || (gemu_config.MaxTransfer == 0)
+            || (gemu_config.NackPercent > 100) || (gemu_config.ArbPercent > 100))
+    {
+        ret = FT_INVALID_PARAMETER;
+    }
+    if (ret != FT_OK)
+    {
+        printf("\e[31mERROR: Invalid emulator config [%s]\e[0m\n", config);
+        return ret;
+    }
+
+    //Create bus and slaves
+    for (int b = 0; b < gemu_config.BusCount; b++)
+    {
+        gemu_bus[b].LocId = EMU_LOCID_BASE + b;
+        gemu_bus[b].Status = EMU_STATUS_IDLE;
+        gemu_bus[b].FaultSeed = EMU_FAULT_SEED + b;
+        for (int s = 0; s < gemu_config.SlaveCount; s++)
+        {
+            const stEmuSlave *slave = &gemu_config.Slave[s];
+            gemu_bus[b].Dev[s].Slave = slave;
+            gemu_bus[b].Dev[s].Mem = (uint8*) malloc(slave->Size);
+            if (gemu_bus[b].Dev[s].Mem == NULL)
+            {
+                emu_free();
+                return FT_INSUFFICIENT_RESOURCES;
+            }
+            memset(gemu_bus[b].Dev[s].Mem, (slave->Type == EMU_EEPROM) ? 0xFF : 0x00, slave->Size);
+        }
+    }
+
+    gemu_ready = 1;
+    return FT_OK;
+}
+
+const char *EMU_getConfig(void)
+{
+    return gemu_config.Text;
+}
+
+static int emu_listBus(FT_DEVICE_LIST_INFO_NODE *devInfo, int max)
+{
+    int count = 0;
+
+    if (!gemu_ready && (EMU_config(NULL) != FT_OK))
+    {
+        return 0;
+    }
+
+    for (int i = 0; (i < gemu_config.BusCount) && (count < max); i++)
+    {
+        memset(&devInfo[count], 0, sizeof(FT_DEVICE_LIST_INFO_NODE));
+        devInfo[count].Flags = 0x2;
+        devInfo[count].Type = FT_DEVICE_4222H_0;
+        devInfo[count].ID = 0x0403601C;
+        devInfo[count].LocId = gemu_bus[i].LocId;
+        snprintf(devInfo[count].SerialNumber, sizeof(devInfo[count].SerialNumber), "EMU%04d", i);
+        snprintf(devInfo[count].Description, sizeof(devInfo[count].Description), "FT4222 A");
+        devInfo[count].ftHandle = gemu_bus[i].Opened ? &gemu_bus[i] : NULL;
+        count++;
+    }
+    return count;
+}
+
+static FT_STATUS emu_open(DWORD locid, FT_HANDLE *pHandle)
+{
+    if (!gemu_ready && (EMU_config(NULL) != FT_OK))
+    {
+        return FT_DEVICE_NOT_FOUND;
+    }
+
+    for (int i = 0; i < gemu_config.BusCount; i++)
+    {
+        if (gemu_bus[i].LocId == locid)
+        {
+            if (gemu_bus[i].Opened)
+            {
+                return FT_DEVICE_NOT_OPENED;
+            }
+            gemu_bus[i].Opened = 1;
+            gemu_bus[i].Kbps = 0;
+            *pHandle = &gemu_bus[i];
+            return FT_OK;
+        }
+    }
+    return FT_DEVICE_NOT_FOUND;
+}
+
+static FT_STATUS emu_close(FT_HANDLE ftHandle)
+{
+    stEmuBus *bus = emu_getBus(ftHandle);
+
+    if (bus == NULL)
+    {
+        return FT_INVALID_HANDLE;
+    }
+    bus->Opened = 0;
+    bus->Cur = NULL;
+    return FT_OK;
+}
+
+static FT_STATUS emu_init(FT_HANDLE ftHandle, uint32 kbps)
+{
+    stEmuBus *bus = emu_getBus(ftHandle);
+
+    if (bus == NULL)
+    {
+        return FT_INVALID_HANDLE;
+    }
+    if ((kbps < 60) || (kbps > 3400))
+    {
+        return FT4222_CLK_NOT_SUPPORTED;
+    }
+    emu_delay(bus, 0);
+    bus->Kbps = kbps;
+    bus->Status = EMU_STATUS_IDLE;
+    bus->Cur = NULL;
+    return FT_OK;
+}
+
+static FT_STATUS emu_getVersion(FT_HANDLE ftHandle, FT4222_Version *pVersion)
+{
+    if (emu_getBus(ftHandle) == NULL)
+    {
+        return FT_INVALID_HANDLE;
+    }
+    pVersion->chipVersion = 0x42220000;
+    pVersion->dllVersion = 0x00000000;
+    return FT_OK;
+}
+
+static FT_STATUS emu_getMaxTransferSize(FT_HANDLE ftHandle, uint16 *pMaxSize)
+{
+    if (emu_getBus(ftHandle) == NULL)
+    {
+        return FT_INVALID_HANDLE;
+    }
+    *pMaxSize = gemu_config.MaxTransfer;
+    return FT_OK;
+}
+
+static FT_STATUS emu_readEx(FT_HANDLE ftHandle, uint16 deviceAddress, uint8 flag, uint8 *buffer, uint16 bufferSize,
+        uint16 *sizeTransferred)
+{
+    stEmuBus *bus = emu_getBus(ftHandle);
+
+    if (bus == NULL)
+    {
+        return FT_INVALID_HANDLE;
+    }
+    if (bufferSize > gemu_config.MaxTransfer)
+    {
+        return FT4222_EXCEEDED_MAX_TRANSFER_SIZE;
+    }
+
+    emu_delay(bus, bufferSize);
+    *sizeTransferred = 0;
+
+    if (!emu_start(bus, deviceAddress, flag))
+    {
+        return FT_OK;
+    }
+
+    stEmuDevice *dev = bus->Cur;
+    for (int i = 0; i < bufferSize; i++)
+    {
+        buffer[i] = dev->Mem[dev->Ptr];
+        dev->Ptr = (dev->Ptr + 1) % dev->Slave->Size;
+    }
+    *sizeTransferred = bufferSize;
+
+    emu_stop(bus, flag);
+    return FT_OK;
+}
+
+static FT_STATUS emu_writeEx(FT_HANDLE ftHandle, uint16 deviceAddress, uint8 flag, uint8 *buffer, uint16 bufferSize,
+        uint16 *sizeTransferred)
+{
+    stEmuBus *bus = emu_getBus(ftHandle);
+
+    if (bus == NULL)
+    {
+        return FT_INVALID_HANDLE;
+    }
+    if (bufferSize > gemu_config.MaxTransfer)
+    {
+        return FT4222_EXCEEDED_MAX_TRANSFER_SIZE;
+    }
+
+    emu_delay(bus, bufferSize);
+    *sizeTransferred = 0;
+
+    if (!emu_start(bus, deviceAddress, flag))
+    {
+        return FT_OK;
+    }
+
+    stEmuDevice *dev = bus->Cur;
+    const stEmuSlave *slave = dev->Slave;
+    for (int i = 0; i < bufferSize; i++)
+    {
+        //Memory address bytes first, MSB first.
+        if (bus->PtrBytes < slave->AddrSize)
+        {
+            dev->Ptr = (bus->PtrBytes == 0) ? buffer[i] : ((dev->Ptr << 8) | buffer[i]);
+            bus->PtrBytes++;
+            if (bus->PtrBytes == slave->AddrSize)
+            {
+                dev->Ptr = ((uint32) bus->Block << 8 | dev->Ptr) % slave->Size;
+            }
+            continue;
+        }
+
+        dev->Mem[dev->Ptr] = buffer[i];
+        bus->DataWritten = 1;
+
+        //EEPROM page write rolls over within the page.
+        if (slave->Type == EMU_EEPROM)
+        {
+            uint32 base = dev->Ptr - dev->Ptr % slave->PageSize;
+            dev->Ptr = base + (dev->Ptr + 1 - base) % slave->PageSize;
+        }
+        else
+        {
+            dev->Ptr = (dev->Ptr + 1) % slave->Size;
+        }
+    }
+    *sizeTransferred = bufferSize;
+
+    emu_stop(bus, flag);
+    return FT_OK;
+}
+
+static FT_STATUS emu_getStatus(FT_HANDLE ftHandle, uint8 *controllerStatus)
+{
+    stEmuBus *bus = emu_getBus(ftHandle);
+
+    if (bus == NULL)
+    {
+        return FT_INVALID_HANDLE;
+    }
+
+    emu_delay(bus, 0);
+    if (bus->BusyLeft > 0)
+    {
+        bus->BusyLeft--;
+        *controllerStatus = EMU_STATUS_BUSY;
+    }
+    else
+    {
+        *controllerStatus = bus->Status;
+    }
+    return FT_OK;
+}
+
+static FT_STATUS emu_reset(FT_HANDLE ftHandle)
+{
+    stEmuBus *bus = emu_getBus(ftHandle);
+
+    if (bus == NULL)
+    {
+        return FT_INVALID_HANDLE;
+    }
+
+    emu_delay(bus, 0);
+    bus->Status = EMU_STATUS_IDLE;
+    bus->BusyLeft = 0;
+    bus->Cur = NULL;
+    return FT_OK;
+}
+
+static stEmuGpio *emu_getGpio(FT_HANDLE ftHandle)
+{
+    stEmuGpio *gpio = (stEmuGpio*) ftHandle;
+
+    if ((gpio < &gemu_gpio[0]) || (gpio >= &gemu_gpio[EMU_BUS_MAX]) || !gpio->Opened)
+    {
+        return NULL;
+    }
+    return gpio;
+}
+
+//Edges of the square wave matching the trigger of a port, since the trigger is set.
+static uint32 emu_getEdges(stEmuGpio *gpio, GPIO_Port port)
+{
+    uint32 period = gemu_config.GpioPeriodUs;
+
+    if ((port != gemu_config.GpioPort) || (gpio->Trigger[port] == 0))
+    {
+        return 0;
+    }
+
+    double us = (emu_getTimeMs() - gpio->ArmMs[port]) * 1000;
+    uint32 rising = us / period;
+    uint32 falling = (us >= period / 2.0) ? (uint32) ((us - period / 2.0) / period) + 1 : 0;
+    return ((gpio->Trigger[port] & GPIO_TRIGGER_RISING) ? rising : 0)
+            + ((gpio->Trigger[port] & GPIO_TRIGGER_FALLING) ? falling : 0);
+}
+
+//GPIO interface of the bus of locid, all ports input.
+static FT_STATUS emu_gpioOpen(DWORD locid, FT_HANDLE *pHandle)
+{
+    for (int i = 0; gemu_ready && (i < gemu_config.BusCount); i++)
+    {
+        if (gemu_bus[i].LocId == locid)
+        {
+            if (gemu_gpio[i].Opened)
+            {
+                return FT_DEVICE_NOT_OPENED;
+            }
+            memset(&gemu_gpio[i], 0, sizeof(stEmuGpio));
+            gemu_gpio[i].Opened = 1;
+            *pHandle = &gemu_gpio[i];
+            emu_delay(&gemu_bus[i], 0);
+            return FT_OK;
+        }
+    }
+    return FT_DEVICE_NOT_FOUND;
+}
+
+static FT_STATUS emu_gpioClose(FT_HANDLE ftHandle)
+{
+    stEmuGpio *gpio = emu_getGpio(ftHandle);
+
+    if (gpio == NULL)
+    {
+        return FT_INVALID_HANDLE;
+    }
+    gpio->Opened = 0;
+    return FT_OK;
+}
+
+//Level triggers are not emulated.
+static FT_STATUS emu_gpioSetTrigger(FT_HANDLE ftHandle, GPIO_Port port, GPIO_Trigger trigger)
+{
+    stEmuGpio *gpio = emu_getGpio(ftHandle);
+
+    if (gpio == NULL)
+    {
+        return FT_INVALID_HANDLE;
+    }
+    if ((port > GPIO_PORT3) || (trigger & ~(GPIO_TRIGGER_RISING | GPIO_TRIGGER_FALLING)))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+    emu_delay(&gemu_bus[gpio - gemu_gpio], 0);
+    gpio->Trigger[port] = trigger;
+    gpio->ArmMs[port] = emu_getTimeMs();
+    gpio->Taken[port] = 0;
+    return FT_OK;
+}
+
+static FT_STATUS emu_gpioGetTriggerStatus(FT_HANDLE ftHandle, GPIO_Port port, uint16 *queueSize)
+{
+    stEmuGpio *gpio = emu_getGpio(ftHandle);
+
+    if ((gpio == NULL) || (port > GPIO_PORT3))
+    {
+        return (gpio == NULL) ? FT_INVALID_HANDLE : FT_INVALID_PARAMETER;
+    }
+    emu_delay(&gemu_bus[gpio - gemu_gpio], 0);
+
+    uint32 edges = emu_getEdges(gpio, port);
+    if (edges - gpio->Taken[port] > EMU_GPIO_QUEUE)
+    {
+        gpio->Taken[port] = edges - EMU_GPIO_QUEUE;
+    }
+    *queueSize = edges - gpio->Taken[port];
+    return FT_OK;
+}
+
+static FT_STATUS emu_gpioReadTriggerQueue(FT_HANDLE ftHandle, GPIO_Port port, GPIO_Trigger *events,
+        uint16 readSize, uint16 *sizeofRead)
+{
+    uint16 queued = 0;
+    FT_STATUS ret = emu_gpioGetTriggerStatus(ftHandle, port, &queued);
+
+    if (ret != FT_OK)
+    {
+        return ret;
+    }
+
+    stEmuGpio *gpio = (stEmuGpio*) ftHandle;
+    uint8 trigger = gpio->Trigger[port];
+    for (*sizeofRead = 0; (*sizeofRead < readSize) && (*sizeofRead < queued); (*sizeofRead)++)
+    {
+        //With both edges, falling edge of each period comes first.
+        uint32 index = gpio->Taken[port]++;
+        if (trigger == (GPIO_TRIGGER_RISING | GPIO_TRIGGER_FALLING))
+        {
+            events[*sizeofRead] = (index % 2 == 0) ? GPIO_TRIGGER_FALLING : GPIO_TRIGGER_RISING;
+        }
+        else
+        {
+            events[*sizeofRead] = (GPIO_Trigger) trigger;
+        }
+    }
+    return FT_OK;
+}
+
+const stI2cBackend HAL_EMU =
+{ "emu", emu_listBus, emu_open, emu_close, emu_init, emu_getVersion, emu_getMaxTransferSize, emu_readEx, emu_writeEx,
+        emu_getStatus, emu_reset, emu_gpioOpen, emu_gpioClose, emu_gpioSetTrigger, emu_gpioGetTriggerStatus,
+        emu_gpioReadTriggerQueue };
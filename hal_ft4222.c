@@ -0,0 +1,147 @@
+/******************************************************************************
+ * @file    hal_ft4222.c
+ *          FT4222H I2C master backend with libft4222.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hal.h"
+
+//Get all "FT4222 A" interfaces, interface A is the I2C master in mode 0.
+static int ft4222_listBus(FT_DEVICE_LIST_INFO_NODE *I2cDevInfo, int max)
+{
+    FT_STATUS ftStatus;
+    FT_DEVICE_LIST_INFO_NODE *devInfo;
+    DWORD numDevs = 0;
+    int numI2cDevs = 0;
+
+    // Create the device information list
+    ftStatus = FT_CreateDeviceInfoList(&numDevs);
+
+    if ((ftStatus == FT_OK) && (numDevs > 0))
+    {
+        // allocate storage for list based on numDevs
+        devInfo = (FT_DEVICE_LIST_INFO_NODE*) malloc(sizeof(FT_DEVICE_LIST_INFO_NODE) * numDevs);
+        if (devInfo == NULL)
+        {
+            return 0;
+        }
+        // get the device information list
+        ftStatus = FT_GetDeviceInfoList(devInfo, &numDevs);
+        if (ftStatus == FT_OK)
+        {
+            for (int i = 0; (i < numDevs) && (numI2cDevs < max); i++)
+            {
+                if (strcmp(devInfo[i].Description, "FT4222 A") == 0)
+                {
+                    //Copy device info
+                    memcpy(&I2cDevInfo[numI2cDevs], &devInfo[i], sizeof(FT_DEVICE_LIST_INFO_NODE));
+                    numI2cDevs++;
+                }
+            }
+        }
+        free(devInfo);
+    }
+
+    return numI2cDevs;
+}
+
+static FT_STATUS ft4222_open(DWORD locid, FT_HANDLE *pHandle)
+{
+    return FT_OpenEx((void*) (uintptr_t) locid, FT_OPEN_BY_LOCATION, pHandle);
+}
+
+static FT_STATUS ft4222_close(FT_HANDLE ftHandle)
+{
+    FT4222_UnInitialize(ftHandle);
+    return FT_Close(ftHandle);
+}
+
+static FT_STATUS ft4222_init(FT_HANDLE ftHandle, uint32 kbps)
+{
+    return FT4222_I2CMaster_Init(ftHandle, kbps);
+}
+
+static FT_STATUS ft4222_getVersion(FT_HANDLE ftHandle, FT4222_Version *pVersion)
+{
+    return FT4222_GetVersion(ftHandle, pVersion);
+}
+
+static FT_STATUS ft4222_getMaxTransferSize(FT_HANDLE ftHandle, uint16 *pMaxSize)
+{
+    return FT4222_GetMaxTransferSize(ftHandle, pMaxSize);
+}
+
+static FT_STATUS ft4222_readEx(FT_HANDLE ftHandle, uint16 deviceAddress, uint8 flag, uint8 *buffer,
+        uint16 bufferSize, uint16 *sizeTransferred)
+{
+    return FT4222_I2CMaster_ReadEx(ftHandle, deviceAddress, flag, buffer, bufferSize, sizeTransferred);
+}
+
+static FT_STATUS ft4222_writeEx(FT_HANDLE ftHandle, uint16 deviceAddress, uint8 flag, uint8 *buffer,
+        uint16 bufferSize, uint16 *sizeTransferred)
+{
+    return FT4222_I2CMaster_WriteEx(ftHandle, deviceAddress, flag, buffer, bufferSize, sizeTransferred);
+}
+
+static FT_STATUS ft4222_getStatus(FT_HANDLE ftHandle, uint8 *controllerStatus)
+{
+    return FT4222_I2CMaster_GetStatus(ftHandle, controllerStatus);
+}
+
+static FT_STATUS ft4222_reset(FT_HANDLE ftHandle)
+{
+    return FT4222_I2CMaster_Reset(ftHandle);
+}
+
+//Open "FT4222 B" of the chip, in mode 0 it's the GPIO interface and its location ID follows interface A.
+static FT_STATUS ft4222_gpioOpen(DWORD locid, FT_HANDLE *pHandle)
+{
+    GPIO_Dir dir[4] =
+    { GPIO_INPUT, GPIO_INPUT, GPIO_INPUT, GPIO_INPUT };
+    FT_STATUS ret = FT_OpenEx((void*) (uintptr_t) (locid + 1), FT_OPEN_BY_LOCATION, pHandle);
+
+    if (ret != FT_OK)
+    {
+        return ret;
+    }
+
+    //GPIO2/3 are suspend out and wake up by default, release them as GPIO.
+    ret = FT4222_GPIO_Init(*pHandle, dir);
+    ret = (ret == FT_OK) ? FT4222_SetSuspendOut(*pHandle, 0) : ret;
+    ret = (ret == FT_OK) ? FT4222_SetWakeUpInterrupt(*pHandle, 0) : ret;
+    if (ret != FT_OK)
+    {
+        ft4222_close(*pHandle);
+        *pHandle = NULL;
+    }
+    return ret;
+}
+
+static FT_STATUS ft4222_gpioSetTrigger(FT_HANDLE ftHandle, GPIO_Port port, GPIO_Trigger trigger)
+{
+    return FT4222_GPIO_SetInputTrigger(ftHandle, port, trigger);
+}
+
+static FT_STATUS ft4222_gpioGetTriggerStatus(FT_HANDLE ftHandle, GPIO_Port port, uint16 *queueSize)
+{
+    return FT4222_GPIO_GetTriggerStatus(ftHandle, port, queueSize);
+}
+
+static FT_STATUS ft4222_gpioReadTriggerQueue(FT_HANDLE ftHandle, GPIO_Port port, GPIO_Trigger *events,
+        uint16 readSize, uint16 *sizeofRead)
+{
+    return FT4222_GPIO_ReadTriggerQueue(ftHandle, port, events, readSize, sizeofRead);
+}
+
+const stI2cBackend HAL_FT4222 =
+{ "ft4222", ft4222_listBus, ft4222_open, ft4222_close, ft4222_init, ft4222_getVersion, ft4222_getMaxTransferSize,
+        ft4222_readEx, ft4222_writeEx, ft4222_getStatus, ft4222_reset, ft4222_gpioOpen, ft4222_close,
+        ft4222_gpioSetTrigger, ft4222_gpioGetTriggerStatus, ft4222_gpioReadTriggerQueue };
@@ -0,0 +1,242 @@
+/******************************************************************************
+ * @file    latency.c
+ *          Latency histograms of bridge calls, to see where the time goes,
+ *          e.g. USB round trips of the bridge or the I2C bus itself.
+ *
+ *          Set environment variable FTI2C_LATENCY to enable, each call of the
+ *          HAL is timed by CLOCK_MONOTONIC and counted in the histogram of
+ *          its call type, with bytes moved of reads and writes. Disabled, a
+ *          call costs 1 more branch.
+ *
+ *          Histograms are HDR style, log linear: 32 sub-buckets for each
+ *          power of 2 of ns, so any latency is kept within ~3% with a fixed
+ *          table and no allocation. Counters are atomic, calls of parallel
+ *          threads go to the same histograms.
+ *
+ *          Summary is printed at exit, or any time on SIGUSR1:
+ *              kill -USR1 $(pidof fti2c)
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "ft_i2c.h"
+#include "latency.h"
+
+//!@typedef stLatencyHist
+//!         Histogram of 1 call type.
+typedef struct stLatencyHist
+{
+    atomic_ullong Count;
+    atomic_ullong SumNs;
+    atomic_ullong MaxNs;
+    atomic_ullong MinNs;
+    atomic_ullong Bytes;
+    atomic_uint Bucket[LATENCY_BUCKETS];
+} stLatencyHist;
+
+static const char *glatency_name[LATENCY_CALL_MAX] =
+{ "LIST", "OPEN", "CLOSE", "INIT", "VERSION", "MAXSIZE", "READ", "WRITE", "STATUS", "RESET", "GPIO_OPEN",
+        "GPIO_CLOSE", "GPIO_TRIGGER", "GPIO_STATUS", "GPIO_QUEUE" };
+
+static atomic_bool glatency_enable = 0;
+static uint64 glatency_start = 0;
+static stLatencyHist glatency_hist[LATENCY_CALL_MAX];
+
+//Bucket of a latency, values below 2^LATENCY_SUB_BITS have their own bucket.
+static uint32 latency_getBucket(uint64 ns)
+{
+    if (ns < (1 << LATENCY_SUB_BITS))
+    {
+        return ns;
+    }
+    int exp = 63 - __builtin_clzll(ns);
+    int shift = exp - LATENCY_SUB_BITS;
+    return ((shift + 1) << LATENCY_SUB_BITS) + ((ns >> shift) & ((1 << LATENCY_SUB_BITS) - 1));
+}
+
+//Highest latency of a bucket.
+static uint64 latency_getValue(uint32 bucket)
+{
+    if (bucket < (1 << LATENCY_SUB_BITS))
+    {
+        return bucket;
+    }
+    int shift = (bucket >> LATENCY_SUB_BITS) - 1;
+    uint64 low = (uint64) ((1 << LATENCY_SUB_BITS) + (bucket & ((1 << LATENCY_SUB_BITS) - 1))) << shift;
+    return low + (((uint64) 1 << shift) - 1);
+}
+
+//Latency at a percentile, counts are taken from a snapshot of buckets.
+static uint64 latency_getPercentile(const stLatencyHist *hist, uint64 count, double percentile)
+{
+    uint64 target = (uint64) (count * percentile / 100.0 + 0.5);
+    uint64 seen = 0;
+
+    target = (target < 1) ? 1 : target;
+    for (uint32 i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += atomic_load_explicit(&hist->Bucket[i], memory_order_relaxed);
+        if (seen >= target)
+        {
+            uint64 value = latency_getValue(i);
+            uint64 max = atomic_load_explicit(&hist->MaxNs, memory_order_relaxed);
+            return (value < max) ? value : max;
+        }
+    }
+    return atomic_load_explicit(&hist->MaxNs, memory_order_relaxed);
+}
+
+//SIGUSR1 is taken by this thread only, the summary is printed out of signal context.
+static void *latency_signalThread(void *arg)
+{
+    sigset_t set;
+    int sig = 0;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    for (;;)
+    {
+        if ((sigwait(&set, &sig) == 0) && (sig == SIGUSR1))
+        {
+            LATENCY_print();
+        }
+    }
+    return NULL;
+}
+
+/*!@brief Enable latency histograms if FTI2C_LATENCY is set and not "0".
+ *          Call before any other thread is created, so SIGUSR1 is blocked in all of them.
+ */
+void LATENCY_enableFromEnv(void)
+{
+    const char *env = getenv(LATENCY_ENV);
+    sigset_t set;
+    pthread_t thread;
+
+    if ((env == NULL) || (env[0] == 0) || (strcmp(env, "0") == 0) || LATENCY_isEnabled())
+    {
+        return;
+    }
+
+    LATENCY_reset();
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    if (pthread_create(&thread, NULL, latency_signalThread, NULL) == 0)
+    {
+        pthread_detach(thread);
+    }
+    atomic_store_explicit(&glatency_enable, 1, memory_order_release);
+}
+
+_Bool LATENCY_isEnabled(void)
+{
+    return atomic_load_explicit(&glatency_enable, memory_order_relaxed);
+}
+
+/*!@brief Count a call, nothing is done if disabled.
+ *
+ * @param call      Call type
+ * @param start     FT_getTimeNs() before the call
+ * @param bytes     Bytes moved by the call
+ */
+void LATENCY_add(LATENCY_CALL call, uint64 start, uint32 bytes)
+{
+    if (!LATENCY_isEnabled() || (call >= LATENCY_CALL_MAX))
+    {
+        return;
+    }
+
+    uint64 ns = FT_getTimeNs() - start;
+    stLatencyHist *hist = &glatency_hist[call];
+
+    atomic_fetch_add_explicit(&hist->Bucket[latency_getBucket(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->Count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->SumNs, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->Bytes, bytes, memory_order_relaxed);
+
+    //Min and max only change on a new extreme, the compare and swap loop is rare.
+    uint64 old = atomic_load_explicit(&hist->MaxNs, memory_order_relaxed);
+    while ((ns > old) && !atomic_compare_exchange_weak_explicit(&hist->MaxNs, &old, ns, memory_order_relaxed,
+            memory_order_relaxed))
+    {
+    }
+    old = atomic_load_explicit(&hist->MinNs, memory_order_relaxed);
+    while ((ns < old) && !atomic_compare_exchange_weak_explicit(&hist->MinNs, &old, ns, memory_order_relaxed,
+            memory_order_relaxed))
+    {
+    }
+}
+
+//Clear all histograms, time in bridge calls is compared to the time from here.
+void LATENCY_reset(void)
+{
+    for (int i = 0; i < LATENCY_CALL_MAX; i++)
+    {
+        stLatencyHist *hist = &glatency_hist[i];
+
+        atomic_store(&hist->Count, 0);
+        atomic_store(&hist->SumNs, 0);
+        atomic_store(&hist->MaxNs, 0);
+        atomic_store(&hist->MinNs, UINT64_MAX);
+        atomic_store(&hist->Bytes, 0);
+        for (int j = 0; j < LATENCY_BUCKETS; j++)
+        {
+            atomic_store_explicit(&hist->Bucket[j], 0, memory_order_relaxed);
+        }
+    }
+    glatency_start = FT_getTimeNs();
+}
+
+/*!@brief Print summary of call types used, latency in us, and the share of time in bridge calls.
+ *          Counters keep going while printing, a summary of a running process is close, not exact.
+ */
+void LATENCY_print(void)
+{
+    uint64 calls = 0;
+    uint64 sum = 0;
+    uint64 bytes = 0;
+
+    if (!LATENCY_isEnabled())
+    {
+        return;
+    }
+
+    for (int i = 0; i < LATENCY_CALL_MAX; i++)
+    {
+        const stLatencyHist *hist = &glatency_hist[i];
+        uint64 count = atomic_load(&hist->Count);
+
+        if (count == 0)
+        {
+            continue;
+        }
+        uint64 ns = atomic_load(&hist->SumNs);
+        uint64 moved = atomic_load(&hist->Bytes);
+        calls += count;
+        sum += ns;
+        bytes += moved;
+
+        CLI_PRINT("I2C LATENCY, call=[%s] count=[%llu] bytes=[%llu], min=[%.1f] avg=[%.1f] p50=[%.1f] p90=[%.1f] "
+                "p99=[%.1f] p99.9=[%.1f] max=[%.1f] us\n", glatency_name[i], (unsigned long long) count,
+                (unsigned long long) moved, atomic_load(&hist->MinNs) / 1e3, (double) ns / count / 1e3,
+                latency_getPercentile(hist, count, 50) / 1e3, latency_getPercentile(hist, count, 90) / 1e3,
+                latency_getPercentile(hist, count, 99) / 1e3, latency_getPercentile(hist, count, 99.9) / 1e3,
+                atomic_load(&hist->MaxNs) / 1e3);
+    }
+
+    double wall = (FT_getTimeNs() - glatency_start) / 1e6;
+    CLI_PRINT("I2C LATENCY, calls=[%llu] bytes=[%llu], in calls=[%.3f] of [%.3f] ms, [%.1f]%%\n",
+            (unsigned long long) calls, (unsigned long long) bytes, sum / 1e6, wall,
+            (wall > 0) ? sum / 1e4 / wall : 0);
+}
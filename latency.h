@@ -0,0 +1,59 @@
+/******************************************************************************
+ * @file    latency.h
+ *          Latency histograms of bridge calls, enabled by FTI2C_LATENCY.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include "ft_i2c.h"
+
+#define LATENCY_ENV             "FTI2C_LATENCY" //!< Environment variable to enable latency histograms.
+#define LATENCY_SUB_BITS        5           //!< Sub-buckets per power of 2 are 2^5, ~3% resolution.
+#define LATENCY_BUCKETS         ((64 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) //!< Buckets to cover uint64 ns.
+
+//!@enum    LATENCY_CALL
+//!         Bridge call of a histogram.
+typedef enum LATENCY_CALL
+{
+    LATENCY_LIST = 0,
+    LATENCY_OPEN,
+    LATENCY_CLOSE,
+    LATENCY_INIT,
+    LATENCY_VERSION,
+    LATENCY_MAXSIZE,
+    LATENCY_READ,
+    LATENCY_WRITE,
+    LATENCY_STATUS,
+    LATENCY_RESET,
+    LATENCY_GPIO_OPEN,
+    LATENCY_GPIO_CLOSE,
+    LATENCY_GPIO_TRIGGER,
+    LATENCY_GPIO_STATUS,
+    LATENCY_GPIO_QUEUE,
+    LATENCY_CALL_MAX,
+} LATENCY_CALL;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void LATENCY_enableFromEnv(void);
+
+_Bool LATENCY_isEnabled(void);
+
+void LATENCY_add(LATENCY_CALL call, uint64 start, uint32 bytes);
+
+void LATENCY_reset(void);
+
+void LATENCY_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LATENCY_H_ */
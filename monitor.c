@@ -0,0 +1,294 @@
+/******************************************************************************
+ * @file    monitor.c
+ *          Register monitor, sample registers at a fixed rate.
+ *
+ *          The bus handle is kept open and a set of registers is read once
+ *          every period by RMW_read(), so nearby registers share 1 burst.
+ *          Sample N is due at start + N * period of CLOCK_MONOTONIC and the
+ *          sampler sleeps to that absolute time, delays don't add up.
+ *
+ *          Samples go to a preallocated single producer / single consumer
+ *          ring buffer. A writer thread drains it and formats the output, so
+ *          the sampler never waits on output. When the ring is full the new
+ *          sample is dropped and counted. A period fully passed while a
+ *          sample was still running is skipped and counted as missed.
+ *
+ *          Output is 1 CSV line per sample, time in ms from the first sample
+ *          and 1 value per register:
+ *              time_ms,0x68:0x10,0x68:0x11
+ *              0.000,0x25,0x80
+ *              10.002,0x25,0x81
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "ft_i2c.h"
+#include "rmw.h"
+#include "shadow.h"
+#include "monitor.h"
+
+//!@typedef stMonitorRing
+//!         Sample ring buffer, Head is only written by the sampler, Tail only by the writer.
+typedef struct stMonitorRing
+{
+    double *Time;               //!< Sample time in ms from the first sample
+    uint8 *Value;               //!< Register values, Count per sample
+    int Count;                  //!< Registers per sample
+    const stRmwRead *Reg;       //!< Registers, for the header line
+    FILE *Out;                  //!< Output stream
+    uint32 Written;             //!< Samples written, read when the writer is joined
+    atomic_uint Head;           //!< Samples put
+    atomic_uint Tail;           //!< Samples taken out
+    atomic_bool Done;           //!< Sampler done, drain and exit
+} stMonitorRing;
+
+static volatile sig_atomic_t gmonitor_stop = 0;
+
+static void monitor_onSignal(int sig)
+{
+    gmonitor_stop = 1;
+}
+
+//Sleep to an absolute time of FT_getTimeMs(), return early on a signal.
+static void monitor_sleepUntil(double ms)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t) (ms / 1000);
+    ts.tv_nsec = (long) ((ms - ts.tv_sec * 1000.0) * 1000000);
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    while ((clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) && !gmonitor_stop)
+    {
+    }
+}
+
+//Writer thread, drain the ring to output until the sampler is done.
+static void *monitor_writer(void *arg)
+{
+    stMonitorRing *ring = (stMonitorRing*) arg;
+
+    fprintf(ring->Out, "time_ms");
+    for (int i = 0; i < ring->Count; i++)
+    {
+        fprintf(ring->Out, ",0x%02X:0x%02X", ring->Reg[i].Addr, ring->Reg[i].Reg);
+    }
+    fprintf(ring->Out, "\n");
+
+    for (;;)
+    {
+        uint32 tail = atomic_load_explicit(&ring->Tail, memory_order_relaxed);
+        uint32 head = atomic_load_explicit(&ring->Head, memory_order_acquire);
+
+        if (tail == head)
+        {
+            //Head is loaded again after Done, samples put right before Done are not lost.
+            if (atomic_load_explicit(&ring->Done, memory_order_acquire)
+                    && (atomic_load_explicit(&ring->Head, memory_order_acquire) == tail))
+            {
+                break;
+            }
+            usleep(1000);
+            continue;
+        }
+
+        for (; tail != head; tail++)
+        {
+            uint32 slot = tail & (MONITOR_RING_SIZE - 1);
+            const uint8 *value = &ring->Value[slot * ring->Count];
+
+            fprintf(ring->Out, "%.3f", ring->Time[slot]);
+            for (int i = 0; i < ring->Count; i++)
+            {
+                fprintf(ring->Out, ",0x%02X", value[i]);
+            }
+            fprintf(ring->Out, "\n");
+            ring->Written++;
+        }
+        atomic_store_explicit(&ring->Tail, tail, memory_order_release);
+    }
+    fflush(ring->Out);
+    return NULL;
+}
+
+/*!@brief Sample registers at a fixed rate until count samples are taken, or SIGINT.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param rd        Registers to sample
+ * @param count     Register count
+ * @param reglen    Register address size in bytes, 1 or 2.
+ * @param rate      Sample rate in Hz, 1~MONITOR_RATE_MAX.
+ * @param samples   Samples to take, 0 to run until SIGINT.
+ * @param out       Output stream of samples
+ * @param stat      Pointer to store statistic
+ * @return          FT_OK or error code of the process, sampling stops at the first error.
+ */
+FT_STATUS MONITOR_run(FT_HANDLE ftHandle, const stRmwRead *rd, int count, uint8 reglen, uint32 rate, uint32 samples,
+        FILE *out, stMonitorStat *stat)
+{
+    stMonitorRing ring;
+    struct sigaction sa;
+    struct sigaction old_int;
+    struct sigaction old_term;
+    pthread_t writer;
+    double period = 0;
+    double start = 0;
+    double last = 0;
+    double sum = 0;
+    double sumsq = 0;
+    FT_STATUS status = FT_OK;
+
+    memset(stat, 0, sizeof(stMonitorStat));
+    if ((count <= 0) || (rate == 0) || (rate > MONITOR_RATE_MAX))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+    period = 1000.0 / rate;
+    stat->TargetHz = rate;
+
+    //1. Preallocate ring and a work copy of registers, RMW_read() sets the values.
+    memset(&ring, 0, sizeof(ring));
+    ring.Time = (double*) malloc(sizeof(double) * MONITOR_RING_SIZE);
+    ring.Value = (uint8*) malloc(MONITOR_RING_SIZE * count);
+    stRmwRead *work = (stRmwRead*) malloc(sizeof(stRmwRead) * count);
+    if ((ring.Time == NULL) || (ring.Value == NULL) || (work == NULL))
+    {
+        free(ring.Time);
+        free(ring.Value);
+        free(work);
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+    memcpy(work, rd, sizeof(stRmwRead) * count);
+    ring.Count = count;
+    ring.Reg = rd;
+    ring.Out = out;
+    atomic_init(&ring.Head, 0);
+    atomic_init(&ring.Tail, 0);
+    atomic_init(&ring.Done, 0);
+
+    if (pthread_create(&writer, NULL, monitor_writer, &ring) != 0)
+    {
+        free(ring.Time);
+        free(ring.Value);
+        free(work);
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+
+    //2. Stop on SIGINT/SIGTERM, no SA_RESTART so the sleep returns.
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = monitor_onSignal;
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+    gmonitor_stop = 0;
+
+    //3. Sample at absolute times, skip periods already passed.
+    start = FT_getTimeMs();
+    for (uint32 n = 0; !gmonitor_stop && ((samples == 0) || (stat->Samples < samples)); n++)
+    {
+        double due = start + n * period;
+
+        monitor_sleepUntil(due);
+        if (gmonitor_stop)
+        {
+            break;
+        }
+
+        double now = FT_getTimeMs();
+        double late = now - due;
+
+        //Monitored registers change by themselves, never take them from the cache.
+        if (SHADOW_isEnabled())
+        {
+            SHADOW_invalidate(ftHandle, SHADOW_ADDR_ALL);
+        }
+        status = RMW_read(ftHandle, work, count, reglen, NULL);
+        if (status != FT_OK)
+        {
+            break;
+        }
+
+        stat->Samples++;
+        sum += late;
+        sumsq += late * late;
+        stat->LateMaxMs = (late > stat->LateMaxMs) ? late : stat->LateMaxMs;
+        last = now;
+
+        uint32 head = atomic_load_explicit(&ring.Head, memory_order_relaxed);
+        if (head - atomic_load_explicit(&ring.Tail, memory_order_acquire) >= MONITOR_RING_SIZE)
+        {
+            stat->Dropped++;
+        }
+        else
+        {
+            uint32 slot = head & (MONITOR_RING_SIZE - 1);
+            ring.Time[slot] = now - start;
+            for (int i = 0; i < count; i++)
+            {
+                ring.Value[slot * count + i] = work[i].Value;
+            }
+            atomic_store_explicit(&ring.Head, head + 1, memory_order_release);
+        }
+
+        now = FT_getTimeMs();
+        while (start + (n + 2) * period <= now)
+        {
+            n++;
+            stat->Missed++;
+        }
+    }
+
+    //4. Let the writer drain, then restore signal handlers.
+    atomic_store_explicit(&ring.Done, 1, memory_order_release);
+    pthread_join(writer, NULL);
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+
+    stat->Written = ring.Written;
+    stat->TimeMs = last - start;
+    if (stat->Samples > 0)
+    {
+        double avg = sum / stat->Samples;
+        double var = sumsq / stat->Samples - avg * avg;
+
+        stat->LateAvgMs = avg;
+        stat->JitterMs = (var > 0) ? sqrt(var) : 0;
+    }
+    if ((stat->Samples > 1) && (stat->TimeMs > 0))
+    {
+        stat->RateHz = (stat->Samples - 1) * 1000.0 / stat->TimeMs;
+    }
+
+    free(ring.Time);
+    free(ring.Value);
+    free(work);
+    return status;
+}
+
+//Stop a running MONITOR_run(), as SIGINT does.
+void MONITOR_stop(void)
+{
+    gmonitor_stop = 1;
+}
+
+void MONITOR_printStat(const stMonitorStat *stat)
+{
+    CLI_PRINT("I2C MONITOR, samples=[%u] written=[%u] dropped=[%u] missed=[%u], rate=[%.1f] of [%.0f] Hz, "
+            "late avg=[%.3f] max=[%.3f] ms, jitter=[%.3f] ms\n", stat->Samples, stat->Written, stat->Dropped,
+            stat->Missed, stat->RateHz, stat->TargetHz, stat->LateAvgMs, stat->LateMaxMs, stat->JitterMs);
+}
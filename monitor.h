@@ -0,0 +1,53 @@
+/******************************************************************************
+ * @file    monitor.h
+ *          Register monitor, sample registers at a fixed rate.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef MONITOR_H_
+#define MONITOR_H_
+
+#include <stdio.h>
+
+#include "ft_i2c.h"
+#include "rmw.h"
+
+#define MONITOR_RATE_DEFAULT    100         //!< Default sample rate in Hz.
+#define MONITOR_RATE_MAX        100000      //!< Max sample rate in Hz.
+#define MONITOR_RING_SIZE       4096        //!< Samples buffered for the writer thread, power of 2.
+
+//!@typedef stMonitorStat
+//!         Statistic of a monitor run.
+typedef struct stMonitorStat
+{
+    uint32 Samples;             //!< Samples taken
+    uint32 Written;             //!< Samples written to output
+    uint32 Dropped;             //!< Samples taken but dropped as the ring buffer is full
+    uint32 Missed;              //!< Sample periods skipped as a sample took longer than the period
+    double TargetHz;            //!< Target rate
+    double RateHz;              //!< Achieved rate
+    double TimeMs;              //!< Time from the first to the last sample
+    double LateAvgMs;           //!< Average delay of sample start to its period
+    double LateMaxMs;           //!< Max delay of sample start to its period
+    double JitterMs;            //!< Standard deviation of sample start delay
+} stMonitorStat;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FT_STATUS MONITOR_run(FT_HANDLE ftHandle, const stRmwRead *rd, int count, uint8 reglen, uint32 rate, uint32 samples,
+        FILE *out, stMonitorStat *stat);
+
+void MONITOR_stop(void);
+
+void MONITOR_printStat(const stMonitorStat *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MONITOR_H_ */
@@ -0,0 +1,256 @@
+/******************************************************************************
+ * @file    parallel.c
+ *          fti2c parallel mode, run scripts on many I2C bus at once.
+ *
+ *          Each bus has a worker thread running the script, all bus args in
+ *          the script lines are replaced by the worker's bus. A script path
+ *          with "%d" is a per-bus script, e.g. "board%d.txt".
+ *
+ *          Output of each worker is buffered and printed bus by bus when
+ *          all workers finish, followed by a summary.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cli.h"
+#include "ft_i2c.h"
+#include "script.h"
+#include "coalesce.h"
+#include "parallel.h"
+
+//!@typedef stParallelJob
+//!         Script job of a bus.
+typedef struct stParallelJob
+{
+    int Bus;                    //!< I2C bus of this job
+    char Script[256];           //!< Script path
+    CliCallBack *Handler;       //!< Command handler
+    _Bool KeepGoing;            //!< Continue when a line fails
+    stI2cWait Wait;             //!< Wait policy of the caller
+    stI2cWaitStat WaitStat;     //!< Wait statistic of the worker
+    int Ret;                    //!< Return of SCRIPT_run()
+    double TimeMs;              //!< Run time
+    char *Output;               //!< Buffered output
+    size_t OutputSize;
+    pthread_t Thread;
+    _Bool Started;              //!< Worker thread created
+} stParallelJob;
+
+//Bus of current worker thread, -1 if not a worker.
+static __thread int gparallel_bus = -1;
+
+//Get bus of current parallel worker, -1 if not in parallel mode.
+int PARALLEL_getBus(void)
+{
+    return gparallel_bus;
+}
+
+/*!@brief Parse bus list.
+ *
+ * @param list      "0,1,2", serial numbers, location IDs, or "all" for all enumerated bus.
+ * @param bus       Buffer to store bus numbers, FT_I2C_BUS_MAX at least.
+ * @return          Bus count, or -1 if list is invalid.
+ */
+int PARALLEL_parseBus(const char *list, int *bus)
+{
+    char text[256];
+    char *save = NULL;
+    int count = 0;
+
+    if (strcmp(list, "all") == 0)
+    {
+        FT_DEVICE_LIST_INFO_NODE devInfo[FT_I2C_BUS_MAX];
+        count = FT_listI2cBus(devInfo);
+        for (int i = 0; i < count; i++)
+        {
+            bus[i] = i;
+        }
+        return count;
+    }
+
+    snprintf(text, sizeof(text), "%s", list);
+    for (char *tok = strtok_r(text, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+    {
+        int value = FT_findI2cBus(tok);
+
+        if ((value < 0) || (count >= FT_I2C_BUS_MAX))
+        {
+            return -1;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            if (bus[i] == value)
+            {
+                return -1;
+            }
+        }
+        bus[count++] = value;
+    }
+    return count;
+}
+
+//Script path of a bus, "%d" is replaced by bus number.
+static void parallel_getScript(const char *script, int bus, char *path, size_t size)
+{
+    const char *token = strstr(script, PARALLEL_BUS_TOKEN);
+
+    if (token == NULL)
+    {
+        snprintf(path, size, "%s", script);
+        return;
+    }
+    snprintf(path, size, "%.*s%d%s", (int) (token - script), script, bus, token + strlen(PARALLEL_BUS_TOKEN));
+}
+
+static void *parallel_worker(void *arg)
+{
+    stParallelJob *job = (stParallelJob*) arg;
+    FILE *out = open_memstream(&job->Output, &job->OutputSize);
+
+    gparallel_bus = job->Bus;
+    FT_setOutput(out);
+    FT_setWaitPolicy(&job->Wait);
+    FT_resetWaitStat();
+
+    double start = FT_getTimeMs();
+    job->Ret = SCRIPT_run(job->Script, job->Handler, job->KeepGoing);
+    FT_STATUS status = COALESCE_flush();
+    job->Ret = (job->Ret == 0) ? status : job->Ret;
+    if (COALESCE_isEnabled())
+    {
+        stCoalesceStat coalesce_stat;
+        COALESCE_getStat(&coalesce_stat);
+        COALESCE_printStat(&coalesce_stat);
+    }
+    job->TimeMs = FT_getTimeMs() - start;
+
+    FT_getWaitStat(&job->WaitStat);
+    FT_setOutput(NULL);
+    if (out != NULL)
+    {
+        fclose(out);
+    }
+    return NULL;
+}
+
+/*!@brief Run script on buses at once, one worker thread per bus.
+ *
+ * @param bus       Bus list
+ * @param count     Bus count
+ * @param script    Script path, "%d" in path is replaced by bus number.
+ * @param kbps      I2C frequency to open the buses with
+ * @param handler   Command handler, e.g. command_i2c
+ * @param keepgoing Continue with next line when a command fails.
+ * @param stat      Pointer to store wait statistic of all buses, NULL if not used.
+ * @return          0 if all buses pass, otherwise the return of the first failed bus.
+ */
+int PARALLEL_run(const int *bus, int count, const char *script, uint32 kbps, CliCallBack *handler, _Bool keepgoing,
+        stI2cWaitStat *stat)
+{
+    FT_DEVICE_LIST_INFO_NODE devInfo[FT_I2C_BUS_MAX];
+    stParallelJob *job = NULL;
+    int bus_count = FT_listI2cBus(devInfo);
+    int count_ok = 0;
+    int count_fail = 0;
+    int ret = 0;
+
+    if ((count <= 0) || (strcmp(script, "-") == 0))
+    {
+        CLI_ERROR("ERROR: Parallel mode needs a bus list and a script file.\n");
+        return FT_INVALID_PARAMETER;
+    }
+
+    //Open all buses first, workers only re-use the handles.
+    for (int i = 0; i < count; i++)
+    {
+        FT_HANDLE ftHandle = NULL;
+
+        if (bus[i] >= bus_count)
+        {
+            CLI_ERROR("ERROR: Can't find I2C bus [%d], [%d] bus found.\n", bus[i], bus_count);
+            return FT_DEVICE_NOT_FOUND;
+        }
+        CHECK_FUNC_RET(FT_OK, FT_openI2cBus(bus[i], &ftHandle, kbps));
+    }
+
+    job = (stParallelJob*) calloc(count, sizeof(stParallelJob));
+    CHECK_NULL_PTR(job);
+
+    double start = FT_getTimeMs();
+    for (int i = 0; i < count; i++)
+    {
+        job[i].Bus = bus[i];
+        job[i].Handler = handler;
+        job[i].KeepGoing = keepgoing;
+        job[i].Ret = FT_OTHER_ERROR;
+        FT_getWaitPolicy(&job[i].Wait);
+        parallel_getScript(script, bus[i], job[i].Script, sizeof(job[i].Script));
+        job[i].Started = (pthread_create(&job[i].Thread, NULL, parallel_worker, &job[i]) == 0);
+        if (!job[i].Started)
+        {
+            CLI_ERROR("ERROR: Can't create worker of bus [%d].\n", bus[i]);
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (job[i].Started)
+        {
+            pthread_join(job[i].Thread, NULL);
+        }
+    }
+    double time = FT_getTimeMs() - start;
+
+    //Report bus by bus
+    if (stat != NULL)
+    {
+        memset(stat, 0, sizeof(stI2cWaitStat));
+    }
+    for (int i = 0; i < count; i++)
+    {
+        CLI_PRINT("==== Bus [%d] script [%s] ====\n", job[i].Bus, job[i].Script);
+        if (job[i].Output != NULL)
+        {
+            CLI_PRINT("%s", job[i].Output);
+            free(job[i].Output);
+        }
+
+        if (job[i].Ret == 0)
+        {
+            CLI_PRINT("[Bus %d] OK, %.3f ms\n", job[i].Bus, job[i].TimeMs);
+            count_ok++;
+        }
+        else
+        {
+            CLI_ERROR("[Bus %d] FAIL, return=[%d], %.3f ms\n", job[i].Bus, job[i].Ret, job[i].TimeMs);
+            count_fail++;
+            ret = (ret == 0) ? job[i].Ret : ret;
+        }
+
+        if (stat != NULL)
+        {
+            stat->Calls += job[i].WaitStat.Calls;
+            stat->BusyCalls += job[i].WaitStat.BusyCalls;
+            stat->Polls += job[i].WaitStat.Polls;
+            stat->Sleeps += job[i].WaitStat.Sleeps;
+            stat->Timeouts += job[i].WaitStat.Timeouts;
+            stat->WaitMs += job[i].WaitStat.WaitMs;
+            if (job[i].WaitStat.MaxWaitMs > stat->MaxWaitMs)
+            {
+                stat->MaxWaitMs = job[i].WaitStat.MaxWaitMs;
+            }
+        }
+    }
+
+    CLI_PRINT("Parallel done: buses=[%d] OK=[%d] FAIL=[%d], total=[%.3f] ms\n", count, count_ok, count_fail, time);
+
+    free(job);
+    return ret;
+}
@@ -0,0 +1,25 @@
+/******************************************************************************
+ * @file    parallel.h
+ *          fti2c parallel mode, run scripts on many I2C bus at once.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include "cli.h"
+#include "ft_i2c.h"
+
+#define PARALLEL_BUS_TOKEN      "%d"        //!< Replaced by bus number in script path.
+
+int PARALLEL_getBus(void);
+
+int PARALLEL_parseBus(const char *list, int *bus);
+
+int PARALLEL_run(const int *bus, int count, const char *script, uint32 kbps, CliCallBack *handler, _Bool keepgoing,
+        stI2cWaitStat *stat);
+
+#endif /* PARALLEL_H_ */
@@ -0,0 +1,607 @@
+/******************************************************************************
+ * @file    regmap.c
+ *          Register map, named devices, registers and fields.
+ *
+ *          A register map is a text file, one item per line, '#' to the end
+ *          of line is comment:
+ *              device sensor 0x68
+ *              reg CTRL 0x10 1 RW
+ *              field MODE 7:4
+ *              field EN 0
+ *              reg STATUS 0x30 1 RO volatile
+ *              reg THRESH 0x12 2
+ *
+ *          device [Name] [Addr]
+ *              Registers after this line belong to the device.
+ *          reg [Name] [Reg] [Width] [RW|RO|WO] [volatile]
+ *              Width in bytes defaults to 1, value is MSB first. Access
+ *              defaults to RW. Volatile registers are never cached.
+ *          field [Name] [Msb][:Lsb]
+ *              Bit field of the register above, Lsb defaults to Msb.
+ *
+ *          The map is parsed once into arrays. Names are found by 1 hash
+ *          table, registers by address through a page index of each device,
+ *          so lookups of script and daemon lines don't depend on map size.
+ *          The map is read only after loading, shared by all threads.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "ft_i2c.h"
+#include "shadow.h"
+#include "regmap.h"
+
+#define REGMAP_PAGE_COUNT       (0x10000 / REGMAP_PAGE_SIZE)
+
+//!@enum    REGMAP_KIND
+//!         Kind of a name in hash table.
+typedef enum REGMAP_KIND
+{
+    REGMAP_DEVICE = 0,
+    REGMAP_REG,
+    REGMAP_FIELD,
+} REGMAP_KIND;
+
+//!@typedef stRegDevice
+//!         Device of a register map.
+typedef struct stRegDevice
+{
+    char Name[REGMAP_NAME_MAX];
+    uint8 Addr;                 //!< 7-bit slave address
+    int32 *Page[REGMAP_PAGE_COUNT]; //!< Register index + 1 of each address, 0 if not defined.
+} stRegDevice;
+
+//!@typedef stRegName
+//!         Hash table entry, a name in scope of its owner.
+typedef struct stRegName
+{
+    const char *Name;           //!< NULL if the entry is free.
+    REGMAP_KIND Kind;
+    int Owner;                  //!< Device of a register, register of a field, -1 for a device.
+    int Index;                  //!< Index of the device, register or field
+} stRegName;
+
+static char gregmap_path[256] =
+{ 0 };
+static stRegDevice *gregmap_dev = NULL;
+static int gregmap_dev_count = 0;
+static stRegDef *gregmap_reg = NULL;
+static int gregmap_reg_count = 0;
+static stRegField *gregmap_field = NULL;
+static int gregmap_field_count = 0;
+static stRegName *gregmap_hash = NULL;
+static uint32 gregmap_hash_size = 0;
+static int gregmap_addr[FT_I2C_ADDR_MAX] =      //!< Device index + 1 of each address, 0 if not defined.
+{ 0 };
+
+//FNV-1a hash of a name in scope of its owner.
+static uint32 regmap_hash(REGMAP_KIND kind, int owner, const char *name)
+{
+    uint32 h = 2166136261u ^ (kind * 0x9E3779B1u) ^ ((owner + 1) * 0x85EBCA6Bu);
+
+    while (*name != 0)
+    {
+        h = (h ^ (uint8) *name++) * 16777619u;
+    }
+    return h;
+}
+
+//Find a name, return its index or -1.
+static int regmap_find(REGMAP_KIND kind, int owner, const char *name, size_t len)
+{
+    char key[REGMAP_NAME_MAX];
+
+    if ((gregmap_hash_size == 0) || (len >= REGMAP_NAME_MAX))
+    {
+        return -1;
+    }
+    memcpy(key, name, len);
+    key[len] = 0;
+
+    for (uint32 i = regmap_hash(kind, owner, key) & (gregmap_hash_size - 1); gregmap_hash[i].Name != NULL;
+            i = (i + 1) & (gregmap_hash_size - 1))
+    {
+        stRegName *e = &gregmap_hash[i];
+        if ((e->Kind == kind) && (e->Owner == owner) && (strcmp(e->Name, key) == 0))
+        {
+            return e->Index;
+        }
+    }
+    return -1;
+}
+
+//Add a name to hash table, return FT_INVALID_PARAMETER if it's defined already.
+static FT_STATUS regmap_addName(REGMAP_KIND kind, int owner, const char *name, int index)
+{
+    uint32 i = regmap_hash(kind, owner, name) & (gregmap_hash_size - 1);
+
+    for (; gregmap_hash[i].Name != NULL; i = (i + 1) & (gregmap_hash_size - 1))
+    {
+        stRegName *e = &gregmap_hash[i];
+        if ((e->Kind == kind) && (e->Owner == owner) && (strcmp(e->Name, name) == 0))
+        {
+            CLI_ERROR("ERROR: Register map name [%s] is defined twice.\n", name);
+            return FT_INVALID_PARAMETER;
+        }
+    }
+    gregmap_hash[i].Name = name;
+    gregmap_hash[i].Kind = kind;
+    gregmap_hash[i].Owner = owner;
+    gregmap_hash[i].Index = index;
+    return FT_OK;
+}
+
+//Build hash table of all names, when all items are parsed.
+static FT_STATUS regmap_buildHash(void)
+{
+    uint32 count = gregmap_dev_count + gregmap_reg_count + gregmap_field_count;
+
+    for (gregmap_hash_size = 16; gregmap_hash_size < count * 2; gregmap_hash_size *= 2)
+    {
+    }
+    gregmap_hash = (stRegName*) calloc(gregmap_hash_size, sizeof(stRegName));
+    if (gregmap_hash == NULL)
+    {
+        gregmap_hash_size = 0;
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+
+    for (int i = 0; i < gregmap_dev_count; i++)
+    {
+        CHECK_FUNC_RET(FT_OK, regmap_addName(REGMAP_DEVICE, -1, gregmap_dev[i].Name, i));
+    }
+    for (int i = 0; i < gregmap_reg_count; i++)
+    {
+        stRegDef *def = &gregmap_reg[i];
+        CHECK_FUNC_RET(FT_OK, regmap_addName(REGMAP_REG, gregmap_addr[def->Addr] - 1, def->Name, i));
+        for (int f = 0; f < def->FieldCount; f++)
+        {
+            CHECK_FUNC_RET(FT_OK, regmap_addName(REGMAP_FIELD, i, gregmap_field[def->Field + f].Name, def->Field + f));
+        }
+    }
+    return FT_OK;
+}
+
+//Check name syntax, letters, digits and '_', not start with a digit.
+static _Bool regmap_isName(const char *name)
+{
+    if ((name == NULL) || (strlen(name) >= REGMAP_NAME_MAX) || !(isalpha((uint8) name[0]) || (name[0] == '_')))
+    {
+        return 0;
+    }
+    for (; *name != 0; name++)
+    {
+        if (!isalnum((uint8) *name) && (*name != '_'))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//Parse a number token, return 0 if it's not a number.
+static _Bool regmap_getNumber(const char *token, uint32 *value)
+{
+    char *tail = NULL;
+
+    if ((token == NULL) || !isdigit((uint8) token[0]))
+    {
+        return 0;
+    }
+    *value = strtoul(token, &tail, 0);
+    return (*tail == 0);
+}
+
+//Grow an array to hold count + 1 items.
+static void *regmap_grow(void *array, int count, size_t size)
+{
+    return ((count & (count - 1)) == 0) ? realloc(array, size * (count ? count * 2 : 1)) : array;
+}
+
+//Add a device line: device [Name] [Addr]
+static FT_STATUS regmap_addDevice(char **tok, int count)
+{
+    uint32 addr = 0;
+
+    if ((count != 3) || !regmap_isName(tok[1]) || !regmap_getNumber(tok[2], &addr) || (addr >= FT_I2C_ADDR_MAX))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+    if (gregmap_addr[addr] != 0)
+    {
+        CLI_ERROR("ERROR: Device address [0x%02X] is defined twice.\n", addr);
+        return FT_INVALID_PARAMETER;
+    }
+
+    stRegDevice *dev = (stRegDevice*) regmap_grow(gregmap_dev, gregmap_dev_count, sizeof(stRegDevice));
+    CHECK_NULL_PTR(dev);
+    gregmap_dev = dev;
+    dev = &gregmap_dev[gregmap_dev_count++];
+    memset(dev, 0, sizeof(stRegDevice));
+    snprintf(dev->Name, sizeof(dev->Name), "%s", tok[1]);
+    dev->Addr = addr;
+    gregmap_addr[addr] = gregmap_dev_count;
+    return FT_OK;
+}
+
+//Add a register line: reg [Name] [Reg] [Width] [RW|RO|WO] [volatile]
+static FT_STATUS regmap_addReg(char **tok, int count)
+{
+    stRegDef def;
+    uint32 reg = 0;
+    uint32 width = 1;
+    _Bool has_width = 0;
+
+    if ((gregmap_dev_count == 0) || (count < 3) || !regmap_isName(tok[1]) || !regmap_getNumber(tok[2], &reg)
+            || (reg > 0xFFFF))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+
+    memset(&def, 0, sizeof(def));
+    for (int i = 3; i < count; i++)
+    {
+        if (!has_width && regmap_getNumber(tok[i], &width))
+        {
+            has_width = 1;
+        }
+        else if (strcasecmp(tok[i], "RW") == 0)
+        {
+            def.Access = REG_RW;
+        }
+        else if (strcasecmp(tok[i], "RO") == 0)
+        {
+            def.Access = REG_RO;
+        }
+        else if (strcasecmp(tok[i], "WO") == 0)
+        {
+            def.Access = REG_WO;
+        }
+        else if (strcasecmp(tok[i], "volatile") == 0)
+        {
+            def.Volatile = 1;
+        }
+        else
+        {
+            return FT_INVALID_PARAMETER;
+        }
+    }
+    if ((width == 0) || (width > REGMAP_WIDTH_MAX) || (reg + width > 0x10000))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+
+    stRegDevice *dev = &gregmap_dev[gregmap_dev_count - 1];
+    snprintf(def.Name, sizeof(def.Name), "%s", tok[1]);
+    def.Addr = dev->Addr;
+    def.Reg = reg;
+    def.Width = width;
+    def.Field = gregmap_field_count;
+
+    //Index every byte of the register, so overlapped registers are found.
+    for (uint32 r = reg; r < reg + width; r++)
+    {
+        int32 **page = &dev->Page[r / REGMAP_PAGE_SIZE];
+        if (*page == NULL)
+        {
+            *page = (int32*) calloc(REGMAP_PAGE_SIZE, sizeof(int32));
+            CHECK_NULL_PTR(*page);
+        }
+        if ((*page)[r % REGMAP_PAGE_SIZE] != 0)
+        {
+            CLI_ERROR("ERROR: Register [%s] overlaps register [0x%02X].\n", def.Name, r);
+            return FT_INVALID_PARAMETER;
+        }
+        (*page)[r % REGMAP_PAGE_SIZE] = gregmap_reg_count + 1;
+    }
+
+    stRegDef *array = (stRegDef*) regmap_grow(gregmap_reg, gregmap_reg_count, sizeof(stRegDef));
+    CHECK_NULL_PTR(array);
+    gregmap_reg = array;
+    gregmap_reg[gregmap_reg_count++] = def;
+
+    if (def.Volatile && (SHADOW_setVolatile(def.Addr, def.Reg, def.Width, 1) != FT_OK))
+    {
+        CLI_WARNING("[Warning]Too many volatile ranges, register [%s] may be cached.\n", def.Name);
+    }
+    return FT_OK;
+}
+
+//Add a field line: field [Name] [Msb][:Lsb]
+static FT_STATUS regmap_addField(char **tok, int count)
+{
+    char *tail = NULL;
+
+    if ((gregmap_reg_count == 0) || (count != 3) || !regmap_isName(tok[1]) || !isdigit((uint8) tok[2][0]))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+
+    stRegDef *def = &gregmap_reg[gregmap_reg_count - 1];
+    uint32 msb = strtoul(tok[2], &tail, 0);
+    uint32 lsb = (*tail == ':') ? strtoul(tail + 1, &tail, 0) : msb;
+    if ((*tail != 0) || (msb < lsb) || (msb >= def->Width * 8u))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+
+    stRegField *array = (stRegField*) regmap_grow(gregmap_field, gregmap_field_count, sizeof(stRegField));
+    CHECK_NULL_PTR(array);
+    gregmap_field = array;
+
+    stRegField *field = &gregmap_field[gregmap_field_count++];
+    snprintf(field->Name, sizeof(field->Name), "%s", tok[1]);
+    field->Msb = msb;
+    field->Lsb = lsb;
+    def->FieldCount++;
+    return FT_OK;
+}
+
+/*!@brief Load a register map file, the map loaded before is dropped.
+ *
+ * @param path      Register map file
+ * @return          FT_OK, or FT_INVALID_PARAMETER if the file can't be read or has a syntax error.
+ */
+FT_STATUS REGMAP_load(const char *path)
+{
+    char line[256];
+    int line_no = 0;
+    FT_STATUS ret = FT_OK;
+    FILE *fp = fopen(path, "r");
+
+    REGMAP_free();
+    if (fp == NULL)
+    {
+        CLI_ERROR("ERROR: Can't open register map [%s]\n", path);
+        return FT_INVALID_PARAMETER;
+    }
+
+    while ((ret == FT_OK) && (fgets(line, sizeof(line), fp) != NULL))
+    {
+        char *tok[8];
+        char *save = NULL;
+        int count = 0;
+
+        line_no++;
+        line[strcspn(line, "#\r\n")] = 0;
+        for (char *t = strtok_r(line, " \t", &save); t != NULL; t = strtok_r(NULL, " \t", &save))
+        {
+            if (count < 8)
+            {
+                tok[count] = t;
+            }
+            count++;
+        }
+        if (count == 0)
+        {
+            continue;
+        }
+
+        if (count > 8)
+        {
+            ret = FT_INVALID_PARAMETER;
+        }
+        else if (strcmp(tok[0], "device") == 0)
+        {
+            ret = regmap_addDevice(tok, count);
+        }
+        else if (strcmp(tok[0], "reg") == 0)
+        {
+            ret = regmap_addReg(tok, count);
+        }
+        else if (strcmp(tok[0], "field") == 0)
+        {
+            ret = regmap_addField(tok, count);
+        }
+        else
+        {
+            ret = FT_INVALID_PARAMETER;
+        }
+        if (ret != FT_OK)
+        {
+            CLI_ERROR("ERROR: Register map [%s] line [%d], invalid [%s].\n", path, line_no, tok[0]);
+        }
+    }
+    fclose(fp);
+
+    ret = (ret == FT_OK) ? regmap_buildHash() : ret;
+    if (ret != FT_OK)
+    {
+        REGMAP_free();
+        return ret;
+    }
+    snprintf(gregmap_path, sizeof(gregmap_path), "%s", path);
+    return FT_OK;
+}
+
+//Load register map of environment variable FTI2C_REGMAP if it's set.
+FT_STATUS REGMAP_loadFromEnv(void)
+{
+    const char *path = getenv(REGMAP_ENV);
+
+    return (path != NULL) ? REGMAP_load(path) : FT_OK;
+}
+
+void REGMAP_free(void)
+{
+    //Volatile registers of the map are cached again.
+    for (int i = 0; i < gregmap_reg_count; i++)
+    {
+        if (gregmap_reg[i].Volatile)
+        {
+            SHADOW_clearVolatile(gregmap_reg[i].Addr, gregmap_reg[i].Reg, gregmap_reg[i].Width);
+        }
+    }
+    for (int i = 0; i < gregmap_dev_count; i++)
+    {
+        for (int p = 0; p < REGMAP_PAGE_COUNT; p++)
+        {
+            free(gregmap_dev[i].Page[p]);
+        }
+    }
+    free(gregmap_dev);
+    free(gregmap_reg);
+    free(gregmap_field);
+    free(gregmap_hash);
+    gregmap_dev = NULL;
+    gregmap_reg = NULL;
+    gregmap_field = NULL;
+    gregmap_hash = NULL;
+    gregmap_dev_count = 0;
+    gregmap_reg_count = 0;
+    gregmap_field_count = 0;
+    gregmap_hash_size = 0;
+    gregmap_path[0] = 0;
+    memset(gregmap_addr, 0, sizeof(gregmap_addr));
+}
+
+_Bool REGMAP_isLoaded(void)
+{
+    return (gregmap_path[0] != 0);
+}
+
+//Path of the loaded map, "" if not loaded.
+const char *REGMAP_getPath(void)
+{
+    return gregmap_path;
+}
+
+//Find slave address of a device name, -1 if not found.
+int REGMAP_findDevice(const char *name)
+{
+    int index = regmap_find(REGMAP_DEVICE, -1, name, strlen(name));
+
+    return (index >= 0) ? gregmap_dev[index].Addr : -1;
+}
+
+/*!@brief Find a register by name.
+ *
+ * @param addr      7-bit slave address of the device
+ * @param name      "REG", or "REG.FIELD" for a field.
+ * @param field     Pointer to store the field, NULL if name has no field.
+ * @return          Register, or NULL if not found.
+ */
+const stRegDef *REGMAP_findReg(uint8 addr, const char *name, const stRegField **field)
+{
+    const char *dot = strchr(name, '.');
+    int dev = (addr < FT_I2C_ADDR_MAX) ? gregmap_addr[addr] - 1 : -1;
+
+    *field = NULL;
+    if (dev < 0)
+    {
+        return NULL;
+    }
+
+    int reg = regmap_find(REGMAP_REG, dev, name, (dot != NULL) ? (size_t) (dot - name) : strlen(name));
+    if ((reg < 0) || (dot == NULL))
+    {
+        return (reg < 0) ? NULL : &gregmap_reg[reg];
+    }
+
+    int index = regmap_find(REGMAP_FIELD, reg, dot + 1, strlen(dot + 1));
+    if (index < 0)
+    {
+        return NULL;
+    }
+    *field = &gregmap_field[index];
+    return &gregmap_reg[reg];
+}
+
+//Get register starting at an address, NULL if not defined.
+const stRegDef *REGMAP_getReg(uint8 addr, uint16 reg)
+{
+    int dev = (addr < FT_I2C_ADDR_MAX) ? gregmap_addr[addr] - 1 : -1;
+
+    if (dev < 0)
+    {
+        return NULL;
+    }
+
+    int32 *page = gregmap_dev[dev].Page[reg / REGMAP_PAGE_SIZE];
+    int index = (page != NULL) ? page[reg % REGMAP_PAGE_SIZE] - 1 : -1;
+    return ((index >= 0) && (gregmap_reg[index].Reg == reg)) ? &gregmap_reg[index] : NULL;
+}
+
+const stRegField *REGMAP_getField(const stRegDef *def, int index)
+{
+    return ((index >= 0) && (index < def->FieldCount)) ? &gregmap_field[def->Field + index] : NULL;
+}
+
+uint32 REGMAP_getFieldMask(const stRegField *field)
+{
+    uint32 bits = field->Msb - field->Lsb + 1;
+
+    return ((bits >= 32) ? 0xFFFFFFFF : ((1u << bits) - 1)) << field->Lsb;
+}
+
+//Get register value of Width bytes, MSB first.
+uint32 REGMAP_getValue(const stRegDef *def, const uint8 *buf)
+{
+    uint32 value = 0;
+
+    for (int i = 0; i < def->Width; i++)
+    {
+        value = (value << 8) | buf[i];
+    }
+    return value;
+}
+
+//Set register value to Width bytes, MSB first.
+void REGMAP_setValue(const stRegDef *def, uint32 value, uint8 *buf)
+{
+    for (int i = def->Width - 1; i >= 0; i--)
+    {
+        buf[i] = value & 0xFF;
+        value >>= 8;
+    }
+}
+
+/*!@brief Print registers and fields defined in a block of register data.
+ *
+ * @param addr      7-bit slave address
+ * @param reg       Register of buf[0]
+ * @param buf       Register data
+ * @param len       Bytes of data
+ */
+void REGMAP_print(uint8 addr, uint16 reg, const uint8 *buf, uint32 len)
+{
+    static const char *access[] =
+    { "RW", "RO", "WO" };
+    int dev = (addr < FT_I2C_ADDR_MAX) ? gregmap_addr[addr] - 1 : -1;
+
+    for (uint32 i = 0; (dev >= 0) && (i < len);)
+    {
+        const stRegDef *def = (reg + i <= 0xFFFF) ? REGMAP_getReg(addr, reg + i) : NULL;
+        if ((def == NULL) || (i + def->Width > len))
+        {
+            i++;
+            continue;
+        }
+
+        uint32 value = REGMAP_getValue(def, &buf[i]);
+        CLI_PRINT("%s.%s [0x%02X] = 0x%0*X, %s%s\n", gregmap_dev[dev].Name, def->Name, def->Reg, def->Width * 2, value,
+                access[def->Access], def->Volatile ? " volatile" : "");
+        for (int f = 0; f < def->FieldCount; f++)
+        {
+            const stRegField *field = &gregmap_field[def->Field + f];
+            uint32 data = (value & REGMAP_getFieldMask(field)) >> field->Lsb;
+            if (field->Msb == field->Lsb)
+            {
+                CLI_PRINT("    %s[%u] = 0x%X\n", field->Name, field->Lsb, data);
+            }
+            else
+            {
+                CLI_PRINT("    %s[%u:%u] = 0x%X\n", field->Name, field->Msb, field->Lsb, data);
+            }
+        }
+        i += def->Width;
+    }
+}
@@ -0,0 +1,86 @@
+/******************************************************************************
+ * @file    regmap.h
+ *          Register map, named devices, registers and fields.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef REGMAP_H_
+#define REGMAP_H_
+
+#include "ft_i2c.h"
+
+#define REGMAP_ENV              "FTI2C_REGMAP"  //!< Environment variable of register map file.
+#define REGMAP_NAME_MAX         32          //!< Max name length, including '\0'.
+#define REGMAP_WIDTH_MAX        4           //!< Max register width in bytes.
+#define REGMAP_PAGE_SIZE        256         //!< Registers per index page of a device.
+
+//!@enum    REG_ACCESS
+//!         Access type of a register.
+typedef enum REG_ACCESS
+{
+    REG_RW = 0,                 //!< Read and write
+    REG_RO,                     //!< Read only
+    REG_WO,                     //!< Write only
+} REG_ACCESS;
+
+//!@typedef stRegField
+//!         Bit field of a register, bits of the register value MSB first.
+typedef struct stRegField
+{
+    char Name[REGMAP_NAME_MAX];
+    uint8 Msb;                  //!< Highest bit
+    uint8 Lsb;                  //!< Lowest bit
+} stRegField;
+
+//!@typedef stRegDef
+//!         Register of a device, Width bytes from Reg, MSB first.
+typedef struct stRegDef
+{
+    char Name[REGMAP_NAME_MAX];
+    uint8 Addr;                 //!< 7-bit slave address of the device
+    uint16 Reg;                 //!< Register address
+    uint8 Width;                //!< Register width in bytes
+    REG_ACCESS Access;          //!< Access type
+    _Bool Volatile;             //!< Value changes by itself, never cached.
+    int Field;                  //!< Index of the first field
+    int FieldCount;             //!< Field count
+} stRegDef;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FT_STATUS REGMAP_load(const char *path);
+
+FT_STATUS REGMAP_loadFromEnv(void);
+
+void REGMAP_free(void);
+
+_Bool REGMAP_isLoaded(void);
+
+const char *REGMAP_getPath(void);
+
+int REGMAP_findDevice(const char *name);
+
+const stRegDef *REGMAP_findReg(uint8 addr, const char *name, const stRegField **field);
+
+const stRegDef *REGMAP_getReg(uint8 addr, uint16 reg);
+
+const stRegField *REGMAP_getField(const stRegDef *def, int index);
+
+uint32 REGMAP_getFieldMask(const stRegField *field);
+
+uint32 REGMAP_getValue(const stRegDef *def, const uint8 *buf);
+
+void REGMAP_setValue(const stRegDef *def, uint32 value, uint8 *buf);
+
+void REGMAP_print(uint8 addr, uint16 reg, const uint8 *buf, uint32 len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REGMAP_H_ */
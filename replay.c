@@ -0,0 +1,237 @@
+/******************************************************************************
+ * @file    replay.c
+ *          Replay a trace of bridge calls over 1 open I2C bus, e.g. a known
+ *          good bring-up sequence recorded by --trace, on a new board.
+ *
+ *          Reads, writes, status polls and resets of 1 recorded handle are
+ *          issued again with the recorded address, flag and data. The handle
+ *          is the one of the first read or write, so a trace of 1 bus replays
+ *          as a whole. Open, close and init are done by the caller. A poll that
+ *          saw the controller busy only waits and is skipped, a poll that saw
+ *          it idle is replayed by polling until idle, so the error bits of
+ *          the transaction are checked, e.g. a NACK of a missing slave.
+ *
+ *          Original timing issues each call at its recorded time from the
+ *          first call, on absolute CLOCK_MONOTONIC deadlines. Fast timing
+ *          issues calls back to back for max throughput.
+ *
+ *          A call diverges when its status, transferred bytes or controller
+ *          error bits differ from the recording. With compare, read data must
+ *          also be the same. The record index, time and the first differing
+ *          value are reported.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "ft_i2c.h"
+#include "hal.h"
+#include "trace.h"
+#include "replay.h"
+
+static const char *greplay_op[] =
+{ "", "OPEN", "CLOSE", "INIT", "READ", "WRITE", "STATUS", "RESET" };
+
+static uint64 replay_getTimeNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//Sleep to an absolute time of replay_getTimeNs().
+static void replay_sleepUntil(uint64 ns)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
+
+//Poll the controller until it's idle, for the wait timeout of FT_setWaitPolicy().
+static FT_STATUS replay_waitIdle(FT_HANDLE ftHandle, uint8 *i2cstatus)
+{
+    stI2cWait wait;
+    uint64 timeout = 0;
+
+    FT_getWaitPolicy(&wait);
+    timeout = replay_getTimeNs() + (uint64) wait.TimeoutMs * 1000000;
+    CHECK_FUNC_RET(FT_OK, HAL_getStatus(ftHandle, i2cstatus));
+    while ((I2CM_BUS_BUSY(*i2cstatus) || I2CM_CONTROLLER_BUSY(*i2cstatus)) && (replay_getTimeNs() < timeout))
+    {
+        usleep(REPLAY_POLL_US);
+        CHECK_FUNC_RET(FT_OK, HAL_getStatus(ftHandle, i2cstatus));
+    }
+    return FT_OK;
+}
+
+//Report a divergence, only the first REPLAY_DIVERGE_PRINT are printed.
+static void replay_diverge(stReplayStat *stat, uint32 index, const stTraceRecord *rec, const char *what, uint32 offset,
+        uint32 expect, uint32 actual)
+{
+    if (stat->Diverged == 0)
+    {
+        stat->FirstDiverged = index;
+    }
+    if (stat->Diverged++ < REPLAY_DIVERGE_PRINT)
+    {
+        char at[16] = "";
+
+        if (offset != (uint32) -1)
+        {
+            snprintf(at, sizeof(at), "[%u]", offset);
+        }
+        CLI_ERROR("DIVERGED: record [%u] at [%.3f] ms, %s addr=[0x%02X] size=[%u], %s%s [0x%02X] -> [0x%02X]\n", index,
+                rec->TimeNs / 1e6, greplay_op[rec->Op], rec->Addr, rec->Size, what, at, expect, actual);
+    }
+}
+
+/*!@brief Replay reads, writes, status polls and resets of a trace over 1 open I2C bus.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param trace     Trace of TRACE_load()
+ * @param timing    REPLAY_ORIGINAL or REPLAY_FAST
+ * @param compare   Read data must be the same as recorded
+ * @param keepgoing Continue after a divergence, otherwise stop at the first one.
+ * @param stat      Pointer to store statistic
+ * @return          FT_OK, FT_OTHER_ERROR if replay diverged, FT_INSUFFICIENT_RESOURCES if no memory.
+ */
+FT_STATUS REPLAY_run(FT_HANDLE ftHandle, const stTraceFile *trace, REPLAY_TIMING timing, _Bool compare,
+        _Bool keepgoing, stReplayStat *stat)
+{
+    uint32 handle = (uint32) -1;
+    uint64 base = 0;
+    uint64 first = 0;
+    uint64 last = 0;
+    uint64 start = 0;
+
+    memset(stat, 0, sizeof(stReplayStat));
+    stat->Records = trace->Count;
+    stat->FirstDiverged = -1;
+
+    uint8 *buf = (uint8*) malloc(0x10000);
+    if (buf == NULL)
+    {
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+
+    //1. Handle of the first read or write is replayed.
+    for (uint32 i = 0; (i < trace->Count) && (handle == (uint32) -1); i++)
+    {
+        if ((trace->Record[i].Op == TRACE_READ) || (trace->Record[i].Op == TRACE_WRITE))
+        {
+            handle = trace->Record[i].Handle;
+        }
+    }
+
+    //2. Issue calls in recorded order.
+    start = replay_getTimeNs();
+    for (uint32 i = 0; i < trace->Count; i++)
+    {
+        const stTraceRecord *rec = &trace->Record[i];
+        uint16 done = 0;
+        uint8 i2cstatus = 0;
+        uint32 diverged = stat->Diverged;
+        FT_STATUS status = FT_OK;
+
+        if ((rec->Handle != handle)
+                || ((rec->Op != TRACE_READ) && (rec->Op != TRACE_WRITE) && (rec->Op != TRACE_STATUS)
+                        && (rec->Op != TRACE_RESET))
+                || ((rec->Op == TRACE_STATUS) && (I2CM_BUS_BUSY(rec->Value) || I2CM_CONTROLLER_BUSY(rec->Value))))
+        {
+            stat->Skipped++;
+            continue;
+        }
+
+        if (stat->Replayed == 0)
+        {
+            base = start;
+            first = rec->TimeNs;
+        }
+        if (timing == REPLAY_ORIGINAL)
+        {
+            uint64 due = base + (rec->TimeNs - first);
+            replay_sleepUntil(due);
+            double late = (replay_getTimeNs() - due) / 1e6;
+            stat->LateMaxMs = (late > stat->LateMaxMs) ? late : stat->LateMaxMs;
+        }
+
+        switch (rec->Op)
+        {
+        case TRACE_READ:
+            memset(buf, 0, rec->Size);
+            status = HAL_readEx(ftHandle, rec->Addr, rec->Flag, buf, rec->Size, &done);
+            break;
+        case TRACE_WRITE:
+            memcpy(buf, rec->Data, rec->Size);
+            status = HAL_writeEx(ftHandle, rec->Addr, rec->Flag, buf, rec->Size, &done);
+            break;
+        case TRACE_STATUS:
+            status = replay_waitIdle(ftHandle, &i2cstatus);
+            break;
+        default:
+            status = HAL_reset(ftHandle);
+            break;
+        }
+        stat->Replayed++;
+        last = rec->TimeNs + rec->DurationNs;
+
+        //3. Check result, status and bytes first, then data of a read.
+        if (status != rec->Status)
+        {
+            replay_diverge(stat, i, rec, "status", (uint32) -1, rec->Status, status);
+        }
+        else if ((rec->Op == TRACE_STATUS) && ((i2cstatus & REPLAY_STATUS_ERROR) != (rec->Value & REPLAY_STATUS_ERROR)))
+        {
+            replay_diverge(stat, i, rec, "controller", (uint32) -1, rec->Value, i2cstatus);
+        }
+        else if (((rec->Op == TRACE_READ) || (rec->Op == TRACE_WRITE)) && (done != rec->Done))
+        {
+            replay_diverge(stat, i, rec, "done", (uint32) -1, rec->Done, done);
+        }
+        else if (compare && (rec->Op == TRACE_READ))
+        {
+            stat->Compared += done;
+            if (memcmp(buf, rec->Data, done) != 0)
+            {
+                uint32 k = 0;
+                while (buf[k] == rec->Data[k])
+                {
+                    k++;
+                }
+                replay_diverge(stat, i, rec, "data", k, rec->Data[k], buf[k]);
+            }
+        }
+        if ((stat->Diverged != diverged) && !keepgoing)
+        {
+            break;
+        }
+    }
+
+    stat->TimeMs = (replay_getTimeNs() - start) / 1e6;
+    stat->TraceMs = (last - first) / 1e6;
+    free(buf);
+    return (stat->Diverged == 0) ? FT_OK : FT_OTHER_ERROR;
+}
+
+void REPLAY_printStat(const stReplayStat *stat)
+{
+    CLI_PRINT("I2C REPLAY, records=[%u] replayed=[%u] skipped=[%u] diverged=[%u] compared=[%u] bytes, "
+            "time=[%.3f] of [%.3f] ms, late max=[%.3f] ms\n", stat->Records, stat->Replayed, stat->Skipped,
+            stat->Diverged, stat->Compared, stat->TimeMs, stat->TraceMs, stat->LateMaxMs);
+    if (stat->FirstDiverged >= 0)
+    {
+        CLI_PRINT("I2C REPLAY, first divergence at record [%d]\n", stat->FirstDiverged);
+    }
+}
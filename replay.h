@@ -0,0 +1,56 @@
+/******************************************************************************
+ * @file    replay.h
+ *          Replay a trace of bridge calls over 1 open I2C bus.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include "ft_i2c.h"
+#include "trace.h"
+
+#define REPLAY_DIVERGE_PRINT    16          //!< Divergences printed, more are only counted.
+#define REPLAY_POLL_US          50          //!< Sleep between status polls of a replayed poll
+#define REPLAY_STATUS_ERROR     0x1E        //!< Controller status bits compared: error, address/data NACK, arbitration lost
+
+//!@enum    REPLAY_TIMING
+//!         Pace of replay.
+typedef enum REPLAY_TIMING
+{
+    REPLAY_ORIGINAL = 0,        //!< Each call at its recorded time from the first call
+    REPLAY_FAST,                //!< No delay between calls
+} REPLAY_TIMING;
+
+//!@typedef stReplayStat
+//!         Statistic of a replay.
+typedef struct stReplayStat
+{
+    uint32 Records;             //!< Records in the trace
+    uint32 Replayed;            //!< Calls issued
+    uint32 Skipped;             //!< Records not replayed, other handles, open/close/init, busy polls
+    uint32 Diverged;            //!< Calls with a result other than recorded
+    uint32 Compared;            //!< Read bytes compared to the trace
+    int32 FirstDiverged;        //!< Record index of the first divergence, -1 if none
+    double TimeMs;              //!< Replay time
+    double TraceMs;             //!< Recorded time of the same calls
+    double LateMaxMs;           //!< Max delay of a call to its recorded time, original timing only
+} stReplayStat;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FT_STATUS REPLAY_run(FT_HANDLE ftHandle, const stTraceFile *trace, REPLAY_TIMING timing, _Bool compare,
+        _Bool keepgoing, stReplayStat *stat);
+
+void REPLAY_printStat(const stReplayStat *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REPLAY_H_ */
@@ -0,0 +1,297 @@
+/******************************************************************************
+ * @file    retry.c
+ *          Retry and bus recovery policy of failed I2C transactions.
+ *
+ *          A transaction is 1 complete START ... STOP sequence, e.g. a
+ *          register read or write. When it ends with address NACK, data NACK
+ *          or arbitration lost, the controller is recovered by a reset or a
+ *          full re-init, then the same transaction is issued again after a
+ *          backoff sleep, up to the retry count of the error type. Other
+ *          transactions of the command are not repeated.
+ *
+ *          Policy spec is a list separated by ',', e.g. "addr=5,arb=3,reinit":
+ *            [Count]               Retries of all error types.
+ *            addr=[Count]          Retries of address NACK.
+ *            data=[Count]          Retries of data NACK.
+ *            arb=[Count]           Retries of arbitration lost.
+ *            backoff=[Min][:Max]   Sleep in us before a retry, doubled on each retry. Default is 100:5000.
+ *            reset | reinit        Recover by controller reset, default, or reset and init again.
+ *          Error types not given are not retried, "0" disables retry.
+ *
+ *          Errors, retries, recovered and failed transactions are counted
+ *          per slave address, whether retry is enabled or not.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "ft_i2c.h"
+#include "retry.h"
+
+//Controller status bits of each error, I2CM_*_NACK() of libft4222 also match the error bit alone.
+#define RETRY_STATUS_ADDR_NACK  0x04
+#define RETRY_STATUS_DATA_NACK  0x08
+#define RETRY_STATUS_ARB_LOST   0x10
+
+static const char *RETRY_ERROR_NAME[RETRY_ERROR_COUNT] =
+{ "addr_nack", "data_nack", "arb_lost", "other" };
+
+//Policy and statistic are shared by all threads, like the register cache.
+static pthread_mutex_t gretry_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Bool gretry_enable = 0;
+static stRetryPolicy gretry_policy =
+{
+{ 0 }, RETRY_MIN_US_DEFAULT, RETRY_MAX_US_DEFAULT, RETRY_RESET };
+static stRetryStat gretry_stat;
+
+//Set the retry policy, retry is enabled if any error type has a retry.
+void RETRY_setPolicy(const stRetryPolicy *policy)
+{
+    pthread_mutex_lock(&gretry_lock);
+    gretry_policy = *policy;
+    if (gretry_policy.BackoffMaxUs < gretry_policy.BackoffMinUs)
+    {
+        gretry_policy.BackoffMaxUs = gretry_policy.BackoffMinUs;
+    }
+    gretry_enable = 0;
+    for (int i = 0; i < RETRY_OTHER; i++)
+    {
+        gretry_policy.Count[i] = (gretry_policy.Count[i] > RETRY_COUNT_MAX) ? RETRY_COUNT_MAX : gretry_policy.Count[i];
+        gretry_enable |= (gretry_policy.Count[i] > 0);
+    }
+    pthread_mutex_unlock(&gretry_lock);
+}
+
+void RETRY_getPolicy(stRetryPolicy *policy)
+{
+    pthread_mutex_lock(&gretry_lock);
+    *policy = gretry_policy;
+    pthread_mutex_unlock(&gretry_lock);
+}
+
+/*!@brief Set the retry policy from a spec, see the top of retry.c for the syntax.
+ *          The whole policy is replaced, items not given take the default.
+ *
+ * @param spec      Policy spec, e.g. "addr=5,arb=3,backoff=200:10000,reinit".
+ * @return          FT_OK or FT_INVALID_PARAMETER
+ */
+FT_STATUS RETRY_parsePolicy(const char *spec)
+{
+    stRetryPolicy policy =
+    {
+    { 0 }, RETRY_MIN_US_DEFAULT, RETRY_MAX_US_DEFAULT, RETRY_RESET };
+    char text[256];
+    char *save = NULL;
+
+    snprintf(text, sizeof(text), "%s", spec);
+    for (char *tok = strtok_r(text, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+    {
+        char *value = strchr(tok, '=');
+        char *tail = NULL;
+        _Bool valid = 1;
+
+        if (value != NULL)
+        {
+            *value++ = 0;
+        }
+
+        if ((value == NULL) && (strcmp(tok, "reset") == 0))
+        {
+            policy.Recover = RETRY_RESET;
+        }
+        else if ((value == NULL) && (strcmp(tok, "reinit") == 0))
+        {
+            policy.Recover = RETRY_REINIT;
+        }
+        else if (value == NULL)
+        {
+            uint32 count = strtoul(tok, &tail, 0);
+            valid = (tail != tok) && (*tail == 0);
+            for (int i = 0; i < RETRY_OTHER; i++)
+            {
+                policy.Count[i] = count;
+            }
+        }
+        else if (strcmp(tok, "backoff") == 0)
+        {
+            policy.BackoffMinUs = strtoul(value, &tail, 0);
+            policy.BackoffMaxUs = policy.BackoffMinUs;
+            valid = (tail != value);
+            if (valid && (*tail == ':'))
+            {
+                value = tail + 1;
+                policy.BackoffMaxUs = strtoul(value, &tail, 0);
+                valid = (tail != value);
+            }
+            valid &= (*tail == 0);
+        }
+        else
+        {
+            int type = (strcmp(tok, "addr") == 0) ? RETRY_ADDR_NACK : (strcmp(tok, "data") == 0) ? RETRY_DATA_NACK :
+                       (strcmp(tok, "arb") == 0) ? RETRY_ARB_LOST : -1;
+            if (type >= 0)
+            {
+                policy.Count[type] = strtoul(value, &tail, 0);
+                valid = (tail != value) && (*tail == 0);
+            }
+            valid &= (type >= 0);
+        }
+
+        if (!valid)
+        {
+            CLI_ERROR("ERROR: Invalid retry policy [%s], see retry.c for the syntax.\n", spec);
+            return FT_INVALID_PARAMETER;
+        }
+    }
+
+    RETRY_setPolicy(&policy);
+    return FT_OK;
+}
+
+_Bool RETRY_isEnabled(void)
+{
+    return gretry_enable;
+}
+
+//Get the error type of a controller status with the error bit set.
+RETRY_ERROR RETRY_getError(uint8 i2cstatus)
+{
+    //Arbitration lost first, the NACK bits of a lost transaction are not of the slave.
+    if (i2cstatus & RETRY_STATUS_ARB_LOST)
+    {
+        return RETRY_ARB_LOST;
+    }
+    if (i2cstatus & RETRY_STATUS_ADDR_NACK)
+    {
+        return RETRY_ADDR_NACK;
+    }
+    if (i2cstatus & RETRY_STATUS_DATA_NACK)
+    {
+        return RETRY_DATA_NACK;
+    }
+    return RETRY_OTHER;
+}
+
+/*!@brief Check if a failed transaction is issued again.
+ *
+ * @param i2cstatus Controller status of the failed attempt
+ * @param attempt   Retries done before, 0 for the first attempt.
+ * @param recover   Pointer to store the recovery before the retry
+ * @return          1 to retry, 0 if retries of the error type are used up.
+ */
+_Bool RETRY_isRetry(uint8 i2cstatus, uint32 attempt, RETRY_RECOVER *recover)
+{
+    RETRY_ERROR error = RETRY_getError(i2cstatus);
+
+    pthread_mutex_lock(&gretry_lock);
+    _Bool retry = (error < RETRY_OTHER) && (attempt < gretry_policy.Count[error]);
+    *recover = gretry_policy.Recover;
+    pthread_mutex_unlock(&gretry_lock);
+    return retry;
+}
+
+//Sleep before a retry, BackoffMinUs doubled for each retry done before, up to BackoffMaxUs.
+void RETRY_backoff(uint32 attempt)
+{
+    stRetryPolicy policy;
+
+    RETRY_getPolicy(&policy);
+    uint64 delay = policy.BackoffMinUs;
+    for (uint32 i = 0; (i < attempt) && (delay < policy.BackoffMaxUs); i++)
+    {
+        delay *= 2;
+    }
+    delay = (delay > policy.BackoffMaxUs) ? policy.BackoffMaxUs : delay;
+    if (delay > 0)
+    {
+        usleep(delay);
+    }
+}
+
+/*!@brief Count a failed attempt of a slave.
+ *
+ * @param addr      7-bit slave address
+ * @param i2cstatus Controller status of the failed attempt
+ * @param retry     1 if the transaction is issued again, 0 if it fails.
+ */
+void RETRY_addError(uint16 addr, uint8 i2cstatus, _Bool retry)
+{
+    stRetryAddrStat *stat = &gretry_stat.Addr[addr & (FT_I2C_ADDR_MAX - 1)];
+
+    pthread_mutex_lock(&gretry_lock);
+    stat->Error[RETRY_getError(i2cstatus)]++;
+    if (retry)
+    {
+        stat->Retries++;
+    }
+    else
+    {
+        stat->Failed++;
+    }
+    pthread_mutex_unlock(&gretry_lock);
+}
+
+//Count a transaction of a slave done after 1 or more retries.
+void RETRY_addRecovered(uint16 addr)
+{
+    pthread_mutex_lock(&gretry_lock);
+    gretry_stat.Addr[addr & (FT_I2C_ADDR_MAX - 1)].Recovered++;
+    pthread_mutex_unlock(&gretry_lock);
+}
+
+void RETRY_getStat(stRetryStat *stat)
+{
+    pthread_mutex_lock(&gretry_lock);
+    *stat = gretry_stat;
+    pthread_mutex_unlock(&gretry_lock);
+}
+
+void RETRY_resetStat(void)
+{
+    pthread_mutex_lock(&gretry_lock);
+    memset(&gretry_stat, 0, sizeof(gretry_stat));
+    pthread_mutex_unlock(&gretry_lock);
+}
+
+//Print the total, then 1 line per slave address with a bus error.
+void RETRY_printStat(const stRetryStat *stat)
+{
+    stRetryAddrStat total;
+
+    memset(&total, 0, sizeof(total));
+    for (int a = 0; a < FT_I2C_ADDR_MAX; a++)
+    {
+        for (int i = 0; i < RETRY_ERROR_COUNT; i++)
+        {
+            total.Error[i] += stat->Addr[a].Error[i];
+        }
+        total.Retries += stat->Addr[a].Retries;
+        total.Recovered += stat->Addr[a].Recovered;
+        total.Failed += stat->Addr[a].Failed;
+    }
+    CLI_PRINT("I2C RETRY, errors=[%u] retries=[%u] recovered=[%u] failed=[%u]\n",
+            total.Error[RETRY_ADDR_NACK] + total.Error[RETRY_DATA_NACK] + total.Error[RETRY_ARB_LOST]
+                    + total.Error[RETRY_OTHER], total.Retries, total.Recovered, total.Failed);
+
+    for (int a = 0; a < FT_I2C_ADDR_MAX; a++)
+    {
+        const stRetryAddrStat *addr = &stat->Addr[a];
+        if (addr->Retries + addr->Failed == 0)
+        {
+            continue;
+        }
+        CLI_PRINT("  addr=[0x%02X]", a);
+        for (int i = 0; i < RETRY_ERROR_COUNT; i++)
+        {
+            CLI_PRINT(" %s=[%u]", RETRY_ERROR_NAME[i], addr->Error[i]);
+        }
+        CLI_PRINT(" retries=[%u] recovered=[%u] failed=[%u]\n", addr->Retries, addr->Recovered, addr->Failed);
+    }
+}
@@ -0,0 +1,97 @@
+/******************************************************************************
+ * @file    retry.h
+ *          Retry and bus recovery policy of failed I2C transactions.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef RETRY_H_
+#define RETRY_H_
+
+#include "ft_i2c.h"
+
+#define RETRY_COUNT_MAX         100         //!< Max retries of an error type.
+#define RETRY_MIN_US_DEFAULT    100         //!< Sleep before the first retry.
+#define RETRY_MAX_US_DEFAULT    5000        //!< Max sleep before a retry.
+
+//!@enum    RETRY_ERROR
+//!         Bus error of a failed transaction, by controller status bits.
+typedef enum RETRY_ERROR
+{
+    RETRY_ADDR_NACK = 0,        //!< Slave address NACKed, e.g. EEPROM in write cycle.
+    RETRY_DATA_NACK,            //!< Data byte NACKed
+    RETRY_ARB_LOST,             //!< Arbitration lost to another master
+    RETRY_OTHER,                //!< Error bit only or bus busy timeout, never retried.
+    RETRY_ERROR_COUNT,
+} RETRY_ERROR;
+
+//!@enum    RETRY_RECOVER
+//!         Recovery of the controller before a retry.
+typedef enum RETRY_RECOVER
+{
+    RETRY_RESET = 0,            //!< Reset the controller, as a bus error without retry does.
+    RETRY_REINIT,               //!< Reset and init the master again at the bus frequency.
+} RETRY_RECOVER;
+
+//!@typedef stRetryPolicy
+//!         Retry policy, a transaction is retried up to Count of its error type.
+typedef struct stRetryPolicy
+{
+    uint32 Count[RETRY_OTHER];  //!< Retries of each error type, 0 to fail at once.
+    uint32 BackoffMinUs;        //!< Sleep before the first retry, doubled on each retry
+    uint32 BackoffMaxUs;        //!< Max sleep
+    RETRY_RECOVER Recover;      //!< Recovery before a retry
+} stRetryPolicy;
+
+//!@typedef stRetryAddrStat
+//!         Bus error statistic of a slave address.
+typedef struct stRetryAddrStat
+{
+    uint32 Error[RETRY_ERROR_COUNT];    //!< Failed attempts by error type
+    uint32 Retries;             //!< Attempts issued again
+    uint32 Recovered;           //!< Transactions done after 1 or more retries
+    uint32 Failed;              //!< Transactions failed, retries used up or not allowed
+} stRetryAddrStat;
+
+//!@typedef stRetryStat
+//!         Bus error statistic of all slave addresses.
+typedef struct stRetryStat
+{
+    stRetryAddrStat Addr[FT_I2C_ADDR_MAX];
+} stRetryStat;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void RETRY_setPolicy(const stRetryPolicy *policy);
+
+void RETRY_getPolicy(stRetryPolicy *policy);
+
+FT_STATUS RETRY_parsePolicy(const char *spec);
+
+_Bool RETRY_isEnabled(void);
+
+RETRY_ERROR RETRY_getError(uint8 i2cstatus);
+
+_Bool RETRY_isRetry(uint8 i2cstatus, uint32 attempt, RETRY_RECOVER *recover);
+
+void RETRY_backoff(uint32 attempt);
+
+void RETRY_addError(uint16 addr, uint8 i2cstatus, _Bool retry);
+
+void RETRY_addRecovered(uint16 addr);
+
+void RETRY_getStat(stRetryStat *stat);
+
+void RETRY_resetStat(void);
+
+void RETRY_printStat(const stRetryStat *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RETRY_H_ */
@@ -0,0 +1,337 @@
+/******************************************************************************
+ * @file    rmw.c
+ *          Register read-modify-write engine, batched per I2C device.
+ *
+ *          Ops are grouped by slave address and register. Ops of nearby
+ *          registers on a device share 1 read: register pointer write, then
+ *          repeated start read of the whole span. All masks are merged in
+ *          order, and each run of consecutive target registers is written
+ *          back in 1 transaction, or skipped if nothing changed. Registers
+ *          between 2 runs are read but never written.
+ *
+ *          Ops of the same register run in the given order, ops of different
+ *          devices may run in any order.
+ *
+ *          RMW_read() plans a gather of scattered registers the same way: each
+ *          span is 1 burst read and values are scattered back to the requests.
+ *          Gap is the max unused registers read to join 2 spans, a gap costs
+ *          1 byte on the bus while an extra transaction costs the slave
+ *          address, register pointer and repeated start, plus 1 USB round trip.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ft_i2c.h"
+#include "rmw.h"
+
+//Max unused registers between 2 ops of 1 read, shared by all threads.
+static uint32 grmw_gap = RMW_GAP_DEFAULT;
+
+//Sort by slave address and register, keep the given order of the same register.
+static int rmw_compare(const void *a, const void *b)
+{
+    const stRmwOp *x = *(const stRmwOp**) a;
+    const stRmwOp *y = *(const stRmwOp**) b;
+
+    if (x->Addr != y->Addr)
+    {
+        return (x->Addr < y->Addr) ? -1 : 1;
+    }
+    if (x->Reg != y->Reg)
+    {
+        return (x->Reg < y->Reg) ? -1 : 1;
+    }
+    return (x > y) - (x < y);
+}
+
+//Find end of the span starting at list[i], ops of the span share 1 read.
+static int rmw_getSpanEnd(stRmwOp **list, int i, int count)
+{
+    int j = i + 1;
+
+    while ((j < count) && (list[j]->Addr == list[i]->Addr) && (list[j]->Reg - list[j - 1]->Reg <= grmw_gap + 1)
+            && (list[j]->Reg - list[i]->Reg < RMW_SPAN_MAX))
+    {
+        j++;
+    }
+    return j;
+}
+
+//Count registers of a span read but not used by any op.
+static uint32 rmw_getBridged(stRmwOp **op, int count)
+{
+    uint32 used = 1;
+
+    for (int i = 1; i < count; i++)
+    {
+        used += (op[i]->Reg != op[i - 1]->Reg) ? 1 : 0;
+    }
+    return op[count - 1]->Reg - op[0]->Reg + 1 - used;
+}
+
+//Register address bytes, MSB first.
+static void rmw_getReg(uint16 reg, uint8 reglen, uint8 *buf)
+{
+    if (reglen == 2)
+    {
+        buf[0] = reg >> 8;
+        buf[1] = reg & 0xFF;
+    }
+    else
+    {
+        buf[0] = reg & 0xFF;
+    }
+}
+
+/*!@brief Run ops of a register span on 1 device.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param op        Sorted ops, all of the same slave address.
+ * @param count     Op count
+ * @param reglen    Register address size in bytes
+ * @param stat      Statistic to update
+ * @return          FT_OK or error code of the process
+ */
+static FT_STATUS rmw_runSpan(FT_HANDLE ftHandle, stRmwOp **op, int count, uint8 reglen, stRmwStat *stat)
+{
+    uint8 value[RMW_SPAN_MAX] =
+    { 0 };
+    uint8 origin[RMW_SPAN_MAX] =
+    { 0 };
+    _Bool touched[RMW_SPAN_MAX] =
+    { 0 };
+    uint8 reg[2];
+    uint8 addr = op[0]->Addr;
+    uint16 base = op[0]->Reg;
+    uint32 len = op[count - 1]->Reg - base + 1;
+    uint32 done = 0;
+    _Bool read = 0;
+
+    //Read is not needed if the first op of every register sets all bits.
+    for (int i = 0; i < count; i++)
+    {
+        if (((i == 0) || (op[i]->Reg != op[i - 1]->Reg)) && (op[i]->Mask != 0xFF))
+        {
+            read = 1;
+        }
+    }
+
+    //1. Register pointer write + repeated start read
+    if (read)
+    {
+        rmw_getReg(base, reglen, reg);
+        CHECK_FUNC_RET(FT_OK, FT_readI2cReg(ftHandle, addr, reg, reglen, value, len, &done));
+        CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
+        if (done != len)
+        {
+            CLI_ERROR("ERROR: RMW read 0x%02X REG=[0x%02X], count=[%u] of [%u].\n", addr, base, done, len);
+            return FT_OTHER_ERROR;
+        }
+        memcpy(origin, value, len);
+        stat->Reads++;
+        stat->Bridged += rmw_getBridged(op, count);
+    }
+
+    //2. Merge masks in order
+    for (int i = 0; i < count; i++)
+    {
+        uint32 r = op[i]->Reg - base;
+
+        op[i]->Old = value[r];
+        value[r] = (value[r] & ~op[i]->Mask) | (op[i]->Data & op[i]->Mask);
+        op[i]->New = value[r];
+        touched[r] = 1;
+        stat->Ops++;
+    }
+
+    //3. Write back each run of target registers that changed
+    for (uint32 r = 0; r < len;)
+    {
+        if (!touched[r])
+        {
+            r++;
+            continue;
+        }
+
+        uint32 start = r;
+        _Bool dirty = 0;
+        for (; (r < len) && touched[r]; r++)
+        {
+            dirty |= !read || (value[r] != origin[r]);
+        }
+
+        if (!dirty)
+        {
+            stat->Skipped++;
+            continue;
+        }
+
+        rmw_getReg(base + start, reglen, reg);
+        CHECK_FUNC_RET(FT_OK, FT_writeI2cReg(ftHandle, addr, reg, reglen, &value[start], r - start, &done));
+        CHECK_FUNC_RET(FT_OK, FT_checkI2cBus(ftHandle));
+        stat->Writes++;
+    }
+
+    return FT_OK;
+}
+
+/*!@brief Run register read-modify-write ops in the minimum bus transactions.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param op        Ops, Old and New are set when done.
+ * @param count     Op count
+ * @param reglen    Register address size in bytes, 1 or 2.
+ * @param stat      Pointer to store statistic, NULL if not used.
+ * @return          FT_OK or error code of the process
+ */
+FT_STATUS RMW_run(FT_HANDLE ftHandle, stRmwOp *op, int count, uint8 reglen, stRmwStat *stat)
+{
+    stRmwStat local =
+    { 0 };
+    FT_STATUS ret = FT_OK;
+
+    if ((count <= 0) || ((reglen != 1) && (reglen != 2)))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+
+    stRmwOp **list = (stRmwOp**) malloc(sizeof(stRmwOp*) * count);
+    CHECK_NULL_PTR(list);
+    for (int i = 0; i < count; i++)
+    {
+        list[i] = &op[i];
+    }
+    qsort(list, count, sizeof(stRmwOp*), rmw_compare);
+
+    for (int i = 0; (i < count) && (ret == FT_OK);)
+    {
+        //Span of nearby registers on the same device.
+        int j = rmw_getSpanEnd(list, i, count);
+
+        if ((i == 0) || (list[i]->Addr != list[i - 1]->Addr))
+        {
+            local.Devices++;
+        }
+        ret = rmw_runSpan(ftHandle, &list[i], j - i, reglen, &local);
+        i = j;
+    }
+
+    free(list);
+    if (stat != NULL)
+    {
+        *stat = local;
+    }
+    return ret;
+}
+
+/*!@brief Read scattered registers in the minimum burst reads.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param rd        Registers to read, Value is set when done.
+ * @param count     Register count
+ * @param reglen    Register address size in bytes, 1 or 2.
+ * @param stat      Pointer to store statistic, NULL if not used.
+ * @return          FT_OK or error code of the process
+ */
+FT_STATUS RMW_read(FT_HANDLE ftHandle, stRmwRead *rd, int count, uint8 reglen, stRmwStat *stat)
+{
+    stRmwStat local =
+    { 0 };
+    uint8 value[RMW_SPAN_MAX];
+    uint8 reg[2];
+    uint32 done = 0;
+    FT_STATUS ret = FT_OK;
+
+    if ((count <= 0) || ((reglen != 1) && (reglen != 2)))
+    {
+        return FT_INVALID_PARAMETER;
+    }
+
+    //Plan with the same sort and span as RMW_run(), a read is an op of mask 0.
+    stRmwOp *op = (stRmwOp*) calloc(count, sizeof(stRmwOp));
+    stRmwOp **list = (stRmwOp**) malloc(sizeof(stRmwOp*) * count);
+    if ((op == NULL) || (list == NULL))
+    {
+        free(op);
+        free(list);
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        op[i].Addr = rd[i].Addr;
+        op[i].Reg = rd[i].Reg;
+        list[i] = &op[i];
+    }
+    qsort(list, count, sizeof(stRmwOp*), rmw_compare);
+
+    for (int i = 0; (i < count) && (ret == FT_OK);)
+    {
+        int j = rmw_getSpanEnd(list, i, count);
+        uint16 base = list[i]->Reg;
+        uint32 len = list[j - 1]->Reg - base + 1;
+
+        if ((i == 0) || (list[i]->Addr != list[i - 1]->Addr))
+        {
+            local.Devices++;
+        }
+
+        //1x burst read of the span, then scatter to each register.
+        rmw_getReg(base, reglen, reg);
+        ret = FT_readI2cReg(ftHandle, list[i]->Addr, reg, reglen, value, len, &done);
+        ret = (ret == FT_OK) ? FT_checkI2cBus(ftHandle) : ret;
+        if ((ret == FT_OK) && (done != len))
+        {
+            CLI_ERROR("ERROR: Gather read 0x%02X REG=[0x%02X], count=[%u] of [%u].\n", list[i]->Addr, base, done, len);
+            ret = FT_OTHER_ERROR;
+        }
+        if (ret == FT_OK)
+        {
+            for (int k = i; k < j; k++)
+            {
+                list[k]->Old = value[list[k]->Reg - base];
+            }
+            local.Reads++;
+            local.Ops += j - i;
+            local.Bridged += rmw_getBridged(&list[i], j - i);
+        }
+        i = j;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        rd[i].Value = op[i].Old;
+    }
+    free(list);
+    free(op);
+    if (stat != NULL)
+    {
+        *stat = local;
+    }
+    return ret;
+}
+
+/*!@brief Set max unused registers read to join 2 reads into 1, for RMW_run() and RMW_read().
+ *
+ * @param gap       Register count, 0 to join only adjacent registers.
+ * @return          FT_OK, or FT_INVALID_PARAMETER if gap is larger than RMW_GAP_MAX.
+ */
+FT_STATUS RMW_setGap(uint32 gap)
+{
+    if (gap > RMW_GAP_MAX)
+    {
+        return FT_INVALID_PARAMETER;
+    }
+    grmw_gap = gap;
+    return FT_OK;
+}
+
+uint32 RMW_getGap(void)
+{
+    return grmw_gap;
+}
@@ -0,0 +1,68 @@
+/******************************************************************************
+ * @file    rmw.h
+ *          Register read-modify-write engine, batched per I2C device.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef RMW_H_
+#define RMW_H_
+
+#include "ft_i2c.h"
+
+#define RMW_GAP_DEFAULT         4           //!< Unused registers read to join 2 ops into 1 read.
+#define RMW_SPAN_MAX            64          //!< Max registers read in 1 transaction.
+#define RMW_GAP_MAX             (RMW_SPAN_MAX - 2)
+
+//!@typedef stRmwOp
+//!         A register read-modify-write, New = (Old & ~Mask) | (Data & Mask).
+typedef struct stRmwOp
+{
+    uint8 Addr;                 //!< 7-bit slave address
+    uint16 Reg;                 //!< Register address
+    uint8 Mask;                 //!< Bits to change
+    uint8 Data;                 //!< New value of the masked bits
+    uint8 Old;                  //!< Value before this op, 0 if not read (mask 0xFF).
+    uint8 New;                  //!< Value after this op
+} stRmwOp;
+
+//!@typedef stRmwRead
+//!         A register read of a gather batch.
+typedef struct stRmwRead
+{
+    uint8 Addr;                 //!< 7-bit slave address
+    uint16 Reg;                 //!< Register address
+    uint8 Value;                //!< Value read
+} stRmwRead;
+
+//!@typedef stRmwStat
+//!         Bus transactions of a RMW or gather batch.
+typedef struct stRmwStat
+{
+    uint32 Ops;                 //!< Ops done
+    uint32 Devices;             //!< Slave addresses
+    uint32 Reads;               //!< Read transactions, pointer write + repeated start read.
+    uint32 Writes;              //!< Write transactions
+    uint32 Skipped;             //!< Write backs skipped as value is not changed
+    uint32 Bridged;             //!< Registers between ops read only to join 2 reads
+} stRmwStat;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FT_STATUS RMW_run(FT_HANDLE ftHandle, stRmwOp *op, int count, uint8 reglen, stRmwStat *stat);
+
+FT_STATUS RMW_read(FT_HANDLE ftHandle, stRmwRead *rd, int count, uint8 reglen, stRmwStat *stat);
+
+FT_STATUS RMW_setGap(uint32 gap);
+
+uint32 RMW_getGap(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RMW_H_ */
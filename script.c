@@ -0,0 +1,167 @@
+/******************************************************************************
+ * @file    script.c
+ *          fti2c script, run a list of fti2c commands in one process.
+ *
+ *          Each line is a fti2c command, with or without the leading "--":
+ *              devwrite 0 0x50 0x00 0x12 0x34
+ *              -d 0 0x50 0x00 2
+ *          Empty lines and lines start with '#' are skipped. A line longer than
+ *          SCRIPT_LINE_MAX fails, it's not run.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cli.h"
+#include "ft_i2c.h"
+#include "script.h"
+
+//Per thread, each parallel bus runs its own script.
+static __thread _Bool gscript_running = 0;
+
+//Check if fgets() stopped before the end of line, the rest of the line is skipped.
+static _Bool script_isCut(const char *line, FILE *fp)
+{
+    size_t len = strlen(line);
+    int c = 0;
+
+    if ((len < SCRIPT_LINE_MAX - 1) || (line[len - 1] == '\n'))
+    {
+        return 0;
+    }
+
+    //A line of exactly the buffer size is followed by its '\n' or the end of file.
+    c = fgetc(fp);
+    if ((c == '\n') || (c == EOF))
+    {
+        return 0;
+    }
+    while ((c != '\n') && (c != EOF))
+    {
+        c = fgetc(fp);
+    }
+    return 1;
+}
+
+//Check if a script is running, scripts can't be nested.
+_Bool SCRIPT_isRunning(void)
+{
+    return gscript_running;
+}
+
+/*!@brief Run all commands in a script file.
+ *
+ * @param path      Script file path, "-" for stdin.
+ * @param handler   Command handler, e.g. command_i2c
+ * @param keepgoing Continue with next line when a command fails.
+ * @return          0 if all commands pass, otherwise the return of the first failed command.
+ */
+int SCRIPT_run(const char *path, CliCallBack *handler, _Bool keepgoing)
+{
+    FILE *fp = NULL;
+    char line[SCRIPT_LINE_MAX];
+    char cmd[SCRIPT_LINE_MAX + 2];
+    char *args[CLI_ARG_COUNT_MAX + 1] =
+    { 0 };
+    int argc = 0;
+    int line_no = 0;
+    int count_ok = 0;
+    int count_fail = 0;
+    int ret = 0;
+    double start = 0;
+
+    if (gscript_running)
+    {
+        CLI_ERROR("ERROR: Script can't be nested.\n");
+        return FT_INVALID_PARAMETER;
+    }
+
+    if (strcmp(path, "-") == 0)
+    {
+        fp = stdin;
+    }
+    else
+    {
+        fp = fopen(path, "r");
+    }
+    if (fp == NULL)
+    {
+        CLI_ERROR("ERROR: Can't open script [%s]\n", path);
+        return FT_INVALID_PARAMETER;
+    }
+
+    gscript_running = 1;
+    start = FT_getTimeMs();
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        line_no++;
+        _Bool cut = script_isCut(line, fp);
+
+        //Skip empty and comment lines
+        char *p = line + strspn(line, CLI_WHITE_SPACE_CHAR);
+        if ((*p == 0) || (*p == SCRIPT_COMMENT_CHAR))
+        {
+            continue;
+        }
+
+        //"devwrite 0 0x50 ..." is same as "--devwrite 0 0x50 ..."
+        if (*p == '-')
+        {
+            snprintf(cmd, sizeof(cmd), "%s", p);
+        }
+        else
+        {
+            snprintf(cmd, sizeof(cmd), "--%s", p);
+        }
+
+        CLI_convertStrToArgs(cmd, &argc, args);
+        args[argc] = NULL;
+
+        //A cut line is never run, its pieces are not commands.
+        double t = FT_getTimeMs();
+        int status = FT_INVALID_PARAMETER;
+        if (cut)
+        {
+            CLI_ERROR("ERROR: Line is longer than [%d] chars.\n", SCRIPT_LINE_MAX - 2);
+        }
+        else
+        {
+            status = handler(argc, args);
+        }
+        t = FT_getTimeMs() - t;
+
+        if (status == 0)
+        {
+            CLI_PRINT("[Line %d] OK, %.3f ms\n", line_no, t);
+            count_ok++;
+        }
+        else
+        {
+            CLI_ERROR("[Line %d] FAIL, return=[%d], %.3f ms\n", line_no, status, t);
+            count_fail++;
+            if (ret == 0)
+            {
+                ret = status;
+            }
+            if (!keepgoing)
+            {
+                break;
+            }
+        }
+    }
+
+    CLI_PRINT("Script done: OK=[%d] FAIL=[%d], total=[%.3f] ms\n", count_ok, count_fail, FT_getTimeMs() - start);
+
+    if (fp != stdin)
+    {
+        fclose(fp);
+    }
+    gscript_running = 0;
+    return ret;
+}
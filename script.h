@@ -0,0 +1,22 @@
+/******************************************************************************
+ * @file    script.h
+ *          fti2c script, run a list of fti2c commands in one process.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef SCRIPT_H_
+#define SCRIPT_H_
+
+#include "cli.h"
+
+#define SCRIPT_LINE_MAX         1024        //!< Max length of a script line.
+#define SCRIPT_COMMENT_CHAR     '#'         //!< Character to start a comment line.
+
+_Bool SCRIPT_isRunning(void);
+
+int SCRIPT_run(const char *path, CliCallBack *handler, _Bool keepgoing);
+
+#endif /* SCRIPT_H_ */
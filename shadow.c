@@ -0,0 +1,391 @@
+/******************************************************************************
+ * @file    shadow.c
+ *          Register shadow cache, skip bus reads of registers already known.
+ *
+ *          Register values are kept per (bus, slave address, register) after
+ *          a register read or write. A later register read of non-volatile
+ *          registers is served from the cache when all bytes are known.
+ *
+ *          All registers are non-volatile by default. Ranges can be marked
+ *          volatile or non-volatile, the last matching range wins. Volatile
+ *          registers are never cached. A new range replaces earlier ranges
+ *          within it, so the same range given again doesn't take a slot.
+ *
+ *          A raw write to a device or a bus error drops the cache of the
+ *          device or bus, closing the bus drops all.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "ft_i2c.h"
+#include "shadow.h"
+
+#define SHADOW_PAGE_COUNT       (0x10000 / SHADOW_PAGE_SIZE)
+
+//!@typedef stShadowPage
+//!         Cached registers of a page.
+typedef struct stShadowPage
+{
+    uint8 Value[SHADOW_PAGE_SIZE];      //!< Register value
+    uint8 Valid[SHADOW_PAGE_SIZE / 8];  //!< Bit map of registers with a known value
+} stShadowPage;
+
+//!@typedef stShadowDevice
+//!         Cached registers of a slave on a bus.
+typedef struct stShadowDevice
+{
+    FT_HANDLE Handle;           //!< I2C bus handle, NULL if the slot is free.
+    uint8 Addr;                 //!< 7-bit slave address
+    stShadowPage *Page[SHADOW_PAGE_COUNT];
+} stShadowDevice;
+
+//!@typedef stShadowRange
+//!         Register range marked volatile or non-volatile.
+typedef struct stShadowRange
+{
+    uint8 Addr;                 //!< 7-bit slave address
+    uint16 First;               //!< First register
+    uint16 Last;                //!< Last register
+    _Bool Volatile;             //!< 1 for volatile
+} stShadowRange;
+
+//Cache is shared by all threads, parallel buses use different handles.
+static pthread_mutex_t gshadow_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Bool gshadow_enable = 0;
+static stShadowDevice gshadow_dev[SHADOW_DEVICE_MAX];
+static stShadowRange gshadow_range[SHADOW_RANGE_MAX];
+static int gshadow_range_count = 0;
+static stShadowStat gshadow_stat =
+{ 0 };
+
+//Get volatile flag of a register, with gshadow_lock held.
+static _Bool shadow_isVolatile(uint8 addr, uint16 reg)
+{
+    for (int i = gshadow_range_count - 1; i >= 0; i--)
+    {
+        stShadowRange *range = &gshadow_range[i];
+        if ((range->Addr == addr) && (reg >= range->First) && (reg <= range->Last))
+        {
+            return range->Volatile;
+        }
+    }
+    return 0;
+}
+
+//Find device slot, create one if create is set, with gshadow_lock held.
+static stShadowDevice *shadow_getDevice(FT_HANDLE ftHandle, uint8 addr, _Bool create)
+{
+    stShadowDevice *free_slot = NULL;
+
+    for (int i = 0; i < SHADOW_DEVICE_MAX; i++)
+    {
+        if ((gshadow_dev[i].Handle == ftHandle) && (gshadow_dev[i].Addr == addr))
+        {
+            return &gshadow_dev[i];
+        }
+        if ((gshadow_dev[i].Handle == NULL) && (free_slot == NULL))
+        {
+            free_slot = &gshadow_dev[i];
+        }
+    }
+
+    if (create && (free_slot != NULL))
+    {
+        free_slot->Handle = ftHandle;
+        free_slot->Addr = addr;
+        return free_slot;
+    }
+    return NULL;
+}
+
+//Free all pages of a device slot, with gshadow_lock held.
+static void shadow_freeDevice(stShadowDevice *dev)
+{
+    for (int i = 0; i < SHADOW_PAGE_COUNT; i++)
+    {
+        free(dev->Page[i]);
+    }
+    memset(dev, 0, sizeof(stShadowDevice));
+}
+
+//Enable or disable register shadow cache, cache is dropped when disabled.
+void SHADOW_enable(_Bool enable)
+{
+    if (!enable)
+    {
+        SHADOW_invalidate(NULL, SHADOW_ADDR_ALL);
+    }
+    gshadow_enable = enable;
+}
+
+_Bool SHADOW_isEnabled(void)
+{
+    return gshadow_enable;
+}
+
+//Remove ranges of addr within first~last, with gshadow_lock held. Later ranges keep their order.
+static void shadow_removeRange(uint8 addr, uint16 first, uint16 last)
+{
+    int count = 0;
+
+    for (int i = 0; i < gshadow_range_count; i++)
+    {
+        stShadowRange *range = &gshadow_range[i];
+        if ((range->Addr != addr) || (range->First < first) || (range->Last > last))
+        {
+            gshadow_range[count++] = *range;
+        }
+    }
+    gshadow_range_count = count;
+}
+
+/*!@brief Mark a register range volatile or non-volatile.
+ *          Earlier ranges within the new range never match again, they are replaced by it.
+ *
+ * @param addr          7-bit slave address
+ * @param reg           First register
+ * @param count         Register count
+ * @param isvolatile    1 for volatile, the register is always read from bus.
+ * @return              FT_OK, or FT_INSUFFICIENT_RESOURCES if there are too many ranges.
+ */
+FT_STATUS SHADOW_setVolatile(uint8 addr, uint16 reg, uint32 count, _Bool isvolatile)
+{
+    FT_STATUS ret = FT_OK;
+    uint16 last = (reg + count - 1 > 0xFFFF) ? 0xFFFF : reg + count - 1;
+
+    if (count == 0)
+    {
+        return FT_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&gshadow_lock);
+    shadow_removeRange(addr, reg, last);
+    if (gshadow_range_count < SHADOW_RANGE_MAX)
+    {
+        stShadowRange *range = &gshadow_range[gshadow_range_count++];
+        range->Addr = addr;
+        range->First = reg;
+        range->Last = last;
+        range->Volatile = isvolatile;
+
+        //Cached value of a register just marked volatile is not used any more.
+        for (int i = 0; isvolatile && (i < SHADOW_DEVICE_MAX); i++)
+        {
+            if ((gshadow_dev[i].Handle != NULL) && (gshadow_dev[i].Addr == addr))
+            {
+                shadow_freeDevice(&gshadow_dev[i]);
+            }
+        }
+    }
+    else
+    {
+        ret = FT_INSUFFICIENT_RESOURCES;
+    }
+    pthread_mutex_unlock(&gshadow_lock);
+    return ret;
+}
+
+/*!@brief Remove volatile and non-volatile ranges within registers, e.g. ranges of a register map being freed.
+ *
+ * @param addr          7-bit slave address
+ * @param reg           First register
+ * @param count         Register count
+ */
+void SHADOW_clearVolatile(uint8 addr, uint16 reg, uint32 count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&gshadow_lock);
+    shadow_removeRange(addr, reg, (reg + count - 1 > 0xFFFF) ? 0xFFFF : reg + count - 1);
+    pthread_mutex_unlock(&gshadow_lock);
+}
+
+/*!@brief Mark register ranges of a list volatile or non-volatile.
+ *
+ * @param list          "Addr:Reg[:Count],...", e.g. "0x68:0x00:16,0x68:0x3B"
+ * @param isvolatile    1 for volatile
+ * @return              FT_OK or FT_INVALID_PARAMETER
+ */
+FT_STATUS SHADOW_parseVolatile(const char *list, _Bool isvolatile)
+{
+    char text[256];
+    char *save = NULL;
+
+    snprintf(text, sizeof(text), "%s", list);
+    for (char *tok = strtok_r(text, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+    {
+        uint32 field[3] =
+        { 0, 0, 1 };
+        int count = 0;
+        char *tail = tok;
+
+        while ((count < 3) && (*tail != 0))
+        {
+            field[count++] = strtoul(tail, &tail, 0);
+            tail += (*tail == ':') ? 1 : 0;
+        }
+        if ((count < 2) || (*tail != 0) || (field[0] >= FT_I2C_ADDR_MAX) || (field[1] > 0xFFFF))
+        {
+            CLI_ERROR("ERROR: Invalid register range [%s], use Addr:Reg[:Count].\n", tok);
+            return FT_INVALID_PARAMETER;
+        }
+        CHECK_FUNC_RET(FT_OK, SHADOW_setVolatile(field[0], field[1], field[2], isvolatile));
+    }
+    return FT_OK;
+}
+
+_Bool SHADOW_isVolatile(uint8 addr, uint16 reg)
+{
+    pthread_mutex_lock(&gshadow_lock);
+    _Bool ret = shadow_isVolatile(addr, reg);
+    pthread_mutex_unlock(&gshadow_lock);
+    return ret;
+}
+
+/*!@brief Read registers from cache.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param addr      7-bit slave address
+ * @param reg       First register
+ * @param buf       Buffer to store data
+ * @param len       Register count
+ * @return          1 if all registers are served from cache, 0 to read from bus.
+ */
+_Bool SHADOW_read(FT_HANDLE ftHandle, uint8 addr, uint16 reg, uint8 *buf, uint32 len)
+{
+    _Bool hit = 1;
+
+    if (!gshadow_enable || (len == 0) || (reg + len > 0x10000))
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&gshadow_lock);
+    stShadowDevice *dev = shadow_getDevice(ftHandle, addr, 0);
+    for (uint32 i = 0; i < len; i++)
+    {
+        uint32 r = reg + i;
+        if (shadow_isVolatile(addr, r))
+        {
+            gshadow_stat.Bypass++;
+            pthread_mutex_unlock(&gshadow_lock);
+            return 0;
+        }
+
+        stShadowPage *page = (dev != NULL) ? dev->Page[r / SHADOW_PAGE_SIZE] : NULL;
+        uint32 n = r % SHADOW_PAGE_SIZE;
+        if ((page == NULL) || !(page->Valid[n / 8] & (1 << (n % 8))))
+        {
+            hit = 0;
+            break;
+        }
+        buf[i] = page->Value[n];
+    }
+
+    if (hit)
+    {
+        gshadow_stat.Hits++;
+    }
+    else
+    {
+        gshadow_stat.Misses++;
+    }
+    pthread_mutex_unlock(&gshadow_lock);
+    return hit;
+}
+
+/*!@brief Store register values read from or written to a device, volatile registers are skipped.
+ *
+ * @param ftHandle  I2C bus handle
+ * @param addr      7-bit slave address
+ * @param reg       First register
+ * @param buf       Register values
+ * @param len       Register count
+ */
+void SHADOW_update(FT_HANDLE ftHandle, uint8 addr, uint16 reg, const uint8 *buf, uint32 len)
+{
+    if (!gshadow_enable || (len == 0))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&gshadow_lock);
+    stShadowDevice *dev = shadow_getDevice(ftHandle, addr, 1);
+    for (uint32 i = 0; (dev != NULL) && (i < len) && (reg + i <= 0xFFFF); i++)
+    {
+        uint32 r = reg + i;
+        uint32 n = r % SHADOW_PAGE_SIZE;
+        if (shadow_isVolatile(addr, r))
+        {
+            continue;
+        }
+
+        stShadowPage **page = &dev->Page[r / SHADOW_PAGE_SIZE];
+        if (*page == NULL)
+        {
+            *page = (stShadowPage*) calloc(1, sizeof(stShadowPage));
+            if (*page == NULL)
+            {
+                break;
+            }
+        }
+        (*page)->Value[n] = buf[i];
+        (*page)->Valid[n / 8] |= 1 << (n % 8);
+    }
+    gshadow_stat.Updates++;
+    pthread_mutex_unlock(&gshadow_lock);
+}
+
+/*!@brief Drop cached registers.
+ *
+ * @param ftHandle  I2C bus handle, NULL for all buses.
+ * @param addr      7-bit slave address, SHADOW_ADDR_ALL for all devices of the bus.
+ */
+void SHADOW_invalidate(FT_HANDLE ftHandle, int addr)
+{
+    pthread_mutex_lock(&gshadow_lock);
+    for (int i = 0; i < SHADOW_DEVICE_MAX; i++)
+    {
+        stShadowDevice *dev = &gshadow_dev[i];
+        if ((dev->Handle != NULL) && ((ftHandle == NULL) || (dev->Handle == ftHandle))
+                && ((addr == SHADOW_ADDR_ALL) || (dev->Addr == addr)))
+        {
+            shadow_freeDevice(dev);
+            gshadow_stat.Invalidates++;
+        }
+    }
+    pthread_mutex_unlock(&gshadow_lock);
+}
+
+void SHADOW_getStat(stShadowStat *stat)
+{
+    pthread_mutex_lock(&gshadow_lock);
+    *stat = gshadow_stat;
+    pthread_mutex_unlock(&gshadow_lock);
+}
+
+void SHADOW_resetStat(void)
+{
+    pthread_mutex_lock(&gshadow_lock);
+    memset(&gshadow_stat, 0, sizeof(gshadow_stat));
+    pthread_mutex_unlock(&gshadow_lock);
+}
+
+void SHADOW_printStat(const stShadowStat *stat)
+{
+    uint32 reads = stat->Hits + stat->Misses + stat->Bypass;
+
+    CLI_PRINT("I2C CACHE, hits=[%u] misses=[%u] volatile=[%u] updates=[%u] invalidates=[%u]", stat->Hits,
+            stat->Misses, stat->Bypass, stat->Updates, stat->Invalidates);
+    CLI_PRINT(", hit rate=[%.1f]%%\n", reads ? stat->Hits * 100.0 / reads : 0);
+}
@@ -0,0 +1,63 @@
+/******************************************************************************
+ * @file    shadow.h
+ *          Register shadow cache, skip bus reads of registers already known.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef SHADOW_H_
+#define SHADOW_H_
+
+#include "ft_i2c.h"
+
+#define SHADOW_DEVICE_MAX       64          //!< Max devices cached, (bus, address) pairs.
+#define SHADOW_RANGE_MAX        64          //!< Max volatile / non-volatile ranges.
+#define SHADOW_PAGE_SIZE        256         //!< Registers per cache page, allocated on first write.
+#define SHADOW_ADDR_ALL         -1          //!< All slave addresses of a bus.
+
+//!@typedef stShadowStat
+//!         Register shadow cache statistic.
+typedef struct stShadowStat
+{
+    uint32 Hits;                //!< Reads served from cache
+    uint32 Misses;              //!< Reads not in cache, read from bus
+    uint32 Bypass;              //!< Reads with a volatile register, always from bus
+    uint32 Updates;             //!< Reads and writes stored to cache
+    uint32 Invalidates;         //!< Devices or buses dropped from cache
+} stShadowStat;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void SHADOW_enable(_Bool enable);
+
+_Bool SHADOW_isEnabled(void);
+
+FT_STATUS SHADOW_setVolatile(uint8 addr, uint16 reg, uint32 count, _Bool isvolatile);
+
+void SHADOW_clearVolatile(uint8 addr, uint16 reg, uint32 count);
+
+FT_STATUS SHADOW_parseVolatile(const char *list, _Bool isvolatile);
+
+_Bool SHADOW_isVolatile(uint8 addr, uint16 reg);
+
+_Bool SHADOW_read(FT_HANDLE ftHandle, uint8 addr, uint16 reg, uint8 *buf, uint32 len);
+
+void SHADOW_update(FT_HANDLE ftHandle, uint8 addr, uint16 reg, const uint8 *buf, uint32 len);
+
+void SHADOW_invalidate(FT_HANDLE ftHandle, int addr);
+
+void SHADOW_getStat(stShadowStat *stat);
+
+void SHADOW_resetStat(void);
+
+void SHADOW_printStat(const stShadowStat *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHADOW_H_ */
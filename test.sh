@@ -8,7 +8,7 @@ echo "===Scan I2C bus==="
 $CMD -s $CHANNEL
 
 echo "===Write 1 byte to EERPROM==="
-$CMD -v $CHANNEL &ADDR &REG 0x12
+$CMD -v $CHANNEL $ADDR $REG 0x12
 
 echo "===Read 1 byte from EERPROM==="
-$CMD -d $CHANNEL &ADDR &REG 1
+$CMD -d $CHANNEL $ADDR $REG 1
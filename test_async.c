@@ -0,0 +1,174 @@
+/******************************************************************************
+ * @file    test_async.c
+ *          Regression test of async.h on the emulated FT4222, run by
+ *          "make test". Each case prints PASS or FAIL, the exit code is
+ *          the number of failed cases.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "ft_i2c.h"
+#include "async.h"
+#include "hal.h"
+
+#define TEST_BUS                0
+#define TEST_REGS               0x68
+#define TEST_ABSENT             0x30
+
+static int gpass = 0;
+static int gfail = 0;
+
+//Callback order and the gate that holds the completion thread.
+static pthread_mutex_t glock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ggate = PTHREAD_COND_INITIALIZER;
+static _Bool gopen = 1;
+static int gorder[ASYNC_QUEUE_MAX + 2];
+static int gorder_count = 0;
+
+static void check(const char *name, _Bool ok)
+{
+    printf("%s %s\n", ok ? "PASS" : "FAIL", name);
+    (ok ? gpass++ : gfail++);
+}
+
+static void test_onDone(stAsyncXfer *xfer)
+{
+    pthread_mutex_lock(&glock);
+    while (!gopen)
+    {
+        pthread_cond_wait(&ggate, &glock);
+    }
+    gorder[gorder_count++] = (int) (intptr_t) xfer->User;
+    pthread_mutex_unlock(&glock);
+}
+
+static void test_setGate(_Bool open)
+{
+    pthread_mutex_lock(&glock);
+    gopen = open;
+    pthread_cond_broadcast(&ggate);
+    pthread_mutex_unlock(&glock);
+}
+
+static void test_fill(stAsyncXfer *xfer, ASYNC_OP op, uint8 addr, uint8 reg, uint8 *buf, uint32 len, int id)
+{
+    memset(xfer, 0, sizeof(stAsyncXfer));
+    xfer->Op = op;
+    xfer->Addr = addr;
+    xfer->Reg[0] = reg;
+    xfer->RegLen = 1;
+    xfer->Buf = buf;
+    xfer->Len = len;
+    xfer->CallBack = test_onDone;
+    xfer->User = (void*) (intptr_t) id;
+}
+
+//Submit of a full queue, it returns when the completion thread frees a slot.
+static void *test_submit(void *arg)
+{
+    static FT_STATUS status;
+
+    status = ASYNC_submit(TEST_BUS, (stAsyncXfer*) arg);
+    return &status;
+}
+
+int main(void)
+{
+    static stAsyncXfer xfer[ASYNC_QUEUE_MAX + 1];
+    static uint8 data[ASYNC_QUEUE_MAX + 1];
+    uint8 wbuf[4] = { 0xA1, 0xB2, 0xC3, 0xD4 };
+    uint8 rbuf[4] = { 0 };
+    stAsyncStat stat;
+    _Bool ordered = 1;
+
+    if ((HAL_useEmulator("regs=0x68:256") != FT_OK) || (ASYNC_open(TEST_BUS, 400) != FT_OK))
+    {
+        printf("FAIL open emulated bus\n");
+        return 1;
+    }
+
+    //write then read, the read is queued behind the write and sees its data
+    test_fill(&xfer[0], ASYNC_WRITE, TEST_REGS, 0x20, wbuf, sizeof(wbuf), 0);
+    test_fill(&xfer[1], ASYNC_READ, TEST_REGS, 0x20, rbuf, sizeof(rbuf), 1);
+    check("async submit write", ASYNC_submit(TEST_BUS, &xfer[0]) == FT_OK);
+    check("async submit read", ASYNC_submit(TEST_BUS, &xfer[1]) == FT_OK);
+    check("async wait read", ASYNC_wait(TEST_BUS, &xfer[1]) == FT_OK);
+    check("async wait completes earlier", xfer[0].Complete && (xfer[0].Status == FT_OK));
+    check("async read data", (memcmp(wbuf, rbuf, sizeof(wbuf)) == 0) && (xfer[1].Done == sizeof(rbuf)));
+
+    //a NACK is the status of its descriptor, later ones still run
+    test_fill(&xfer[0], ASYNC_READ, TEST_ABSENT, 0x00, rbuf, 1, 0);
+    test_fill(&xfer[1], ASYNC_READ, TEST_REGS, 0x20, rbuf, 1, 1);
+    check("async submit absent", ASYNC_submit(TEST_BUS, &xfer[0]) == FT_OK);
+    check("async submit after absent", ASYNC_submit(TEST_BUS, &xfer[1]) == FT_OK);
+    check("async wait absent fails", ASYNC_wait(TEST_BUS, &xfer[0]) != FT_OK);
+    check("async wait after absent", ASYNC_wait(TEST_BUS, &xfer[1]) == FT_OK);
+
+    //invalid descriptors are refused, not queued
+    test_fill(&xfer[0], ASYNC_READ, TEST_REGS, 0x00, rbuf, 1, 0);
+    xfer[0].RegLen = 3;
+    check("async reglen refused", ASYNC_submit(TEST_BUS, &xfer[0]) == FT_INVALID_PARAMETER);
+    test_fill(&xfer[0], ASYNC_READ, TEST_REGS, 0x00, NULL, 1, 0);
+    check("async null buffer refused", ASYNC_submit(TEST_BUS, &xfer[0]) == FT_INVALID_PARAMETER);
+    check("async bus not open refused", ASYNC_submit(TEST_BUS + 1, &xfer[0]) == FT_INVALID_PARAMETER);
+
+    //callbacks run in submit order, a held callback keeps the queue full and the next submit waits
+    ASYNC_drain(TEST_BUS);
+    gorder_count = 0;
+    test_setGate(0);
+    for (int i = 0; i < ASYNC_QUEUE_MAX; i++)
+    {
+        test_fill(&xfer[i], ASYNC_READ, TEST_REGS, (uint8) i, &data[i], 1, i);
+        ASYNC_submit(TEST_BUS, &xfer[i]);
+    }
+
+    pthread_t submitter;
+    void *submitted = NULL;
+    test_fill(&xfer[ASYNC_QUEUE_MAX], ASYNC_READ, TEST_REGS, 0x00, &data[ASYNC_QUEUE_MAX], 1, ASYNC_QUEUE_MAX);
+    pthread_create(&submitter, NULL, test_submit, &xfer[ASYNC_QUEUE_MAX]);
+    for (int i = 0; i < 100; i++)
+    {
+        ASYNC_getStat(TEST_BUS, &stat);
+        if (stat.Full > 0)
+        {
+            break;
+        }
+        usleep(10 * 1000);
+    }
+    check("async full queue waits", (stat.Full == 1) && (stat.MaxDepth == ASYNC_QUEUE_MAX)
+            && (gorder_count == 0) && !xfer[0].Complete);
+
+    test_setGate(1);
+    pthread_join(submitter, &submitted);
+    check("async full queue submits", *(FT_STATUS*) submitted == FT_OK);
+    check("async drain", ASYNC_drain(TEST_BUS) == FT_OK);
+    for (int i = 0; i <= ASYNC_QUEUE_MAX; i++)
+    {
+        ordered = ordered && xfer[i].Complete && (i < gorder_count) && (gorder[i] == i);
+    }
+    check("async callback order", ordered && (gorder_count == ASYNC_QUEUE_MAX + 1));
+
+    //close completes the queue, the statistic is kept and the bus refuses submits
+    test_fill(&xfer[0], ASYNC_READ, TEST_REGS, 0x20, rbuf, 1, 0);
+    ASYNC_submit(TEST_BUS, &xfer[0]);
+    ASYNC_close(TEST_BUS);
+    ASYNC_getStat(TEST_BUS, &stat);
+    check("async close completes", xfer[0].Complete && (xfer[0].Status == FT_OK));
+    check("async stat", (stat.Submitted == stat.Completed) && (stat.Errors == 1));
+    check("async submit after close", ASYNC_submit(TEST_BUS, &xfer[0]) == FT_INVALID_PARAMETER);
+    check("async wait after close", ASYNC_wait(TEST_BUS, &xfer[0]) == FT_INVALID_PARAMETER);
+    check("async drain after close", ASYNC_drain(TEST_BUS) == FT_INVALID_PARAMETER);
+    check("async reopen", ASYNC_open(TEST_BUS, 400) == FT_OK);
+    ASYNC_close(TEST_BUS);
+
+    printf("Test done: PASS=[%d] FAIL=[%d]\n", gpass, gfail);
+    return gfail;
+}
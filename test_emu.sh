@@ -0,0 +1,327 @@
+#!/bin/sh
+#fti2c regression test on the emulated FT4222 bridge, no hardware or libft4222 needed. Run by "make test".
+#Each case runs fti2c, then checks its exit code and output. Exit code of this script is the failed case count.
+
+CMD=${CMD:-$(pwd)/fti2c}
+EMU="-E default"
+TMP=$(mktemp -d /tmp/fti2c_test.XXXXXX)
+PASS=0
+FAIL=0
+
+#Keep the test away from a daemon, register map or bus snapshot of the user.
+export FTI2C_SOCKET=$TMP/fti2c.sock
+unset FTI2C_EMU FTI2C_REGMAP FTI2C_BUS_CACHE FTI2C_LATENCY
+cd $TMP || exit 1
+
+#check [Name] [Exit] [Pattern] [Command...]
+#   Exit - Exit code, "!0" for any failure.
+#   Pattern - Extended regex the output must match, "!" in front for must not match, "" for any output.
+check()
+{
+    name=$1
+    expect=$2
+    pattern=$3
+    shift 3
+    out=$("$@" 2>&1)
+    ret=$?
+    ok=1
+
+    if [ "$expect" = "!0" ]; then
+        [ $ret -ne 0 ] || ok=0
+    else
+        [ $ret -eq $expect ] || ok=0
+    fi
+    case "$pattern" in
+    "") ;;
+    !*) printf '%s\n' "$out" | grep -Eq -- "${pattern#!}" && ok=0 ;;
+    *) printf '%s\n' "$out" | grep -Eq -- "$pattern" || ok=0 ;;
+    esac
+
+    if [ $ok -eq 1 ]; then
+        PASS=$((PASS + 1))
+        echo "PASS $name"
+    else
+        FAIL=$((FAIL + 1))
+        echo "FAIL $name, exit=[$ret] expect=[$expect] pattern=[$pattern]"
+        printf '%s\n' "$out" | sed 's/^/    /'
+    fi
+}
+
+#mkimage [File] [Size] [Seed]  Byte i of the file is (i * 7 + Seed) % 256.
+mkimage()
+{
+    i=0
+    fmt=""
+    while [ $i -lt $2 ]; do
+        fmt="$fmt\\$(printf %o $(((i * 7 + $3) % 256)))"
+        i=$((i + 1))
+    done
+    printf "$fmt" > $1
+}
+
+#mkscript [File] [Line...]  Script of 1 line per arg.
+mkscript()
+{
+    file=$1
+    shift
+    printf '%s\n' "$@" > $file
+}
+
+mkimage img256.bin 256 3
+
+echo "==== Sweep ===="
+check "sweep all" 0 "detected=\[2\]" $CMD $EMU -s 0
+check "sweep finds eeprom" 0 "detected: 0x50" $CMD $EMU -s 0
+check "sweep finds regs" 0 "detected: 0x68" $CMD $EMU -s 0
+check "sweep range" 0 "probed=\[8\] detected=\[1\]" $CMD $EMU -s 0 -a 0x50 -b 0x57
+check "sweep allowlist quick" 0 "probed=\[3\] detected=\[2\]" $CMD $EMU -s 0 0x50 0x55 0x68 -q
+check "sweep bad range" "!0" "Invalid sweep range" $CMD $EMU -s 0 -a 0x70 -b 0x10
+
+echo "==== Read / write ===="
+check "devread" 0 "REG_READ, REG=\[0x10\], count=\[4\]" $CMD $EMU -d 0 0x68 0x10 4
+check "devread absent slave" "!0" "ADDRESS_NACK" $CMD $EMU -d 0 0x40 0x10 1
+check "read" 0 "I2C READ, count=\[2\]" $CMD $EMU -r 0 0x68 2
+check "write" 0 "I2C WRITE, count=\[2\]" $CMD $EMU -w 0 0x68 0x10 0x55
+check "missing args" "!0" "Not enough parameters" $CMD $EMU -d 0 0x68 0x10
+check "bus out of range" "!0" "" $CMD $EMU -d 5 0x68 0x10 1
+
+echo "==== Bus id ===="
+#Emulated bus N has LocId 0x1000+N and serial EMU000N, a register written on bus 1 shows which bus --id selects.
+BUS2="-E bus=2,regs=0x68:256"
+mkscript idserial.txt "-v 1 0x68 0x20 0x77" "-i EMU0001 -d 0 0x68 0x20 2"
+check "id serial" 0 "0x77	0x00" $CMD $BUS2 -S idserial.txt
+mkscript idlocid.txt "-v 1 0x68 0x20 0x77" "-i 0x1001 -d 0 0x68 0x20 2"
+check "id locid" 0 "0x77	0x00" $CMD $BUS2 -S idlocid.txt
+check "id with emu" 0 "REG_READ" $CMD $BUS2 -i EMU0001 -d 0 0x68 0x20 1
+check "id missing" "!0" "Can't find I2C bus \[EMU0009\]" $CMD $BUS2 -i EMU0009 -d 0 0x68 0x20 1
+printf 'fti2c-bus-cache emu\n0x1001 0x2 0xA 0x403601C 12345678 FT4222 A\n' > bus.cache
+check "id all-digit serial" 0 "REG_READ" env FTI2C_BUS_CACHE=bus.cache $CMD $BUS2 -i 12345678 -d 0 0x68 0x20 1
+printf 'fti2c-bus-cache emu\n0x1000 0x2 0xA 0x403601C EMU0000 FT4222 A\n' > bus.cache
+check "id stale cache serial" 0 "REG_READ" env FTI2C_BUS_CACHE=bus.cache $CMD $BUS2 -i EMU0001 -d 0 0x68 0x20 1
+check "id stale cache refreshed" 0 "EMU0001" cat bus.cache
+printf 'fti2c-bus-cache emu\n0x1005 0x2 0xA 0x403601C EMU0005 FT4222 A\n' > bus.cache
+check "id stale cache locid" 0 "REG_READ" env FTI2C_BUS_CACHE=bus.cache $CMD $BUS2 -d 0 0x68 0x20 1
+check "id stale cache locid refreshed" 0 "!EMU0005" cat bus.cache
+
+echo "==== Script ===="
+mkscript rw.txt "# register file @ 0x68" "devwrite 0 0x68 0x10 0x11 0x22 0x33" "-d 0 0x68 0x10 3" \
+        "--maskwrite 0 0x68 0x10 0x0F 0xFF"  "-d 0 0x68 0x10 1"
+check "script ok" 0 "OK=\[4\] FAIL=\[0\]" $CMD $EMU -S rw.txt
+check "script read back" 0 "0x11	0x22	0x33" $CMD $EMU -S rw.txt
+check "script mask write" 0 "0x1F" $CMD $EMU -S rw.txt
+mkscript fail.txt "-d 0 0x68 0x10 1" "-d 0 0x40 0x10 1" "-d 0 0x68 0x10 1"
+check "script stops at fail" "!0" "OK=\[1\] FAIL=\[1\]" $CMD $EMU -S fail.txt
+check "script keepgoing" "!0" "OK=\[2\] FAIL=\[1\]" $CMD $EMU -S fail.txt -k
+mkscript stdin.txt "-d 0 0x68 0x10 1"
+check "script stdin" 0 "OK=\[1\] FAIL=\[0\]" sh -c "$CMD $EMU -S - < stdin.txt"
+check "script missing" "!0" "Can't open script" $CMD $EMU -S none.txt
+mkscript long.txt "devwrite 0 0x68 0x10$(printf ' 0x%02X' $(seq 1 250))" "-d 0 0x68 0x10 1"
+check "script long line fails" "!0" "longer than \[1022\]" $CMD $EMU -S long.txt -k
+check "script long line once" "!0" "OK=\[1\] FAIL=\[1\]" $CMD $EMU -S long.txt -k
+check "script long line not run" "!0" "!REG_WRITE" $CMD $EMU -S long.txt -k
+LONGARG=$(printf 'a%.0s' $(seq 1 600))
+check "option data too long" "!0" "longer than \[255\] chars" $CMD $EMU -d 0 0x68 0x10 1 -j $LONGARG
+check "option data too long not run" "!0" "!REG_READ" $CMD $EMU -d 0 0x68 0x10 1 -F $LONGARG
+check "option data missing" "!0" "Missing data args of \[-z\]" $CMD $EMU -d 0 0x68 0x10 1 -z
+mkscript initfail.txt "-d 0 0x68 0x10 1 -f 5000" "-d 0 0x68 0x10 1"
+check "script opens bus after init failed" "!0" "OK=\[1\] FAIL=\[1\]" $CMD $EMU -S initfail.txt -k
+mkscript nodata.txt "-d 0 0x68 0x10 1" "-d 0 0x68 0x10 1 -z" "-d 0 0x68 0x10 1 -F $LONGARG"
+check "script option data missing" "!0" "OK=\[1\] FAIL=\[2\]" $CMD $EMU -S nodata.txt -k
+check "script option data no pointer" "!0" "!NULL pointer" $CMD $EMU -S nodata.txt -k
+
+echo "==== Transfer of any length ===="
+mkscript file.txt "devwrite 0 0x68 0x00 -F img256.bin" "devread 0 0x68 0x00 256 -F out.bin"
+check "file write and read" 0 "count=\[256\], file=\[out.bin\]" $CMD -E "max=16,regs=0x68:256" -S file.txt
+check "file read back" 0 "" cmp img256.bin out.bin
+check "read to file" 0 "I2C READ, count=\[64\]" $CMD $EMU -r 0 0x68 64 -F raw.bin
+
+echo "==== EEPROM ===="
+mkscript eeprom.txt "eeprom 0 0x50 0 -F img256.bin" "devread 0 0x50 0 256 -F out.bin"
+check "eeprom write" 0 "EEPROM WRITE, offset=\[0x0\], count=\[256\], pages=\[32\]" $CMD $EMU -S eeprom.txt
+check "eeprom read back" 0 "" cmp img256.bin out.bin
+check "eeprom page size" 0 "pages=\[16\]" $CMD $EMU -e 0 0x50 0 -p 16 -F img256.bin
+check "eeprom unaligned" 0 "count=\[20\], pages=\[4\]" sh -c "head -c 20 img256.bin > part.bin; $CMD $EMU -e 0 0x50 5 -F part.bin"
+check "eeprom no file" "!0" "Not enough parameters" $CMD $EMU -e 0 0x50 0
+check "eeprom missing file" "!0" "Can't read file" $CMD $EMU -e 0 0x50 0 -F none.bin
+check "eeprom end of 1 byte address" 0 "count=\[256\]" $CMD -E "eeprom=0x50:2048:16" -e 0 0x50 0x700 -F img256.bin
+check "eeprom past 1 byte address" "!0" "out of \[0x800\]" $CMD -E "eeprom=0x50:2048:16" -e 0 0x50 0x701 -F img256.bin
+check "eeprom end of 2 bytes address" 0 "count=\[256\]" $CMD -E "eeprom=0x50:65536:64:2" -e 0 0x50 0xFF00 -z 2 -p 64 -F img256.bin
+check "eeprom past 2 bytes address" "!0" "out of \[0x10000\]" $CMD -E "eeprom=0x50:65536:64:2" -e 0 0x50 0xFF01 -z 2 -p 64 -F img256.bin
+check "eeprom past address not written" "!0" "count=\[0\], pages=\[0\]" $CMD -E "eeprom=0x50:65536:64:2" -e 0 0x50 0x10000 -z 2 -F img256.bin
+
+mkimage img256b.bin 256 5
+mkscript delta.txt "eeprom 0 0x50 0 -F img256.bin" "eeprom 0 0x50 0 -u -F img256.bin" "eeprom 0 0x50 0 -u -F img256b.bin" \
+        "devread 0 0x50 0 256 -F out.bin"
+check "delta unchanged" 0 "pages skipped=\[32\] written=\[0\] verified=\[0\]" $CMD $EMU -S delta.txt
+check "delta changed" 0 "pages skipped=\[0\] written=\[32\] verified=\[32\]" $CMD $EMU -S delta.txt
+check "delta read back" 0 "" cmp img256b.bin out.bin
+#Page 0 is rewritten by the wrapped write of 16 bytes, the cache still holds the image.
+sh -c "head -c 8 img256.bin; printf '\356\356\356\356\356\356\356\356'" > wrap.bin
+mkscript deltacache.txt "eeprom 0 0x50 0 -F img256.bin" "devread 0 0x50 0 16" "eeprom 0 0x50 0 -p 16 -F wrap.bin" \
+        "eeprom 0 0x50 0 -u -F img256.bin" "devread 0 0x50 0 256 -F out.bin"
+check "delta cache" 0 "pages skipped=\[31\] written=\[1\] verified=\[1\]" $CMD $EMU -C -S deltacache.txt
+check "delta cache read back" 0 "" cmp img256.bin out.bin
+
+mkscript verify.txt "eeprom 0 0x50 0 -F img256.bin" "verify 0 0x50 0 -F img256.bin"
+check "verify match" 0 "count=\[256\], match" $CMD $EMU -S verify.txt
+mkscript verifybad.txt "eeprom 0 0x50 0 -F img256.bin" "verify 0 0x50 0 -F img256b.bin"
+check "verify mismatch" "!0" "mismatch at \[0x0\]" $CMD $EMU -S verifybad.txt
+mkscript verifycache.txt "eeprom 0 0x50 0 -F img256.bin" "devread 0 0x50 0 16" "eeprom 0 0x50 0 -p 16 -F wrap.bin" \
+        "verify 0 0x50 0 -F img256.bin"
+check "verify cache" "!0" "mismatch at \[0x0\]" $CMD $EMU -C -S verifycache.txt
+
+echo "==== Read-modify-write ===="
+mkscript rmw.txt "-v 0 0x68 0x12 0x33 0x44" "-M 0 0x68 0x12 0xF0 0x50 0x68 0x13 0x01 0x01 0x68 0x20 0xFF 0x99" \
+        "-M 0 0x68 0x12 0x0F 0x03" "-d 0 0x68 0x12 2"
+check "rmw batch" 0 "ops=\[3\] devices=\[1\] reads=\[1\] writes=\[2\]" $CMD $EMU -S rmw.txt
+check "rmw value" 0 "REG=\[0x12\] MASK=\[0xF0\] 0x33 -> 0x53" $CMD $EMU -S rmw.txt
+check "rmw unchanged skipped" 0 "ops=\[1\] devices=\[1\] reads=\[1\] writes=\[0\] skipped=\[1\]" $CMD $EMU -S rmw.txt
+check "rmw read back" 0 "0x53	0x45" $CMD $EMU -S rmw.txt
+check "rmw groups of 4" "!0" "groups of" $CMD $EMU -M 0 0x68 0x12 0xF0
+check "rmw 2 bytes register" 0 "REG=\[0x110\]" $CMD -E "regs=0x68:1024:2" -z 2 -M 0 0x68 0x110 0xFF 0x01
+check "rmw register past addrsize" "!0" "Register \[0x110\] is larger" $CMD $EMU -M 0 0x68 0x110 0xFF 0x01
+check "maskwrite registers past addrsize" "!0" "Register \[0x100\] is larger" $CMD $EMU -m 0 0x68 0xFF 0xFF 0x01 0x02
+check "maskwrite last register" 0 "" $CMD $EMU -m 0 0x68 0xFE 0xFF 0x01 0x02
+
+echo "==== Gather ===="
+mkscript gather.txt "-v 0 0x68 0x02 0x12 0x13" "-v 0 0x68 0x07 0x17 0x18" "-G 0 0x68 0x08 0x68 0x02 0x68 0x07 0x68 0x03"
+check "gather 1 read" 0 "regs=\[4\] devices=\[1\] reads=\[1\] bridged=\[3\] gap=\[4\]" $CMD $EMU -S gather.txt
+check "gather given order" 0 "REG=\[0x08\] 0x18" $CMD $EMU -S gather.txt
+check "gather value" 0 "REG=\[0x03\] 0x13" $CMD $EMU -S gather.txt
+check "gather gap 0" 0 "reads=\[2\] bridged=\[0\] gap=\[0\]" $CMD $EMU -S gather.txt -g 0
+check "gather bad gap" "!0" "Invalid gap" $CMD $EMU -G 0 0x68 0x02 -g 100000
+check "gather pairs" "!0" "groups of" $CMD $EMU -G 0 0x68 0x02 0x68
+check "gather register past addrsize" "!0" "Register \[0x102\] is larger" $CMD $EMU -G 0 0x68 0x102
+
+echo "==== Coalesce ===="
+mkscript coal.txt "-v 0 0x68 0x10 0x01" "-v 0 0x68 0x11 0x02" "-v 0 0x68 0x12 0x03" "-d 0 0x68 0x10 3"
+check "coalesce burst" 0 "writes=\[3\] bursts=\[1\] bytes=\[3\]" $CMD $EMU -c -W -S coal.txt
+check "coalesce data" 0 "0x01.0x02.0x03" $CMD $EMU -c -W -S coal.txt
+check "coalesce off" 0 "!I2C COALESCE" $CMD $EMU -W -S coal.txt
+check "coalesce noinc" 0 "writes=\[3\] bursts=\[3\]" $CMD $EMU -c -A 0x68 -W -S coal.txt
+mkscript coalgap.txt "-v 0 0x68 0x10 0x01" "-v 0 0x68 0x14 0x02" "-d 0 0x68 0x10 5"
+check "coalesce not contiguous" 0 "writes=\[2\] bursts=\[2\]" $CMD $EMU -c -W -S coalgap.txt
+check "coalesce no script" 0 "!queued" $CMD $EMU -c -v 0 0x68 0x10 0x01
+
+echo "==== Cache ===="
+mkscript cache.txt "-v 0 0x68 0x10 0x01 0x02" "-d 0 0x68 0x10 2" "-d 0 0x68 0x11 1" "-d 0 0x68 0x10 4"
+check "cache hits" 0 "hits=\[2\] misses=\[1\] volatile=\[0\]" $CMD $EMU -C -W -S cache.txt
+check "cache off" 0 "!I2C CACHE" $CMD $EMU -W -S cache.txt
+check "cache volatile" 0 "hits=\[0\] misses=\[0\] volatile=\[3\]" $CMD $EMU -C -W -V 0x68:0x10:2 -S cache.txt
+check "cache nonvolatile" 0 "hits=\[1\] misses=\[0\] volatile=\[2\]" $CMD $EMU -C -W -V 0x68:0x10:2 -N 0x68:0x11 -S cache.txt
+mkscript cacheraw.txt "-v 0 0x68 0x10 0x01" "-w 0 0x68 0x10 0x05" "-d 0 0x68 0x10 1"
+check "cache raw write drops device" 0 "0x05.*hits=\[0\] misses=\[1\]" sh -c "$CMD $EMU -C -W -S cacheraw.txt | tr '\n' ' '"
+for i in $(seq 1 70); do echo "-V 0x68:0x10:1 -d 0 0x68 0x10 1"; done > cachevol.txt
+check "cache same volatile range" 0 "OK=\[70\] FAIL=\[0\]" $CMD $EMU -C -S cachevol.txt
+printf 'device sensor 0x68\nreg STATUS 0x30 1 RO volatile\n' > vol.map
+printf 'device sensor 0x68\nreg STATUS 0x30 1 RO\n' > novol.map
+for i in $(seq 1 40); do echo "-d 0 sensor STATUS -R vol.map"; echo "-d 0 sensor STATUS -R novol.map"; done > cachemap.txt
+check "cache map reload" 0 "OK=\[80\] FAIL=\[0\]" $CMD $EMU -C -S cachemap.txt
+mkscript cachemap2.txt "-d 0 0x68 0x30 1 -R vol.map" "-d 0 0x68 0x30 1" "-d 0 0x68 0x30 1 -R novol.map" "-d 0 0x68 0x30 1"
+check "cache map volatile cleared" 0 "hits=\[1\] misses=\[1\] volatile=\[2\]" $CMD $EMU -C -W -S cachemap2.txt
+mkscript cachewrap.txt "eeprom 0 0x50 0 -F img256.bin" "devread 0 0x50 0 16" "eeprom 0 0x50 0 -p 16 -F wrap.bin" \
+        "devread 0 0x50 0 16"
+check "cache eeprom wrapped page" 0 "^0xEE	0xEE	0xEE	0xEE	0xEE	0xEE	0xEE	0xEE	0x" $CMD $EMU -C -S cachewrap.txt
+mkscript cacheother.txt "-d 0 0x68 0x10 1" "eeprom 0 0x50 0 -F img256.bin" "verify 0 0x50 0 -F img256.bin" \
+        "-d 0 0x68 0x10 1"
+check "cache eeprom keeps other devices" 0 "hits=\[1\] misses=\[" $CMD $EMU -C -W -S cacheother.txt
+
+echo "==== Monitor ===="
+check "monitor samples" 0 "samples=\[3\] written=\[3\] dropped=\[0\]" $CMD $EMU -o 0 0x68 0x10 0x68 0x11 -H 200 -x 3
+check "monitor csv header" 0 "time_ms,0x68:0x10,0x68:0x11" $CMD $EMU -o 0 0x68 0x10 0x68 0x11 -x 1
+check "monitor to file" 0 "" sh -c "$CMD $EMU -o 0 0x68 0x10 -x 2 -F mon.csv && [ \$(wc -l < mon.csv) -eq 3 ]"
+check "monitor bad rate" "!0" "Invalid rate" $CMD $EMU -o 0 0x68 0x10 -H 0 -x 1
+check "monitor register past addrsize" "!0" "Register \[0x110\] is larger" $CMD $EMU -o 0 0x68 0x110 -x 1
+
+echo "==== Trigger ===="
+GPIO="-E eeprom=0x50:256:8,regs=0x68:256,gpio=3:10000"
+check "trigger reads" 0 "TRIGGER, waits=\[3\].*timeouts=\[0\]" $CMD $GPIO -T 0 0x68 0x10 4 -x 3
+check "trigger cache bypass" 0 "call=\[READ\] count=\[5\] bytes=\[20\]" \
+        env FTI2C_LATENCY=1 $CMD $GPIO -C -T 0 0x68 0x10 4 -x 5
+check "trigger no edge" "!0" "No edge on GPIO3 in \[50\] ms" $CMD $EMU -T 0 0x68 0x10 1 -t 50
+
+echo "==== Trace ===="
+check "trace records" 0 "records=\[5\] dropped=\[0\]" $CMD $EMU -v 0 0x68 0x10 0x55 0x66 -j write.trace
+mkscript trace.txt "-v 0 0x68 0x10 0x55" "-d 0 0x68 0x10 1"
+check "trace script" 0 "records=\[8\] dropped=\[0\]" $CMD $EMU -S trace.txt -j script.trace
+check "trace empty" 0 "records=\[0\] dropped=\[0\] chunks=\[0\]" $CMD $EMU -S /dev/null -j empty.trace
+check "trace bad file" "!0" "Can't open trace file" $CMD $EMU -v 0 0x68 0x10 0x55 -j none/x.trace
+check "trace cut short" 0 "is cut short" sh -c "head -c 30 write.trace > cut.trace; $CMD $EMU -Y 0 -F cut.trace"
+
+echo "==== Replay ===="
+$CMD -E "regs=0x70:256,busy=3" -d 0 0x70 0x10 2 -j board.trace > /dev/null
+check "replay same board" 0 "replayed=\[3\] skipped=\[6\] diverged=\[0\] compared=\[2\]" \
+        $CMD -E "regs=0x70:256" -Y 0 -F board.trace -K
+check "replay fast busy" 0 "replayed=\[3\] skipped=\[6\] diverged=\[0\]" $CMD -E "regs=0x70:256,busy=5" -Y 0 -F board.trace -Q -K
+check "replay other board" "!0" "first divergence at record \[2\]" $CMD $EMU -Y 0 -F board.trace -Q
+check "replay status" "!0" "STATUS .*controller \[0x20\] -> \[0x26\]" $CMD $EMU -Y 0 -F board.trace -Q -k
+$CMD -E "eeprom=0x50:256:8" -d 0 0x50 0 2 -j rom.trace > /dev/null
+check "replay data" "!0" "READ addr=\[0x50\] size=\[2\], data\[0\] \[0xFF\] -> \[0x00\]" \
+        $CMD -E "regs=0x50:256" -Y 0 -F rom.trace -K -Q
+check "replay data not compared" 0 "diverged=\[0\] compared=\[0\]" $CMD -E "regs=0x50:256" -Y 0 -F rom.trace -Q
+check "replay no file" "!0" "must be given by --file" $CMD $EMU -Y 0
+
+echo "==== Retry ===="
+FAULT="-E regs=0x68:256,nack=10,arb=5"
+for i in $(seq 1 20); do echo "-d 0 0x68 0x10 2"; done > retry.txt
+check "retry recovers" 0 "OK=\[20\] FAIL=\[0\]" $CMD $FAULT -U "3,reinit" -W -S retry.txt
+check "retry stat" 0 "I2C RETRY, errors=\[[1-9][0-9]*\] retries=\[[1-9][0-9]*\].* failed=\[0\]" \
+        $CMD $FAULT -U "3,reinit" -W -S retry.txt
+check "no retry fails" "!0" "FAIL=\[1\]" $CMD $FAULT -W -S retry.txt
+check "retry gives up" "!0" "errors=\[3\] retries=\[2\] recovered=\[0\] failed=\[1\]" \
+        sh -c "echo '-d 0 0x68 0x10 1' > one.txt; $CMD -E regs=0x68:256,nack=100 -U 2 -W -S one.txt"
+check "retry 1 status poll" 0 "call=\[STATUS\] count=\[1\]" env FTI2C_LATENCY=1 $CMD $EMU -U 3 -d 0 0x68 0x10 2
+check "retry 1 status poll write" 0 "call=\[STATUS\] count=\[1\]" env FTI2C_LATENCY=1 $CMD $EMU -U 3 -v 0 0x68 0x10 2
+
+echo "==== Parallel ===="
+PAR="-E bus=3,eeprom=0x50:256:8,regs=0x68:256"
+mkscript par.txt "devwrite 0 0x68 0x10 0x12 0x34" "devread 0 0x68 0x10 2"
+check "parallel all" 0 "buses=\[3\] OK=\[3\] FAIL=\[0\]" $CMD $PAR -P all -S par.txt
+check "parallel list" 0 "buses=\[2\] OK=\[2\] FAIL=\[0\]" $CMD $PAR -P 0,2 -S par.txt
+check "parallel settings on --parallel" 0 "buses=\[3\] OK=\[3\]" $CMD $PAR -P all -S par.txt -g 2 -c -A 0x50
+mkscript pargap.txt "-G 0 0x68 0x10 0x68 0x12 -g 2"
+check "parallel refuses gap" "!0" "Can't change --gap" $CMD $PAR -P all -S pargap.txt
+mkscript parcoal.txt "-v 0 0x68 0x10 0x01 -c"
+check "parallel refuses coalesce" "!0" "Can't change --gap" $CMD $PAR -P all -S parcoal.txt
+mkscript parnoinc.txt "-v 0 0x68 0x10 0x01 -A 0x68"
+check "parallel refuses noinc" "!0" "Can't change --gap" $CMD $PAR -P all -S parnoinc.txt
+mkscript parnest.txt "-P all -S par.txt"
+check "parallel nested" "!0" "can't be nested" $CMD $PAR -P all -S parnest.txt
+
+echo "==== Daemon ===="
+#The daemon runs in another working directory, relative paths of a client are resolved by the client.
+cd /
+FTI2C_EMU="bus=2,eeprom=0x50:256:8,regs=0x68:256" $CMD -D > $TMP/daemon.log 2>&1 &
+DAEMON=$!
+cd $TMP
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -S $FTI2C_SOCKET ] && break
+    sleep 0.2
+done
+check "daemon running" "!0" "already running" $CMD -D
+check "daemon write" 0 "REG_WRITE, REG=\[0x20\], count=\[1\]" $CMD -v 0 0x68 0x20 0x5A
+check "daemon keeps bus" 0 "0x5A" $CMD -d 0 0x68 0x20 1
+check "daemon error" "!0" "ADDRESS_NACK" $CMD -d 0 0x40 0x10 1
+check "nodaemon" 0 "!0x5A" $CMD $EMU -n -d 0 0x68 0x20 1
+check "daemon relative file" 0 "EEPROM WRITE, offset=\[0x0\], count=\[256\]" $CMD -e 0 0x50 0 -F img256.bin
+check "daemon relative new file" 0 "file=\[$TMP/new.bin\]" $CMD -d 0 0x50 0 256 -F new.bin
+check "daemon new file read back" 0 "" cmp img256.bin new.bin
+check "daemon relative script" 0 "OK=\[1\] FAIL=\[0\]" $CMD -S stdin.txt
+cp img256.bin "my img.bin"
+check "daemon arg with space" 0 "EEPROM WRITE" $CMD -e 0 0x50 0 -F "my img.bin"
+check "daemon refuses emu" "!0" "use --nodaemon" $CMD -E "regs=0x10:16" -s 0
+check "daemon keeps backend" 0 "detected=\[2\]" $CMD -s 0
+check "daemon refuses trace" "!0" "use --nodaemon" $CMD -d 0 0x68 0x20 1 -j x.trace
+check "daemon refuses endless monitor" "!0" "use --nodaemon" $CMD -o 0 0x68 0x20
+check "daemon monitor samples" 0 "samples=\[2\]" $CMD -o 0 0x68 0x20 -x 2
+check "daemon init fails" "!0" "CLK_NOT_SUPPORTED" $CMD -d 1 0x68 0x10 1 -f 5000
+check "daemon opens bus after init failed" 0 "REG_READ, REG=\[0x10\]" $CMD -d 1 0x68 0x10 1
+check "daemon refuses endless trigger" "!0" "use --nodaemon" $CMD -T 0 0x68 0x20 1 -t 0
+kill -INT $DAEMON
+wait $DAEMON
+check "daemon stopped" 0 "daemon stopped" cat daemon.log
+
+cd /
+rm -rf $TMP
+echo "Test done: PASS=[$PASS] FAIL=[$FAIL]"
+exit $FAIL
@@ -0,0 +1,98 @@
+/******************************************************************************
+ * @file    test_hpp.cpp
+ *          Regression test of ft_i2c.hpp on the emulated FT4222, run by
+ *          "make test". Each case prints PASS or FAIL, the exit code is
+ *          the number of failed cases.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <cstdio>
+
+#include "ft_i2c.hpp"
+#include "hal.h"
+
+//_Bool of the C API is a typedef for C++, a macro would leak into every C++ file.
+#ifdef _Bool
+#error "_Bool must not be a macro."
+#endif
+
+using Ctrl = fti2c::Register<0x10>;
+using Mode = fti2c::Field<Ctrl, 7, 4>;
+using En = fti2c::Field<Ctrl, 0>;
+using All = fti2c::Field<Ctrl, 7, 0>;
+using Thresh = fti2c::Register<0x12, 2, fti2c::Endian::Little>;
+
+static int gpass = 0;
+static int gfail = 0;
+
+static void check(const char *name, bool ok)
+{
+    std::printf("%s %s\n", ok ? "PASS" : "FAIL", name);
+    (ok ? gpass : gfail)++;
+}
+
+//Bus checks since the last call, 1 per register read or write of fti2c::Device.
+static uint32 transfers(void)
+{
+    stI2cWaitStat stat;
+
+    FT_getWaitStat(&stat);
+    FT_resetWaitStat();
+    return stat.Calls;
+}
+
+int main(void)
+{
+    FT_HANDLE ftHandle = NULL;
+
+    if ((HAL_useEmulator("regs=0x68:256") != FT_OK) || (FT_openI2cBus(0, &ftHandle, 400) != FT_OK))
+    {
+        std::printf("FAIL open emulated bus\n");
+        return 1;
+    }
+    fti2c::Device sensor(ftHandle, 0x68);
+
+    //write + read of a register
+    Ctrl ctrl;
+    check("hpp write", sensor.write(Ctrl{ 0x5A }) == FT_OK);
+    check("hpp read", (sensor.read(ctrl) == FT_OK) && (ctrl.value == 0x5A));
+
+    Mode mode;
+    check("hpp read field", (sensor.read(mode) == FT_OK) && (mode.value == 0x5));
+
+    //Little endian register, LSB at the lowest register address.
+    uint8 reg[1] = { Thresh::address };
+    uint8 buf[2] = { 0 };
+    uint32 done = 0;
+    Thresh thresh;
+    check("hpp write 16-bit", sensor.write(Thresh{ 0x1234 }) == FT_OK);
+    check("hpp byte order", (FT_readI2cReg(ftHandle, 0x68, reg, 1, buf, 2, &done) == FT_OK) && (buf[0] == 0x34)
+            && (buf[1] == 0x12));
+    check("hpp read 16-bit", (sensor.read(thresh) == FT_OK) && (thresh.value == 0x1234));
+
+    //Partial mask: read + write, other bits kept.
+    transfers();
+    check("hpp modify partial", sensor.modify(Mode{ 0xA }, En{ 1 }) == FT_OK);
+    check("hpp modify partial transfers", transfers() == 2);
+    check("hpp modify partial value", (sensor.read(ctrl) == FT_OK) && (ctrl.value == 0xAB));
+
+    //Unchanged value: read only.
+    transfers();
+    check("hpp modify unchanged", (sensor.modify(En{ 1 }) == FT_OK) && (transfers() == 1));
+
+    //Full mask: write only, no read.
+    transfers();
+    check("hpp modify full", sensor.modify(All{ 0x3C }) == FT_OK);
+    check("hpp modify full transfers", transfers() == 1);
+    check("hpp modify full value", (sensor.read(ctrl) == FT_OK) && (ctrl.value == 0x3C));
+
+    //Missing slave
+    fti2c::Device none(ftHandle, 0x40);
+    check("hpp read nack", none.read(ctrl) != FT_OK);
+
+    std::printf("Test done: PASS=[%d] FAIL=[%d]\n", gpass, gfail);
+    return gfail;
+}
@@ -0,0 +1,638 @@
+/******************************************************************************
+ * @file    trace.c
+ *          Binary trace of all bridge calls, for post-mortem of a board.
+ *
+ *          Every call of the HAL is a record, encoded by the calling thread
+ *          into its own chunk buffer, no lock is taken. A full chunk is
+ *          handed to a writer thread, which does the file I/O. Chunks left
+ *          are handed over when their thread exits or on TRACE_stop().
+ *
+ *          File:   "FTI2CTR1", u64 wall clock ns of the trace start, chunks.
+ *          Chunk:  u32 bytes of the chunk body, body:
+ *                  varint thread id, varint ns of the first record from trace start, records.
+ *          Record: u8 TRACE_OP, varint ns from the previous record of the chunk,
+ *                  varint duration ns, varint handle id, varint FT_STATUS,
+ *                  fields of the op, see TRACE_OP.
+ *
+ *          All integers are little endian, varint is 7 bits per byte LSB
+ *          first, bit 7 set if more bytes follow. Handle ids are given in
+ *          the order handles are first seen, TRACE_OPEN gives the LocId.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "ft_i2c.h"
+#include "trace.h"
+
+#define TRACE_RECORD_MAX        (1 + 8 * 10 + 1)    //!< Record bytes without payload.
+
+//!@typedef stTraceChunk
+//!         Chunk buffer of a thread, also a node of the writer queue.
+typedef struct stTraceChunk
+{
+    struct stTraceChunk *Next;
+    uint32 Len;                 //!< Bytes used in Data, header included.
+    uint32 Records;             //!< Records in the chunk
+    uint64 LastNs;              //!< Time of the last record
+    uint8 Data[TRACE_CHUNK_SIZE];
+} stTraceChunk;
+
+static atomic_bool gtrace_enable = 0;
+static char gtrace_path[256] =
+{ 0 };
+static FILE *gtrace_fp = NULL;
+static uint64 gtrace_start = 0;
+static pthread_t gtrace_writer;
+static pthread_key_t gtrace_key;
+static pthread_once_t gtrace_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t gtrace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gtrace_cond = PTHREAD_COND_INITIALIZER;
+static stTraceChunk *gtrace_head = NULL;    //!< Writer queue
+static stTraceChunk *gtrace_tail = NULL;
+static stTraceChunk *gtrace_free = NULL;    //!< Chunks written, for reuse
+static uint32 gtrace_queued = 0;
+static _Bool gtrace_stop = 0;
+static stTraceStat gtrace_stat;
+static FT_HANDLE gtrace_handle[TRACE_HANDLE_MAX];
+static atomic_uint gtrace_handle_count = 0;
+static atomic_uint gtrace_thread_count = 0;
+static atomic_uint gtrace_records = 0;
+
+static __thread stTraceChunk *gtrace_chunk = NULL;
+static __thread uint32 gtrace_thread_id = 0;
+
+static uint8 *trace_putVarint(uint8 *p, uint64 value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
+
+//Writer thread, write queued chunks until TRACE_stop().
+static void *trace_writer(void *arg)
+{
+    pthread_mutex_lock(&gtrace_lock);
+    for (;;)
+    {
+        while ((gtrace_head == NULL) && !gtrace_stop)
+        {
+            pthread_cond_wait(&gtrace_cond, &gtrace_lock);
+        }
+        if (gtrace_head == NULL)
+        {
+            break;
+        }
+
+        stTraceChunk *chunk = gtrace_head;
+        gtrace_head = chunk->Next;
+        gtrace_tail = (gtrace_head == NULL) ? NULL : gtrace_tail;
+        gtrace_queued--;
+        pthread_mutex_unlock(&gtrace_lock);
+
+        fwrite(chunk->Data, 1, chunk->Len, gtrace_fp);
+
+        pthread_mutex_lock(&gtrace_lock);
+        gtrace_stat.Chunks++;
+        gtrace_stat.Bytes += chunk->Len;
+        chunk->Next = gtrace_free;
+        gtrace_free = chunk;
+    }
+    pthread_mutex_unlock(&gtrace_lock);
+    fflush(gtrace_fp);
+    return NULL;
+}
+
+//Hand the chunk of current thread to the writer, or drop it if the writer is behind.
+static void trace_submit(stTraceChunk *chunk)
+{
+    if ((chunk == NULL) || (chunk->Records == 0))
+    {
+        return;
+    }
+
+    //Body length goes to the chunk header.
+    uint32 body = chunk->Len - 4;
+    chunk->Data[0] = body & 0xFF;
+    chunk->Data[1] = (body >> 8) & 0xFF;
+    chunk->Data[2] = (body >> 16) & 0xFF;
+    chunk->Data[3] = (body >> 24) & 0xFF;
+    chunk->Next = NULL;
+
+    pthread_mutex_lock(&gtrace_lock);
+    if (gtrace_queued >= TRACE_QUEUE_MAX)
+    {
+        gtrace_stat.Dropped += chunk->Records;
+        chunk->Next = gtrace_free;
+        gtrace_free = chunk;
+    }
+    else
+    {
+        if (gtrace_tail != NULL)
+        {
+            gtrace_tail->Next = chunk;
+        }
+        else
+        {
+            gtrace_head = chunk;
+        }
+        gtrace_tail = chunk;
+        gtrace_queued++;
+        pthread_cond_signal(&gtrace_cond);
+    }
+    pthread_mutex_unlock(&gtrace_lock);
+}
+
+//Thread exit, hand over the chunk left, or free it if trace is stopped.
+static void trace_onThreadExit(void *arg)
+{
+    if (TRACE_isEnabled())
+    {
+        trace_submit((stTraceChunk*) arg);
+    }
+    else
+    {
+        free(arg);
+    }
+    gtrace_chunk = NULL;
+}
+
+static void trace_initKey(void)
+{
+    pthread_key_create(&gtrace_key, trace_onThreadExit);
+}
+
+//Get a chunk of current thread with room for bytes, the first record time is start.
+static stTraceChunk *trace_reserve(uint32 bytes, uint64 start)
+{
+    stTraceChunk *chunk = gtrace_chunk;
+
+    if ((chunk != NULL) && (chunk->Len + bytes <= TRACE_CHUNK_SIZE))
+    {
+        return chunk;
+    }
+    trace_submit(chunk);
+
+    pthread_mutex_lock(&gtrace_lock);
+    chunk = gtrace_free;
+    gtrace_free = (chunk != NULL) ? chunk->Next : NULL;
+    pthread_mutex_unlock(&gtrace_lock);
+    chunk = (chunk != NULL) ? chunk : (stTraceChunk*) malloc(sizeof(stTraceChunk));
+    gtrace_chunk = chunk;
+    pthread_setspecific(gtrace_key, chunk);
+    if (chunk == NULL)
+    {
+        return NULL;
+    }
+
+    if (gtrace_thread_id == 0)
+    {
+        gtrace_thread_id = atomic_fetch_add(&gtrace_thread_count, 1) + 1;
+    }
+    uint8 *p = trace_putVarint(&chunk->Data[4], gtrace_thread_id);
+    p = trace_putVarint(p, start);
+    chunk->Len = p - chunk->Data;
+    chunk->Records = 0;
+    chunk->LastNs = start;
+    return chunk;
+}
+
+//Id of a handle, given in the order handles are first seen.
+static uint32 trace_getHandleId(FT_HANDLE ftHandle)
+{
+    uint32 count = atomic_load_explicit(&gtrace_handle_count, memory_order_acquire);
+
+    for (uint32 i = 0; i < count; i++)
+    {
+        if (gtrace_handle[i] == ftHandle)
+        {
+            return i;
+        }
+    }
+
+    pthread_mutex_lock(&gtrace_lock);
+    count = atomic_load_explicit(&gtrace_handle_count, memory_order_relaxed);
+    uint32 id = 0;
+    while ((id < count) && (gtrace_handle[id] != ftHandle))
+    {
+        id++;
+    }
+    if ((id == count) && (count < TRACE_HANDLE_MAX))
+    {
+        gtrace_handle[id] = ftHandle;
+        atomic_store_explicit(&gtrace_handle_count, count + 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&gtrace_lock);
+    return id;
+}
+
+//Encode record head, return pointer to the op fields or NULL if trace is stopped or no memory.
+static uint8 *trace_begin(stTraceChunk **pchunk, TRACE_OP op, uint64 start, FT_HANDLE ftHandle, FT_STATUS status,
+        uint32 payload)
+{
+    //Start is of FT_getTimeNs(), a call started right before the trace counts from trace start.
+    uint64 end = FT_getTimeNs() - gtrace_start;
+    start = (start > gtrace_start) ? start - gtrace_start : 0;
+
+    stTraceChunk *chunk = TRACE_isEnabled() ? trace_reserve(TRACE_RECORD_MAX + payload, start) : NULL;
+    *pchunk = chunk;
+    if (chunk == NULL)
+    {
+        return NULL;
+    }
+
+    //Records of a chunk are in call order of 1 thread, start is never before the last one.
+    uint8 *p = &chunk->Data[chunk->Len];
+    *p++ = op;
+    p = trace_putVarint(p, (start > chunk->LastNs) ? start - chunk->LastNs : 0);
+    p = trace_putVarint(p, end - start);
+    p = trace_putVarint(p, trace_getHandleId(ftHandle));
+    p = trace_putVarint(p, status);
+    chunk->LastNs = (start > chunk->LastNs) ? start : chunk->LastNs;
+    return p;
+}
+
+static void trace_end(stTraceChunk *chunk, uint8 *p)
+{
+    chunk->Len = p - chunk->Data;
+    chunk->Records++;
+    atomic_fetch_add_explicit(&gtrace_records, 1, memory_order_relaxed);
+}
+
+/*!@brief Start trace of all bridge calls to a file.
+ *
+ * @param path      Trace file, truncated if exists.
+ * @return          FT_OK, FT_INVALID_PARAMETER if the file can't be opened or trace is started already.
+ */
+FT_STATUS TRACE_start(const char *path)
+{
+    struct timespec ts;
+    uint8 head[16];
+
+    if (TRACE_isEnabled())
+    {
+        return FT_INVALID_PARAMETER;
+    }
+    pthread_once(&gtrace_once, trace_initKey);
+
+    gtrace_fp = fopen(path, "wb");
+    if (gtrace_fp == NULL)
+    {
+        CLI_ERROR("ERROR: Can't open trace file [%s]\n", path);
+        return FT_INVALID_PARAMETER;
+    }
+
+    //Header has the wall clock of trace start, records count from it by the monotonic clock.
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64 wall = (uint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    memcpy(head, TRACE_MAGIC, 8);
+    for (int i = 0; i < 8; i++)
+    {
+        head[8 + i] = (wall >> (i * 8)) & 0xFF;
+    }
+    fwrite(head, 1, sizeof(head), gtrace_fp);
+
+    memset(&gtrace_stat, 0, sizeof(gtrace_stat));
+    gtrace_stat.Bytes = sizeof(head);
+    atomic_store(&gtrace_records, 0);
+    atomic_store(&gtrace_handle_count, 0);
+    gtrace_start = FT_getTimeNs();
+    gtrace_stop = 0;
+    if (pthread_create(&gtrace_writer, NULL, trace_writer, NULL) != 0)
+    {
+        fclose(gtrace_fp);
+        gtrace_fp = NULL;
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+    snprintf(gtrace_path, sizeof(gtrace_path), "%s", path);
+    atomic_store_explicit(&gtrace_enable, 1, memory_order_release);
+    return FT_OK;
+}
+
+/*!@brief Stop trace, chunk of current thread and all chunks queued are written.
+ *          Records of other threads still running are lost, stop after they exit.
+ */
+void TRACE_stop(void)
+{
+    if (!TRACE_isEnabled())
+    {
+        return;
+    }
+    atomic_store_explicit(&gtrace_enable, 0, memory_order_release);
+    trace_submit(gtrace_chunk);
+    gtrace_chunk = NULL;
+    pthread_setspecific(gtrace_key, NULL);
+
+    pthread_mutex_lock(&gtrace_lock);
+    gtrace_stop = 1;
+    pthread_cond_signal(&gtrace_cond);
+    pthread_mutex_unlock(&gtrace_lock);
+    pthread_join(gtrace_writer, NULL);
+
+    fclose(gtrace_fp);
+    gtrace_fp = NULL;
+    gtrace_stat.Records = atomic_load(&gtrace_records);
+    while (gtrace_free != NULL)
+    {
+        stTraceChunk *next = gtrace_free->Next;
+        free(gtrace_free);
+        gtrace_free = next;
+    }
+}
+
+_Bool TRACE_isEnabled(void)
+{
+    return atomic_load_explicit(&gtrace_enable, memory_order_relaxed);
+}
+
+//Path of the trace file, "" if never started.
+const char *TRACE_getPath(void)
+{
+    return gtrace_path;
+}
+
+/*!@brief Add a record of a call without payload, nothing is done if trace is stopped.
+ *
+ * @param op        Call
+ * @param start     FT_getTimeNs() before the call
+ * @param ftHandle  Handle of the call
+ * @param status    Return of the call
+ * @param value     LocId of TRACE_OPEN, kbps of TRACE_INIT, controller status of TRACE_STATUS.
+ */
+void TRACE_add(TRACE_OP op, uint64 start, FT_HANDLE ftHandle, FT_STATUS status, uint32 value)
+{
+    stTraceChunk *chunk = NULL;
+    uint8 *p = trace_begin(&chunk, op, start, ftHandle, status, 0);
+
+    if (p == NULL)
+    {
+        return;
+    }
+    if ((op == TRACE_OPEN) || (op == TRACE_INIT))
+    {
+        p = trace_putVarint(p, value);
+    }
+    else if (op == TRACE_STATUS)
+    {
+        *p++ = value;
+    }
+    trace_end(chunk, p);
+}
+
+/*!@brief Add a record of a read or write with the data, nothing is done if trace is stopped.
+ *
+ * @param op        TRACE_READ or TRACE_WRITE
+ * @param start     FT_getTimeNs() before the call
+ * @param ftHandle  Handle of the call
+ * @param status    Return of the call
+ * @param addr      Slave address
+ * @param flag      I2C_MasterFlag
+ * @param buf       Data, Done bytes read or Size bytes to write.
+ * @param size      Bytes requested
+ * @param done      Bytes transferred
+ */
+void TRACE_addTransfer(TRACE_OP op, uint64 start, FT_HANDLE ftHandle, FT_STATUS status, uint16 addr, uint8 flag,
+        const uint8 *buf, uint16 size, uint16 done)
+{
+    stTraceChunk *chunk = NULL;
+    uint16 len = (op == TRACE_READ) ? done : size;
+    uint8 *p = trace_begin(&chunk, op, start, ftHandle, status, len);
+
+    if (p == NULL)
+    {
+        return;
+    }
+    p = trace_putVarint(p, addr);
+    *p++ = flag;
+    p = trace_putVarint(p, size);
+    p = trace_putVarint(p, done);
+    memcpy(p, buf, len);
+    trace_end(chunk, p + len);
+}
+
+//Get statistic of the last trace, complete after TRACE_stop().
+void TRACE_getStat(stTraceStat *stat)
+{
+    pthread_mutex_lock(&gtrace_lock);
+    *stat = gtrace_stat;
+    pthread_mutex_unlock(&gtrace_lock);
+    stat->Records = atomic_load(&gtrace_records);
+}
+
+void TRACE_printStat(const stTraceStat *stat)
+{
+    CLI_PRINT("I2C TRACE, file=[%s], records=[%u] dropped=[%u] chunks=[%u] bytes=[%llu]\n", gtrace_path,
+            stat->Records, stat->Dropped, stat->Chunks, (unsigned long long) stat->Bytes);
+}
+
+//Decode a varint, return 0 if it runs past end.
+static _Bool trace_getVarint(const uint8 **pp, const uint8 *end, uint64 *value)
+{
+    const uint8 *p = *pp;
+    uint64 v = 0;
+
+    for (int shift = 0; (p < end) && (shift < 64); shift += 7)
+    {
+        v |= (uint64) (*p & 0x7F) << shift;
+        if ((*p++ & 0x80) == 0)
+        {
+            *pp = p;
+            *value = v;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//Decode a record, return 0 if it runs past end or is unknown.
+static _Bool trace_getRecord(const uint8 **pp, const uint8 *end, uint64 *time, stTraceRecord *rec)
+{
+    const uint8 *p = *pp;
+    uint64 v[4];
+
+    if (p >= end)
+    {
+        return 0;
+    }
+    rec->Op = (TRACE_OP) *p++;
+    for (int i = 0; i < 4; i++)
+    {
+        if (!trace_getVarint(&p, end, &v[i]))
+        {
+            return 0;
+        }
+    }
+    *time += v[0];
+    rec->TimeNs = *time;
+    rec->DurationNs = v[1];
+    rec->Handle = v[2];
+    rec->Status = v[3];
+
+    switch (rec->Op)
+    {
+    case TRACE_OPEN:
+    case TRACE_INIT:
+        if (!trace_getVarint(&p, end, &v[0]))
+        {
+            return 0;
+        }
+        rec->Value = v[0];
+        break;
+    case TRACE_STATUS:
+        if (p >= end)
+        {
+            return 0;
+        }
+        rec->Value = *p++;
+        break;
+    case TRACE_READ:
+    case TRACE_WRITE:
+        if (!trace_getVarint(&p, end, &v[0]) || (p >= end))
+        {
+            return 0;
+        }
+        rec->Addr = v[0];
+        rec->Flag = *p++;
+        if (!trace_getVarint(&p, end, &v[1]) || !trace_getVarint(&p, end, &v[2]))
+        {
+            return 0;
+        }
+        rec->Size = v[1];
+        rec->Done = v[2];
+        uint32 len = (rec->Op == TRACE_READ) ? rec->Done : rec->Size;
+        if ((uint32) (end - p) < len)
+        {
+            return 0;
+        }
+        rec->Data = p;
+        p += len;
+        break;
+    case TRACE_CLOSE:
+    case TRACE_RESET:
+        break;
+    default:
+        return 0;
+    }
+    *pp = p;
+    return 1;
+}
+
+static int trace_compareRecord(const void *a, const void *b)
+{
+    const stTraceRecord *ra = (const stTraceRecord*) a;
+    const stTraceRecord *rb = (const stTraceRecord*) b;
+
+    if (ra->TimeNs != rb->TimeNs)
+    {
+        return (ra->TimeNs < rb->TimeNs) ? -1 : 1;
+    }
+    return (ra->Seq < rb->Seq) ? -1 : (ra->Seq > rb->Seq);
+}
+
+/*!@brief Load a trace file, records of all threads are sorted by time.
+ *          A file cut in a chunk, e.g. by a crash, keeps the records before it and sets Truncated.
+ *
+ * @param path      Trace file
+ * @param file      Pointer to store the trace, free by TRACE_unload().
+ * @return          FT_OK, FT_INVALID_PARAMETER if the file can't be read or isn't a trace,
+ *                  FT_INSUFFICIENT_RESOURCES if no memory.
+ */
+FT_STATUS TRACE_load(const char *path, stTraceFile *file)
+{
+    memset(file, 0, sizeof(stTraceFile));
+
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        CLI_ERROR("ERROR: Can't open trace file [%s]\n", path);
+        return FT_INVALID_PARAMETER;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    file->Buf = (size > 16) ? (uint8*) malloc(size) : NULL;
+    file->Size = (file->Buf != NULL) ? fread(file->Buf, 1, size, fp) : 0;
+    fclose(fp);
+    if ((file->Size < 16) || (memcmp(file->Buf, TRACE_MAGIC, 8) != 0))
+    {
+        CLI_ERROR("ERROR: [%s] is not a trace file.\n", path);
+        TRACE_unload(file);
+        return FT_INVALID_PARAMETER;
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        file->WallNs |= (uint64) file->Buf[8 + i] << (i * 8);
+    }
+
+    //1. Count records for the array, the smallest record is 5 bytes.
+    file->Record = (stTraceRecord*) calloc(file->Size / 5 + 1, sizeof(stTraceRecord));
+    if (file->Record == NULL)
+    {
+        TRACE_unload(file);
+        return FT_INSUFFICIENT_RESOURCES;
+    }
+
+    //2. Decode chunk by chunk, stop at a chunk cut short.
+    const uint8 *p = &file->Buf[16];
+    const uint8 *end = &file->Buf[file->Size];
+    while (p < end)
+    {
+        if (end - p < 4)
+        {
+            file->Truncated = 1;
+            break;
+        }
+        uint32 body = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32) p[3] << 24);
+        p += 4;
+        if ((uint32) (end - p) < body)
+        {
+            file->Truncated = 1;
+            break;
+        }
+
+        const uint8 *chunk_end = p + body;
+        uint64 thread = 0;
+        uint64 time = 0;
+        if (!trace_getVarint(&p, chunk_end, &thread) || !trace_getVarint(&p, chunk_end, &time))
+        {
+            file->Truncated = 1;
+            break;
+        }
+        while (p < chunk_end)
+        {
+            stTraceRecord *rec = &file->Record[file->Count];
+
+            memset(rec, 0, sizeof(stTraceRecord));
+            if (!trace_getRecord(&p, chunk_end, &time, rec))
+            {
+                file->Truncated = 1;
+                break;
+            }
+            rec->Thread = thread;
+            rec->Seq = file->Count++;
+        }
+        p = chunk_end;
+    }
+
+    qsort(file->Record, file->Count, sizeof(stTraceRecord), trace_compareRecord);
+    return FT_OK;
+}
+
+void TRACE_unload(stTraceFile *file)
+{
+    free(file->Buf);
+    free(file->Record);
+    memset(file, 0, sizeof(stTraceFile));
+}
@@ -0,0 +1,103 @@
+/******************************************************************************
+ * @file    trace.h
+ *          Binary trace of all bridge calls, for post-mortem of a board.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "ft_i2c.h"
+
+#define TRACE_MAGIC             "FTI2CTR1"  //!< File magic, 8 bytes.
+#define TRACE_CHUNK_SIZE        (128 * 1024) //!< Bytes of a chunk, holds a record of the max payload.
+#define TRACE_QUEUE_MAX         64          //!< Chunks waiting for the writer, more are dropped.
+#define TRACE_HANDLE_MAX        32          //!< Handles with an id, others share id TRACE_HANDLE_MAX.
+
+//!@enum    TRACE_OP
+//!         Bridge call of a record.
+typedef enum TRACE_OP
+{
+    TRACE_OPEN = 1,             //!< HAL_open, + LocId
+    TRACE_CLOSE,                //!< HAL_close
+    TRACE_INIT,                 //!< HAL_init, + kbps
+    TRACE_READ,                 //!< HAL_readEx, + Addr Flag Size Done Data[Done]
+    TRACE_WRITE,                //!< HAL_writeEx, + Addr Flag Size Done Data[Size]
+    TRACE_STATUS,               //!< HAL_getStatus, + controller status byte
+    TRACE_RESET,                //!< HAL_reset
+} TRACE_OP;
+
+//!@typedef stTraceStat
+//!         Trace statistic.
+typedef struct stTraceStat
+{
+    uint32 Records;             //!< Records encoded
+    uint32 Dropped;             //!< Records dropped as the writer is behind
+    uint32 Chunks;              //!< Chunks written
+    uint64 Bytes;               //!< Bytes written, file header included.
+} stTraceStat;
+
+//!@typedef stTraceRecord
+//!         Record decoded from a trace file.
+typedef struct stTraceRecord
+{
+    uint64 TimeNs;              //!< Call start from trace start
+    uint32 DurationNs;          //!< Call duration
+    uint32 Thread;              //!< Thread id, 1 for the first thread
+    uint32 Handle;              //!< Handle id
+    uint32 Seq;                 //!< Order in the file
+    FT_STATUS Status;           //!< Return of the call
+    TRACE_OP Op;                //!< Call
+    uint32 Value;               //!< LocId, kbps or controller status
+    uint16 Addr;                //!< Slave address of a read or write
+    uint8 Flag;                 //!< I2C_MasterFlag of a read or write
+    uint16 Size;                //!< Bytes requested
+    uint16 Done;                //!< Bytes transferred
+    const uint8 *Data;          //!< Data of a read or write, in the file buffer
+} stTraceRecord;
+
+//!@typedef stTraceFile
+//!         Trace file loaded in memory, records sorted by time.
+typedef struct stTraceFile
+{
+    uint8 *Buf;                 //!< File content
+    uint32 Size;                //!< File size
+    uint64 WallNs;              //!< Wall clock of trace start
+    stTraceRecord *Record;      //!< Records
+    uint32 Count;               //!< Record count
+    _Bool Truncated;            //!< File ends in a chunk, records before it are kept.
+} stTraceFile;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FT_STATUS TRACE_start(const char *path);
+
+void TRACE_stop(void);
+
+_Bool TRACE_isEnabled(void);
+
+const char *TRACE_getPath(void);
+
+void TRACE_add(TRACE_OP op, uint64 start, FT_HANDLE ftHandle, FT_STATUS status, uint32 value);
+
+void TRACE_addTransfer(TRACE_OP op, uint64 start, FT_HANDLE ftHandle, FT_STATUS status, uint16 addr, uint8 flag,
+        const uint8 *buf, uint16 size, uint16 done);
+
+void TRACE_getStat(stTraceStat *stat);
+
+void TRACE_printStat(const stTraceStat *stat);
+
+FT_STATUS TRACE_load(const char *path, stTraceFile *file);
+
+void TRACE_unload(stTraceFile *file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,153 @@
+/******************************************************************************
+ * @file    trigger.c
+ *          GPIO edge trigger, wait a data ready line of a slave.
+ *
+ *          The INT line of a slave is wired to a GPIO of the FT4222. An edge
+ *          trigger is set on the port by FT4222_GPIO_SetInputTrigger(), the
+ *          bridge records every edge into its trigger queue. Waiting polls
+ *          only the queue size of the GPIO interface, there's no I2C traffic
+ *          until an edge comes, then the caller runs its register read.
+ *
+ *          Edges queued while the caller is reading are all taken by the next
+ *          wait, so 1 read serves them and none is left to fire late.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "ft_i2c.h"
+#include "hal.h"
+#include "trigger.h"
+
+//Take queued events out of the trigger queue, edges is set to events taken.
+static FT_STATUS trigger_drain(FT_HANDLE gpio, GPIO_Port port, uint16 queued, uint32 *edges)
+{
+    GPIO_Trigger events[TRIGGER_QUEUE_MAX];
+    uint16 count = 0;
+
+    *edges = 0;
+    while (queued > 0)
+    {
+        uint16 size = (queued > TRIGGER_QUEUE_MAX) ? TRIGGER_QUEUE_MAX : queued;
+        CHECK_FUNC_RET(FT_OK, HAL_gpioReadTriggerQueue(gpio, port, events, size, &count));
+        *edges += count;
+        if (count != size)
+        {
+            break;
+        }
+        queued -= count;
+    }
+    return FT_OK;
+}
+
+/*!@brief Parse GPIO port and edge.
+ *
+ * @param text      "[Port][:rising|falling|both]", e.g. "3:falling", edge defaults to falling.
+ * @param port      Pointer to store the port
+ * @param trigger   Pointer to store the edge trigger
+ * @return          FT_OK or FT_INVALID_PARAMETER
+ */
+FT_STATUS TRIGGER_parse(const char *text, GPIO_Port *port, GPIO_Trigger *trigger)
+{
+    char *tail = NULL;
+    unsigned long value = strtoul(text, &tail, 0);
+
+    if ((tail == text) || (value > GPIO_PORT3) || ((*tail != 0) && (*tail != ':')))
+    {
+        CLI_ERROR("ERROR: Invalid GPIO [%s], must be [Port][:rising|falling|both].\n", text);
+        return FT_INVALID_PARAMETER;
+    }
+    *port = (GPIO_Port) value;
+
+    if ((*tail == 0) || (strcasecmp(tail + 1, "falling") == 0))
+    {
+        *trigger = GPIO_TRIGGER_FALLING;
+    }
+    else if (strcasecmp(tail + 1, "rising") == 0)
+    {
+        *trigger = GPIO_TRIGGER_RISING;
+    }
+    else if (strcasecmp(tail + 1, "both") == 0)
+    {
+        *trigger = (GPIO_Trigger) (GPIO_TRIGGER_RISING | GPIO_TRIGGER_FALLING);
+    }
+    else
+    {
+        CLI_ERROR("ERROR: Invalid GPIO edge [%s], must be rising, falling or both.\n", tail + 1);
+        return FT_INVALID_PARAMETER;
+    }
+    return FT_OK;
+}
+
+/*!@brief Set edge trigger of a GPIO port, edges queued before are dropped.
+ *
+ * @param gpio      GPIO handle of FT_openGpio()
+ * @param port      GPIO port
+ * @param trigger   Edge trigger
+ * @return          FT_OK or error code of the process
+ */
+FT_STATUS TRIGGER_arm(FT_HANDLE gpio, GPIO_Port port, GPIO_Trigger trigger)
+{
+    uint16 queued = 0;
+    uint32 edges = 0;
+
+    CHECK_FUNC_RET(FT_OK, HAL_gpioSetTrigger(gpio, port, trigger));
+    CHECK_FUNC_RET(FT_OK, HAL_gpioGetTriggerStatus(gpio, port, &queued));
+    CHECK_FUNC_RET(FT_OK, trigger_drain(gpio, port, queued, &edges));
+    return FT_OK;
+}
+
+/*!@brief Wait edges of a GPIO port.
+ *
+ * @param gpio      GPIO handle of FT_openGpio()
+ * @param port      GPIO port armed by TRIGGER_arm()
+ * @param timeoutMs Max time to wait
+ * @param edges     Pointer to store edges taken out of the queue, 0 if timeout.
+ * @param stat      Statistic to add to
+ * @return          FT_OK or error code of the process, timeout is not an error.
+ */
+FT_STATUS TRIGGER_wait(FT_HANDLE gpio, GPIO_Port port, uint32 timeoutMs, uint32 *edges, stTriggerStat *stat)
+{
+    struct timespec ts =
+    { 0, TRIGGER_POLL_US * 1000 };
+    double start = FT_getTimeMs();
+    double now = start;
+    uint16 queued = 0;
+
+    *edges = 0;
+    stat->Waits++;
+    for (;;)
+    {
+        CHECK_FUNC_RET(FT_OK, HAL_gpioGetTriggerStatus(gpio, port, &queued));
+        stat->Polls++;
+        now = FT_getTimeMs();
+        if ((queued > 0) || (now - start >= timeoutMs))
+        {
+            break;
+        }
+        nanosleep(&ts, NULL);
+    }
+    stat->WaitMs += now - start;
+
+    if (queued == 0)
+    {
+        stat->Timeouts++;
+        return FT_OK;
+    }
+    CHECK_FUNC_RET(FT_OK, trigger_drain(gpio, port, queued, edges));
+    stat->Edges += *edges;
+    return FT_OK;
+}
+
+void TRIGGER_printStat(const stTriggerStat *stat)
+{
+    CLI_PRINT("GPIO TRIGGER, waits=[%u] edges=[%u] timeouts=[%u] polls=[%u], wait=[%.3f] ms\n", stat->Waits,
+            stat->Edges, stat->Timeouts, stat->Polls, stat->WaitMs);
+}
@@ -0,0 +1,46 @@
+/******************************************************************************
+ * @file    trigger.h
+ *          GPIO edge trigger, wait a data ready line of a slave.
+ *
+ * @author  Nick Yang
+ * @date    2018/03/15
+ * @version V0.1
+ *****************************************************************************/
+
+#ifndef TRIGGER_H_
+#define TRIGGER_H_
+
+#include "ft_i2c.h"
+
+#define TRIGGER_DEFAULT         "3:falling" //!< Default port and edge, GPIO3 is free in I2C mode.
+#define TRIGGER_POLL_US         100         //!< Sleep between polls of an empty trigger queue.
+#define TRIGGER_QUEUE_MAX       64          //!< Events read out of the trigger queue at a time.
+
+//!@typedef stTriggerStat
+//!         Statistic of waiting GPIO edges.
+typedef struct stTriggerStat
+{
+    uint32 Waits;               //!< Waits done
+    uint32 Edges;               //!< Edges received, more than Waits if edges come during a read.
+    uint32 Polls;               //!< Trigger queue polls
+    uint32 Timeouts;            //!< Waits without an edge
+    double WaitMs;              //!< Time waiting edges
+} stTriggerStat;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FT_STATUS TRIGGER_parse(const char *text, GPIO_Port *port, GPIO_Trigger *trigger);
+
+FT_STATUS TRIGGER_arm(FT_HANDLE gpio, GPIO_Port port, GPIO_Trigger trigger);
+
+FT_STATUS TRIGGER_wait(FT_HANDLE gpio, GPIO_Port port, uint32 timeoutMs, uint32 *edges, stTriggerStat *stat);
+
+void TRIGGER_printStat(const stTriggerStat *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRIGGER_H_ */